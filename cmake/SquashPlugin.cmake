@@ -3,8 +3,56 @@ include (RequireStandard)
 
 # set (SQUASH_ENABLED_PLUGINS "" CACHE INTERNAL "enabled plugins")
 
+# Instruction set variants.  Plugins which pass SIMD_VARIANTS are
+# built once more for each of these (when the bundled library is
+# used), and squash_plugin_init loads the best one the CPU supports,
+# so packages can stay portable without leaving AVX2 / AVX-512 on the
+# table.  The names must match squash_get_simd_variants in util.c.
+set (SQUASH_SIMD_VARIANTS "avx2;avx512" CACHE STRING "Instruction set variants to build SIMD-heavy plugins for (empty to disable)")
+
+set (SQUASH_SIMD_AVAILABLE_VARIANTS)
+if ("${CMAKE_SYSTEM_PROCESSOR}" MATCHES "^(x86_64|AMD64|amd64|i[3-6]86|x86)$")
+  if ("${CMAKE_C_COMPILER_ID}" STREQUAL "MSVC")
+    set (SQUASH_SIMD_avx2_FLAGS "/arch:AVX2")
+    set (SQUASH_SIMD_avx512_FLAGS "/arch:AVX512")
+  else ()
+    set (SQUASH_SIMD_avx2_FLAGS "-mavx2 -mbmi -mbmi2 -mfma -mlzcnt -mpopcnt")
+    set (SQUASH_SIMD_avx512_FLAGS "${SQUASH_SIMD_avx2_FLAGS} -mavx512f -mavx512bw -mavx512cd -mavx512dq -mavx512vl")
+  endif ()
+
+  foreach (variant ${SQUASH_SIMD_VARIANTS})
+    if (NOT DEFINED SQUASH_SIMD_${variant}_FLAGS)
+      message (FATAL_ERROR "Unknown SIMD variant: ${variant} (valid: avx2, avx512)")
+    endif ()
+
+    CHECK_C_COMPILER_FLAG ("${ADD_COMPILER_FLAGS_PREPEND} ${SQUASH_SIMD_${variant}_FLAGS}" SQUASH_SIMD_${variant}_SUPPORTED)
+    if (SQUASH_SIMD_${variant}_SUPPORTED)
+      list (APPEND SQUASH_SIMD_AVAILABLE_VARIANTS ${variant})
+    endif ()
+  endforeach ()
+endif ()
+
+# Build another copy of a plugin's shared object for an instruction
+# set variant.  Per-source settings are shared with the baseline
+# target automatically; target-level ones are copied.
+function (squash_plugin_add_variant target variant)
+  set (variant_target ${target}-${variant})
+  get_target_property (sources ${target} SOURCES)
+
+  add_library (${variant_target} SHARED ${sources})
+
+  foreach (property INCLUDE_DIRECTORIES COMPILE_DEFINITIONS COMPILE_FLAGS LINK_FLAGS LINK_LIBRARIES C_STANDARD C_STANDARD_REQUIRED CXX_STANDARD CXX_STANDARD_REQUIRED)
+    get_target_property (value ${target} ${property})
+    if (NOT "${value}" STREQUAL "value-NOTFOUND")
+      set_property (TARGET ${variant_target} PROPERTY ${property} ${value})
+    endif ()
+  endforeach ()
+
+  set_property (TARGET ${variant_target} APPEND_STRING PROPERTY COMPILE_FLAGS " ${SQUASH_SIMD_${variant}_FLAGS}")
+endfunction ()
+
 function (SQUASH_PLUGIN)
-  set (options EXTRA_WARNINGS DEFAULT_DISABLED)
+  set (options EXTRA_WARNINGS DEFAULT_DISABLED SIMD_VARIANTS)
   set (oneValueArgs NAME EXTERNAL_PKG EXTERNAL_PKG_PREFIX C_STANDARD CXX_STANDARD)
   set (multiValueArgs SOURCES EMBED_SOURCES LIBRARIES LDFLAGS COMPILER_FLAGS EMBED_COMPILER_FLAGS INCLUDE_DIRS EMBED_INCLUDE_DIRS DEFINES EMBED_DEFINES ALLOW_UNDEFINED_DEFINES NO_UNDEFINED_DEFINES)
   cmake_parse_arguments(SQUASH_PLUGIN "${options}" "${oneValueArgs}" "${multiValueArgs}" ${ARGN})
@@ -107,7 +155,15 @@ function (SQUASH_PLUGIN)
   install(FILES ${CMAKE_CURRENT_BINARY_DIR}/squash.ini
     DESTINATION "${SQUASH_PLUGIN_DIRECTORY}/${SQUASH_PLUGIN_NAME}")
 
-  install(TARGETS ${PLUGIN_TARGET}
+  set (PLUGIN_TARGETS ${PLUGIN_TARGET})
+  if (${EMBED} AND ${SQUASH_PLUGIN_SIMD_VARIANTS})
+    foreach (variant ${SQUASH_SIMD_AVAILABLE_VARIANTS})
+      squash_plugin_add_variant (${PLUGIN_TARGET} ${variant})
+      list (APPEND PLUGIN_TARGETS ${PLUGIN_TARGET}-${variant})
+    endforeach ()
+  endif ()
+
+  install(TARGETS ${PLUGIN_TARGETS}
     RUNTIME DESTINATION "${SQUASH_PLUGIN_DIRECTORY}/${SQUASH_PLUGIN_NAME}"
     LIBRARY DESTINATION "${SQUASH_PLUGIN_DIRECTORY}/${SQUASH_PLUGIN_NAME}"
     ARCHIVE DESTINATION "${SQUASH_PLUGIN_DIRECTORY}/${SQUASH_PLUGIN_NAME}")
@@ -124,5 +180,6 @@ function (SQUASH_PLUGIN)
   unset (EMBED)
   unset (PLUGIN_NAME_UC)
   unset (PLUGIN_TARGET)
+  unset (PLUGIN_TARGETS)
   unset (sources)
 endfunction ()
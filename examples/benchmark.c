@@ -0,0 +1,160 @@
+#if !defined(_WIN32)
+#  if !defined(_POSIX_C_SOURCE)
+#    define _POSIX_C_SOURCE 199309L
+#  endif
+#  include <time.h>
+#else
+#  include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <squash/squash.h>
+
+/* Measures how compression throughput scales as the number of
+ * concurrent streams grows.  Each stream compresses its own copy of
+ * the input; all streams, and any helper threads the codec uses, are
+ * drawn from Squash's thread budget (SQUASH_THREADS, or the number
+ * of CPUs if it isn't set), so the total should level off at roughly
+ * the number of CPUs instead of collapsing from oversubscription.
+ *
+ * For example, to compare lzham with and without helper threads:
+ *
+ *   benchmark lzham 16
+ *   benchmark lzham 16 helper-threads=0
+ */
+
+#define BENCHMARK_INPUT_SIZE ((size_t) 8 * 1024 * 1024)
+#define BENCHMARK_BUFFER_SIZE ((size_t) 1024 * 1024)
+
+struct Benchmark {
+  SquashCodec* codec;
+  SquashOptions* options;
+  const uint8_t* input;
+  size_t input_size;
+};
+
+static double
+benchmark_now (void) {
+#if defined(_WIN32)
+  LARGE_INTEGER frequency, count;
+  QueryPerformanceFrequency (&frequency);
+  QueryPerformanceCounter (&count);
+  return ((double) count.QuadPart) / ((double) frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0);
+#endif
+}
+
+static SquashStatus
+benchmark_stream (size_t index, void* user_data) {
+  struct Benchmark* benchmark = (struct Benchmark*) user_data;
+  SquashStatus res;
+  uint8_t* output = malloc (BENCHMARK_BUFFER_SIZE);
+  SquashStream* stream = squash_stream_new_with_options (benchmark->codec, SQUASH_STREAM_COMPRESS, benchmark->options);
+
+  (void) index;
+
+  if (stream == NULL || output == NULL) {
+    res = SQUASH_MEMORY;
+    goto cleanup;
+  }
+
+  stream->next_in = benchmark->input;
+  stream->avail_in = benchmark->input_size;
+
+  do {
+    stream->next_out = output;
+    stream->avail_out = BENCHMARK_BUFFER_SIZE;
+    res = squash_stream_finish (stream);
+  } while (res == SQUASH_PROCESSING);
+
+ cleanup:
+  free (output);
+  squash_object_unref (stream);
+
+  return res;
+}
+
+int main (int argc, char** argv) {
+  if (argc < 2) {
+    fprintf (stderr, "USAGE: %s CODEC [MAX_STREAMS] [KEY=VALUE...]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  SquashCodec* codec = squash_get_codec (argv[1]);
+  if (codec == NULL) {
+    fprintf (stderr, "Unable to find codec '%s'\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  const unsigned int max_streams = (argc > 2) ? (unsigned int) strtoul (argv[2], NULL, 10) : 8;
+  if (max_streams == 0) {
+    fprintf (stderr, "Invalid number of streams '%s'\n", argv[2]);
+    return EXIT_FAILURE;
+  }
+
+  /* Shared by every stream, so take ownership of the floating
+     reference. */
+  SquashOptions* options = squash_object_ref_sink (squash_options_new (codec, NULL));
+  for (int i = 3 ; i < argc ; i++) {
+    char* value = strchr (argv[i], '=');
+    if (value == NULL) {
+      fprintf (stderr, "Invalid option '%s'\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+    *(value++) = '\0';
+
+    SquashStatus res = squash_options_parse_option (options, argv[i], value);
+    if (res != SQUASH_OK) {
+      fprintf (stderr, "Unable to set '%s' to '%s': %s\n", argv[i], value, squash_status_to_string (res));
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (getenv ("SQUASH_THREADS") == NULL)
+    squash_set_max_threads (0);
+
+  /* Mildly compressible text-like data, the same for every run. */
+  uint8_t* input = malloc (BENCHMARK_INPUT_SIZE);
+  if (input == NULL) {
+    fprintf (stderr, "Failed to allocate memory.\n");
+    return EXIT_FAILURE;
+  }
+  uint32_t state = 0x12345678;
+  for (size_t i = 0 ; i < BENCHMARK_INPUT_SIZE ; i++) {
+    state = (state * 1103515245) + 12345;
+    input[i] = (uint8_t) ("etaoin shrdlu cmfwyp\n"[(state >> 16) % 21]);
+  }
+
+  struct Benchmark benchmark = { codec, options, input, BENCHMARK_INPUT_SIZE };
+
+  fprintf (stdout, "# %s, %u thread budget, %zu MiB per stream\n",
+           squash_codec_get_name (codec), squash_get_max_threads (), BENCHMARK_INPUT_SIZE / (1024 * 1024));
+  fprintf (stdout, "%8s %12s %12s\n", "streams", "seconds", "MiB/s");
+
+  for (unsigned int streams = 1 ; streams <= max_streams ; streams *= 2) {
+    const double start = benchmark_now ();
+    SquashStatus res = squash_parallel_for (streams, streams, benchmark_stream, &benchmark);
+    const double elapsed = benchmark_now () - start;
+
+    if (res != SQUASH_OK) {
+      fprintf (stderr, "Compression failed: %s (%d)\n", squash_status_to_string (res), res);
+      free (input);
+      squash_object_unref (options);
+      return EXIT_FAILURE;
+    }
+
+    fprintf (stdout, "%8u %12.3f %12.1f\n", streams, elapsed,
+             (((double) streams) * ((double) BENCHMARK_INPUT_SIZE) / (1024.0 * 1024.0)) / elapsed);
+  }
+
+  free (input);
+  squash_object_unref (options);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,433 @@
+/* Copyright (c) 2015-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ *   Eugene Kliuchnikov <eustas.ru+squash@gmail.com>
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <squash/squash.h>
+
+#include <brotli/encode.h>
+#include <brotli/decode.h>
+
+enum SquashBrotliOptionIndex {
+  SQUASH_BROTLI_OPT_LEVEL = 0,
+  SQUASH_BROTLI_OPT_MODE,
+  SQUASH_BROTLI_OPT_WINDOW_BITS,
+  SQUASH_BROTLI_OPT_BLOCK_BITS,
+  SQUASH_BROTLI_OPT_SIZE_HINT,
+  SQUASH_BROTLI_OPT_REFERENCE
+};
+
+static SquashOptionInfo squash_brotli_options[] = {
+  { "level",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 1,
+      .max = BROTLI_MAX_QUALITY },
+    .default_value.int_value = BROTLI_MAX_QUALITY },
+  { "mode",
+    SQUASH_OPTION_TYPE_ENUM_STRING,
+    .info.enum_string = {
+      .values = (const SquashOptionInfoEnumStringMap []) {
+        { "generic", BROTLI_MODE_GENERIC },
+        { "text", BROTLI_MODE_TEXT },
+        { "font", BROTLI_MODE_FONT },
+        { NULL, 0 } } },
+    .default_value.int_value = BROTLI_MODE_GENERIC },
+  { "window-bits",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = BROTLI_MIN_WINDOW_BITS,
+      .max = BROTLI_MAX_WINDOW_BITS },
+    .default_value.int_value = BROTLI_DEFAULT_WINDOW },
+  { "block-bits",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = BROTLI_MIN_INPUT_BLOCK_BITS,
+      .max = BROTLI_MAX_INPUT_BLOCK_BITS,
+      .allow_zero = true },
+    .default_value.int_value = 0 },
+  { "size-hint",
+    SQUASH_OPTION_TYPE_RANGE_SIZE,
+    .info.range_size = {
+      .min = 0,
+      .max = UINT32_MAX },
+    .default_value.size_value = 0 },
+  { "reference",
+    SQUASH_OPTION_TYPE_FILE, },
+  { NULL, SQUASH_OPTION_TYPE_NONE, }
+};
+
+typedef struct SquashBrotliStream_s {
+  SquashStream base_object;
+
+  BrotliEncoderState* encoder;
+  BrotliDecoderState* decoder;
+  BrotliEncoderPreparedDictionary* dictionary;
+} SquashBrotliStream;
+
+SQUASH_PLUGIN_EXPORT
+SquashStatus                squash_plugin_init_codec      (SquashCodec* codec, SquashCodecImpl* impl);
+
+static void                 squash_brotli_stream_init     (SquashBrotliStream* stream,
+                                                           SquashCodec* codec,
+                                                           SquashStreamType stream_type,
+                                                           SquashOptions* options,
+                                                           SquashDestroyNotify destroy_notify);
+static SquashBrotliStream*  squash_brotli_stream_new      (SquashCodec* codec,
+                                                           SquashStreamType stream_type,
+                                                           SquashOptions* options);
+static void                 squash_brotli_stream_destroy  (void* stream);
+
+/* All of the encoder's and decoder's memory (including the large
+ * hash tables and ring buffers) is allocated through these, so it is
+ * accounted for by Squash and, when an arena is bound, recycled from
+ * one stream to the next instead of going back to the system. */
+static void*
+squash_brotli_malloc (void* opaque, size_t size) {
+  return squash_scratch_malloc (size);
+}
+
+static void
+squash_brotli_free (void* opaque, void* ptr) {
+  squash_scratch_free (ptr);
+}
+
+/* A reference is attached as a raw (compound) dictionary which both
+ * sides must supply.  Distances into a large reference don't fit in
+ * a standard stream, so both sides also switch to the large window
+ * format whenever a reference is in use.  The prepared dictionary
+ * must outlive the encoder it is attached to. */
+static BrotliEncoderState*
+squash_brotli_encoder_new (SquashCodec* codec, SquashOptions* options, size_t uncompressed_size,
+                           BrotliEncoderPreparedDictionary** dictionary) {
+  *dictionary = NULL;
+
+  BrotliEncoderState* encoder = BrotliEncoderCreateInstance (squash_brotli_malloc, squash_brotli_free, NULL);
+  if (SQUASH_UNLIKELY(encoder == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  size_t size_hint = squash_options_get_size_at (options, codec, SQUASH_BROTLI_OPT_SIZE_HINT);
+  if (size_hint == 0)
+    size_hint = (uncompressed_size < UINT32_MAX) ? uncompressed_size : UINT32_MAX;
+
+  BrotliEncoderSetParameter (encoder, BROTLI_PARAM_QUALITY,
+                             (uint32_t) squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_LEVEL));
+  BrotliEncoderSetParameter (encoder, BROTLI_PARAM_MODE,
+                             (uint32_t) squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_MODE));
+  BrotliEncoderSetParameter (encoder, BROTLI_PARAM_LGWIN,
+                             (uint32_t) squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_WINDOW_BITS));
+  BrotliEncoderSetParameter (encoder, BROTLI_PARAM_LGBLOCK,
+                             (uint32_t) squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_BLOCK_BITS));
+  BrotliEncoderSetParameter (encoder, BROTLI_PARAM_SIZE_HINT, (uint32_t) size_hint);
+
+  size_t reference_size;
+  const uint8_t* reference = squash_options_get_file_at (options, codec, SQUASH_BROTLI_OPT_REFERENCE, &reference_size);
+  if (reference != NULL) {
+    *dictionary = BrotliEncoderPrepareDictionary (BROTLI_SHARED_DICTIONARY_RAW, reference_size, reference,
+                                                  squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_LEVEL),
+                                                  squash_brotli_malloc, squash_brotli_free, NULL);
+    if (SQUASH_UNLIKELY(*dictionary == NULL)) {
+      BrotliEncoderDestroyInstance (encoder);
+      return (squash_error (SQUASH_MEMORY), NULL);
+    }
+
+    BrotliEncoderSetParameter (encoder, BROTLI_PARAM_LARGE_WINDOW, BROTLI_TRUE);
+    if (SQUASH_UNLIKELY(!BrotliEncoderAttachPreparedDictionary (encoder, *dictionary))) {
+      BrotliEncoderDestroyInstance (encoder);
+      BrotliEncoderDestroyPreparedDictionary (*dictionary);
+      *dictionary = NULL;
+      return (squash_error (SQUASH_FAILED), NULL);
+    }
+  }
+
+  return encoder;
+}
+
+static BrotliDecoderState*
+squash_brotli_decoder_new (SquashCodec* codec, SquashOptions* options) {
+  BrotliDecoderState* decoder = BrotliDecoderCreateInstance (squash_brotli_malloc, squash_brotli_free, NULL);
+  if (SQUASH_UNLIKELY(decoder == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  size_t reference_size;
+  const uint8_t* reference = squash_options_get_file_at (options, codec, SQUASH_BROTLI_OPT_REFERENCE, &reference_size);
+  if (reference != NULL) {
+    BrotliDecoderSetParameter (decoder, BROTLI_DECODER_PARAM_LARGE_WINDOW, 1);
+    if (SQUASH_UNLIKELY(!BrotliDecoderAttachDictionary (decoder, BROTLI_SHARED_DICTIONARY_RAW, reference_size, reference))) {
+      BrotliDecoderDestroyInstance (decoder);
+      return (squash_error (SQUASH_FAILED), NULL);
+    }
+  }
+
+  return decoder;
+}
+
+static SquashBrotliStream*
+squash_brotli_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  SquashBrotliStream* stream;
+
+  assert (codec != NULL);
+  assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
+
+  stream = (SquashBrotliStream*) squash_malloc (sizeof (SquashBrotliStream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  squash_brotli_stream_init (stream, codec, stream_type, options, squash_brotli_stream_destroy);
+
+  if (SQUASH_UNLIKELY(stream->encoder == NULL && stream->decoder == NULL)) {
+    squash_object_unref (stream);
+    return NULL;
+  }
+
+  return stream;
+}
+
+static void
+squash_brotli_stream_init (SquashBrotliStream* s,
+                           SquashCodec* codec,
+                           SquashStreamType stream_type,
+                           SquashOptions* options,
+                           SquashDestroyNotify destroy_notify) {
+  SquashStream* stream = (SquashStream*) s;
+  squash_stream_init (stream, codec, stream_type, (SquashOptions*) options, destroy_notify);
+
+  s->encoder = NULL;
+  s->decoder = NULL;
+  s->dictionary = NULL;
+
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    s->encoder = squash_brotli_encoder_new (codec, stream->options, 0, &(s->dictionary));
+  } else if (stream_type == SQUASH_STREAM_DECOMPRESS) {
+    s->decoder = squash_brotli_decoder_new (codec, stream->options);
+  } else {
+    squash_assert_unreachable();
+  }
+}
+
+static void
+squash_brotli_stream_destroy (void* stream) {
+  SquashBrotliStream* s = (SquashBrotliStream*) stream;
+
+  if (s->encoder != NULL)
+    BrotliEncoderDestroyInstance (s->encoder);
+  if (s->decoder != NULL)
+    BrotliDecoderDestroyInstance (s->decoder);
+  if (s->dictionary != NULL)
+    BrotliEncoderDestroyPreparedDictionary (s->dictionary);
+
+  squash_stream_destroy (stream);
+}
+
+static SquashStream*
+squash_brotli_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  return (SquashStream*) squash_brotli_stream_new (codec, stream_type, options);
+}
+
+static BrotliEncoderOperation
+squash_brotli_encoder_operation (SquashOperation operation) {
+  switch (operation) {
+    case SQUASH_OPERATION_PROCESS:
+      return BROTLI_OPERATION_PROCESS;
+    case SQUASH_OPERATION_FLUSH:
+      return BROTLI_OPERATION_FLUSH;
+    case SQUASH_OPERATION_FINISH:
+      return BROTLI_OPERATION_FINISH;
+    case SQUASH_OPERATION_TERMINATE:
+      squash_assert_unreachable ();
+      break;
+  }
+
+  squash_assert_unreachable ();
+}
+
+static SquashStatus
+squash_brotli_compress_stream (SquashStream* stream, SquashOperation operation) {
+  SquashBrotliStream* s = (SquashBrotliStream*) stream;
+
+  if (SQUASH_UNLIKELY(!BrotliEncoderCompressStream (s->encoder, squash_brotli_encoder_operation (operation),
+                                                    &(stream->avail_in), &(stream->next_in),
+                                                    &(stream->avail_out), &(stream->next_out),
+                                                    NULL)))
+    return squash_error (SQUASH_FAILED);
+
+  /* A flush is complete once all the input has been consumed and
+     everything buffered in the encoder has been written, so each
+     flush emits a complete, decodable prefix of the stream. */
+  if (operation == SQUASH_OPERATION_FINISH)
+    return BrotliEncoderIsFinished (s->encoder) ? SQUASH_OK : SQUASH_PROCESSING;
+  else
+    return (stream->avail_in != 0 || BrotliEncoderHasMoreOutput (s->encoder)) ? SQUASH_PROCESSING : SQUASH_OK;
+}
+
+static SquashStatus
+squash_brotli_decompress_stream (SquashStream* stream, SquashOperation operation) {
+  SquashBrotliStream* s = (SquashBrotliStream*) stream;
+
+  if (BrotliDecoderIsFinished (s->decoder))
+    return SQUASH_OK;
+
+  const BrotliDecoderResult res =
+    BrotliDecoderDecompressStream (s->decoder,
+                                   &(stream->avail_in), &(stream->next_in),
+                                   &(stream->avail_out), &(stream->next_out),
+                                   NULL);
+
+  switch (res) {
+    case BROTLI_DECODER_RESULT_SUCCESS:
+    case BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT:
+      return SQUASH_OK;
+    case BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT:
+      return SQUASH_PROCESSING;
+    case BROTLI_DECODER_RESULT_ERROR:
+    default:
+      return squash_error (SQUASH_FAILED);
+  }
+}
+
+static SquashStatus
+squash_brotli_process_stream (SquashStream* stream, SquashOperation operation) {
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS)
+    return squash_brotli_compress_stream (stream, operation);
+  else
+    return squash_brotli_decompress_stream (stream, operation);
+}
+
+static size_t
+squash_brotli_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
+  const size_t max_size = BrotliEncoderMaxCompressedSize (uncompressed_size);
+
+  return (max_size != 0) ? max_size : (uncompressed_size + 5 + ((uncompressed_size / (1024 * 1024 * 8)) * 4));
+}
+
+static SquashStatus
+squash_brotli_decompress_buffer (SquashCodec* codec,
+                                 size_t* decompressed_size,
+                                 uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                                 size_t compressed_size,
+                                 const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                                 SquashOptions* options) {
+  size_t available_in = compressed_size;
+  const uint8_t* next_in = compressed;
+  size_t available_out = *decompressed_size;
+  uint8_t* next_out = decompressed;
+
+  BrotliDecoderState* decoder = squash_brotli_decoder_new (codec, options);
+  if (SQUASH_UNLIKELY(decoder == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  const BrotliDecoderResult res =
+    BrotliDecoderDecompressStream (decoder, &available_in, &next_in, &available_out, &next_out, NULL);
+
+  BrotliDecoderDestroyInstance (decoder);
+
+  switch (res) {
+    case BROTLI_DECODER_RESULT_SUCCESS:
+      *decompressed_size -= available_out;
+      return SQUASH_OK;
+    case BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT:
+      return squash_error (SQUASH_BUFFER_EMPTY);
+    case BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT:
+      return squash_error (SQUASH_BUFFER_FULL);
+    case BROTLI_DECODER_RESULT_ERROR:
+    default:
+      return squash_error (SQUASH_FAILED);
+  }
+}
+
+static SquashStatus
+squash_brotli_compress_buffer (SquashCodec* codec,
+                               size_t* compressed_size,
+                               uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                               size_t uncompressed_size,
+                               const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                               SquashOptions* options) {
+  size_t available_in = uncompressed_size;
+  const uint8_t* next_in = uncompressed;
+  size_t available_out = *compressed_size;
+  uint8_t* next_out = compressed;
+
+  BrotliEncoderPreparedDictionary* dictionary;
+  BrotliEncoderState* encoder = squash_brotli_encoder_new (codec, options, uncompressed_size, &dictionary);
+  if (SQUASH_UNLIKELY(encoder == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  const BROTLI_BOOL success =
+    BrotliEncoderCompressStream (encoder, BROTLI_OPERATION_FINISH,
+                                 &available_in, &next_in, &available_out, &next_out, NULL);
+  const BROTLI_BOOL finished = BrotliEncoderIsFinished (encoder);
+
+  BrotliEncoderDestroyInstance (encoder);
+  if (dictionary != NULL)
+    BrotliEncoderDestroyPreparedDictionary (dictionary);
+
+  if (SQUASH_UNLIKELY(!success))
+    return squash_error (SQUASH_FAILED);
+  if (SQUASH_UNLIKELY(!finished))
+    return squash_error (SQUASH_BUFFER_FULL);
+
+  *compressed_size -= available_out;
+
+  return SQUASH_OK;
+}
+
+static size_t
+squash_brotli_get_memory_usage (SquashCodec* codec, SquashOptions* options, SquashStreamType stream_type) {
+  const size_t window_size = ((size_t) 1) << squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_WINDOW_BITS);
+
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    /* The ring buffer plus the hasher, which for the higher levels
+       is several times the size of the window. */
+    const int level = squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_LEVEL);
+    return window_size * ((level >= 10) ? 10 : 4) + (1024 * 1024);
+  } else {
+    return window_size + (64 * 1024);
+  }
+}
+
+SquashStatus
+squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
+  const char* name = squash_codec_get_name (codec);
+
+  if (SQUASH_LIKELY(strcmp ("brotli", name) == 0)) {
+    impl->info = SQUASH_CODEC_INFO_CAN_FLUSH;
+    impl->options = squash_brotli_options;
+    impl->get_max_compressed_size = squash_brotli_get_max_compressed_size;
+    impl->get_memory_usage = squash_brotli_get_memory_usage;
+    impl->create_stream = squash_brotli_create_stream;
+    impl->process_stream = squash_brotli_process_stream;
+    impl->decompress_buffer = squash_brotli_decompress_buffer;
+    impl->compress_buffer = squash_brotli_compress_buffer;
+  } else {
+    return squash_error (SQUASH_UNABLE_TO_LOAD);
+  }
+
+  return SQUASH_OK;
+}
@@ -41,16 +41,22 @@ enum SquashBscOptIndex {
   SQUASH_BSC_OPT_LZP_HASH_SIZE,
   SQUASH_BSC_OPT_LZP_MIN_LEN,
   SQUASH_BSC_OPT_BLOCK_SORTER,
-  SQUASH_BSC_OPT_CODER
+  SQUASH_BSC_OPT_CODER,
+  SQUASH_BSC_OPT_BLOCK_SIZE,
+  SQUASH_BSC_OPT_THREADS
 };
 
+/* Smallest allowed block size; get_max_compressed_size assumes the
+ * worst case of one header per block of this size. */
+#define SQUASH_BSC_MIN_BLOCK_SIZE (1024 * 1024)
+
 static SquashOptionInfo squash_bsc_options[] = {
   { "fast-mode",
     SQUASH_OPTION_TYPE_BOOL,
     .default_value.bool_value = true },
   { "multi-threading",
     SQUASH_OPTION_TYPE_BOOL,
-    .default_value.bool_value = true },
+    .default_value.bool_value = false },
   { "large-pages",
     SQUASH_OPTION_TYPE_BOOL,
     .default_value.bool_value = false },
@@ -86,51 +92,116 @@ static SquashOptionInfo squash_bsc_options[] = {
         { "qflc-adaptive", LIBBSC_CODER_QLFC_ADAPTIVE },
         { NULL, 0 } } },
     .default_value.int_value = LIBBSC_CODER_QLFC_STATIC },
+  { "block-size",
+    SQUASH_OPTION_TYPE_RANGE_SIZE,
+    .info.range_size = {
+      .min = SQUASH_BSC_MIN_BLOCK_SIZE,
+      .max = 1024 * 1024 * 1024 },
+    .default_value.size_value = 25 * 1024 * 1024 },
+  { "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 256 },
+    .default_value.int_value = 0 },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
+typedef struct SquashBscBlock_ {
+  size_t compressed_offset;
+  size_t compressed_size;
+  size_t uncompressed_offset;
+  size_t uncompressed_size;
+} SquashBscBlock;
+
+typedef struct SquashBscJob_ {
+  const uint8_t* input;
+  uint8_t* output;
+  SquashBscBlock* blocks;
+  int lzp_hash_size;
+  int lzp_min_len;
+  int block_sorter;
+  int coder;
+  int features;
+} SquashBscJob;
+
 SQUASH_PLUGIN_EXPORT
 SquashStatus             squash_plugin_init_codec   (SquashCodec* codec, SquashCodecImpl* impl);
 
 static void* squash_bsc_malloc (size_t size) {
-  return squash_malloc (size);
+  return squash_scratch_malloc (size);
 }
 
 static void* squash_bsc_zero_malloc (size_t size) {
-  return squash_calloc (size, 1);
+  return squash_scratch_calloc (size, 1);
 }
 
 static void squash_bsc_free (void* ptr) {
-  squash_free (ptr);
+  squash_scratch_free (ptr);
 }
 
 static size_t
 squash_bsc_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
-  return uncompressed_size + LIBBSC_HEADER_SIZE;
+  const size_t n_blocks = (uncompressed_size / SQUASH_BSC_MIN_BLOCK_SIZE) + 1;
+  return uncompressed_size + (n_blocks * LIBBSC_HEADER_SIZE);
+}
+
+/* Walk the blocks in a compressed buffer.  If blocks is NULL only
+ * count them; returns the number of blocks, or 0 if the data is
+ * invalid. */
+static size_t
+squash_bsc_parse_blocks (size_t compressed_size,
+                         const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                         SquashBscBlock* blocks,
+                         size_t* uncompressed_size) {
+  size_t n_blocks = 0;
+  size_t compressed_offset = 0;
+  size_t uncompressed_offset = 0;
+
+  while (compressed_offset < compressed_size) {
+    const size_t remaining = compressed_size - compressed_offset;
+    int p_block_size, p_data_size;
+
+    if (SQUASH_UNLIKELY(remaining < LIBBSC_HEADER_SIZE))
+      return 0;
+
+    const int res = bsc_block_info (compressed + compressed_offset, LIBBSC_HEADER_SIZE,
+                                    &p_block_size, &p_data_size, LIBBSC_DEFAULT_FEATURES);
+    if (SQUASH_UNLIKELY(res != LIBBSC_NO_ERROR) ||
+        SQUASH_UNLIKELY(p_block_size < LIBBSC_HEADER_SIZE) ||
+        SQUASH_UNLIKELY(p_data_size < 0) ||
+        SQUASH_UNLIKELY((size_t) p_block_size > remaining) ||
+        SQUASH_UNLIKELY((size_t) p_data_size > (SIZE_MAX - uncompressed_offset)))
+      return 0;
+
+    if (blocks != NULL) {
+      blocks[n_blocks].compressed_offset = compressed_offset;
+      blocks[n_blocks].compressed_size = (size_t) p_block_size;
+      blocks[n_blocks].uncompressed_offset = uncompressed_offset;
+      blocks[n_blocks].uncompressed_size = (size_t) p_data_size;
+    }
+
+    n_blocks++;
+    compressed_offset += (size_t) p_block_size;
+    uncompressed_offset += (size_t) p_data_size;
+  }
+
+  if (uncompressed_size != NULL)
+    *uncompressed_size = uncompressed_offset;
+
+  return n_blocks;
 }
 
 static size_t
 squash_bsc_get_uncompressed_size (SquashCodec* codec,
                                   size_t compressed_size,
                                   const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)]) {
-  int p_block_size, p_data_size;
-
-#if INT_MAX < SIZE_MAX
-  if (SQUASH_UNLIKELY(INT_MAX < compressed_size))
-    return (squash_error (SQUASH_RANGE), 0);
-#endif
-
-  int res = bsc_block_info (compressed, (int) compressed_size, &p_block_size, &p_data_size, LIBBSC_DEFAULT_FEATURES);
+  size_t uncompressed_size = 0;
 
-  if (res != LIBBSC_NO_ERROR) {
+  if (squash_bsc_parse_blocks (compressed_size, compressed, NULL, &uncompressed_size) == 0)
     return 0;
-  } else {
-#if SIZE_MAX < INT_MAX
-    if (SQUASH_UNLIKELY(SIZE_MAX < p_data_size))
-      return (squash_error (SQUASH_RANGE), 0);
-#endif
-    return (size_t) p_data_size;
-  }
+
+  return uncompressed_size;
 }
 
 static int
@@ -143,6 +214,37 @@ squash_bsc_options_get_features (SquashCodec* codec,
     (squash_options_get_bool_at (options, codec, SQUASH_BSC_OPT_CUDA) ? LIBBSC_FEATURE_CUDA : 0);
 }
 
+static SquashStatus
+squash_bsc_compress_block (size_t index, void* user_data) {
+  SquashBscJob* job = (SquashBscJob*) user_data;
+  SquashBscBlock* block = &(job->blocks[index]);
+
+  const int res = bsc_compress (job->input + block->uncompressed_offset,
+                                job->output + block->compressed_offset,
+                                (int) block->uncompressed_size,
+                                job->lzp_hash_size, job->lzp_min_len, job->block_sorter, job->coder, job->features);
+  if (SQUASH_UNLIKELY(res < 0))
+    return squash_error (SQUASH_FAILED);
+
+  block->compressed_size = (size_t) res;
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_bsc_decompress_block (size_t index, void* user_data) {
+  SquashBscJob* job = (SquashBscJob*) user_data;
+  SquashBscBlock* block = &(job->blocks[index]);
+
+  const int res = bsc_decompress (job->input + block->compressed_offset,
+                                  (int) block->compressed_size,
+                                  job->output + block->uncompressed_offset,
+                                  (int) block->uncompressed_size,
+                                  job->features);
+
+  return SQUASH_LIKELY(res == LIBBSC_NO_ERROR) ? SQUASH_OK : squash_error (SQUASH_FAILED);
+}
+
 static SquashStatus
 squash_bsc_compress_buffer_unsafe (SquashCodec* codec,
                                    size_t* compressed_size,
@@ -150,35 +252,54 @@ squash_bsc_compress_buffer_unsafe (SquashCodec* codec,
                                    size_t uncompressed_size,
                                    const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
                                    SquashOptions* options) {
-  const int lzp_hash_size = squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_LZP_HASH_SIZE);
-  const int lzp_min_len = squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_LZP_MIN_LEN);
-  const int block_sorter = squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_BLOCK_SORTER);
-  const int coder = squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_CODER);
-  const int features = squash_bsc_options_get_features (codec, options);
-
-#if INT_MAX < SIZE_MAX
-  if (SQUASH_UNLIKELY(INT_MAX < uncompressed_size))
-    return squash_error (SQUASH_RANGE);
-#endif
-
-  if (SQUASH_UNLIKELY(*compressed_size < (uncompressed_size + LIBBSC_HEADER_SIZE)))
+  const size_t block_size = squash_options_get_size_at (options, codec, SQUASH_BSC_OPT_BLOCK_SIZE);
+  const unsigned int threads = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_THREADS);
+  SquashBscJob job = {
+    uncompressed,
+    compressed,
+    NULL,
+    squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_LZP_HASH_SIZE),
+    squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_LZP_MIN_LEN),
+    squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_BLOCK_SORTER),
+    squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_CODER),
+    squash_bsc_options_get_features (codec, options)
+  };
+
+  if (SQUASH_UNLIKELY(*compressed_size < squash_bsc_get_max_compressed_size (codec, uncompressed_size)))
     return squash_error (SQUASH_BUFFER_FULL);
 
-  const int res = bsc_compress (uncompressed, compressed, (int) uncompressed_size,
-                                lzp_hash_size, lzp_min_len, block_sorter, coder, features);
-
-  if (SQUASH_UNLIKELY(res < 0)) {
-    return squash_error (SQUASH_FAILED);
+  const size_t n_blocks = (uncompressed_size == 0) ? 1 : ((uncompressed_size + (block_size - 1)) / block_size);
+  job.blocks = squash_calloc (n_blocks, sizeof (SquashBscBlock));
+  if (SQUASH_UNLIKELY(job.blocks == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  /* Each block gets a worst-case slot so they can be compressed
+     independently; the output is compacted afterwards. */
+  for (size_t i = 0 ; i < n_blocks ; i++) {
+    SquashBscBlock* block = &(job.blocks[i]);
+    block->uncompressed_offset = i * block_size;
+    block->uncompressed_size = uncompressed_size - block->uncompressed_offset;
+    if (block->uncompressed_size > block_size)
+      block->uncompressed_size = block_size;
+    block->compressed_offset = block->uncompressed_offset + (i * LIBBSC_HEADER_SIZE);
   }
 
-#if SIZE_MAX < INT_MAX
-  if (SQUASH_UNLIKELY(SIZE_MAX < res))
-    return squash_error (SQUASH_RANGE);
-#endif
+  SquashStatus res = squash_parallel_for (threads, n_blocks, squash_bsc_compress_block, &job);
+
+  if (SQUASH_LIKELY(res == SQUASH_OK)) {
+    size_t pos = 0;
+    for (size_t i = 0 ; i < n_blocks ; i++) {
+      const SquashBscBlock* block = &(job.blocks[i]);
+      if (block->compressed_offset != pos)
+        memmove (compressed + pos, compressed + block->compressed_offset, block->compressed_size);
+      pos += block->compressed_size;
+    }
+    *compressed_size = pos;
+  }
 
-  *compressed_size = (size_t) res;
+  squash_free (job.blocks);
 
-  return SQUASH_OK;
+  return res;
 }
 
 static SquashStatus
@@ -188,36 +309,53 @@ squash_bsc_decompress_buffer (SquashCodec* codec,
                               size_t compressed_size,
                               const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
                               SquashOptions* options) {
-#if INT_MAX < SIZE_MAX
-  if (SQUASH_UNLIKELY(INT_MAX < compressed_size) ||
-      SQUASH_UNLIKELY(INT_MAX < *decompressed_size))
-    return squash_error (SQUASH_RANGE);
-#endif
-
-  const int features = squash_bsc_options_get_features (codec, options);
-
-  int p_block_size, p_data_size;
+  const unsigned int threads = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_THREADS);
+  size_t total = 0;
 
-  int res = bsc_block_info (compressed, (int) compressed_size, &p_block_size, &p_data_size, LIBBSC_DEFAULT_FEATURES);
-
-  if (SQUASH_UNLIKELY(p_block_size != (int) compressed_size))
+  const size_t n_blocks = squash_bsc_parse_blocks (compressed_size, compressed, NULL, &total);
+  if (SQUASH_UNLIKELY(n_blocks == 0))
     return squash_error (SQUASH_FAILED);
-  if (SQUASH_UNLIKELY(p_data_size > (int) *decompressed_size))
+  if (SQUASH_UNLIKELY(total > *decompressed_size))
     return squash_error (SQUASH_BUFFER_FULL);
 
-  res = bsc_decompress (compressed, p_block_size, decompressed, p_data_size, features);
+  SquashBscJob job = {
+    compressed,
+    decompressed,
+    squash_calloc (n_blocks, sizeof (SquashBscBlock)),
+    0, 0, 0, 0,
+    squash_bsc_options_get_features (codec, options)
+  };
+  if (SQUASH_UNLIKELY(job.blocks == NULL))
+    return squash_error (SQUASH_MEMORY);
 
-  if (SQUASH_UNLIKELY(res < 0))
-    return squash_error (SQUASH_FAILED);
+  squash_bsc_parse_blocks (compressed_size, compressed, job.blocks, NULL);
 
-#if SIZE_MAX < INT_MAX
-  if (SQUASH_UNLIKELY(SIZE_MAX < p_data_size))
-    return squash_error (SQUASH_RANGE);
-#endif
+  const SquashStatus res = squash_parallel_for (threads, n_blocks, squash_bsc_decompress_block, &job);
+  if (SQUASH_LIKELY(res == SQUASH_OK))
+    *decompressed_size = total;
 
-  *decompressed_size = (size_t) p_data_size;
+  squash_free (job.blocks);
 
-  return SQUASH_OK;
+  return res;
+}
+
+static size_t
+squash_bsc_get_memory_usage (SquashCodec* codec, SquashOptions* options, SquashStreamType stream_type) {
+  /* libbsc needs roughly 5n bytes per block being compressed (the
+     suffix array plus working copies) and about 1.25n when
+     decompressing, plus the LZP hash table. */
+  const size_t block_size = squash_options_get_size_at (options, codec, SQUASH_BSC_OPT_BLOCK_SIZE);
+  const size_t lzp_table = ((size_t) 1) << squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_LZP_HASH_SIZE);
+  unsigned int threads = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_BSC_OPT_THREADS);
+  const unsigned int max_threads = squash_get_max_threads ();
+
+  if (threads == 0 || threads > max_threads)
+    threads = max_threads;
+
+  if (stream_type == SQUASH_STREAM_COMPRESS)
+    return threads * ((5 * block_size) + (lzp_table * sizeof (int)));
+  else
+    return threads * ((block_size + (block_size / 4)) + (lzp_table * sizeof (int)));
 }
 
 SquashStatus
@@ -232,6 +370,7 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->get_max_compressed_size = squash_bsc_get_max_compressed_size;
     impl->decompress_buffer = squash_bsc_decompress_buffer;
     impl->compress_buffer_unsafe = squash_bsc_compress_buffer_unsafe;
+    impl->get_memory_usage = squash_bsc_get_memory_usage;
   } else {
     return squash_error (SQUASH_UNABLE_TO_LOAD);
   }
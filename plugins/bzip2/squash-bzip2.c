@@ -84,6 +84,22 @@ squash_bz2_free (void* opaque, void* ptr) {
   squash_free (ptr);
 }
 
+static int
+squash_bz2_stream_begin (SquashBZ2Stream* stream) {
+  SquashStream* s = (SquashStream*) stream;
+
+  if (s->stream_type == SQUASH_STREAM_COMPRESS) {
+    return BZ2_bzCompressInit (&(stream->stream),
+                               squash_options_get_int_at (s->options, s->codec, SQUASH_BZ2_OPT_LEVEL),
+                               0,
+                               squash_options_get_int_at (s->options, s->codec, SQUASH_BZ2_OPT_WORK_FACTOR));
+  } else {
+    return BZ2_bzDecompressInit (&(stream->stream),
+                                 0,
+                                 squash_options_get_bool_at (s->options, s->codec, SQUASH_BZ2_OPT_SMALL));
+  }
+}
+
 static SquashBZ2Stream*
 squash_bz2_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
   int bz2_e = 0;
@@ -93,21 +109,11 @@ squash_bz2_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashO
   assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
 
   stream = squash_malloc (sizeof (SquashBZ2Stream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
   squash_bz2_stream_init (stream, codec, stream_type, options, squash_bz2_stream_destroy);
 
-  if (stream_type == SQUASH_STREAM_COMPRESS) {
-    bz2_e = BZ2_bzCompressInit (&(stream->stream),
-                                squash_options_get_int_at (options, codec, SQUASH_BZ2_OPT_LEVEL),
-                                0,
-                                squash_options_get_int_at (options, codec, SQUASH_BZ2_OPT_WORK_FACTOR));
-  } else if (stream_type == SQUASH_STREAM_DECOMPRESS) {
-    bz2_e = BZ2_bzDecompressInit (&(stream->stream),
-                                  0,
-                                  squash_options_get_bool_at (options, codec, SQUASH_BZ2_OPT_SMALL));
-  } else {
-    squash_assert_unreachable();
-  }
-
+  bz2_e = squash_bz2_stream_begin (stream);
   if (bz2_e != BZ_OK) {
     /* We validate the params so OOM is really the only time this
        should happen, and that really shouldn't be happening here. */
@@ -146,6 +152,19 @@ squash_bz2_stream_destroy (void* stream) {
   squash_stream_destroy (stream);
 }
 
+static SquashStatus
+squash_bz2_reset_stream (SquashStream* stream) {
+  SquashBZ2Stream* s = (SquashBZ2Stream*) stream;
+
+  /* libbzip2 has no reset function, so start over. */
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS)
+    BZ2_bzCompressEnd (&(s->stream));
+  else
+    BZ2_bzDecompressEnd (&(s->stream));
+
+  return SQUASH_LIKELY(squash_bz2_stream_begin (s) == BZ_OK) ? SQUASH_OK : squash_error (SQUASH_FAILED);
+}
+
 static SquashStream*
 squash_bz2_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
   return (SquashStream*) squash_bz2_stream_new (codec, stream_type, options);
@@ -281,6 +300,20 @@ squash_bz2_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size
     600;
 }
 
+static size_t
+squash_bz2_get_memory_usage (SquashCodec* codec, SquashOptions* options, SquashStreamType stream_type) {
+  /* Figures from the "Memory management" section of the bzip2
+     manual; the block size is 100k times the level. */
+  const size_t block_size = ((size_t) squash_options_get_int_at (options, codec, SQUASH_BZ2_OPT_LEVEL)) * 100000;
+
+  if (stream_type == SQUASH_STREAM_COMPRESS)
+    return 400000 + (8 * block_size);
+  else if (squash_options_get_bool_at (options, codec, SQUASH_BZ2_OPT_SMALL))
+    return 100000 + ((5 * block_size) / 2);
+  else
+    return 100000 + (4 * block_size);
+}
+
 SquashStatus
 squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   if (strcmp ("bzip2", squash_codec_get_name (codec)) == 0) {
@@ -289,7 +322,9 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->options = squash_bz2_options;
     impl->create_stream = squash_bz2_create_stream;
     impl->process_stream = squash_bz2_process_stream;
+    impl->reset_stream = squash_bz2_reset_stream;
     impl->get_max_compressed_size = squash_bz2_get_max_compressed_size;
+    impl->get_memory_usage = squash_bz2_get_memory_usage;
   } else {
     return SQUASH_UNABLE_TO_LOAD;
   }
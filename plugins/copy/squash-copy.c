@@ -66,6 +66,8 @@ squash_copy_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squash
   assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
 
   stream = (SquashCopyStream*) squash_malloc (sizeof (SquashCopyStream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
   squash_copy_stream_init (stream, codec, stream_type, options, squash_copy_stream_destroy);
 
   return stream;
@@ -105,6 +107,27 @@ squash_copy_process_stream (SquashStream* stream, SquashOperation operation) {
   return (stream->avail_in != 0) ? SQUASH_PROCESSING : SQUASH_OK;
 }
 
+static SquashStatus
+squash_copy_reset_stream (SquashStream* stream) {
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_copy_checkpoint_stream (SquashStream* stream,
+                               size_t* checkpoint_size,
+                               uint8_t checkpoint[SQUASH_ARRAY_PARAM(*checkpoint_size)]) {
+  /* Nothing is buffered, so the totals are all there is. */
+  *checkpoint_size = 0;
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_copy_restore_stream (SquashStream* stream,
+                            size_t checkpoint_size,
+                            const uint8_t checkpoint[SQUASH_ARRAY_PARAM(checkpoint_size)]) {
+  return SQUASH_LIKELY(checkpoint_size == 0) ? SQUASH_OK : squash_error (SQUASH_INVALID_BUFFER);
+}
+
 static SquashStatus
 squash_copy_compress_buffer (SquashCodec* codec,
                              size_t* compressed_size,
@@ -149,6 +172,9 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->compress_buffer = squash_copy_compress_buffer;
     impl->create_stream = squash_copy_create_stream;
     impl->process_stream = squash_copy_process_stream;
+    impl->reset_stream = squash_copy_reset_stream;
+    impl->checkpoint_stream = squash_copy_checkpoint_stream;
+    impl->restore_stream = squash_copy_restore_stream;
   } else {
     return squash_error (SQUASH_UNABLE_TO_LOAD);
   }
@@ -211,8 +211,8 @@ int crush_compress(CrushContext* ctx, int level)
   int* prev = (int*)ctx->alloc(W_SIZE * sizeof(int), ctx->user_data);
 
   if (head == NULL || prev == NULL) {
-    free (head);
-    free (prev);
+    ctx->dealloc (head, ctx->user_data);
+    ctx->dealloc (prev, ctx->user_data);
     return -1;
   }
 
@@ -59,12 +59,12 @@ SquashStatus               squash_plugin_init_codec     (SquashCodec* codec, Squ
 
 static void*
 squash_crush_malloc (size_t size, void* user_data) {
-  return squash_calloc (size, 1);
+  return squash_scratch_calloc (size, 1);
 }
 
 static void
 squash_crush_free (void* ptr, void* user_data) {
-  return squash_free (ptr);
+  squash_scratch_free (ptr);
 }
 
 static size_t
@@ -0,0 +1,915 @@
+/* Copyright (c) 2013-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#  include <direct.h>
+#  include <process.h>
+#  define squash_dedup_mkdir(path) _mkdir(path)
+#  define squash_dedup_getpid() _getpid()
+#else
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  define squash_dedup_mkdir(path) mkdir(path, 0777)
+#  define squash_dedup_getpid() getpid()
+#endif
+
+#include <squash/squash.h>
+
+#include "sha256.h"
+
+/* Content-defined chunking and deduplication in front of another
+ * codec.
+ *
+ * Input is split into chunks with FastCDC: a Gear rolling hash, cut
+ * points are never considered in the first min-size bytes of a chunk,
+ * and the mask is harder to match before avg-size than after it
+ * ("normalized chunking"), which keeps chunk sizes close to avg-size.
+ * Since cut points only depend on the content, an insertion or
+ * deletion only changes the chunks around it.
+ *
+ * The output starts with a 6 byte header ("SQDD", a version, and the
+ * length of the inner codec's name) followed by the name.  Then
+ * there is one record per chunk: a type, the uncompressed size and
+ * the payload size (both 32-bit little-endian), the SHA-256 of the
+ * chunk, and the payload.  Chunks are either compressed with the
+ * inner codec, stored, or, when the chunk is already in the chunk
+ * store, a reference with no payload.  A record of type 0 ends the
+ * stream.
+ *
+ * The chunk store is a directory with one file per chunk, named
+ * after its hash (in a subdirectory named after the first byte).
+ * Each file is a 6 byte header ("SQDC", a version and the codec name
+ * length), the codec name, and a record as above.  Chunks are added
+ * as they are first seen, so duplicates later in the same stream, and
+ * in later streams using the same store, cost a hash and a lookup
+ * rather than compression.  Decompressing a stream with references
+ * needs the same store. */
+
+#define SQUASH_DEDUP_VERSION 1
+#define SQUASH_DEDUP_HEADER_SIZE ((size_t) 6)
+#define SQUASH_DEDUP_RECORD_SIZE ((size_t) (9 + SQUASH_DEDUP_SHA256_SIZE))
+#define SQUASH_DEDUP_MAX_CHUNK_SIZE ((size_t) 16 * 1024 * 1024)
+#define SQUASH_DEDUP_MIN_MIN_SIZE ((size_t) 1024)
+
+static const uint8_t squash_dedup_magic[4] = { 'S', 'Q', 'D', 'D' };
+static const uint8_t squash_dedup_chunk_magic[4] = { 'S', 'Q', 'D', 'C' };
+
+enum SquashDedupRecordType {
+  SQUASH_DEDUP_RECORD_END = 0,
+  SQUASH_DEDUP_RECORD_COMPRESSED = 1,
+  SQUASH_DEDUP_RECORD_STORED = 2,
+  SQUASH_DEDUP_RECORD_REFERENCE = 3
+};
+
+enum SquashDedupOptIndex {
+  SQUASH_DEDUP_OPT_CODEC = 0,
+  SQUASH_DEDUP_OPT_STORE,
+  SQUASH_DEDUP_OPT_MIN_SIZE,
+  SQUASH_DEDUP_OPT_AVG_SIZE,
+  SQUASH_DEDUP_OPT_MAX_SIZE
+};
+
+static SquashOptionInfo squash_dedup_options[] = {
+  { "codec",
+    SQUASH_OPTION_TYPE_STRING,
+    .default_value.string_value = (char*) "deflate" },
+  { "store",
+    SQUASH_OPTION_TYPE_STRING,
+    .default_value.string_value = (char*) "" },
+  { "min-size",
+    SQUASH_OPTION_TYPE_RANGE_SIZE,
+    .info.range_size = {
+      .min = SQUASH_DEDUP_MIN_MIN_SIZE,
+      .max = 1024 * 1024 },
+    .default_value.size_value = 2 * 1024 },
+  { "avg-size",
+    SQUASH_OPTION_TYPE_RANGE_SIZE,
+    .info.range_size = {
+      .min = 4 * 1024,
+      .max = 4 * 1024 * 1024 },
+    .default_value.size_value = 8 * 1024 },
+  { "max-size",
+    SQUASH_OPTION_TYPE_RANGE_SIZE,
+    .info.range_size = {
+      .min = 8 * 1024,
+      .max = SQUASH_DEDUP_MAX_CHUNK_SIZE },
+    .default_value.size_value = 64 * 1024 },
+  { NULL, SQUASH_OPTION_TYPE_NONE, }
+};
+
+static const uint64_t squash_dedup_gear[256] = {
+  UINT64_C(0xfff42f91e0244b7b), UINT64_C(0xddd25862eef1a87b), UINT64_C(0xb30e1dc907cdc872),
+  UINT64_C(0x57251ba22933897b), UINT64_C(0x3403928ad0e81d2c), UINT64_C(0xdb816262d3ecd828),
+  UINT64_C(0xf5da47e9f161d73a), UINT64_C(0xe747a821dcad37d3), UINT64_C(0x7e4f4d63710e655f),
+  UINT64_C(0x29853ae7a07caf02), UINT64_C(0x0da266adfee593cd), UINT64_C(0x206af86ad8d2ab17),
+  UINT64_C(0x3b96c0d33f2b0960), UINT64_C(0x2ac7302bf9718107), UINT64_C(0x6a98de48df9e3597),
+  UINT64_C(0x54850d73ab221b26), UINT64_C(0x428a638787a96542), UINT64_C(0x63e126d91eb085a1),
+  UINT64_C(0x9ef738fad6e99377), UINT64_C(0x72512356e9f48c25), UINT64_C(0xca4c50ee9d1d909f),
+  UINT64_C(0x7e1b5f66cdb1fa7d), UINT64_C(0xd2889beaefeae02e), UINT64_C(0x267e6f1a19322e63),
+  UINT64_C(0x4c1d2514563bc137), UINT64_C(0x53e09c29a08c1365), UINT64_C(0xf60752400d750fc3),
+  UINT64_C(0xae6b7bc02d67ccd4), UINT64_C(0x66d26b8567e757cf), UINT64_C(0x8495182427073ccd),
+  UINT64_C(0x8d6d5c493effab7c), UINT64_C(0xca9fe9deb8ff29eb), UINT64_C(0x259a792914b3595a),
+  UINT64_C(0xf8e54be9d151bb00), UINT64_C(0x170b6e14abcf8a4c), UINT64_C(0x0ecd871557af297e),
+  UINT64_C(0xcb4384768d1cda19), UINT64_C(0xb15772e34424429f), UINT64_C(0x724e4e2b7c005902),
+  UINT64_C(0x4bd4ec29a1448b25), UINT64_C(0xa84b2f6ce8cce913), UINT64_C(0x6b1b0460b60da6c4),
+  UINT64_C(0xa8a9fd8c429949e9), UINT64_C(0xa745108edf3663a3), UINT64_C(0x4358e3b8b6effd32),
+  UINT64_C(0x207d96dff2a36950), UINT64_C(0x49d76bddf2aaed77), UINT64_C(0xb02133582ef55bf6),
+  UINT64_C(0xe03186202a878065), UINT64_C(0xb1f5ec4281b56acb), UINT64_C(0xfc30492dee4a869a),
+  UINT64_C(0xfce92992f7289a57), UINT64_C(0x68a8b7e00c0f4b0f), UINT64_C(0xcf581d58349dadc8),
+  UINT64_C(0x24dc4408f20234fa), UINT64_C(0x15a1425b51b4d1b3), UINT64_C(0xdfad5e61448584c3),
+  UINT64_C(0xf09ece08785b3053), UINT64_C(0xaf254145f3e03aa3), UINT64_C(0x87b662c548366bd5),
+  UINT64_C(0xcd4429e3c262a284), UINT64_C(0x525a85a3b2e75d0e), UINT64_C(0x0eef135db26b7951),
+  UINT64_C(0x0ab367af83ebd1b3), UINT64_C(0x7f95f81280c2c02c), UINT64_C(0x91f8bc9d5b1510e0),
+  UINT64_C(0xa91336cd6b4804e1), UINT64_C(0x2ca5845ac9ca8f1f), UINT64_C(0x95f52f6b29cd3139),
+  UINT64_C(0xbab50c19bd3fb817), UINT64_C(0x488970a99193593c), UINT64_C(0x9b7b34053445a2f2),
+  UINT64_C(0xbb60bd96686d8266), UINT64_C(0x67509326e9c3d2b6), UINT64_C(0x6b2a600d18a4cb8f),
+  UINT64_C(0x945d218c1f8a83b0), UINT64_C(0x7ccfdb57d46b7d95), UINT64_C(0xae3bf6b28fa18b07),
+  UINT64_C(0xd3012b7c4eeab055), UINT64_C(0x07a06a2d70460195), UINT64_C(0x7fd636cc847a2dc9),
+  UINT64_C(0x8533e6bf410215d9), UINT64_C(0x75c6d88bdb6ed72b), UINT64_C(0x074c812dd6cb9ea8),
+  UINT64_C(0x774f9b8de11b80f6), UINT64_C(0x19709899fcd53439), UINT64_C(0x33766f32c3808d57),
+  UINT64_C(0x2f563919b41357a8), UINT64_C(0x6967cce377f5399e), UINT64_C(0xfdddcef5faf643b1),
+  UINT64_C(0x6a8e19e9923fea8e), UINT64_C(0x6c93e62916382932), UINT64_C(0x2284287ff2ec4d0c),
+  UINT64_C(0x578d0049628b8d25), UINT64_C(0xe55413ce7435a08c), UINT64_C(0x37b64fe667980c85),
+  UINT64_C(0x2bac4dd15d435ae8), UINT64_C(0xbc24e27d190356c1), UINT64_C(0x3c19f89cefdd3c66),
+  UINT64_C(0x774f31819e38569f), UINT64_C(0x368ecc69a92bdcee), UINT64_C(0xc1537333760822bc),
+  UINT64_C(0x755a064c3f6b20a2), UINT64_C(0x00a655a817ee4f0b), UINT64_C(0x7ba475d70ec08623),
+  UINT64_C(0xa97c442343e90863), UINT64_C(0x1b4e75b1c567f5ec), UINT64_C(0x0e3e4dd962ada06e),
+  UINT64_C(0x2213ec93ceab3f88), UINT64_C(0x307d6f02a0e369c8), UINT64_C(0xc09617104e0d5662),
+  UINT64_C(0x4d5e19449f79d345), UINT64_C(0xfe33a0737c7b8743), UINT64_C(0xbe2bba5fe8b42f71),
+  UINT64_C(0xc6db3fd151e266d2), UINT64_C(0x60078bf3b5023680), UINT64_C(0x1cec93c849f4d032),
+  UINT64_C(0xaeba753b84b5ac53), UINT64_C(0xc7601cbf3b45e3d1), UINT64_C(0x998c5314e3847d2a),
+  UINT64_C(0x0036a3c66caeeffd), UINT64_C(0x7b3a142a3e419884), UINT64_C(0x4488f478b513f04e),
+  UINT64_C(0xa1961b1033053414), UINT64_C(0x1d4efcf1cf92bcae), UINT64_C(0x3c620104f4d54fc2),
+  UINT64_C(0x2639e5fb8f94f873), UINT64_C(0x57ad427865579448), UINT64_C(0xee638e7b122cd7b8),
+  UINT64_C(0xe971abb84af55058), UINT64_C(0x85adb11291f8b35f), UINT64_C(0x54bd8057c0541150),
+  UINT64_C(0x636a474d978562c5), UINT64_C(0xf2bdba7395e9eca5), UINT64_C(0x728676d25943e83d),
+  UINT64_C(0x7f06c3f5285cd8ba), UINT64_C(0x970c8eb1cfbdb7de), UINT64_C(0x63e5e61370db8972),
+  UINT64_C(0xb7a67f95406f24b5), UINT64_C(0x02ab5a641bad8132), UINT64_C(0x3e4deacf8e881735),
+  UINT64_C(0xeb3017cfbb33a70b), UINT64_C(0xf2a1e62ed5f5ebdf), UINT64_C(0x9edf129118015a6a),
+  UINT64_C(0x9ed07c329a92c554), UINT64_C(0x4d7679a4b41885a4), UINT64_C(0x462ea52b0bd8ef3f),
+  UINT64_C(0x9ecf618078f8a9f8), UINT64_C(0x92513d8bab941216), UINT64_C(0x9565da334e1c8428),
+  UINT64_C(0x1e0e437c267afff5), UINT64_C(0xe2ed6077b6a68ef3), UINT64_C(0x6044405970efd935),
+  UINT64_C(0xd366a91ec2118613), UINT64_C(0xaec7e994d94a0e90), UINT64_C(0xa2bedf1477dac923),
+  UINT64_C(0x5f8003b6f475565d), UINT64_C(0x47bfe856aca83518), UINT64_C(0xe41507901a6b6ca0),
+  UINT64_C(0xf41ef811324dbd5b), UINT64_C(0x8f528d9996a34953), UINT64_C(0x4dcab9bc6f876ea1),
+  UINT64_C(0xed0e9c242633b7d6), UINT64_C(0xa398a0db9e6e2e0c), UINT64_C(0x3182f48350bd1515),
+  UINT64_C(0xec197ddde675664e), UINT64_C(0xa8846feb609a0e3a), UINT64_C(0xe13a341ac22e44c7),
+  UINT64_C(0xb442f7d5e2620b2a), UINT64_C(0x753e8eb69707af2c), UINT64_C(0xb68778fa27f6970f),
+  UINT64_C(0x37a874e47c778b67), UINT64_C(0x202584eab6c15bf6), UINT64_C(0x16159f5484f9b864),
+  UINT64_C(0x064980fcd41a844f), UINT64_C(0x8abe221bf110a9cf), UINT64_C(0xdd21c335d8a23c1f),
+  UINT64_C(0xb47e3d7aa1fa0244), UINT64_C(0x49956899b051a012), UINT64_C(0x8da7f6d8220e2812),
+  UINT64_C(0x63144b0464e662f0), UINT64_C(0x48f1733a2aa7c1b8), UINT64_C(0x9acdb44d73382957),
+  UINT64_C(0xeb7f3c11f0573747), UINT64_C(0x5cbd3a7c89e17b05), UINT64_C(0x81127409fb41a6c8),
+  UINT64_C(0x24d696a84e66b0bf), UINT64_C(0x32c82d2f265fc0ea), UINT64_C(0x4f54fa17cc34c373),
+  UINT64_C(0xa75b712e1ae73f48), UINT64_C(0xbec08d4d67290abd), UINT64_C(0xdbf51226aa36e88c),
+  UINT64_C(0xa86fb054e1f1ab39), UINT64_C(0x22851d9d78e0557e), UINT64_C(0xeb81a58f9ee305ef),
+  UINT64_C(0xed2632f1e4d0fc90), UINT64_C(0xf3df08d5d1a0688f), UINT64_C(0xc4137ab4ecd14380),
+  UINT64_C(0xc3ed31b67a563c6d), UINT64_C(0x2dbbd3b1d2dcc151), UINT64_C(0xc59878944eb3e027),
+  UINT64_C(0xe6d04ada42cfb089), UINT64_C(0x7614fca549f3111e), UINT64_C(0xd04fece1a0cb3241),
+  UINT64_C(0x683d064441c0baff), UINT64_C(0x320f749f092ec8c9), UINT64_C(0x8ed25253f50cd087),
+  UINT64_C(0x625b142433ad0405), UINT64_C(0x38210dc6696c5805), UINT64_C(0x8d34f03093141153),
+  UINT64_C(0x9c30d2bcd81c7e1c), UINT64_C(0x15bafd7d38e5b2d7), UINT64_C(0x6ec0c258a1490a92),
+  UINT64_C(0x4ae207a1092defbf), UINT64_C(0xe5ebc0f10855cfdd), UINT64_C(0xf67be935bbf2a127),
+  UINT64_C(0xa20e695754e9e104), UINT64_C(0xc6493c7e775e2eb0), UINT64_C(0x5dfbd541dd98d479),
+  UINT64_C(0xc06b746f95b9f567), UINT64_C(0xedfcb7e73287e09a), UINT64_C(0x35f386282a6480e5),
+  UINT64_C(0xe62693b312f704f0), UINT64_C(0xab4413c2881b9636), UINT64_C(0xaf6ebe106ceaf50a),
+  UINT64_C(0xe615af6c6e3ecc11), UINT64_C(0xa3cf8c9a1fd336bc), UINT64_C(0xcd530219aec1ffe2),
+  UINT64_C(0xec1cfa7910c971d4), UINT64_C(0x19ecd942fcc540b4), UINT64_C(0x7ef370eb6b6ec52a),
+  UINT64_C(0xf8977d44b79fe10f), UINT64_C(0x95ecb7656220d0e7), UINT64_C(0xe8c4fcca65d99e6e),
+  UINT64_C(0x39547a7f05d2267b), UINT64_C(0xe3da30a33e7e7642), UINT64_C(0x7ab7d5a2e9d6834a),
+  UINT64_C(0x8a3b4d12987670a1), UINT64_C(0x5a8b6fb5f9e0e0af), UINT64_C(0xdf4e4dd2b8a0f0a9),
+  UINT64_C(0xf40b77c60d012642), UINT64_C(0xb0d1cbafbc2bc866), UINT64_C(0xf61ca2e7090f35ac),
+  UINT64_C(0xe51bad342e8d52dc), UINT64_C(0xffbb84dd31aa4c2b), UINT64_C(0x2382bc8ad50ca4c6),
+  UINT64_C(0x93a696958f318e53), UINT64_C(0x7f6c396b1ce27f8d), UINT64_C(0xe914fec05ec9ca30),
+  UINT64_C(0x2f8e4bfcbfed6418), UINT64_C(0x0a04de02f26fbc1a), UINT64_C(0x97c92f818e81f742),
+  UINT64_C(0xc47f3a69d1a99af6), UINT64_C(0x66e930f81fdc28ed), UINT64_C(0x89e05dc071f84100),
+  UINT64_C(0xd6c1cfbc140eb270)
+};
+
+enum SquashDedupState {
+  SQUASH_DEDUP_STATE_HEADER,
+  SQUASH_DEDUP_STATE_NAME,
+  SQUASH_DEDUP_STATE_RECORD,
+  SQUASH_DEDUP_STATE_PAYLOAD,
+  SQUASH_DEDUP_STATE_FINISHED
+};
+
+typedef struct SquashDedupStream_s {
+  SquashStream base_object;
+
+  enum SquashDedupState state;
+
+  /* The inner codec; when decompressing, known once the header has
+     been read. */
+  SquashCodec* codec;
+  const char* store;
+  char* path;
+
+  size_t min_size;
+  size_t avg_size;
+  size_t max_size;
+  uint64_t mask_s;
+  uint64_t mask_l;
+
+  /* Data waiting to be copied to next_out. */
+  uint8_t* output;
+  size_t output_size;
+  size_t output_length;
+  size_t output_pos;
+
+  /* Compression: input waiting for a cut point.  Decompression: the
+     part of the header, record or payload read so far. */
+  uint8_t* input;
+  size_t input_size;
+  size_t input_length;
+  size_t needed;
+
+  uint8_t record[SQUASH_DEDUP_RECORD_SIZE];
+} SquashDedupStream;
+
+SQUASH_PLUGIN_EXPORT
+SquashStatus              squash_plugin_init_codec    (SquashCodec* codec, SquashCodecImpl* impl);
+
+static void               squash_dedup_stream_init    (SquashDedupStream* stream,
+                                                       SquashCodec* codec,
+                                                       SquashStreamType stream_type,
+                                                       SquashOptions* options,
+                                                       SquashDestroyNotify destroy_notify);
+static SquashDedupStream* squash_dedup_stream_new     (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options);
+static void               squash_dedup_stream_destroy (void* stream);
+
+static void
+squash_dedup_put_u32 (uint8_t* dest, size_t value) {
+  for (size_t i = 0 ; i < 4 ; i++)
+    dest[i] = (uint8_t) (value >> (8 * i));
+}
+
+static size_t
+squash_dedup_get_u32 (const uint8_t* src) {
+  return
+    (((size_t) src[0]) <<  0) | (((size_t) src[1]) <<  8) |
+    (((size_t) src[2]) << 16) | (((size_t) src[3]) << 24);
+}
+
+/* A mask of the given number of bits, taken from the top of the hash
+   since the Gear hash shifts older bytes out to the left. */
+static uint64_t
+squash_dedup_mask (unsigned int bits) {
+  return ~((~UINT64_C(0)) >> bits);
+}
+
+static void
+squash_dedup_stream_init (SquashDedupStream* stream,
+                          SquashCodec* codec,
+                          SquashStreamType stream_type,
+                          SquashOptions* options,
+                          SquashDestroyNotify destroy_notify) {
+  squash_stream_init ((SquashStream*) stream, codec, stream_type, (SquashOptions*) options, destroy_notify);
+
+  stream->state = SQUASH_DEDUP_STATE_HEADER;
+  stream->codec = NULL;
+  stream->store = squash_options_get_string_at (options, codec, SQUASH_DEDUP_OPT_STORE);
+  if (stream->store != NULL && stream->store[0] == '\0')
+    stream->store = NULL;
+  stream->path = NULL;
+
+  stream->min_size = squash_options_get_size_at (options, codec, SQUASH_DEDUP_OPT_MIN_SIZE);
+  stream->avg_size = squash_options_get_size_at (options, codec, SQUASH_DEDUP_OPT_AVG_SIZE);
+  stream->max_size = squash_options_get_size_at (options, codec, SQUASH_DEDUP_OPT_MAX_SIZE);
+  if (stream->avg_size <= stream->min_size)
+    stream->avg_size = stream->min_size + 1;
+  if (stream->max_size < stream->avg_size)
+    stream->max_size = stream->avg_size;
+
+  unsigned int bits = 0;
+  while ((((size_t) 1) << (bits + 1)) <= stream->avg_size)
+    bits++;
+  stream->mask_s = squash_dedup_mask (bits + 2);
+  stream->mask_l = squash_dedup_mask (bits - 2);
+
+  stream->output = NULL;
+  stream->output_size = 0;
+  stream->output_length = 0;
+  stream->output_pos = 0;
+
+  stream->input = NULL;
+  stream->input_size = 0;
+  stream->input_length = 0;
+  stream->needed = SQUASH_DEDUP_HEADER_SIZE;
+}
+
+static void
+squash_dedup_stream_destroy (void* stream) {
+  SquashDedupStream* s = (SquashDedupStream*) stream;
+
+  squash_free (s->path);
+  squash_free (s->output);
+  squash_free (s->input);
+
+  squash_stream_destroy (stream);
+}
+
+static SquashDedupStream*
+squash_dedup_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  SquashDedupStream* stream;
+
+  assert (codec != NULL);
+  assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
+
+  stream = (SquashDedupStream*) squash_malloc (sizeof (SquashDedupStream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+  squash_dedup_stream_init (stream, codec, stream_type, options, squash_dedup_stream_destroy);
+
+  if (stream->store != NULL) {
+    /* "/xx/", 64 hex digits, and room for a temporary suffix. */
+    stream->path = squash_malloc (strlen (stream->store) + 4 + (SQUASH_DEDUP_SHA256_SIZE * 2) + 32);
+    if (SQUASH_UNLIKELY(stream->path == NULL))
+      goto error;
+  }
+
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    const char* codec_name = squash_options_get_string_at (options, codec, SQUASH_DEDUP_OPT_CODEC);
+    stream->codec = (codec_name != NULL) ? squash_get_codec (codec_name) : NULL;
+    if (SQUASH_UNLIKELY(stream->codec == NULL) || SQUASH_UNLIKELY(stream->codec == codec)) {
+      squash_error (SQUASH_BAD_VALUE);
+      goto error;
+    }
+
+    const char* name = squash_codec_get_name (stream->codec);
+    const size_t name_length = strlen (name);
+    assert (name_length <= UINT8_MAX);
+
+    stream->input_size = stream->max_size;
+    stream->input = squash_malloc (stream->input_size);
+
+    size_t payload_size = squash_codec_get_max_compressed_size (stream->codec, stream->max_size);
+    if (payload_size < stream->max_size)
+      payload_size = stream->max_size;
+    stream->output_size = SQUASH_DEDUP_HEADER_SIZE + UINT8_MAX + SQUASH_DEDUP_RECORD_SIZE + payload_size;
+    stream->output = squash_malloc (stream->output_size);
+
+    if (SQUASH_UNLIKELY(stream->input == NULL) || SQUASH_UNLIKELY(stream->output == NULL)) {
+      squash_error (SQUASH_MEMORY);
+      goto error;
+    }
+
+    memcpy (stream->output, squash_dedup_magic, sizeof (squash_dedup_magic));
+    stream->output[4] = SQUASH_DEDUP_VERSION;
+    stream->output[5] = (uint8_t) name_length;
+    memcpy (stream->output + SQUASH_DEDUP_HEADER_SIZE, name, name_length);
+    stream->output_length = SQUASH_DEDUP_HEADER_SIZE + name_length;
+
+    stream->state = SQUASH_DEDUP_STATE_RECORD;
+  }
+
+  return stream;
+
+ error:
+  squash_object_unref (stream);
+  return NULL;
+}
+
+static SquashStream*
+squash_dedup_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  return (SquashStream*) squash_dedup_stream_new (codec, stream_type, options);
+}
+
+/* Find the end of the first chunk in data.  Only called with at least
+   max_size bytes, or at the end of the input, so the result doesn't
+   depend on how the input was split up. */
+static size_t
+squash_dedup_find_cut (SquashDedupStream* s, const uint8_t* data, size_t length) {
+  if (length <= s->min_size)
+    return length;
+
+  const size_t normal = (length < s->avg_size) ? length : s->avg_size;
+  const size_t end = (length < s->max_size) ? length : s->max_size;
+  uint64_t hash = 0;
+  size_t i = s->min_size;
+
+  for ( ; i < normal ; i++) {
+    hash = (hash << 1) + squash_dedup_gear[data[i]];
+    if ((hash & s->mask_s) == 0)
+      return i + 1;
+  }
+
+  for ( ; i < end ; i++) {
+    hash = (hash << 1) + squash_dedup_gear[data[i]];
+    if ((hash & s->mask_l) == 0)
+      return i + 1;
+  }
+
+  return end;
+}
+
+/* Fill in s->path for a chunk; with dir_only, just the subdirectory. */
+static char*
+squash_dedup_chunk_path (SquashDedupStream* s, const uint8_t hash[SQUASH_DEDUP_SHA256_SIZE], bool dir_only) {
+  static const char hex[] = "0123456789abcdef";
+  char* p = s->path + strlen (strcpy (s->path, s->store));
+
+  *(p++) = '/';
+  *(p++) = hex[hash[0] >> 4];
+  *(p++) = hex[hash[0] & 0xf];
+  if (!dir_only) {
+    *(p++) = '/';
+    for (size_t i = 0 ; i < SQUASH_DEDUP_SHA256_SIZE ; i++) {
+      *(p++) = hex[hash[i] >> 4];
+      *(p++) = hex[hash[i] & 0xf];
+    }
+  }
+  *p = '\0';
+
+  return s->path;
+}
+
+static bool
+squash_dedup_record_is_valid (SquashDedupStream* s, SquashCodec* codec, const uint8_t record[SQUASH_DEDUP_RECORD_SIZE]) {
+  const size_t size = squash_dedup_get_u32 (record + 1);
+  const size_t payload_size = squash_dedup_get_u32 (record + 5);
+
+  switch (record[0]) {
+    case SQUASH_DEDUP_RECORD_COMPRESSED:
+      return size != 0 && size <= SQUASH_DEDUP_MAX_CHUNK_SIZE && payload_size <= squash_codec_get_max_compressed_size (codec, size);
+    case SQUASH_DEDUP_RECORD_STORED:
+      return size != 0 && size <= SQUASH_DEDUP_MAX_CHUNK_SIZE && payload_size == size;
+    case SQUASH_DEDUP_RECORD_REFERENCE:
+      return size != 0 && size <= SQUASH_DEDUP_MAX_CHUNK_SIZE && payload_size == 0;
+    default:
+      return false;
+  }
+}
+
+/* Open the chunk for a size byte block with the given hash, check its
+   header and leave fp at the start of the payload.  The status is not
+   passed to squash_error, since a missing or damaged chunk is
+   expected while compressing. */
+static SquashStatus
+squash_dedup_chunk_open (SquashDedupStream* s, const uint8_t hash[SQUASH_DEDUP_SHA256_SIZE], size_t size,
+                         FILE** fp, SquashCodec** codec, uint8_t record[SQUASH_DEDUP_RECORD_SIZE]) {
+  uint8_t header[SQUASH_DEDUP_HEADER_SIZE];
+  char name[UINT8_MAX + 1];
+  SquashStatus res = SQUASH_INVALID_BUFFER;
+
+  *fp = fopen (squash_dedup_chunk_path (s, hash, false), "rb");
+  if (*fp == NULL)
+    return SQUASH_NOT_FOUND;
+
+  if (SQUASH_UNLIKELY(fread (header, 1, sizeof (header), *fp) != sizeof (header)) ||
+      SQUASH_UNLIKELY(memcmp (header, squash_dedup_chunk_magic, sizeof (squash_dedup_chunk_magic)) != 0) ||
+      SQUASH_UNLIKELY(header[4] != SQUASH_DEDUP_VERSION) ||
+      SQUASH_UNLIKELY(fread (name, 1, header[5], *fp) != header[5]) ||
+      SQUASH_UNLIKELY(fread (record, 1, SQUASH_DEDUP_RECORD_SIZE, *fp) != SQUASH_DEDUP_RECORD_SIZE))
+    goto fail;
+  name[header[5]] = '\0';
+
+  *codec = squash_get_codec (name);
+  if (SQUASH_UNLIKELY(*codec == NULL)) {
+    res = SQUASH_UNABLE_TO_LOAD;
+    goto fail;
+  }
+
+  if (SQUASH_UNLIKELY(*codec == ((SquashStream*) s)->codec) ||
+      SQUASH_UNLIKELY(record[0] == SQUASH_DEDUP_RECORD_REFERENCE) ||
+      SQUASH_UNLIKELY(!squash_dedup_record_is_valid (s, *codec, record)) ||
+      SQUASH_UNLIKELY(squash_dedup_get_u32 (record + 1) != size) ||
+      SQUASH_UNLIKELY(memcmp (record + 9, hash, SQUASH_DEDUP_SHA256_SIZE) != 0))
+    goto fail;
+
+  return SQUASH_OK;
+
+ fail:
+  fclose (*fp);
+  *fp = NULL;
+  return res;
+}
+
+/* Whether the store holds a complete, well-formed chunk for a size
+   byte block with the given hash.  Anything else (say a chunk torn by
+   a crash) is ignored, and gets replaced when the block is written. */
+static bool
+squash_dedup_chunk_exists (SquashDedupStream* s, const uint8_t hash[SQUASH_DEDUP_SHA256_SIZE], size_t size) {
+  uint8_t record[SQUASH_DEDUP_RECORD_SIZE];
+  SquashCodec* codec;
+  FILE* fp;
+
+  if (squash_dedup_chunk_open (s, hash, size, &fp, &codec, record) != SQUASH_OK)
+    return false;
+
+  const long payload_pos = ftell (fp);
+  const bool complete =
+    payload_pos >= 0 &&
+    fseek (fp, 0, SEEK_END) == 0 &&
+    ftell (fp) - payload_pos == (long) squash_dedup_get_u32 (record + 5);
+
+  fclose (fp);
+  return complete;
+}
+
+/* Add a chunk (the record at the start of s->output) to the store.
+   It is written to a temporary file and renamed so readers never see
+   a partial chunk, even with several writers. */
+static SquashStatus
+squash_dedup_chunk_write (SquashDedupStream* s, size_t record_length) {
+  const char* name = squash_codec_get_name (s->codec);
+  uint8_t header[SQUASH_DEDUP_HEADER_SIZE];
+  char* tmp_path = NULL;
+  SquashStatus res = SQUASH_OK;
+
+  squash_dedup_mkdir (squash_dedup_chunk_path (s, s->output + 9, true));
+
+  const char* path = squash_dedup_chunk_path (s, s->output + 9, false);
+  tmp_path = squash_malloc (strlen (path) + 32);
+  if (SQUASH_UNLIKELY(tmp_path == NULL))
+    return squash_error (SQUASH_MEMORY);
+  /* The pid keeps writers in different processes apart, the stream
+     those within one process. */
+  sprintf (tmp_path, "%s.%ld.%p.tmp", path, (long) squash_dedup_getpid (), (void*) s);
+
+  memcpy (header, squash_dedup_chunk_magic, sizeof (squash_dedup_chunk_magic));
+  header[4] = SQUASH_DEDUP_VERSION;
+  header[5] = (uint8_t) strlen (name);
+
+  FILE* fp = fopen (tmp_path, "wb");
+  if (SQUASH_UNLIKELY(fp == NULL)) {
+    res = squash_error (SQUASH_IO);
+    goto cleanup;
+  }
+
+  const bool written =
+    fwrite (header, 1, sizeof (header), fp) == sizeof (header) &&
+    fwrite (name, 1, header[5], fp) == header[5] &&
+    fwrite (s->output, 1, record_length, fp) == record_length;
+  if (SQUASH_UNLIKELY(fclose (fp) != 0) || SQUASH_UNLIKELY(!written)) {
+    remove (tmp_path);
+    res = squash_error (SQUASH_IO);
+    goto cleanup;
+  }
+
+  if (rename (tmp_path, path) != 0) {
+    /* Another writer got there first (rename won't replace a file on
+       Windows); that's fine as long as the chunk is there now.  If
+       what is there is damaged, replace it. */
+    if (!squash_dedup_chunk_exists (s, s->output + 9, squash_dedup_get_u32 (s->output + 1))) {
+      remove (path);
+      if (rename (tmp_path, path) != 0)
+        res = squash_error (SQUASH_IO);
+    }
+    remove (tmp_path);
+  }
+
+ cleanup:
+  squash_free (tmp_path);
+
+  return res;
+}
+
+/* Write the record for a chunk to s->output, which must be empty. */
+static SquashStatus
+squash_dedup_emit_chunk (SquashDedupStream* s, const uint8_t* data, size_t size) {
+  uint8_t* record = s->output;
+  size_t payload_size = 0;
+  SquashStatus res;
+
+  assert (s->output_length == 0);
+  assert (size != 0 && size <= s->max_size);
+
+  squash_dedup_sha256 (data, size, record + 9);
+
+  if (s->store != NULL && squash_dedup_chunk_exists (s, record + 9, size)) {
+    record[0] = SQUASH_DEDUP_RECORD_REFERENCE;
+  } else {
+    payload_size = s->output_size - SQUASH_DEDUP_RECORD_SIZE;
+    res = squash_codec_compress_with_options (s->codec, &payload_size, record + SQUASH_DEDUP_RECORD_SIZE, size, data, NULL);
+    if (res == SQUASH_OK && payload_size < size) {
+      record[0] = SQUASH_DEDUP_RECORD_COMPRESSED;
+    } else if (res == SQUASH_OK || res == SQUASH_BUFFER_FULL) {
+      memcpy (record + SQUASH_DEDUP_RECORD_SIZE, data, size);
+      payload_size = size;
+      record[0] = SQUASH_DEDUP_RECORD_STORED;
+    } else {
+      return res;
+    }
+  }
+
+  squash_dedup_put_u32 (record + 1, size);
+  squash_dedup_put_u32 (record + 5, payload_size);
+  s->output_length = SQUASH_DEDUP_RECORD_SIZE + payload_size;
+
+  if (s->store != NULL && record[0] != SQUASH_DEDUP_RECORD_REFERENCE) {
+    res = squash_dedup_chunk_write (s, s->output_length);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      return res;
+  }
+
+  return SQUASH_OK;
+}
+
+static bool
+squash_dedup_drain (SquashDedupStream* s) {
+  SquashStream* stream = (SquashStream*) s;
+  const size_t remaining = s->output_length - s->output_pos;
+  const size_t cp_size = (remaining < stream->avail_out) ? remaining : stream->avail_out;
+
+  if (cp_size != 0) {
+    memcpy (stream->next_out, s->output + s->output_pos, cp_size);
+    stream->next_out += cp_size;
+    stream->avail_out -= cp_size;
+    s->output_pos += cp_size;
+  }
+
+  if (s->output_pos != s->output_length)
+    return false;
+
+  s->output_length = 0;
+  s->output_pos = 0;
+  return true;
+}
+
+static SquashStatus
+squash_dedup_compress_stream (SquashStream* stream, SquashOperation operation) {
+  SquashDedupStream* s = (SquashDedupStream*) stream;
+  SquashStatus res;
+
+  while (true) {
+    if (s->output_length != 0 && !squash_dedup_drain (s))
+      return SQUASH_PROCESSING;
+
+    if (s->state == SQUASH_DEDUP_STATE_FINISHED)
+      return SQUASH_OK;
+
+    if (s->input_length == 0 && stream->avail_in >= s->max_size) {
+      /* Chunk straight from next_in when there is enough of it. */
+      const size_t cut = squash_dedup_find_cut (s, stream->next_in, stream->avail_in);
+      res = squash_dedup_emit_chunk (s, stream->next_in, cut);
+      if (SQUASH_UNLIKELY(res != SQUASH_OK))
+        return res;
+      stream->next_in += cut;
+      stream->avail_in -= cut;
+      continue;
+    }
+
+    const size_t cp_size = (stream->avail_in < (s->max_size - s->input_length)) ? stream->avail_in : (s->max_size - s->input_length);
+    if (cp_size != 0) {
+      memcpy (s->input + s->input_length, stream->next_in, cp_size);
+      s->input_length += cp_size;
+      stream->next_in += cp_size;
+      stream->avail_in -= cp_size;
+    }
+
+    if (s->input_length == s->max_size || (operation == SQUASH_OPERATION_FINISH && s->input_length != 0)) {
+      const size_t cut = squash_dedup_find_cut (s, s->input, s->input_length);
+      res = squash_dedup_emit_chunk (s, s->input, cut);
+      if (SQUASH_UNLIKELY(res != SQUASH_OK))
+        return res;
+      memmove (s->input, s->input + cut, s->input_length - cut);
+      s->input_length -= cut;
+    } else if (operation == SQUASH_OPERATION_FINISH) {
+      memset (s->output, 0, SQUASH_DEDUP_RECORD_SIZE);
+      s->output_length = SQUASH_DEDUP_RECORD_SIZE;
+      s->state = SQUASH_DEDUP_STATE_FINISHED;
+    } else {
+      return SQUASH_OK;
+    }
+  }
+}
+
+/* Decode a compressed or stored chunk to s->output and check it
+   against the hash in the record. */
+static SquashStatus
+squash_dedup_decode_chunk (SquashDedupStream* s, SquashCodec* codec, const uint8_t record[SQUASH_DEDUP_RECORD_SIZE], const uint8_t* payload) {
+  const size_t size = squash_dedup_get_u32 (record + 1);
+  const size_t payload_size = squash_dedup_get_u32 (record + 5);
+  uint8_t hash[SQUASH_DEDUP_SHA256_SIZE];
+
+  if (s->output_size < size) {
+    squash_free (s->output);
+    s->output = squash_malloc (size);
+    s->output_size = (s->output != NULL) ? size : 0;
+    if (SQUASH_UNLIKELY(s->output == NULL))
+      return squash_error (SQUASH_MEMORY);
+  }
+
+  if (record[0] == SQUASH_DEDUP_RECORD_STORED) {
+    if (SQUASH_UNLIKELY(payload_size != size))
+      return squash_error (SQUASH_INVALID_BUFFER);
+    memcpy (s->output, payload, size);
+  } else {
+    size_t decompressed_size = size;
+    SquashStatus res = squash_codec_decompress_with_options (codec, &decompressed_size, s->output, payload_size, payload, NULL);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      return res;
+    if (SQUASH_UNLIKELY(decompressed_size != size))
+      return squash_error (SQUASH_INVALID_BUFFER);
+  }
+
+  squash_dedup_sha256 (s->output, size, hash);
+  if (SQUASH_UNLIKELY(memcmp (hash, record + 9, SQUASH_DEDUP_SHA256_SIZE) != 0))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  s->output_length = size;
+  s->output_pos = 0;
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_dedup_reserve_input (SquashDedupStream* s, size_t size) {
+  if (s->input_size < size) {
+    squash_free (s->input);
+    s->input = squash_malloc (size);
+    s->input_size = (s->input != NULL) ? size : 0;
+    if (SQUASH_UNLIKELY(s->input == NULL))
+      return squash_error (SQUASH_MEMORY);
+  }
+
+  return SQUASH_OK;
+}
+
+/* Read a chunk referenced by the current record from the store. */
+static SquashStatus
+squash_dedup_load_chunk (SquashDedupStream* s) {
+  uint8_t record[SQUASH_DEDUP_RECORD_SIZE];
+  SquashCodec* codec;
+  FILE* fp;
+  SquashStatus res;
+
+  if (SQUASH_UNLIKELY(s->store == NULL))
+    return squash_error (SQUASH_NOT_FOUND);
+
+  res = squash_dedup_chunk_open (s, s->record + 9, squash_dedup_get_u32 (s->record + 1), &fp, &codec, record);
+  if (SQUASH_UNLIKELY(res != SQUASH_OK))
+    return squash_error (res);
+
+  const size_t payload_size = squash_dedup_get_u32 (record + 5);
+  res = squash_dedup_reserve_input (s, payload_size);
+  if (SQUASH_UNLIKELY(res != SQUASH_OK))
+    goto cleanup;
+
+  if (SQUASH_UNLIKELY(fread (s->input, 1, payload_size, fp) != payload_size)) {
+    res = squash_error (SQUASH_INVALID_BUFFER);
+    goto cleanup;
+  }
+
+  res = squash_dedup_decode_chunk (s, codec, record, s->input);
+
+ cleanup:
+  fclose (fp);
+
+  return res;
+}
+
+static SquashStatus
+squash_dedup_decompress_stream (SquashStream* stream, SquashOperation operation) {
+  SquashDedupStream* s = (SquashDedupStream*) stream;
+  SquashStatus res;
+
+  if (SQUASH_UNLIKELY(s->input == NULL)) {
+    res = squash_dedup_reserve_input (s, UINT8_MAX + 1);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      return res;
+  }
+
+  while (true) {
+    if (s->output_length != 0 && !squash_dedup_drain (s))
+      return SQUASH_PROCESSING;
+
+    if (s->state == SQUASH_DEDUP_STATE_FINISHED)
+      return SQUASH_OK;
+
+    const size_t cp_size = (stream->avail_in < (s->needed - s->input_length)) ? stream->avail_in : (s->needed - s->input_length);
+    if (cp_size != 0) {
+      memcpy (s->input + s->input_length, stream->next_in, cp_size);
+      s->input_length += cp_size;
+      stream->next_in += cp_size;
+      stream->avail_in -= cp_size;
+    }
+
+    if (s->input_length != s->needed)
+      return (operation == SQUASH_OPERATION_FINISH) ? squash_error (SQUASH_FAILED) : SQUASH_OK;
+    s->input_length = 0;
+
+    switch (s->state) {
+      case SQUASH_DEDUP_STATE_HEADER:
+        if (SQUASH_UNLIKELY(memcmp (s->input, squash_dedup_magic, sizeof (squash_dedup_magic)) != 0) ||
+            SQUASH_UNLIKELY(s->input[4] != SQUASH_DEDUP_VERSION) ||
+            SQUASH_UNLIKELY(s->input[5] == 0))
+          return squash_error (SQUASH_INVALID_BUFFER);
+        s->needed = s->input[5];
+        s->state = SQUASH_DEDUP_STATE_NAME;
+        break;
+      case SQUASH_DEDUP_STATE_NAME:
+        s->input[s->needed] = '\0';
+        s->codec = squash_get_codec ((const char*) s->input);
+        if (SQUASH_UNLIKELY(s->codec == NULL))
+          return squash_error (SQUASH_UNABLE_TO_LOAD);
+        /* The compressor never nests dedup, and decoding a nested
+           stream would recurse without bound. */
+        if (SQUASH_UNLIKELY(s->codec == stream->codec))
+          return squash_error (SQUASH_INVALID_BUFFER);
+        res = squash_dedup_reserve_input (s, SQUASH_DEDUP_RECORD_SIZE);
+        if (SQUASH_UNLIKELY(res != SQUASH_OK))
+          return res;
+        s->needed = SQUASH_DEDUP_RECORD_SIZE;
+        s->state = SQUASH_DEDUP_STATE_RECORD;
+        break;
+      case SQUASH_DEDUP_STATE_RECORD:
+        memcpy (s->record, s->input, SQUASH_DEDUP_RECORD_SIZE);
+        if (s->record[0] == SQUASH_DEDUP_RECORD_END) {
+          s->state = SQUASH_DEDUP_STATE_FINISHED;
+        } else if (SQUASH_UNLIKELY(!squash_dedup_record_is_valid (s, s->codec, s->record))) {
+          return squash_error (SQUASH_INVALID_BUFFER);
+        } else if (s->record[0] == SQUASH_DEDUP_RECORD_REFERENCE) {
+          res = squash_dedup_load_chunk (s);
+          if (SQUASH_UNLIKELY(res != SQUASH_OK))
+            return res;
+        } else {
+          s->needed = squash_dedup_get_u32 (s->record + 5);
+          res = squash_dedup_reserve_input (s, s->needed);
+          if (SQUASH_UNLIKELY(res != SQUASH_OK))
+            return res;
+          s->state = SQUASH_DEDUP_STATE_PAYLOAD;
+        }
+        break;
+      case SQUASH_DEDUP_STATE_PAYLOAD:
+        res = squash_dedup_decode_chunk (s, s->codec, s->record, s->input);
+        if (SQUASH_UNLIKELY(res != SQUASH_OK))
+          return res;
+        s->needed = SQUASH_DEDUP_RECORD_SIZE;
+        s->state = SQUASH_DEDUP_STATE_RECORD;
+        break;
+      case SQUASH_DEDUP_STATE_FINISHED:
+      default:
+        squash_assert_unreachable ();
+    }
+  }
+}
+
+static SquashStatus
+squash_dedup_process_stream (SquashStream* stream, SquashOperation operation) {
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS)
+    return squash_dedup_compress_stream (stream, operation);
+  else
+    return squash_dedup_decompress_stream (stream, operation);
+}
+
+static size_t
+squash_dedup_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
+  /* Every chunk but the last is at least min-size bytes, and chunks
+     which don't shrink are stored. */
+  const size_t chunks = (uncompressed_size / SQUASH_DEDUP_MIN_MIN_SIZE) + 1;
+
+  return
+    SQUASH_DEDUP_HEADER_SIZE + UINT8_MAX +
+    (chunks * SQUASH_DEDUP_RECORD_SIZE) + uncompressed_size +
+    SQUASH_DEDUP_RECORD_SIZE;
+}
+
+SquashStatus
+squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
+  const char* name = squash_codec_get_name (codec);
+
+  if (SQUASH_LIKELY(strcmp ("dedup", name) == 0)) {
+    impl->options = squash_dedup_options;
+    impl->create_stream = squash_dedup_create_stream;
+    impl->process_stream = squash_dedup_process_stream;
+    impl->get_max_compressed_size = squash_dedup_get_max_compressed_size;
+  } else {
+    return squash_error (SQUASH_UNABLE_TO_LOAD);
+  }
+
+  return SQUASH_OK;
+}
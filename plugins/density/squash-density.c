@@ -119,6 +119,8 @@ squash_density_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squ
   assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
 
   stream = (SquashDensityStream*) squash_malloc (sizeof (SquashDensityStream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
   squash_density_stream_init (stream, codec, stream_type, options, squash_density_stream_destroy);
 
   return stream;
@@ -174,6 +176,13 @@ squash_density_level_to_mode (int level) {
   }
 }
 
+static DENSITY_BLOCK_TYPE
+squash_density_get_block_type (SquashCodec* codec, SquashOptions* options) {
+  return squash_options_get_bool_at (options, codec, SQUASH_DENSITY_OPT_CHECKSUM) ?
+    DENSITY_BLOCK_TYPE_WITH_HASHSUM_INTEGRITY_CHECK :
+    DENSITY_BLOCK_TYPE_DEFAULT;
+}
+
 static bool
 squash_density_flush_internal_buffer (SquashStream* stream) {
   SquashDensityStream* s = (SquashDensityStream*) stream;
@@ -198,10 +207,8 @@ squash_density_flush_internal_buffer (SquashStream* stream) {
   squash_assert_unreachable();
 }
 
-static size_t total_bytes_written = 0;
-
 static SquashStatus
-squash_density_process_stream (SquashStream* stream, SquashOperation operation) {
+squash_density_process_stream_once (SquashStream* stream, SquashOperation operation) {
   SquashStatus res = SQUASH_OK;
   SquashDensityStream* s = (SquashDensityStream*) stream;
 
@@ -262,7 +269,6 @@ squash_density_process_stream (SquashStream* stream, SquashOperation operation)
       {
         if (!s->output_invalid) {
           const size_t written = density_stream_output_available_for_use (s->stream);
-          total_bytes_written += written;
 
           if (s->buffer_active) {
             s->buffer_size = written;
@@ -316,10 +322,7 @@ squash_density_process_stream (SquashStream* stream, SquashOperation operation)
         if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
           DENSITY_COMPRESSION_MODE compression_mode =
             squash_density_level_to_mode (squash_options_get_int_at (stream->options, stream->codec, SQUASH_DENSITY_OPT_LEVEL));
-          DENSITY_BLOCK_TYPE block_type =
-            squash_options_get_bool_at (stream->options, stream->codec, SQUASH_DENSITY_OPT_CHECKSUM) ?
-              DENSITY_BLOCK_TYPE_WITH_HASHSUM_INTEGRITY_CHECK :
-              DENSITY_BLOCK_TYPE_DEFAULT;
+          DENSITY_BLOCK_TYPE block_type = squash_density_get_block_type (stream->codec, stream->options);
 
           s->state = density_stream_compress_init (s->stream, compression_mode, block_type);
         } else {
@@ -379,7 +382,6 @@ squash_density_process_stream (SquashStream* stream, SquashOperation operation)
     {
       if (!s->output_invalid) {
         const size_t written = density_stream_output_available_for_use (s->stream);
-        total_bytes_written += written;
 
         if (s->buffer_active) {
           s->buffer_size = written;
@@ -409,15 +411,189 @@ squash_density_process_stream (SquashStream* stream, SquashOperation operation)
     }
   }
 
-  if (operation == SQUASH_OPERATION_FINISH)
-    total_bytes_written = 0;
-
   res = (stream->avail_in == 0) ? SQUASH_OK : SQUASH_PROCESSING;
 
  finish:
   return res;
 }
 
+/* Each pass above stops as soon as density stalls, and returning
+   SQUASH_PROCESSING sends it all the way back to the caller, so keep
+   going for as long as there is input to consume and room for output.
+   Full multiples of SQUASH_DENSITY_INPUT_MULTIPLE are fed straight from
+   next_in; only a shorter tail is copied to input_buffer. */
+static SquashStatus
+squash_density_process_stream (SquashStream* stream, SquashOperation operation) {
+  SquashDensityStream* s = (SquashDensityStream*) stream;
+  SquashStatus res;
+
+  do {
+    const uint8_t* next_in = stream->next_in;
+    const uint8_t* next_out = stream->next_out;
+    const bool output_invalid = s->output_invalid;
+
+    res = squash_density_process_stream_once (stream, operation);
+
+    if (stream->next_in == next_in && stream->next_out == next_out && s->output_invalid == output_invalid)
+      break;
+  } while (res == SQUASH_PROCESSING && stream->avail_out != 0 && s->buffer_size == 0);
+
+  return res;
+}
+
+/* Runs a density stream over an entire buffer.  This is essentially
+   what density_buffer_compress and density_buffer_decompress do, except
+   that they fail as soon as density stalls on output, which it does
+   once less than DENSITY_MINIMUM_OUTPUT_BUFFER_SIZE bytes are left even
+   if the data would fit (for example, when decompressing into a buffer
+   of exactly the right size).  Here, the output buffer is used directly
+   for as long as possible and only the last few bytes are staged. */
+static SquashStatus
+squash_density_process_buffer (SquashCodec* codec,
+                               SquashStreamType stream_type,
+                               SquashOptions* options,
+                               size_t* output_size,
+                               uint8_t* output,
+                               size_t input_size,
+                               const uint8_t* input) {
+  SquashStatus res = SQUASH_OK;
+  DENSITY_STREAM_STATE state;
+  uint8_t* scratch = NULL;
+  bool scratch_active = false;
+  bool finishing = false;
+  size_t output_pos = 0;
+
+  /* Until it is finished, compression only accepts multiples of
+     SQUASH_DENSITY_INPUT_MULTIPLE bytes. */
+  const size_t head_size = (stream_type == SQUASH_STREAM_COMPRESS) ?
+    ((input_size / SQUASH_DENSITY_INPUT_MULTIPLE) * SQUASH_DENSITY_INPUT_MULTIPLE) :
+    input_size;
+
+  density_stream* ds = density_stream_create (squash_density_malloc, squash_density_free);
+  if (SQUASH_UNLIKELY(ds == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  if (*output_size < DENSITY_MINIMUM_OUTPUT_BUFFER_SIZE) {
+    scratch = squash_scratch_malloc (DENSITY_MINIMUM_OUTPUT_BUFFER_SIZE);
+    if (SQUASH_UNLIKELY(scratch == NULL)) {
+      res = squash_error (SQUASH_MEMORY);
+      goto cleanup;
+    }
+    scratch_active = true;
+    state = density_stream_prepare (ds, (uint8_t*) input, head_size, scratch, DENSITY_MINIMUM_OUTPUT_BUFFER_SIZE);
+  } else {
+    state = density_stream_prepare (ds, (uint8_t*) input, head_size, output, *output_size);
+  }
+
+  if (SQUASH_LIKELY(state == DENSITY_STREAM_STATE_READY)) {
+    if (stream_type == SQUASH_STREAM_COMPRESS) {
+      state = density_stream_compress_init (ds,
+                                            squash_density_level_to_mode (squash_options_get_int_at (options, codec, SQUASH_DENSITY_OPT_LEVEL)),
+                                            squash_density_get_block_type (codec, options));
+    } else {
+      state = density_stream_decompress_init (ds, NULL);
+    }
+  }
+
+  if (SQUASH_UNLIKELY(state != DENSITY_STREAM_STATE_READY)) {
+    res = squash_error (SQUASH_FAILED);
+    goto cleanup;
+  }
+
+  for (;;) {
+    if (stream_type == SQUASH_STREAM_COMPRESS)
+      state = finishing ? density_stream_compress_finish (ds) : density_stream_compress_continue (ds);
+    else
+      state = finishing ? density_stream_decompress_finish (ds) : density_stream_decompress_continue (ds);
+
+    switch (state) {
+      case DENSITY_STREAM_STATE_READY:
+        if (!finishing)
+          continue;
+        break;
+      case DENSITY_STREAM_STATE_STALL_ON_INPUT:
+        if (SQUASH_UNLIKELY(finishing)) {
+          res = squash_error (SQUASH_FAILED);
+          goto cleanup;
+        }
+        finishing = true;
+        density_stream_update_input (ds, (uint8_t*) input + head_size, input_size - head_size);
+        continue;
+      case DENSITY_STREAM_STATE_STALL_ON_OUTPUT:
+        break;
+      case DENSITY_STREAM_STATE_ERROR_OUTPUT_BUFFER_TOO_SMALL:
+        res = squash_error (SQUASH_BUFFER_FULL);
+        goto cleanup;
+      case DENSITY_STREAM_STATE_ERROR_INVALID_INTERNAL_STATE:
+      case DENSITY_STREAM_STATE_ERROR_INTEGRITY_CHECK_FAIL:
+      default:
+        res = squash_error (SQUASH_FAILED);
+        goto cleanup;
+    }
+
+    const size_t written = density_stream_output_available_for_use (ds);
+    if (scratch_active) {
+      if (SQUASH_UNLIKELY(written > (*output_size - output_pos))) {
+        res = squash_error (SQUASH_BUFFER_FULL);
+        goto cleanup;
+      }
+      memcpy (output + output_pos, scratch, written);
+    }
+    output_pos += written;
+
+    if (state == DENSITY_STREAM_STATE_READY)
+      break;
+
+    const size_t output_remaining = *output_size - output_pos;
+    if (output_remaining >= DENSITY_MINIMUM_OUTPUT_BUFFER_SIZE) {
+      scratch_active = false;
+      density_stream_update_output (ds, output + output_pos, output_remaining);
+    } else {
+      if (scratch == NULL) {
+        scratch = squash_scratch_malloc (DENSITY_MINIMUM_OUTPUT_BUFFER_SIZE);
+        if (SQUASH_UNLIKELY(scratch == NULL)) {
+          res = squash_error (SQUASH_MEMORY);
+          goto cleanup;
+        }
+      }
+      scratch_active = true;
+      density_stream_update_output (ds, scratch, DENSITY_MINIMUM_OUTPUT_BUFFER_SIZE);
+    }
+  }
+
+  *output_size = output_pos;
+
+ cleanup:
+  squash_scratch_free (scratch);
+  density_stream_destroy (ds);
+
+  return res;
+}
+
+static SquashStatus
+squash_density_compress_buffer (SquashCodec* codec,
+                                size_t* compressed_size,
+                                uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                                size_t uncompressed_size,
+                                const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                                SquashOptions* options) {
+  return squash_density_process_buffer (codec, SQUASH_STREAM_COMPRESS, options,
+                                        compressed_size, compressed,
+                                        uncompressed_size, uncompressed);
+}
+
+static SquashStatus
+squash_density_decompress_buffer (SquashCodec* codec,
+                                  size_t* decompressed_size,
+                                  uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                                  size_t compressed_size,
+                                  const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                                  SquashOptions* options) {
+  return squash_density_process_buffer (codec, SQUASH_STREAM_DECOMPRESS, options,
+                                        decompressed_size, decompressed,
+                                        compressed_size, compressed);
+}
+
 SquashStatus
 squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   const char* name = squash_codec_get_name (codec);
@@ -426,6 +602,8 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->options = squash_density_options;
     impl->create_stream = squash_density_create_stream;
     impl->process_stream = squash_density_process_stream;
+    impl->compress_buffer = squash_density_compress_buffer;
+    impl->decompress_buffer = squash_density_decompress_buffer;
     impl->get_max_compressed_size = squash_density_get_max_compressed_size;
   } else {
     return squash_error (SQUASH_UNABLE_TO_LOAD);
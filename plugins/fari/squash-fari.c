@@ -49,6 +49,8 @@ squash_fari_decompress_buffer (SquashCodec* codec,
                                const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
                                SquashOptions* options) {
   void* workmem = squash_malloc (FA_WORKMEM);
+  if (SQUASH_UNLIKELY(workmem == NULL))
+    return squash_error (SQUASH_MEMORY);
   int fari_e = (size_t) fa_decompress ((const unsigned char*) compressed, (unsigned char*) decompressed,
                                        compressed_size, decompressed_size, workmem);
   squash_free (workmem);
@@ -77,6 +79,8 @@ squash_fari_compress_buffer (SquashCodec* codec,
                              const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
                              SquashOptions* options) {
   void* workmem = squash_malloc (FA_WORKMEM);
+  if (SQUASH_UNLIKELY(workmem == NULL))
+    return squash_error (SQUASH_MEMORY);
   int fari_e = fa_compress ((const unsigned char*) uncompressed, (unsigned char*) compressed,
                             uncompressed_size, compressed_size, workmem);
   squash_free (workmem);
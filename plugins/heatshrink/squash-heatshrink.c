@@ -25,6 +25,7 @@
  */
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -254,6 +255,242 @@ squash_heatshrink_process_stream (SquashStream* stream, SquashOperation operatio
   squash_assert_unreachable ();
 }
 
+/* The buffer functions below don't use the heatshrink library; its
+ * incremental API only moves a few bytes per call, which makes it very
+ * slow for large buffers.  They produce exactly what heatshrink's
+ * encoder would:
+ *
+ *  - a 1 bit, then an 8-bit literal, or
+ *  - a 0 bit, then (distance - 1) in window-size bits and (length - 1)
+ *    in lookahead-size bits,
+ *
+ * packed MSB first, with the last byte padded with zeros.  The window
+ * initially contains 2^window-size zero bytes, and heatshrink picks the
+ * longest match (the nearest one if there is a tie) as long as it is
+ * longer than the size of a back-reference in bytes.  Matches that
+ * short can never be shorter than the hash key, so hashing the first
+ * few bytes of each position finds the same matches as heatshrink's
+ * search of the whole window. */
+
+#define SQUASH_HEATSHRINK_HASH_BITS 16
+
+typedef struct SquashHeatshrinkWriter_s {
+  uint8_t* out;
+  size_t out_size;
+  size_t out_pos;
+  uint32_t bit_buffer;
+  unsigned int bit_count;
+} SquashHeatshrinkWriter;
+
+static bool
+squash_heatshrink_writer_put (SquashHeatshrinkWriter* writer, uint32_t value, unsigned int bits) {
+  writer->bit_buffer = (writer->bit_buffer << bits) | value;
+  writer->bit_count += bits;
+
+  while (writer->bit_count >= 8) {
+    if (SQUASH_UNLIKELY(writer->out_pos == writer->out_size))
+      return false;
+    writer->bit_count -= 8;
+    writer->out[writer->out_pos++] = (uint8_t) (writer->bit_buffer >> writer->bit_count);
+  }
+
+  return true;
+}
+
+static bool
+squash_heatshrink_writer_flush (SquashHeatshrinkWriter* writer) {
+  if (writer->bit_count == 0)
+    return true;
+
+  return squash_heatshrink_writer_put (writer, 0, 8 - writer->bit_count);
+}
+
+static uint32_t
+squash_heatshrink_hash (const uint8_t* data, uint32_t key_length) {
+  if (key_length == 2)
+    return (((uint32_t) data[0]) << 8) | data[1];
+  else
+    return ((((uint32_t) data[0] << 16) | ((uint32_t) data[1] << 8) | data[2]) * UINT32_C(2654435761)) >> (32 - SQUASH_HEATSHRINK_HASH_BITS);
+}
+
+/* Positions count from the start of the initial window of zeros, so
+   the input starts at `window'.  Anything before twice that is read
+   from a copy which has the zeros in front of it. */
+static const uint8_t*
+squash_heatshrink_at (uint32_t pos, uint32_t window, const uint8_t* prefix, const uint8_t* input) {
+  return (pos < (2 * window)) ? (prefix + pos) : (input + (pos - window));
+}
+
+static SquashStatus
+squash_heatshrink_compress_buffer (SquashCodec* codec,
+                                   size_t* compressed_size,
+                                   uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                                   size_t uncompressed_size,
+                                   const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                                   SquashOptions* options) {
+  const unsigned int window_bits = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_HEATSHRINK_OPT_WINDOW_SIZE);
+  const unsigned int lookahead_bits = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_HEATSHRINK_OPT_LOOKAHEAD_SIZE);
+
+  /* heatshrink_encoder_alloc refuses these, too. */
+  if (SQUASH_UNLIKELY(lookahead_bits >= window_bits))
+    return squash_error (SQUASH_BAD_VALUE);
+
+  if (SQUASH_UNLIKELY(uncompressed_size > (UINT32_MAX - (UINT32_C(1) << 16))))
+    return squash_error (SQUASH_RANGE);
+
+  const uint32_t window = UINT32_C(1) << window_bits;
+  const uint32_t lookahead = UINT32_C(1) << lookahead_bits;
+  const uint32_t min_match = ((1 + window_bits + lookahead_bits) / 8) + 1;
+  const uint32_t key_length = (min_match < 3) ? min_match : 3;
+
+  /* `prefix' holds the initial zeros and enough input for any match
+     which could reference them. */
+  const uint32_t end = window + (uint32_t) uncompressed_size;
+  const size_t prefix_size = (2 * (size_t) window) + lookahead;
+  uint8_t* scratch = squash_scratch_calloc (1, prefix_size + (sizeof (uint32_t) * (((size_t) 1 << SQUASH_HEATSHRINK_HASH_BITS) + window)));
+  if (SQUASH_UNLIKELY(scratch == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  uint8_t* prefix = scratch;
+  uint32_t* head = (uint32_t*) (scratch + prefix_size);
+  uint32_t* prev = head + ((size_t) 1 << SQUASH_HEATSHRINK_HASH_BITS);
+  memcpy (prefix + window, uncompressed,
+          (uncompressed_size < (size_t) (window + lookahead)) ? uncompressed_size : (size_t) (window + lookahead));
+
+  SquashHeatshrinkWriter writer = { compressed, *compressed_size, 0, 0, 0 };
+  uint32_t inserted = 0;
+  uint32_t pos = window;
+  bool full = false;
+
+  while (pos < end) {
+    const uint8_t* needle = squash_heatshrink_at (pos, window, prefix, uncompressed);
+    const uint32_t max_length = ((end - pos) < lookahead) ? (end - pos) : lookahead;
+    uint32_t best_length = 0;
+    uint32_t best_pos = 0;
+
+    if (max_length >= min_match) {
+      /* Every position before this one goes into the chains, including
+         those covered by earlier matches. */
+      for ( ; inserted < pos ; inserted++) {
+        const uint32_t h = squash_heatshrink_hash (squash_heatshrink_at (inserted, window, prefix, uncompressed), key_length);
+        prev[inserted & (window - 1)] = head[h];
+        head[h] = inserted + 1;
+      }
+
+      for (uint32_t candidate = head[squash_heatshrink_hash (needle, key_length)] ;
+           candidate != 0 && (candidate - 1) >= (pos - window) ;
+           candidate = prev[(candidate - 1) & (window - 1)]) {
+        const uint8_t* match = squash_heatshrink_at (candidate - 1, window, prefix, uncompressed);
+        uint32_t length = 0;
+
+        if (match[best_length] != needle[best_length])
+          continue;
+
+        while (length < max_length && match[length] == needle[length])
+          length++;
+
+        if (length > best_length) {
+          best_length = length;
+          best_pos = candidate - 1;
+          if (length == max_length)
+            break;
+        }
+      }
+    }
+
+    if (best_length >= min_match) {
+      if (SQUASH_UNLIKELY(!squash_heatshrink_writer_put (&writer, 0, 1) ||
+                          !squash_heatshrink_writer_put (&writer, pos - best_pos - 1, window_bits) ||
+                          !squash_heatshrink_writer_put (&writer, best_length - 1, lookahead_bits))) {
+        full = true;
+        break;
+      }
+      pos += best_length;
+    } else {
+      if (SQUASH_UNLIKELY(!squash_heatshrink_writer_put (&writer, 0x100 | *needle, 9))) {
+        full = true;
+        break;
+      }
+      pos++;
+    }
+  }
+
+  squash_scratch_free (scratch);
+
+  if (SQUASH_UNLIKELY(full || !squash_heatshrink_writer_flush (&writer)))
+    return squash_error (SQUASH_BUFFER_FULL);
+
+  *compressed_size = writer.out_pos;
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_heatshrink_decompress_buffer (SquashCodec* codec,
+                                     size_t* decompressed_size,
+                                     uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                                     size_t compressed_size,
+                                     const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                                     SquashOptions* options) {
+  const unsigned int window_bits = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_HEATSHRINK_OPT_WINDOW_SIZE);
+  const unsigned int lookahead_bits = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_HEATSHRINK_OPT_LOOKAHEAD_SIZE);
+  const size_t out_size = *decompressed_size;
+  size_t out_pos = 0;
+  size_t in_pos = 0;
+  uint64_t bit_buffer = 0;
+  unsigned int bit_count = 0;
+
+#define SQUASH_HEATSHRINK_GET(bits) \
+  ((uint32_t) ((bit_count -= (bits)), (bit_buffer >> bit_count) & ((UINT64_C(1) << (bits)) - 1)))
+
+  for (;;) {
+    while (bit_count <= 56 && in_pos < compressed_size) {
+      bit_buffer = (bit_buffer << 8) | compressed[in_pos++];
+      bit_count += 8;
+    }
+
+    /* Whatever is left over at the end, usually just the padding, is
+       ignored, as heatshrink's decoder does. */
+    if (bit_count == 0)
+      break;
+
+    if (SQUASH_HEATSHRINK_GET(1)) {
+      if (bit_count < 8)
+        break;
+      if (SQUASH_UNLIKELY(out_pos == out_size))
+        return squash_error (SQUASH_BUFFER_FULL);
+      decompressed[out_pos++] = (uint8_t) SQUASH_HEATSHRINK_GET(8);
+    } else {
+      if (bit_count < (window_bits + lookahead_bits))
+        break;
+      const size_t distance = (size_t) SQUASH_HEATSHRINK_GET(window_bits) + 1;
+      size_t length = (size_t) SQUASH_HEATSHRINK_GET(lookahead_bits) + 1;
+
+      if (SQUASH_UNLIKELY((out_size - out_pos) < length))
+        return squash_error (SQUASH_BUFFER_FULL);
+
+      /* The window starts out filled with zeros. */
+      for ( ; length != 0 && distance > out_pos ; length--)
+        decompressed[out_pos++] = 0;
+
+      const uint8_t* src = decompressed + (out_pos - distance);
+      if (distance >= length) {
+        memcpy (decompressed + out_pos, src, length);
+        out_pos += length;
+      } else {
+        for ( ; length != 0 ; length--)
+          decompressed[out_pos++] = *(src++);
+      }
+    }
+  }
+
+#undef SQUASH_HEATSHRINK_GET
+
+  *decompressed_size = out_pos;
+
+  return SQUASH_OK;
+}
+
 static size_t
 squash_heatshrink_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
   return uncompressed_size + (uncompressed_size / 8) + 1;
@@ -265,6 +502,8 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->options = squash_heatshrink_options;
     impl->create_stream = squash_heatshrink_create_stream;
     impl->process_stream = squash_heatshrink_process_stream;
+    impl->compress_buffer = squash_heatshrink_compress_buffer;
+    impl->decompress_buffer = squash_heatshrink_decompress_buffer;
     impl->get_max_compressed_size = squash_heatshrink_get_max_compressed_size;
   } else {
     return SQUASH_UNABLE_TO_LOAD;
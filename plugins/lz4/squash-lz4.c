@@ -229,6 +229,7 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   const char* name = squash_codec_get_name (codec);
 
   if (strcmp ("lz4-raw", name) == 0) {
+    impl->info |= SQUASH_CODEC_INFO_SEGMENTED;
     impl->options = squash_lz4_options;
     impl->get_max_compressed_size = squash_lz4_get_max_compressed_size;
     impl->decompress_buffer = squash_lz4_decompress_buffer;
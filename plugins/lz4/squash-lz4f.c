@@ -31,16 +31,28 @@
 
 #include <squash/squash.h>
 #include <lz4.h>
+#include <lz4hc.h>
 #include <lz4frame_static.h>
+#include <xxhash.h>
 
 SquashStatus squash_plugin_init_lz4f (SquashCodec* codec, SquashCodecImpl* impl);
 
 #define SQUASH_LZ4F_DICT_SIZE ((size_t) 65536)
 
+/* Frame layout used by the parallel compressor: magic number, FLG,
+   BD and header checksum; a 4-byte size in front of each block; and
+   an end mark followed by the optional content checksum. */
+#define SQUASH_LZ4F_MAGIC 0x184D2204U
+#define SQUASH_LZ4F_HEADER_SIZE ((size_t) 7)
+#define SQUASH_LZ4F_BLOCK_HEADER_SIZE ((size_t) 4)
+#define SQUASH_LZ4F_TRAILER_SIZE ((size_t) 8)
+#define SQUASH_LZ4F_UNCOMPRESSED_BIT 0x80000000U
+
 enum SquashLZ4FOptIndex {
   SQUASH_LZ4F_OPT_LEVEL = 0,
   SQUASH_LZ4F_OPT_BLOCK_SIZE,
   SQUASH_LZ4F_OPT_CHECKSUM,
+  SQUASH_LZ4F_OPT_THREADS,
 };
 
 static SquashOptionInfo squash_lz4f_options[] = {
@@ -59,6 +71,12 @@ static SquashOptionInfo squash_lz4f_options[] = {
   { "checksum",
     SQUASH_OPTION_TYPE_BOOL,
     .default_value.bool_value = false },
+  { "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 256 },
+    .default_value.int_value = 1 },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
@@ -84,6 +102,17 @@ typedef struct SquashLZ4FStream_s {
       size_t output_buffer_size;
 
       size_t input_buffer_size;
+
+      /* Only used when compressing in parallel (threads != 1).  Input
+         is gathered into batches of up to n_slots independent blocks
+         which are compressed on the thread pool. */
+      unsigned int threads;
+      size_t n_slots;
+      size_t block_size;
+      uint8_t* batch;
+      size_t batch_size;
+      size_t* block_sizes;
+      XXH32_state_t* checksum;
     } comp;
 
     struct {
@@ -102,6 +131,7 @@ static void               squash_lz4f_stream_init     (SquashLZ4FStream* stream,
                                                        SquashDestroyNotify destroy_notify);
 static SquashLZ4FStream*  squash_lz4f_stream_new      (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options);
 static void               squash_lz4f_stream_destroy  (void* stream);
+static size_t             squash_lz4f_block_size_id_to_size (LZ4F_blockSizeID_t blkid);
 
 static SquashStatus
 squash_lz4f_get_status (size_t res) {
@@ -165,6 +195,15 @@ squash_lz4f_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squash
 
     stream->data.comp.input_buffer_size = 0;
 
+    stream->data.comp.threads = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_LZ4F_OPT_THREADS);
+    stream->data.comp.n_slots = (stream->data.comp.threads == 0) ? squash_get_max_threads () : stream->data.comp.threads;
+    stream->data.comp.block_size =
+      squash_lz4f_block_size_id_to_size ((LZ4F_blockSizeID_t) squash_options_get_int_at (options, codec, SQUASH_LZ4F_OPT_BLOCK_SIZE));
+    stream->data.comp.batch = NULL;
+    stream->data.comp.batch_size = 0;
+    stream->data.comp.block_sizes = NULL;
+    stream->data.comp.checksum = NULL;
+
     stream->data.comp.prefs = (LZ4F_preferences_t) {
       {
         (LZ4F_blockSizeID_t) squash_options_get_int_at (options, codec, SQUASH_LZ4F_OPT_BLOCK_SIZE),
@@ -208,6 +247,10 @@ squash_lz4f_stream_destroy (void* stream) {
 
     if (s->data.comp.output_buffer != NULL)
       squash_free (s->data.comp.output_buffer);
+    squash_free (s->data.comp.batch);
+    squash_free (s->data.comp.block_sizes);
+    if (s->data.comp.checksum != NULL)
+      XXH32_freeState (s->data.comp.checksum);
   } else {
     LZ4F_freeDecompressionContext(s->data.decomp.ctx);
   }
@@ -290,15 +333,20 @@ squash_lz4f_compress_stream (SquashStream* stream, SquashOperation operation) {
 
   while ((stream->avail_in != 0 || operation != SQUASH_OPERATION_PROCESS) && stream->avail_out != 0) {
     if (s->data.comp.state == SQUASH_LZ4F_STATE_INIT) {
-      s->data.comp.state = SQUASH_LZ4F_STATE_ACTIVE;
       if (stream->avail_out < 19) {
+        uint8_t* obuf = squash_lz4f_stream_get_output_buffer (stream);
+        if (SQUASH_UNLIKELY(obuf == NULL))
+          return squash_error (SQUASH_MEMORY);
+
+        s->data.comp.state = SQUASH_LZ4F_STATE_ACTIVE;
         s->data.comp.output_buffer_size =
           LZ4F_compressBegin (s->data.comp.ctx,
-                              squash_lz4f_stream_get_output_buffer (stream),
+                              obuf,
                               squash_lz4f_stream_get_output_buffer_size (stream),
                               &(s->data.comp.prefs));
         break;
       } else {
+        s->data.comp.state = SQUASH_LZ4F_STATE_ACTIVE;
         size_t written = LZ4F_compressBegin (s->data.comp.ctx, stream->next_out, stream->avail_out, &(s->data.comp.prefs));
         stream->next_out += written;
         stream->avail_out -= written;
@@ -318,6 +366,8 @@ squash_lz4f_compress_stream (SquashStream* stream, SquashOperation operation) {
       const size_t input_size = (total_input > input_buffer_size) ? (input_buffer_size - s->data.comp.input_buffer_size) : stream->avail_in;
       if (input_size > 0) {
         obuf = (output_buffer_max_size > stream->avail_out) ? squash_lz4f_stream_get_output_buffer (stream) : stream->next_out;
+        if (SQUASH_UNLIKELY(obuf == NULL))
+          return squash_error (SQUASH_MEMORY);
         olen = LZ4F_compressUpdate (s->data.comp.ctx, obuf, output_buffer_max_size, stream->next_in, input_size, NULL);
 
         if (!LZ4F_isError (olen)) {
@@ -337,6 +387,8 @@ squash_lz4f_compress_stream (SquashStream* stream, SquashOperation operation) {
         assert (stream->avail_in == 0);
         olen = squash_lz4f_stream_get_output_buffer_size (stream);
         obuf = (olen > stream->avail_out) ? squash_lz4f_stream_get_output_buffer (stream) : stream->next_out;
+        if (SQUASH_UNLIKELY(obuf == NULL))
+          return squash_error (SQUASH_MEMORY);
         olen = LZ4F_flush (s->data.comp.ctx, obuf, olen, NULL);
 
         s->data.comp.input_buffer_size = 0;
@@ -344,6 +396,8 @@ squash_lz4f_compress_stream (SquashStream* stream, SquashOperation operation) {
         assert (stream->avail_in == 0);
         olen = squash_lz4f_stream_get_output_buffer_size (stream);
         obuf = (olen > stream->avail_out) ? squash_lz4f_stream_get_output_buffer (stream) : stream->next_out;
+        if (SQUASH_UNLIKELY(obuf == NULL))
+          return squash_error (SQUASH_MEMORY);
         olen = LZ4F_compressEnd (s->data.comp.ctx, obuf, olen, NULL);
 
         s->data.comp.input_buffer_size = 0;
@@ -395,6 +449,230 @@ squash_lz4f_compress_stream (SquashStream* stream, SquashOperation operation) {
   return (stream->avail_in == 0 && s->data.comp.output_buffer_size == 0) ? SQUASH_OK : SQUASH_PROCESSING;
 }
 
+typedef struct SquashLZ4FBatch_ {
+  SquashLZ4FStream* stream;
+  const uint8_t* input;
+  size_t input_size;
+  size_t n_blocks;
+} SquashLZ4FBatch;
+
+static void
+squash_lz4f_write_le32 (uint8_t* dest, uint32_t value) {
+  dest[0] = (uint8_t) (value >>  0);
+  dest[1] = (uint8_t) (value >>  8);
+  dest[2] = (uint8_t) (value >> 16);
+  dest[3] = (uint8_t) (value >> 24);
+}
+
+static size_t
+squash_lz4f_slot_size (SquashLZ4FStream* s) {
+  return SQUASH_LZ4F_BLOCK_HEADER_SIZE + s->data.comp.block_size;
+}
+
+/* Compress one block of a batch into its slot in output_buffer,
+ * falling back to storing it uncompressed if it doesn't shrink, just
+ * like LZ4F does.  The extra index after the last block feeds the
+ * batch to the content checksum, so hashing overlaps with
+ * compression. */
+static SquashStatus
+squash_lz4f_compress_block (size_t index, void* user_data) {
+  SquashLZ4FBatch* batch = (SquashLZ4FBatch*) user_data;
+  SquashLZ4FStream* s = batch->stream;
+
+  if (index == batch->n_blocks) {
+    XXH32_update (s->data.comp.checksum, batch->input, batch->input_size);
+    return SQUASH_OK;
+  }
+
+  const size_t offset = index * s->data.comp.block_size;
+  const size_t input_size = ((batch->input_size - offset) < s->data.comp.block_size) ? (batch->input_size - offset) : s->data.comp.block_size;
+  const char* input = (const char*) batch->input + offset;
+  uint8_t* slot = s->data.comp.output_buffer + SQUASH_LZ4F_HEADER_SIZE + (index * squash_lz4f_slot_size (s));
+  char* output = (char*) slot + SQUASH_LZ4F_BLOCK_HEADER_SIZE;
+  const int level = s->data.comp.prefs.compressionLevel;
+  int compressed_size;
+
+  if (level < 3)
+    compressed_size = LZ4_compress_fast (input, output, (int) input_size, (int) input_size - 1, 1);
+  else
+    compressed_size = LZ4_compressHC2_limitedOutput (input, output, (int) input_size, (int) input_size - 1, level);
+
+  if (compressed_size > 0) {
+    squash_lz4f_write_le32 (slot, (uint32_t) compressed_size);
+    s->data.comp.block_sizes[index] = SQUASH_LZ4F_BLOCK_HEADER_SIZE + (size_t) compressed_size;
+  } else {
+    memcpy (output, input, input_size);
+    squash_lz4f_write_le32 (slot, ((uint32_t) input_size) | SQUASH_LZ4F_UNCOMPRESSED_BIT);
+    s->data.comp.block_sizes[index] = SQUASH_LZ4F_BLOCK_HEADER_SIZE + input_size;
+  }
+
+  return SQUASH_OK;
+}
+
+/* Compress a batch of blocks and lay out the result (preceded by the
+ * frame header on the first call, and followed by the end mark and
+ * content checksum on the last) directly in next_out if it fits, or
+ * in output_buffer to be drained otherwise. */
+static SquashStatus
+squash_lz4f_compress_batch (SquashLZ4FStream* s, const uint8_t* input, size_t input_size, bool last) {
+  SquashStream* stream = (SquashStream*) s;
+  const bool content_checksum = s->data.comp.prefs.frameInfo.contentChecksumFlag == contentChecksumEnabled;
+  SquashLZ4FBatch batch = {
+    s,
+    input,
+    input_size,
+    (input_size + (s->data.comp.block_size - 1)) / s->data.comp.block_size
+  };
+
+  const size_t n_tasks = batch.n_blocks + ((content_checksum && input_size != 0) ? 1 : 0);
+  if (n_tasks != 0) {
+    SquashStatus res = squash_parallel_for (s->data.comp.threads, n_tasks, squash_lz4f_compress_block, &batch);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      return res;
+  }
+
+  size_t total = 0;
+  if (s->data.comp.state == SQUASH_LZ4F_STATE_INIT)
+    total += SQUASH_LZ4F_HEADER_SIZE;
+  for (size_t i = 0 ; i < batch.n_blocks ; i++)
+    total += s->data.comp.block_sizes[i];
+  if (last)
+    total += content_checksum ? SQUASH_LZ4F_TRAILER_SIZE : 4;
+
+  uint8_t* dest = (stream->avail_out >= total) ? stream->next_out : s->data.comp.output_buffer;
+  size_t pos = 0;
+
+  if (s->data.comp.state == SQUASH_LZ4F_STATE_INIT) {
+    squash_lz4f_write_le32 (dest, SQUASH_LZ4F_MAGIC);
+    dest[4] = (uint8_t) ((1 << 6) | (1 << 5) | (content_checksum ? (1 << 2) : 0));
+    dest[5] = (uint8_t) ((s->data.comp.prefs.frameInfo.blockSizeID & 7) << 4);
+    dest[6] = (uint8_t) ((XXH32 (dest + 4, 2, 0) >> 8) & 0xff);
+    pos += SQUASH_LZ4F_HEADER_SIZE;
+    s->data.comp.state = SQUASH_LZ4F_STATE_ACTIVE;
+  }
+
+  /* Slots never start before their final position, so compacting
+     them within output_buffer is safe. */
+  for (size_t i = 0 ; i < batch.n_blocks ; i++) {
+    memmove (dest + pos,
+             s->data.comp.output_buffer + SQUASH_LZ4F_HEADER_SIZE + (i * squash_lz4f_slot_size (s)),
+             s->data.comp.block_sizes[i]);
+    pos += s->data.comp.block_sizes[i];
+  }
+
+  if (last) {
+    squash_lz4f_write_le32 (dest + pos, 0);
+    pos += 4;
+    if (content_checksum) {
+      squash_lz4f_write_le32 (dest + pos, (uint32_t) XXH32_digest (s->data.comp.checksum));
+      pos += 4;
+    }
+    s->data.comp.state = SQUASH_LZ4F_STATE_FINISHED;
+  }
+
+  assert (pos == total);
+
+  if (dest == stream->next_out) {
+    stream->next_out += total;
+    stream->avail_out -= total;
+  } else {
+    s->data.comp.output_buffer_size = total;
+    s->data.comp.output_buffer_pos = 0;
+  }
+
+  return SQUASH_OK;
+}
+
+/* With the threads option set to anything other than 1 the frame is
+ * written here instead of by LZ4F: blocks are independent, so a whole
+ * batch of them can be compressed at once.  The output is a standard
+ * LZ4 frame. */
+static SquashStatus
+squash_lz4f_compress_stream_parallel (SquashStream* stream, SquashOperation operation) {
+  SquashLZ4FStream* s = (SquashLZ4FStream*) stream;
+  const size_t batch_capacity = s->data.comp.n_slots * s->data.comp.block_size;
+
+  if (SQUASH_UNLIKELY(s->data.comp.output_buffer == NULL)) {
+    const bool content_checksum = s->data.comp.prefs.frameInfo.contentChecksumFlag == contentChecksumEnabled;
+
+    s->data.comp.output_buffer = squash_malloc (SQUASH_LZ4F_HEADER_SIZE + (s->data.comp.n_slots * squash_lz4f_slot_size (s)) + SQUASH_LZ4F_TRAILER_SIZE);
+    s->data.comp.block_sizes = squash_calloc (s->data.comp.n_slots, sizeof (size_t));
+    if (content_checksum) {
+      s->data.comp.checksum = XXH32_createState ();
+      if (s->data.comp.checksum != NULL)
+        XXH32_reset (s->data.comp.checksum, 0);
+    }
+
+    if (SQUASH_UNLIKELY(s->data.comp.output_buffer == NULL) ||
+        SQUASH_UNLIKELY(s->data.comp.block_sizes == NULL) ||
+        SQUASH_UNLIKELY(content_checksum && s->data.comp.checksum == NULL))
+      return squash_error (SQUASH_MEMORY);
+  }
+
+  while (true) {
+    if (s->data.comp.output_buffer_size != 0) {
+      const size_t buffer_remaining = s->data.comp.output_buffer_size - s->data.comp.output_buffer_pos;
+      const size_t cp_size = (buffer_remaining < stream->avail_out) ? buffer_remaining : stream->avail_out;
+
+      memcpy (stream->next_out, s->data.comp.output_buffer + s->data.comp.output_buffer_pos, cp_size);
+      stream->next_out += cp_size;
+      stream->avail_out -= cp_size;
+      s->data.comp.output_buffer_pos += cp_size;
+
+      if (cp_size != buffer_remaining)
+        return SQUASH_PROCESSING;
+
+      s->data.comp.output_buffer_size = 0;
+      s->data.comp.output_buffer_pos = 0;
+    }
+
+    if (s->data.comp.state == SQUASH_LZ4F_STATE_FINISHED)
+      return SQUASH_OK;
+
+    const uint8_t* input;
+    size_t input_size;
+
+    if (s->data.comp.batch_size == 0 && stream->avail_in >= batch_capacity) {
+      /* A whole batch is available, so compress it in place. */
+      input = stream->next_in;
+      input_size = batch_capacity;
+      stream->next_in += input_size;
+      stream->avail_in -= input_size;
+    } else {
+      if (s->data.comp.batch == NULL) {
+        s->data.comp.batch = squash_malloc (batch_capacity);
+        if (SQUASH_UNLIKELY(s->data.comp.batch == NULL))
+          return squash_error (SQUASH_MEMORY);
+      }
+
+      const size_t batch_remaining = batch_capacity - s->data.comp.batch_size;
+      const size_t cp_size = (stream->avail_in < batch_remaining) ? stream->avail_in : batch_remaining;
+      memcpy (s->data.comp.batch + s->data.comp.batch_size, stream->next_in, cp_size);
+      s->data.comp.batch_size += cp_size;
+      stream->next_in += cp_size;
+      stream->avail_in -= cp_size;
+
+      if (s->data.comp.batch_size != batch_capacity && operation == SQUASH_OPERATION_PROCESS)
+        return SQUASH_OK;
+
+      input = s->data.comp.batch;
+      input_size = s->data.comp.batch_size;
+      s->data.comp.batch_size = 0;
+    }
+
+    const bool last = (operation == SQUASH_OPERATION_FINISH) && (stream->avail_in == 0);
+    if (input_size == 0 && !last && s->data.comp.state != SQUASH_LZ4F_STATE_INIT)
+      return SQUASH_OK;
+
+    SquashStatus res = squash_lz4f_compress_batch (s, input, input_size, last);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      return res;
+
+    if (stream->avail_in == 0 && operation == SQUASH_OPERATION_PROCESS && s->data.comp.output_buffer_size == 0)
+      return SQUASH_OK;
+  }
+}
+
 static SquashStatus
 squash_lz4f_decompress_stream (SquashStream* stream, SquashOperation operation) {
   SquashLZ4FStream* s = (SquashLZ4FStream*) stream;
@@ -426,7 +704,10 @@ static SquashStatus
 squash_lz4f_process_stream (SquashStream* stream, SquashOperation operation) {
   switch (stream->stream_type) {
     case SQUASH_STREAM_COMPRESS:
-      return squash_lz4f_compress_stream (stream, operation);
+      if (((SquashLZ4FStream*) stream)->data.comp.threads != 1)
+        return squash_lz4f_compress_stream_parallel (stream, operation);
+      else
+        return squash_lz4f_compress_stream (stream, operation);
     case SQUASH_STREAM_DECOMPRESS:
       return squash_lz4f_decompress_stream (stream, operation);
     default:
@@ -434,6 +715,62 @@ squash_lz4f_process_stream (SquashStream* stream, SquashOperation operation) {
   }
 }
 
+/* LZ4F has no way to pick up a frame part way through, but the frames
+ * written by squash_lz4f_compress_stream_parallel have independent
+ * blocks, so once a flush has drained the batch the only state is
+ * whether the header has been written.  The running content checksum
+ * can't be saved portably, so checkpoints need it to be disabled. */
+static bool
+squash_lz4f_can_checkpoint (SquashLZ4FStream* s) {
+  return
+    ((SquashStream*) s)->stream_type == SQUASH_STREAM_COMPRESS &&
+    s->data.comp.threads != 1 &&
+    s->data.comp.prefs.frameInfo.contentChecksumFlag != contentChecksumEnabled;
+}
+
+static SquashStatus
+squash_lz4f_checkpoint_stream (SquashStream* stream,
+                               size_t* checkpoint_size,
+                               uint8_t checkpoint[SQUASH_ARRAY_PARAM(*checkpoint_size)]) {
+  SquashLZ4FStream* s = (SquashLZ4FStream*) stream;
+
+  if (!squash_lz4f_can_checkpoint (s))
+    return squash_error (SQUASH_INVALID_OPERATION);
+
+  if (SQUASH_UNLIKELY(s->data.comp.state == SQUASH_LZ4F_STATE_FINISHED) ||
+      SQUASH_UNLIKELY(s->data.comp.batch_size != 0) ||
+      SQUASH_UNLIKELY(s->data.comp.output_buffer_size != 0))
+    return squash_error (SQUASH_STATE);
+
+  if (checkpoint == NULL || *checkpoint_size < 1) {
+    *checkpoint_size = 1;
+    return squash_error (SQUASH_BUFFER_FULL);
+  }
+
+  checkpoint[0] = (s->data.comp.state == SQUASH_LZ4F_STATE_ACTIVE) ? 1 : 0;
+  *checkpoint_size = 1;
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_lz4f_restore_stream (SquashStream* stream,
+                            size_t checkpoint_size,
+                            const uint8_t checkpoint[SQUASH_ARRAY_PARAM(checkpoint_size)]) {
+  SquashLZ4FStream* s = (SquashLZ4FStream*) stream;
+
+  if (!squash_lz4f_can_checkpoint (s))
+    return squash_error (SQUASH_INVALID_OPERATION);
+
+  if (SQUASH_UNLIKELY(checkpoint_size != 1) || SQUASH_UNLIKELY(checkpoint[0] > 1))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  if (checkpoint[0] == 1)
+    s->data.comp.state = SQUASH_LZ4F_STATE_ACTIVE;
+
+  return SQUASH_OK;
+}
+
 static size_t
 squash_lz4f_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
   static const LZ4F_preferences_t prefs = {
@@ -449,7 +786,7 @@ squash_lz4f_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_siz
   const size_t res =
     (full_blocks * (block_overhead + block_size)) +
     (last_block == 0 ? 0 : (block_overhead + last_block))
-    + 7;
+    + SQUASH_LZ4F_HEADER_SIZE + SQUASH_LZ4F_TRAILER_SIZE;
 
   return res;
 }
@@ -464,6 +801,8 @@ squash_plugin_init_lz4f (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->get_max_compressed_size = squash_lz4f_get_max_compressed_size;
     impl->create_stream = squash_lz4f_create_stream;
     impl->process_stream = squash_lz4f_process_stream;
+    impl->checkpoint_stream = squash_lz4f_checkpoint_stream;
+    impl->restore_stream = squash_lz4f_restore_stream;
   } else {
     return SQUASH_UNABLE_TO_LOAD;
   }
@@ -157,6 +157,7 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   const char* name = squash_codec_get_name (codec);
 
   if (SQUASH_LIKELY(strcmp ("lzf", name) == 0)) {
+    impl->info |= SQUASH_CODEC_INFO_SEGMENTED;
     impl->options = squash_lzf_options;
     impl->get_max_compressed_size = squash_lzf_get_max_compressed_size;
     impl->decompress_buffer = squash_lzf_decompress_buffer;
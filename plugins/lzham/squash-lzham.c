@@ -39,6 +39,7 @@ typedef struct SquashLZHAMStream_s {
     struct {
       lzham_compress_state_ptr ctx;
       lzham_compress_params params;
+      unsigned int helper_threads;
     } comp;
     struct {
       lzham_decompress_state_ptr ctx;
@@ -54,7 +55,8 @@ enum SquashLZHAMOptIndex {
   SQUASH_LZHAM_OPT_DECOMPRESSION_RATE_FOR_RATIO,
   SQUASH_LZHAM_OPT_DICT_SIZE_LOG2,
   SQUASH_LZHAM_OPT_UPDATE_RATE,
-  SQUASH_LZHAM_OPT_UPDATE_INTERVAL
+  SQUASH_LZHAM_OPT_UPDATE_INTERVAL,
+  SQUASH_LZHAM_OPT_HELPER_THREADS
 };
 
 static SquashOptionInfo squash_lzham_options[] = {
@@ -96,6 +98,12 @@ static SquashOptionInfo squash_lzham_options[] = {
       .min = 12,
       .max = 128 },
     .default_value.int_value = 64 },
+  { "helper-threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = -1,
+      .max = LZHAM_MAX_HELPER_THREADS },
+    .default_value.int_value = -1 },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
@@ -126,14 +134,14 @@ squash_lzham_compress_apply_options (SquashCodec* codec,
     .m_dict_size_log2                  = squash_options_get_int_at (options, codec, SQUASH_LZHAM_OPT_DICT_SIZE_LOG2),
     .m_level                           = (lzham_compress_level) squash_options_get_int_at (options, codec, SQUASH_LZHAM_OPT_LEVEL),
     .m_table_update_rate               = squash_options_get_int_at (options, codec, SQUASH_LZHAM_OPT_UPDATE_RATE),
-    .m_max_helper_threads              = -1,
+    .m_max_helper_threads              = 0,
     .m_compress_flags                  =
-      squash_options_get_int_at (options, codec, SQUASH_LZHAM_OPT_EXTREME_PARSING) ?
-        LZHAM_COMP_FLAG_EXTREME_PARSING : 0 |
-      squash_options_get_int_at (options, codec, SQUASH_LZHAM_OPT_DETERMINISTIC_PARSING) ?
-        LZHAM_COMP_FLAG_DETERMINISTIC_PARSING : 0 |
-      squash_options_get_int_at (options, codec, SQUASH_LZHAM_OPT_DECOMPRESSION_RATE_FOR_RATIO) ?
-        LZHAM_COMP_FLAG_TRADEOFF_DECOMPRESSION_RATE_FOR_COMP_RATIO : 0,
+      (squash_options_get_bool_at (options, codec, SQUASH_LZHAM_OPT_EXTREME_PARSING) ?
+        LZHAM_COMP_FLAG_EXTREME_PARSING : 0) |
+      (squash_options_get_bool_at (options, codec, SQUASH_LZHAM_OPT_DETERMINISTIC_PARSING) ?
+        LZHAM_COMP_FLAG_DETERMINISTIC_PARSING : 0) |
+      (squash_options_get_bool_at (options, codec, SQUASH_LZHAM_OPT_DECOMPRESSION_RATE_FOR_RATIO) ?
+        LZHAM_COMP_FLAG_TRADEOFF_DECOMPRESSION_RATE_FOR_COMP_RATIO : 0),
     .m_num_seed_bytes                  = 0,
     .m_pSeed_bytes                     = NULL,
     .m_table_max_update_interval       = squash_options_get_int_at (options, codec, SQUASH_LZHAM_OPT_UPDATE_INTERVAL),
@@ -143,6 +151,17 @@ squash_lzham_compress_apply_options (SquashCodec* codec,
   *params = opts;
 }
 
+/* Helper threads come out of Squash's process-wide budget (see
+ * squash_set_max_threads) so that concurrent streams share the CPUs
+ * instead of each spawning one thread per core.  The result must be
+ * passed to squash_threads_release once the compressor is done. */
+static unsigned int
+squash_lzham_acquire_helper_threads (SquashCodec* codec, SquashOptions* options) {
+  const int requested = squash_options_get_int_at (options, codec, SQUASH_LZHAM_OPT_HELPER_THREADS);
+
+  return squash_threads_acquire ((requested < 0) ? LZHAM_MAX_HELPER_THREADS : (unsigned int) requested);
+}
+
 static void
 squash_lzham_decompress_apply_options (SquashCodec* codec,
                                        lzham_decompress_params* params,
@@ -169,6 +188,8 @@ squash_lzham_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squas
   assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
 
   stream = (SquashLZHAMStream*) squash_malloc (sizeof (SquashLZHAMStream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
   squash_lzham_stream_init (stream, codec, stream_type, options, squash_lzham_stream_destroy);
 
   return stream;
@@ -184,6 +205,8 @@ squash_lzham_stream_init (SquashLZHAMStream* stream,
 
   if (stream->base_object.stream_type == SQUASH_STREAM_COMPRESS) {
     squash_lzham_compress_apply_options (codec, &(stream->lzham.comp.params), options);
+    stream->lzham.comp.helper_threads = squash_lzham_acquire_helper_threads (codec, options);
+    stream->lzham.comp.params.m_max_helper_threads = (lzham_int32) stream->lzham.comp.helper_threads;
     stream->lzham.comp.ctx = lzham_compress_init (&(stream->lzham.comp.params));
   } else {
     squash_lzham_decompress_apply_options (codec, &(stream->lzham.decomp.params), options);
@@ -197,6 +220,7 @@ squash_lzham_stream_destroy (void* stream) {
 
   if (s->base_object.stream_type == SQUASH_STREAM_COMPRESS) {
     lzham_compress_deinit (s->lzham.comp.ctx);
+    squash_threads_release (s->lzham.comp.helper_threads);
   } else {
     lzham_decompress_deinit (s->lzham.decomp.ctx);
   }
@@ -308,12 +332,16 @@ squash_lzham_compress_buffer (SquashCodec* codec,
   lzham_compress_params params;
 
   squash_lzham_compress_apply_options (codec, &params, options);
+  const unsigned int helper_threads = squash_lzham_acquire_helper_threads (codec, options);
+  params.m_max_helper_threads = (lzham_int32) helper_threads;
 
   status = lzham_compress_memory (&params,
                                   compressed, compressed_size,
                                   uncompressed, uncompressed_size,
                                   NULL);
 
+  squash_threads_release (helper_threads);
+
   if (SQUASH_UNLIKELY(status != LZHAM_COMP_STATUS_SUCCESS)) {
     switch ((int) status) {
       case LZHAM_COMP_STATUS_INVALID_PARAMETER:
@@ -359,6 +387,22 @@ squash_lzham_decompress_buffer (SquashCodec* codec,
   squash_assert_unreachable ();
 }
 
+static size_t
+squash_lzham_get_memory_usage (SquashCodec* codec, SquashOptions* options, SquashStreamType stream_type) {
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    const size_t dict_size = ((size_t) 1) << squash_options_get_int_at (options, codec, SQUASH_LZHAM_OPT_DICT_SIZE_LOG2);
+
+    /* Rough figure: the match accelerator keeps the dictionary plus a
+       pair of 32-bit tree links per position, and the hash tables and
+       parser state add a fairly constant amount on top. */
+    return (dict_size * 9) + (16 * 1024 * 1024);
+  } else {
+    /* The decoder always uses the largest dictionary (see
+       squash_lzham_decompress_apply_options). */
+    return (((size_t) 1) << LZHAM_MAX_DICT_SIZE_LOG2_X86) + (1024 * 1024);
+  }
+}
+
 SquashStatus
 squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   if (SQUASH_LIKELY(strcmp ("lzham", squash_codec_get_name (codec)) == 0)) {
@@ -367,6 +411,7 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->create_stream = squash_lzham_create_stream;
     impl->process_stream = squash_lzham_process_stream;
     impl->get_max_compressed_size = squash_lzham_get_max_compressed_size;
+    impl->get_memory_usage = squash_lzham_get_memory_usage;
     impl->decompress_buffer = squash_lzham_decompress_buffer;
     impl->compress_buffer = squash_lzham_compress_buffer;
   } else {
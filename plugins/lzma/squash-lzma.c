@@ -57,6 +57,10 @@ enum SquashLZMAOptIndex {
   SQUASH_LZMA_OPT_CHECK,
 };
 
+/* lzma1 and lzma2 have neither mem-limit nor check, so their
+ * reference option takes the next slot after pb. */
+#define SQUASH_LZMA12_OPT_REFERENCE SQUASH_LZMA_OPT_MEM_LIMIT
+
 static SquashOptionInfo squash_lzma_options[] = {
   { "level",
     SQUASH_OPTION_TYPE_RANGE_INT,
@@ -128,6 +132,8 @@ static SquashOptionInfo squash_lzma12_options[] = {
       .min = 0,
       .max = 4 },
     .default_value.int_value = 2 },
+  { "reference",
+    SQUASH_OPTION_TYPE_FILE, },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
@@ -210,6 +216,57 @@ static SquashLZMAType squash_lzma_codec_to_type (SquashCodec* codec) {
   }
 }
 
+static void
+squash_lzma_filters_init (SquashCodec* codec,
+                          SquashOptions* options,
+                          SquashLZMAType lzma_type,
+                          lzma_options_lzma* lzma_options,
+                          lzma_filter filters[2]) {
+  lzma_lzma_preset (lzma_options, (uint32_t) squash_options_get_int_at (options, codec, SQUASH_LZMA_OPT_LEVEL));
+  lzma_options->lc = squash_options_get_int_at (options, codec, SQUASH_LZMA_OPT_LC);
+  lzma_options->lp = squash_options_get_int_at (options, codec, SQUASH_LZMA_OPT_LP);
+  lzma_options->pb = squash_options_get_int_at (options, codec, SQUASH_LZMA_OPT_PB);
+
+  filters[0].options = lzma_options;
+
+  switch (lzma_type) {
+    case SQUASH_LZMA_TYPE_XZ:
+    case SQUASH_LZMA_TYPE_LZMA2:
+      filters[0].id = LZMA_FILTER_LZMA2;
+      break;
+    case SQUASH_LZMA_TYPE_LZMA:
+    case SQUASH_LZMA_TYPE_LZMA1:
+      filters[0].id = LZMA_FILTER_LZMA1;
+      break;
+  }
+
+  /* The raw formats can be primed with a preset dictionary, which
+     both sides must supply.  Grow the dictionary so the whole
+     reference stays reachable while the input still gets the usual
+     amount of history on top of it; the decoder derives the same
+     size from the same options. */
+  if (lzma_type == SQUASH_LZMA_TYPE_LZMA1 || lzma_type == SQUASH_LZMA_TYPE_LZMA2) {
+    size_t reference_size;
+    const uint8_t* reference = squash_options_get_file_at (options, codec, SQUASH_LZMA12_OPT_REFERENCE, &reference_size);
+    if (reference != NULL && reference_size > 0) {
+      const size_t max_dict_size = 1610612736;
+      if (reference_size > max_dict_size) {
+        reference += reference_size - max_dict_size;
+        reference_size = max_dict_size;
+      }
+
+      lzma_options->preset_dict = reference;
+      lzma_options->preset_dict_size = (uint32_t) reference_size;
+      lzma_options->dict_size = (reference_size < (max_dict_size - lzma_options->dict_size)) ?
+        (uint32_t) (reference_size + lzma_options->dict_size) :
+        (uint32_t) max_dict_size;
+    }
+  }
+
+  filters[1].id = LZMA_VLI_UNKNOWN;
+  filters[1].options = NULL;
+}
+
 static void* squash_lzma_calloc (void *opaque, size_t nmemb, size_t size) {
   void* ptr = squash_malloc (nmemb * size);
   if (SQUASH_UNLIKELY(ptr == NULL))
@@ -259,28 +316,11 @@ squash_lzma_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squash
 
   lzma_type = squash_lzma_codec_to_type (codec);
 
-  lzma_lzma_preset (&lzma_options, (uint32_t) squash_options_get_int_at (options, codec, SQUASH_LZMA_OPT_LEVEL));
-  lzma_options.lc = squash_options_get_int_at (options, codec, SQUASH_LZMA_OPT_LC);
-  lzma_options.lp = squash_options_get_int_at (options, codec, SQUASH_LZMA_OPT_LP);
-  lzma_options.pb = squash_options_get_int_at (options, codec, SQUASH_LZMA_OPT_PB);
-
-  filters[0].options = &(lzma_options);
-
-  switch (lzma_type) {
-    case SQUASH_LZMA_TYPE_XZ:
-    case SQUASH_LZMA_TYPE_LZMA2:
-      filters[0].id = LZMA_FILTER_LZMA2;
-      break;
-    case SQUASH_LZMA_TYPE_LZMA:
-    case SQUASH_LZMA_TYPE_LZMA1:
-      filters[0].id = LZMA_FILTER_LZMA1;
-      break;
-  }
-
-  filters[1].id = LZMA_VLI_UNKNOWN;
-  filters[1].options = NULL;
+  squash_lzma_filters_init (codec, options, lzma_type, &lzma_options, filters);
 
   stream = (SquashLZMAStream*) squash_malloc (sizeof (SquashLZMAStream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
   squash_lzma_stream_init (stream, codec, lzma_type, stream_type, options, squash_lzma_stream_destroy);
 
   if (stream_type == SQUASH_STREAM_COMPRESS) {
@@ -402,6 +442,28 @@ squash_lzma_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_siz
   squash_assert_unreachable ();
 }
 
+static size_t
+squash_lzma_get_memory_usage (SquashCodec* codec, SquashOptions* options, SquashStreamType stream_type) {
+  const SquashLZMAType lzma_type = squash_lzma_codec_to_type (codec);
+  lzma_options_lzma lzma_options = { 0, };
+  lzma_filter filters[2];
+  uint64_t usage;
+
+  /* For the container formats the decoder's dictionary size is read
+     from the stream; assume it was created with the same options. */
+  squash_lzma_filters_init (codec, options, lzma_type, &lzma_options, filters);
+
+  if (stream_type == SQUASH_STREAM_COMPRESS)
+    usage = lzma_raw_encoder_memusage (filters);
+  else
+    usage = lzma_raw_decoder_memusage (filters);
+
+  if (SQUASH_UNLIKELY(usage == UINT64_MAX) || SQUASH_UNLIKELY(usage > SIZE_MAX))
+    return 0;
+
+  return (size_t) usage;
+}
+
 SquashStatus
 squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   impl->options = squash_lzma_options;
@@ -426,6 +488,7 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   impl->create_stream = squash_lzma_create_stream;
   impl->process_stream = squash_lzma_process_stream;
   impl->get_max_compressed_size = squash_lzma_get_max_compressed_size;
+  impl->get_memory_usage = squash_lzma_get_memory_usage;
 
   return SQUASH_OK;
 }
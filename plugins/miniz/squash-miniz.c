@@ -171,6 +171,8 @@ squash_miniz_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squas
   assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
 
   stream = squash_malloc (sizeof (SquashMinizStream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
   squash_miniz_stream_init (stream, codec, stream_type, options, squash_miniz_stream_destroy);
 
   stream->type = squash_miniz_codec_to_type (codec);
@@ -0,0 +1,146 @@
+/* Compares the streaming LZW implementation in the ncompress plugin
+ * with the original buffer-based port of ncompress (compress.c),
+ * which is no longer used by the plugin but kept for reference.
+ *
+ * Both implementations should produce identical output, so this also
+ * checks that each one can decompress the other's data.
+ *
+ *   ncompress-benchmark [SIZE_IN_MIB]
+ *
+ * The plugin is loaded through Squash, so SQUASH_PLUGINS may need to
+ * point to the build directory. */
+
+#if !defined(_WIN32)
+#  if !defined(_POSIX_C_SOURCE)
+#    define _POSIX_C_SOURCE 199309L
+#  endif
+#  include <time.h>
+#else
+#  include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <squash/squash.h>
+
+#include "compress.h"
+
+static double
+benchmark_now (void) {
+#if defined(_WIN32)
+  LARGE_INTEGER frequency, count;
+  QueryPerformanceFrequency (&frequency);
+  QueryPerformanceCounter (&count);
+  return ((double) count.QuadPart) / ((double) frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0);
+#endif
+}
+
+static void
+benchmark_report (const char* name, size_t bytes, double elapsed) {
+  fprintf (stdout, "%-24s %10.3f s %10.1f MiB/s\n", name, elapsed, (((double) bytes) / (1024.0 * 1024.0)) / elapsed);
+}
+
+/* Text-like data with some longer repeats and a stretch of noise, so
+   that the table fills up and gets cleared a few times. */
+static void
+benchmark_fill (uint8_t* data, size_t size) {
+  uint32_t state = 0x12345678;
+  size_t i = 0;
+
+  while (i < size) {
+    state = (state * 1103515245) + 12345;
+    const uint32_t kind = (state >> 16) % 16;
+
+    if (kind == 0 && i > 4096) {
+      const size_t distance = 1 + ((state >> 4) % 4096);
+      const size_t length = 16 + ((state >> 8) % 256);
+      for (size_t j = 0 ; j < length && i < size ; j++, i++)
+        data[i] = data[i - distance];
+    } else if (kind == 1 && (i % (1024 * 1024)) > (768 * 1024)) {
+      data[i++] = (uint8_t) (state >> 24);
+    } else {
+      data[i++] = (uint8_t) ("etaoin shrdlu cmfwyp\n"[(state >> 16) % 21]);
+    }
+  }
+}
+
+int
+main (int argc, char** argv) {
+  const size_t size = ((argc > 1) ? (size_t) strtoul (argv[1], NULL, 10) : 32) * 1024 * 1024;
+  SquashCodec* codec = squash_get_codec ("compress");
+  if (codec == NULL) {
+    fprintf (stderr, "Unable to find the compress codec (is SQUASH_PLUGINS set?)\n");
+    return EXIT_FAILURE;
+  }
+
+  const size_t max_compressed_size = squash_codec_get_max_compressed_size (codec, size);
+  uint8_t* data = malloc (size);
+  uint8_t* reference = malloc (max_compressed_size);
+  uint8_t* compressed = malloc (max_compressed_size);
+  uint8_t* decompressed = malloc (size);
+  if (data == NULL || reference == NULL || compressed == NULL || decompressed == NULL) {
+    fprintf (stderr, "Failed to allocate memory.\n");
+    return EXIT_FAILURE;
+  }
+  benchmark_fill (data, size);
+
+  int ret = EXIT_SUCCESS;
+  double start;
+  SquashStatus res;
+
+  size_t reference_size = max_compressed_size;
+  start = benchmark_now ();
+  if (compress (reference, &reference_size, data, size) != COMPRESS_OK) {
+    fprintf (stderr, "compress.c: compression failed\n");
+    return EXIT_FAILURE;
+  }
+  benchmark_report ("compress.c compress", size, benchmark_now () - start);
+
+  size_t compressed_size = max_compressed_size;
+  start = benchmark_now ();
+  res = squash_codec_compress (codec, &compressed_size, compressed, size, data, NULL);
+  if (res != SQUASH_OK) {
+    fprintf (stderr, "plugin: compression failed: %s\n", squash_status_to_string (res));
+    return EXIT_FAILURE;
+  }
+  benchmark_report ("plugin compress", size, benchmark_now () - start);
+
+  if (compressed_size != reference_size || memcmp (compressed, reference, compressed_size) != 0) {
+    fprintf (stderr, "Compressed data differs (%zu vs. %zu bytes)\n", compressed_size, reference_size);
+    ret = EXIT_FAILURE;
+  }
+
+  size_t decompressed_size = size;
+  start = benchmark_now ();
+  if (decompress (decompressed, &decompressed_size, compressed, compressed_size) != COMPRESS_OK ||
+      decompressed_size != size || memcmp (decompressed, data, size) != 0) {
+    fprintf (stderr, "compress.c: decompression failed\n");
+    ret = EXIT_FAILURE;
+  }
+  benchmark_report ("compress.c decompress", size, benchmark_now () - start);
+
+  memset (decompressed, 0, size);
+  decompressed_size = size;
+  start = benchmark_now ();
+  res = squash_codec_decompress (codec, &decompressed_size, decompressed, reference_size, reference, NULL);
+  if (res != SQUASH_OK || decompressed_size != size || memcmp (decompressed, data, size) != 0) {
+    fprintf (stderr, "plugin: decompression failed: %s\n", squash_status_to_string (res));
+    ret = EXIT_FAILURE;
+  }
+  benchmark_report ("plugin decompress", size, benchmark_now () - start);
+
+  fprintf (stdout, "%zu bytes -> %zu bytes\n", size, compressed_size);
+
+  free (data);
+  free (reference);
+  free (compressed);
+  free (decompressed);
+
+  return ret;
+}
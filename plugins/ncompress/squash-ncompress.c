@@ -25,58 +25,661 @@
  */
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
-#include <errno.h>
 
 #include <squash/squash.h>
 
-#include "compress.h"
+/* A streaming implementation of the LZW variant used by compress(1),
+ * producing output identical to ncompress 4.2.
+ *
+ * Some quirks of the format worth knowing about:
+ *
+ *  - Codes are packed LSB-first.  Whenever the code width changes,
+ *    and after a CLEAR code, the output is padded to a multiple of
+ *    eight codes of the old width (this is an artifact of the
+ *    original implementation reading and writing eight codes at a
+ *    time).
+ *  - Once the table is full the encoder checks the compression ratio
+ *    every CHECK_GAP input bytes, and emits a CLEAR code to start
+ *    over with an empty table if it has dropped.
+ *  - The encoder only re-evaluates the code width and the ratio after
+ *    a code has been emitted and another byte of input is available,
+ *    so nothing happens after the final code.
+ *
+ * The encoder uses a linear-probing hash table with the key and code
+ * packed into one word, so a lookup touches a single cache line.
+ * The decoder remembers, for each code, its length and where it was
+ * last written; when that is still in the output buffer the string
+ * is copied as a block instead of walking the prefix chain one byte
+ * at a time. */
+
+#define SQUASH_NCOMPRESS_MAGIC_1    0x1f
+#define SQUASH_NCOMPRESS_MAGIC_2    0x9d
+#define SQUASH_NCOMPRESS_BIT_MASK   0x1f
+#define SQUASH_NCOMPRESS_BLOCK_MODE 0x80
+#define SQUASH_NCOMPRESS_HEADER_SIZE 3
+
+#define SQUASH_NCOMPRESS_INIT_BITS 9
+#define SQUASH_NCOMPRESS_MAX_BITS  16
+#define SQUASH_NCOMPRESS_MAX_CODES (1 << SQUASH_NCOMPRESS_MAX_BITS)
+#define SQUASH_NCOMPRESS_CLEAR     256
+#define SQUASH_NCOMPRESS_FIRST     257
+#define SQUASH_NCOMPRESS_CHECK_GAP 10000
+
+#define SQUASH_NCOMPRESS_HASH_BITS 17
+#define SQUASH_NCOMPRESS_HASH_SIZE (1 << SQUASH_NCOMPRESS_HASH_BITS)
+#define SQUASH_NCOMPRESS_HASH_MASK (SQUASH_NCOMPRESS_HASH_SIZE - 1)
+
+/* Encoder output is staged here before being copied to the caller's
+   buffer.  The slack must hold everything a single input byte can
+   produce: a code, a CLEAR code, and padding for both. */
+#define SQUASH_NCOMPRESS_OUT_SIZE  8192
+#define SQUASH_NCOMPRESS_OUT_SLACK 64
+
+typedef struct SquashNcompressEncoder_ {
+  /* ((key + 1) << 16) | code, or 0 if the slot is empty */
+  uint64_t table[SQUASH_NCOMPRESS_HASH_SIZE];
+
+  int32_t ent;
+  uint32_t free_ent;
+  uint32_t extcode;
+  unsigned int n_bits;
+  unsigned int codes;
+  bool adding;
+  bool boundary;
+
+  long ratio;
+  uint64_t checkpoint;
+  uint64_t bytes_in;
+  uint64_t bits_out;
+
+  uint64_t bit_buffer;
+  unsigned int bit_count;
+
+  size_t out_pos;
+  size_t out_size;
+  uint8_t out[SQUASH_NCOMPRESS_OUT_SIZE];
+} SquashNcompressEncoder;
+
+typedef struct SquashNcompressDecoder_ {
+  uint16_t prefix[SQUASH_NCOMPRESS_MAX_CODES];
+  uint8_t suffix[SQUASH_NCOMPRESS_MAX_CODES];
+  uint8_t first[SQUASH_NCOMPRESS_MAX_CODES];
+  uint32_t length[SQUASH_NCOMPRESS_MAX_CODES];
+  /* Offset in the output where the string was most recently written */
+  uint64_t position[SQUASH_NCOMPRESS_MAX_CODES];
+
+  uint8_t header[SQUASH_NCOMPRESS_HEADER_SIZE];
+  size_t header_size;
+  bool block_mode;
+  unsigned int maxbits;
+
+  int32_t oldcode;
+  uint64_t old_position;
+  uint32_t free_ent;
+  uint32_t maxcode;
+  uint32_t maxmaxcode;
+  unsigned int n_bits;
+  unsigned int codes;
+  uint64_t skip_bits;
+
+  uint64_t bit_buffer;
+  unsigned int bit_count;
+
+  uint64_t total_out;
+
+  size_t pending_pos;
+  size_t pending_size;
+  uint8_t pending[SQUASH_NCOMPRESS_MAX_CODES];
+} SquashNcompressDecoder;
+
+typedef struct SquashNcompressStream_s {
+  SquashStream base_object;
+
+  union {
+    SquashNcompressEncoder* comp;
+    SquashNcompressDecoder* decomp;
+  } ctx;
+} SquashNcompressStream;
 
 SQUASH_PLUGIN_EXPORT
 SquashStatus                 squash_plugin_init_codec       (SquashCodec* codec, SquashCodecImpl* impl);
 
+static void                  squash_ncompress_stream_destroy (void* stream);
+
 static size_t
 squash_ncompress_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
   return uncompressed_size + 4 + (uncompressed_size / 2);
 }
 
+static size_t
+squash_ncompress_get_memory_usage (SquashCodec* codec,
+                                   SquashOptions* options,
+                                   SquashStreamType stream_type) {
+  return sizeof (SquashNcompressStream) +
+    ((stream_type == SQUASH_STREAM_COMPRESS) ? sizeof (SquashNcompressEncoder) : sizeof (SquashNcompressDecoder));
+}
+
+/* Encoder */
+
+static void
+squash_ncompress_encoder_reset_table (SquashNcompressEncoder* enc) {
+  memset (enc->table, 0, sizeof (enc->table));
+}
+
+static void
+squash_ncompress_encoder_init (SquashNcompressEncoder* enc) {
+  squash_ncompress_encoder_reset_table (enc);
+
+  enc->ent = -1;
+  enc->free_ent = SQUASH_NCOMPRESS_FIRST;
+  enc->n_bits = SQUASH_NCOMPRESS_INIT_BITS;
+  enc->extcode = (1 << SQUASH_NCOMPRESS_INIT_BITS) + 1;
+  enc->codes = 0;
+  enc->adding = true;
+  enc->boundary = false;
+  enc->ratio = 0;
+  enc->checkpoint = SQUASH_NCOMPRESS_CHECK_GAP;
+  enc->bytes_in = 0;
+
+  enc->out[0] = SQUASH_NCOMPRESS_MAGIC_1;
+  enc->out[1] = SQUASH_NCOMPRESS_MAGIC_2;
+  enc->out[2] = SQUASH_NCOMPRESS_MAX_BITS | SQUASH_NCOMPRESS_BLOCK_MODE;
+  enc->out_pos = 0;
+  enc->out_size = SQUASH_NCOMPRESS_HEADER_SIZE;
+  enc->bits_out = SQUASH_NCOMPRESS_HEADER_SIZE * 8;
+  enc->bit_buffer = 0;
+  enc->bit_count = 0;
+}
+
+static void
+squash_ncompress_encoder_put (SquashNcompressEncoder* enc, uint32_t value, unsigned int bits) {
+  enc->bit_buffer |= ((uint64_t) value) << enc->bit_count;
+  enc->bit_count += bits;
+  enc->bits_out += bits;
+
+  while (enc->bit_count >= 8) {
+    enc->out[enc->out_size++] = (uint8_t) enc->bit_buffer;
+    enc->bit_buffer >>= 8;
+    enc->bit_count -= 8;
+  }
+}
+
+static void
+squash_ncompress_encoder_emit (SquashNcompressEncoder* enc, uint32_t code) {
+  squash_ncompress_encoder_put (enc, code, enc->n_bits);
+  enc->codes++;
+}
+
+/* Pad to a multiple of eight codes of the current width. */
+static void
+squash_ncompress_encoder_pad (SquashNcompressEncoder* enc) {
+  for (unsigned int i = enc->codes & 7 ; i != 0 && i < 8 ; i++)
+    squash_ncompress_encoder_put (enc, 0, enc->n_bits);
+  enc->codes = 0;
+}
+
+/* Called after a code was emitted, once we know more input follows. */
+static void
+squash_ncompress_encoder_boundary (SquashNcompressEncoder* enc) {
+  if (enc->free_ent >= enc->extcode) {
+    if (enc->n_bits < SQUASH_NCOMPRESS_MAX_BITS) {
+      squash_ncompress_encoder_pad (enc);
+      enc->n_bits++;
+      enc->extcode = (1 << enc->n_bits) + ((enc->n_bits < SQUASH_NCOMPRESS_MAX_BITS) ? 1 : 0);
+    } else {
+      enc->extcode = UINT32_MAX;
+      enc->adding = false;
+    }
+  }
+
+  if (!enc->adding && enc->bytes_in >= enc->checkpoint) {
+    const uint64_t bytes_out = enc->bits_out >> 3;
+    long rat;
+
+    enc->checkpoint = enc->bytes_in + SQUASH_NCOMPRESS_CHECK_GAP;
+
+    if (enc->bytes_in > 0x007fffff) {
+      /* Avoid overflowing the shift */
+      rat = (long) (bytes_out >> 8);
+      rat = (rat == 0) ? 0x7fffffff : (long) (enc->bytes_in / (uint64_t) rat);
+    } else {
+      rat = (long) ((enc->bytes_in << 8) / bytes_out);
+    }
+
+    if (rat >= enc->ratio) {
+      enc->ratio = rat;
+    } else {
+      enc->ratio = 0;
+      squash_ncompress_encoder_reset_table (enc);
+      squash_ncompress_encoder_emit (enc, SQUASH_NCOMPRESS_CLEAR);
+      squash_ncompress_encoder_pad (enc);
+      enc->n_bits = SQUASH_NCOMPRESS_INIT_BITS;
+      enc->extcode = (1 << SQUASH_NCOMPRESS_INIT_BITS) + 1;
+      enc->free_ent = SQUASH_NCOMPRESS_FIRST;
+      enc->adding = true;
+    }
+  }
+}
+
+static size_t
+squash_ncompress_encoder_consume (SquashNcompressEncoder* enc, const uint8_t* in, size_t in_size) {
+  uint64_t* const table = enc->table;
+  size_t pos = 0;
+
+  if (enc->ent < 0 && in_size != 0) {
+    enc->ent = in[pos++];
+    enc->bytes_in++;
+  }
+
+  /* The state used for every byte lives in locals; it is written back
+     before anything rarer (a width change or a ratio check) has to
+     look at it. */
+  const uint64_t bytes_base = enc->bytes_in - pos;
+  int32_t ent = enc->ent;
+  uint32_t free_ent = enc->free_ent;
+  bool boundary = enc->boundary;
+  uint64_t bit_buffer = enc->bit_buffer;
+  unsigned int bit_count = enc->bit_count;
+  unsigned int n_bits = enc->n_bits;
+  unsigned int codes = enc->codes;
+  size_t out_size = enc->out_size;
+  uint8_t* const out = enc->out;
+
+  while (pos < in_size && out_size <= (SQUASH_NCOMPRESS_OUT_SIZE - SQUASH_NCOMPRESS_OUT_SLACK)) {
+    if (boundary) {
+      boundary = false;
+
+      if (SQUASH_UNLIKELY(free_ent >= enc->extcode) ||
+          SQUASH_UNLIKELY(!enc->adding && (bytes_base + pos) >= enc->checkpoint)) {
+        enc->free_ent = free_ent;
+        enc->bit_buffer = bit_buffer;
+        enc->bit_count = bit_count;
+        enc->codes = codes;
+        enc->out_size = out_size;
+        enc->bytes_in = bytes_base + pos;
+
+        squash_ncompress_encoder_boundary (enc);
+
+        free_ent = enc->free_ent;
+        bit_buffer = enc->bit_buffer;
+        bit_count = enc->bit_count;
+        n_bits = enc->n_bits;
+        codes = enc->codes;
+        out_size = enc->out_size;
+      }
+    }
+
+    const uint8_t c = in[pos++];
+    const uint32_t key = (((uint32_t) ent) << 8) | c;
+    const uint64_t tag = ((uint64_t) (key + 1)) << 16;
+    uint32_t h = (key * UINT32_C(2654435761)) >> (32 - SQUASH_NCOMPRESS_HASH_BITS);
+    uint64_t slot;
+
+    while ((slot = table[h]) != 0 && (slot & ~UINT64_C(0xffff)) != tag)
+      h = (h + 1) & SQUASH_NCOMPRESS_HASH_MASK;
+
+    if (slot != 0) {
+      ent = (int32_t) (slot & 0xffff);
+    } else {
+      bit_buffer |= ((uint64_t) ent) << bit_count;
+      bit_count += n_bits;
+      enc->bits_out += n_bits;
+      codes++;
+      while (bit_count >= 8) {
+        out[out_size++] = (uint8_t) bit_buffer;
+        bit_buffer >>= 8;
+        bit_count -= 8;
+      }
+
+      if (enc->adding)
+        table[h] = tag | free_ent++;
+      ent = c;
+      boundary = true;
+    }
+  }
+
+  enc->ent = ent;
+  enc->free_ent = free_ent;
+  enc->boundary = boundary;
+  enc->bit_buffer = bit_buffer;
+  enc->bit_count = bit_count;
+  enc->codes = codes;
+  enc->out_size = out_size;
+  enc->bytes_in = bytes_base + pos;
+
+  return pos;
+}
+
+static void
+squash_ncompress_encoder_finish (SquashNcompressEncoder* enc) {
+  if (enc->ent >= 0) {
+    squash_ncompress_encoder_emit (enc, (uint32_t) enc->ent);
+    enc->ent = -1;
+  }
+
+  if (enc->bit_count != 0) {
+    enc->out[enc->out_size++] = (uint8_t) enc->bit_buffer;
+    enc->bit_buffer = 0;
+    enc->bit_count = 0;
+  }
+}
+
+static void
+squash_ncompress_encoder_drain (SquashNcompressEncoder* enc, SquashStream* stream) {
+  size_t n = enc->out_size - enc->out_pos;
+  if (n > stream->avail_out)
+    n = stream->avail_out;
+
+  memcpy (stream->next_out, enc->out + enc->out_pos, n);
+  stream->next_out += n;
+  stream->avail_out -= n;
+  enc->out_pos += n;
+
+  if (enc->out_pos == enc->out_size)
+    enc->out_pos = enc->out_size = 0;
+}
+
 static SquashStatus
-squash_ncompress_status_to_squash_status (enum CompressStatus status) {
-  switch (status) {
-    case COMPRESS_OK:
-      return SQUASH_OK;
-    case COMPRESS_WRITE_ERROR:
-      return squash_error (SQUASH_BUFFER_FULL);
-    case COMPRESS_READ_ERROR:
-    case COMPRESS_FAILED:
-      return SQUASH_FAILED;
+squash_ncompress_compress_stream (SquashStream* stream, SquashOperation operation) {
+  SquashNcompressEncoder* enc = ((SquashNcompressStream*) stream)->ctx.comp;
+
+  while (true) {
+    squash_ncompress_encoder_drain (enc, stream);
+    if (enc->out_size != 0)
+      return SQUASH_PROCESSING;
+
+    if (stream->avail_in == 0)
+      break;
+
+    const size_t consumed = squash_ncompress_encoder_consume (enc, stream->next_in, stream->avail_in);
+    stream->next_in += consumed;
+    stream->avail_in -= consumed;
+  }
+
+  if (operation == SQUASH_OPERATION_FINISH) {
+    squash_ncompress_encoder_finish (enc);
+    squash_ncompress_encoder_drain (enc, stream);
+    if (enc->out_size != 0)
+      return SQUASH_PROCESSING;
   }
-  squash_assert_unreachable();
+
+  return SQUASH_OK;
+}
+
+/* Decoder */
+
+static void
+squash_ncompress_decoder_init (SquashNcompressDecoder* dec) {
+  for (uint32_t code = 0 ; code < 256 ; code++) {
+    dec->suffix[code] = (uint8_t) code;
+    dec->first[code] = (uint8_t) code;
+    dec->length[code] = 1;
+  }
+
+  dec->header_size = 0;
+  dec->oldcode = -1;
+  dec->n_bits = SQUASH_NCOMPRESS_INIT_BITS;
+  dec->maxcode = (1 << SQUASH_NCOMPRESS_INIT_BITS) - 1;
+  dec->codes = 0;
+  dec->skip_bits = 0;
+  dec->bit_buffer = 0;
+  dec->bit_count = 0;
+  dec->total_out = 0;
+  dec->pending_pos = 0;
+  dec->pending_size = 0;
+}
+
+static void
+squash_ncompress_decoder_pad (SquashNcompressDecoder* dec) {
+  dec->skip_bits += (uint64_t) ((8 - (dec->codes & 7)) & 7) * dec->n_bits;
+  dec->codes = 0;
+}
+
+/* Write the string for a code, back to front, by walking the prefix
+   chain. */
+static void
+squash_ncompress_decoder_walk (const SquashNcompressDecoder* dec, uint32_t code, uint8_t* dest, size_t length) {
+  uint8_t* p = dest + length;
+
+  while (code >= 256) {
+    *--p = dec->suffix[code];
+    code = dec->prefix[code];
+  }
+  *--p = (uint8_t) code;
+
+  assert (p == dest);
 }
 
 static SquashStatus
-squash_ncompress_decompress_buffer (SquashCodec* codec,
-                                    size_t* decompressed_size,
-                                    uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
-                                    size_t compressed_size,
-                                    const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
-                                    SquashOptions* options) {
-  enum CompressStatus res = decompress (decompressed, decompressed_size, compressed, compressed_size);
+squash_ncompress_decompress_stream (SquashStream* stream, SquashOperation operation) {
+  SquashNcompressDecoder* dec = ((SquashNcompressStream*) stream)->ctx.decomp;
+
+  /* Output written during this call can be copied from directly.
+     It starts with whatever is left over from the last call. */
+  uint8_t* const window = stream->next_out;
+  const uint64_t window_start = dec->total_out - (dec->pending_size - dec->pending_pos);
+
+  while (dec->header_size < SQUASH_NCOMPRESS_HEADER_SIZE) {
+    if (stream->avail_in == 0)
+      return (operation == SQUASH_OPERATION_FINISH) ? squash_error (SQUASH_FAILED) : SQUASH_OK;
+
+    dec->header[dec->header_size++] = *(stream->next_in++);
+    stream->avail_in--;
+
+    if (dec->header_size == SQUASH_NCOMPRESS_HEADER_SIZE) {
+      dec->maxbits = dec->header[2] & SQUASH_NCOMPRESS_BIT_MASK;
+
+      if (SQUASH_UNLIKELY(dec->header[0] != SQUASH_NCOMPRESS_MAGIC_1) ||
+          SQUASH_UNLIKELY(dec->header[1] != SQUASH_NCOMPRESS_MAGIC_2) ||
+          SQUASH_UNLIKELY(dec->maxbits < SQUASH_NCOMPRESS_INIT_BITS) ||
+          SQUASH_UNLIKELY(dec->maxbits > SQUASH_NCOMPRESS_MAX_BITS))
+        return squash_error (SQUASH_FAILED);
+
+      dec->block_mode = (dec->header[2] & SQUASH_NCOMPRESS_BLOCK_MODE) != 0;
+      dec->maxmaxcode = 1U << dec->maxbits;
+      dec->free_ent = dec->block_mode ? SQUASH_NCOMPRESS_FIRST : 256;
+    }
+  }
+
+  while (true) {
+    /* Flush anything which didn't fit last time. */
+    if (dec->pending_size != 0) {
+      size_t n = dec->pending_size - dec->pending_pos;
+      if (n > stream->avail_out)
+        n = stream->avail_out;
+      memcpy (stream->next_out, dec->pending + dec->pending_pos, n);
+      stream->next_out += n;
+      stream->avail_out -= n;
+      dec->pending_pos += n;
+
+      if (dec->pending_pos != dec->pending_size)
+        return SQUASH_PROCESSING;
+      dec->pending_pos = dec->pending_size = 0;
+    }
+
+    /* Refill the bit buffer, discarding padding as we go. */
+    while (true) {
+      if (dec->skip_bits != 0 && dec->bit_count != 0) {
+        const unsigned int n = (dec->skip_bits < dec->bit_count) ? (unsigned int) dec->skip_bits : dec->bit_count;
+        dec->bit_buffer = (n == 64) ? 0 : (dec->bit_buffer >> n);
+        dec->bit_count -= n;
+        dec->skip_bits -= n;
+      }
+
+      if (dec->bit_count > 56 || stream->avail_in == 0)
+        break;
 
-  return squash_ncompress_status_to_squash_status (res);
+      dec->bit_buffer |= ((uint64_t) *(stream->next_in++)) << dec->bit_count;
+      dec->bit_count += 8;
+      stream->avail_in--;
+    }
+
+    if (dec->free_ent > dec->maxcode) {
+      squash_ncompress_decoder_pad (dec);
+      dec->n_bits++;
+      dec->maxcode = (dec->n_bits == dec->maxbits) ? dec->maxmaxcode : ((1U << dec->n_bits) - 1);
+      continue;
+    }
+
+    if (dec->skip_bits != 0 || dec->bit_count < dec->n_bits) {
+      /* Out of input.  Any bits left over at the end of the stream
+         are padding. */
+      return SQUASH_OK;
+    }
+
+    uint32_t code = (uint32_t) (dec->bit_buffer & ((UINT64_C(1) << dec->n_bits) - 1));
+    dec->bit_buffer >>= dec->n_bits;
+    dec->bit_count -= dec->n_bits;
+    dec->codes++;
+
+    if (dec->oldcode < 0) {
+      if (SQUASH_UNLIKELY(code >= 256))
+        return squash_error (SQUASH_FAILED);
+    } else if (code == SQUASH_NCOMPRESS_CLEAR && dec->block_mode) {
+      squash_ncompress_decoder_pad (dec);
+      dec->n_bits = SQUASH_NCOMPRESS_INIT_BITS;
+      dec->maxcode = (1 << SQUASH_NCOMPRESS_INIT_BITS) - 1;
+      dec->free_ent = SQUASH_NCOMPRESS_FIRST;
+      dec->oldcode = -1;
+      continue;
+    } else if (SQUASH_UNLIKELY(code > dec->free_ent)) {
+      return squash_error (SQUASH_FAILED);
+    }
+
+    /* code == free_ent is the KwKwK case: the previous string
+       followed by its own first character. */
+    const bool kwkwk = (code == dec->free_ent);
+    const uint32_t src = kwkwk ? (uint32_t) dec->oldcode : code;
+    const size_t length = dec->length[src] + (kwkwk ? 1 : 0);
+    const uint8_t first = dec->first[src];
+    const uint64_t position = dec->total_out;
+    const uint64_t written = dec->total_out - (uint64_t) dec->pending_size;
+    uint8_t* dest;
+
+    if (SQUASH_LIKELY(length <= stream->avail_out)) {
+      dest = stream->next_out;
+      stream->next_out += length;
+      stream->avail_out -= length;
+    } else {
+      dest = dec->pending;
+      dec->pending_size = length;
+    }
+
+    if (length == 1) {
+      *dest = (uint8_t) code;
+    } else {
+      const uint64_t from = kwkwk ? dec->old_position : dec->position[src];
+      const size_t avail = kwkwk ? (length - 1) : length;
+
+      if (dest != dec->pending && from >= window_start && (from + avail) <= written) {
+        const uint8_t* s = window + (from - window_start);
+        if (kwkwk) {
+          /* Overlaps the destination, like an LZ77 match */
+          for (size_t i = 0 ; i < length ; i++)
+            dest[i] = s[i];
+        } else {
+          memcpy (dest, s, length);
+        }
+      } else if (kwkwk) {
+        squash_ncompress_decoder_walk (dec, src, dest, length - 1);
+        dest[length - 1] = first;
+      } else {
+        squash_ncompress_decoder_walk (dec, src, dest, length);
+      }
+    }
+
+    if (dec->oldcode >= 0) {
+      if (dec->free_ent < dec->maxmaxcode) {
+        const uint32_t entry = dec->free_ent++;
+        dec->prefix[entry] = (uint16_t) dec->oldcode;
+        dec->suffix[entry] = first;
+        dec->first[entry] = dec->first[dec->oldcode];
+        dec->length[entry] = dec->length[dec->oldcode] + 1;
+        dec->position[entry] = dec->old_position;
+      }
+    }
+
+    if (code >= 256 && !kwkwk)
+      dec->position[code] = position;
+
+    dec->oldcode = (int32_t) code;
+    dec->old_position = position;
+    dec->total_out += length;
+  }
+}
+
+/* Streams */
+
+static SquashNcompressStream*
+squash_ncompress_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  SquashNcompressStream* stream;
+
+  assert (codec != NULL);
+  assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
+
+  stream = squash_malloc (sizeof (SquashNcompressStream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  squash_stream_init ((SquashStream*) stream, codec, stream_type, options, squash_ncompress_stream_destroy);
+
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    stream->ctx.comp = squash_malloc (sizeof (SquashNcompressEncoder));
+    if (SQUASH_UNLIKELY(stream->ctx.comp == NULL)) {
+      squash_object_unref (stream);
+      return (squash_error (SQUASH_MEMORY), NULL);
+    }
+    squash_ncompress_encoder_init (stream->ctx.comp);
+  } else {
+    stream->ctx.decomp = squash_malloc (sizeof (SquashNcompressDecoder));
+    if (SQUASH_UNLIKELY(stream->ctx.decomp == NULL)) {
+      squash_object_unref (stream);
+      return (squash_error (SQUASH_MEMORY), NULL);
+    }
+    squash_ncompress_decoder_init (stream->ctx.decomp);
+  }
+
+  return stream;
+}
+
+static void
+squash_ncompress_stream_destroy (void* stream) {
+  SquashNcompressStream* s = (SquashNcompressStream*) stream;
+
+  if (s->base_object.stream_type == SQUASH_STREAM_COMPRESS)
+    squash_free (s->ctx.comp);
+  else
+    squash_free (s->ctx.decomp);
+
+  squash_stream_destroy (stream);
+}
+
+static SquashStream*
+squash_ncompress_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  return (SquashStream*) squash_ncompress_stream_new (codec, stream_type, options);
 }
 
 static SquashStatus
-squash_ncompress_compress_buffer (SquashCodec* codec,
-                                  size_t* compressed_size,
-                                  uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
-                                  size_t uncompressed_size,
-                                  const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
-                                  SquashOptions* options) {
-  enum CompressStatus res = compress (compressed, compressed_size, uncompressed, uncompressed_size);
+squash_ncompress_reset_stream (SquashStream* stream) {
+  SquashNcompressStream* s = (SquashNcompressStream*) stream;
+
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS)
+    squash_ncompress_encoder_init (s->ctx.comp);
+  else
+    squash_ncompress_decoder_init (s->ctx.decomp);
 
-  return squash_ncompress_status_to_squash_status (res);
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_ncompress_process_stream (SquashStream* stream, SquashOperation operation) {
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS)
+    return squash_ncompress_compress_stream (stream, operation);
+  else
+    return squash_ncompress_decompress_stream (stream, operation);
 }
 
 SquashStatus
@@ -85,8 +688,10 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
 
   if (SQUASH_LIKELY(strcmp ("compress", name) == 0)) {
     impl->get_max_compressed_size = squash_ncompress_get_max_compressed_size;
-    impl->decompress_buffer = squash_ncompress_decompress_buffer;
-    impl->compress_buffer = squash_ncompress_compress_buffer;
+    impl->get_memory_usage = squash_ncompress_get_memory_usage;
+    impl->create_stream = squash_ncompress_create_stream;
+    impl->process_stream = squash_ncompress_process_stream;
+    impl->reset_stream = squash_ncompress_reset_stream;
   } else {
     return squash_error (SQUASH_UNABLE_TO_LOAD);
   }
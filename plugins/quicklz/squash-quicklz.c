@@ -68,13 +68,15 @@ squash_quicklz_decompress_buffer (SquashCodec* codec,
     return SQUASH_BUFFER_FULL;
   }
 
-  qlz_s = (qlz_state_decompress*) malloc (sizeof (qlz_state_decompress));
+  qlz_s = (qlz_state_decompress*) squash_malloc (sizeof (qlz_state_decompress));
+  if (SQUASH_UNLIKELY(qlz_s == NULL))
+    return squash_error (SQUASH_MEMORY);
 
   *decompressed_size = qlz_decompress ((const char*) compressed,
                                          (void*) decompressed,
                                          qlz_s);
 
-  free (qlz_s);
+  squash_free (qlz_s);
 
   return SQUASH_LIKELY(decompressed_s == *decompressed_size) ? SQUASH_OK : squash_error (SQUASH_FAILED);
 }
@@ -92,14 +94,16 @@ squash_quicklz_compress_buffer (SquashCodec* codec,
     return squash_error (SQUASH_BUFFER_FULL);
   }
 
-  qlz_s = (qlz_state_compress*) malloc (sizeof (qlz_state_compress));
+  qlz_s = (qlz_state_compress*) squash_malloc (sizeof (qlz_state_compress));
+  if (SQUASH_UNLIKELY(qlz_s == NULL))
+    return squash_error (SQUASH_MEMORY);
 
   *compressed_size = qlz_compress ((const void*) uncompressed,
                                      (char*) compressed,
                                      uncompressed_size,
                                      qlz_s);
 
-  free (qlz_s);
+  squash_free (qlz_s);
 
   return SQUASH_UNLIKELY(*compressed_size == 0) ? squash_error (SQUASH_FAILED) : SQUASH_OK;
 }
@@ -109,6 +113,7 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   const char* name = squash_codec_get_name (codec);
 
   if (SQUASH_LIKELY(strcmp ("quicklz", name) == 0)) {
+    impl->info |= SQUASH_CODEC_INFO_SEGMENTED;
     impl->get_uncompressed_size = squash_quicklz_get_uncompressed_size;
     impl->get_max_compressed_size = squash_quicklz_get_max_compressed_size;
     impl->decompress_buffer = squash_quicklz_decompress_buffer;
@@ -24,12 +24,6 @@
  *   Evan Nemerson <evan@nemerson.com>
  */
 
-/* THIS CODE IS DISABLED FOR A REASON.  See
-   <https://github.com/quixdb/squash/issues/138>.  If you would like
-   snappy-framed support, you should consider re-writing this code.
-   It is really more of a proof-of-concept, and is not ready for
-   production use. */
-
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE
 
@@ -83,6 +77,31 @@ enum SquashSnappyFramedChunkType {
 #define SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX ((size_t) 65536)
 const uint8_t squash_snappy_framed_identifier[] = { 0xff, 0x06, 0x00, 0x00, 0x73, 0x4e, 0x61, 0x50, 0x70, 0x59 };
 
+/* Number of chunks per thread the buffer compressor works on at a
+   time; each needs a worst-case output slot. */
+#define SQUASH_SNAPPY_FRAMED_BATCH_CHUNKS ((size_t) 4)
+
+enum SquashSnappyFramedOptIndex {
+  SQUASH_SNAPPY_FRAMED_OPT_THREADS = 0
+};
+
+static SquashOptionInfo squash_snappy_framed_options[] = {
+  { "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 256 },
+    .default_value.int_value = 1 },
+  { NULL, SQUASH_OPTION_TYPE_NONE, }
+};
+
+typedef struct SquashSnappyFramedChunk_ {
+  const uint8_t* input;
+  size_t input_size;
+  uint8_t* output;
+  size_t output_size;
+} SquashSnappyFramedChunk;
+
 typedef struct SquashSnappyFramedStream_s {
   SquashStream base_object;
 
@@ -140,9 +159,9 @@ squash_snappy_framed_stream_destroy (void* stream) {
   SquashSnappyFramedStream* s = (SquashSnappyFramedStream*) stream;
 
   if (s->input_buffer != NULL)
-    free (s->input_buffer);
+    squash_free (s->input_buffer);
   if (s->output_buffer != NULL)
-    free (s->output_buffer);
+    squash_free (s->output_buffer);
 
   squash_stream_destroy (stream);
 }
@@ -154,7 +173,9 @@ squash_snappy_framed_stream_new (SquashCodec* codec, SquashStreamType stream_typ
   assert (codec != NULL);
   assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
 
-  stream = (SquashSnappyFramedStream*) malloc (sizeof (SquashSnappyFramedStream));
+  stream = (SquashSnappyFramedStream*) squash_malloc (sizeof (SquashSnappyFramedStream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
   squash_snappy_framed_stream_init (stream, codec, stream_type, options, squash_snappy_framed_stream_destroy);
 
   return stream;
@@ -213,29 +234,32 @@ squash_snappy_framed_header_skippable (const uint8_t header[4]) {
 
 #define SQUASH_SNAPPY_FRAMED_MAX_CHUNK_SIZE ((size_t) 16777211)
 
-static size_t
+static SquashStatus
 squash_snappy_framed_buffer (SquashSnappyFramedStream* s) {
   SquashStream* stream = (SquashStream*) s;
 
   if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
     if (s->input_buffer == NULL) {
+      s->input_buffer = squash_malloc (SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX);
+      if (SQUASH_UNLIKELY(s->input_buffer == NULL))
+        return squash_error (SQUASH_MEMORY);
       s->input_buffer_size = SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX;
-      s->input_buffer = malloc (s->input_buffer_size);
     }
-    return squash_snappy_framed_read_to_buffer(s, SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX - s->input_buffer_length);
+    squash_snappy_framed_read_to_buffer(s, SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX - s->input_buffer_length);
   } else {
     if (s->input_buffer == NULL) {
+      s->input_buffer = squash_malloc (SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX + 8);
+      if (SQUASH_UNLIKELY(s->input_buffer == NULL))
+        return squash_error (SQUASH_MEMORY);
       s->input_buffer_size = SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX + 8;
-      s->input_buffer = malloc (s->input_buffer_size);
     }
 
-    size_t bytes_read = 0;
     size_t chunk_size;
 
     if (s->input_buffer_length < 4) {
-      bytes_read += squash_snappy_framed_read_to_buffer (s, 4 - s->input_buffer_length);
+      squash_snappy_framed_read_to_buffer (s, 4 - s->input_buffer_length);
       if (s->input_buffer_length != 4)
-        return bytes_read;
+        return SQUASH_OK;
     }
 
     chunk_size = squash_snappy_framed_header_get_chunk_size (s->input_buffer);
@@ -243,21 +267,24 @@ squash_snappy_framed_buffer (SquashSnappyFramedStream* s) {
     if (s->input_buffer_size < chunk_size + 4 &&
         !squash_snappy_framed_header_skippable (s->input_buffer)) {
       if (chunk_size > SQUASH_SNAPPY_FRAMED_MAX_CHUNK_SIZE)
-        return SQUASH_SNAPPY_FRAMED_MAX_CHUNK_SIZE + 1;
+        return squash_error (SQUASH_FAILED);
+      uint8_t* input_buffer = squash_realloc (s->input_buffer, chunk_size + 4);
+      if (SQUASH_UNLIKELY(input_buffer == NULL))
+        return squash_error (SQUASH_MEMORY);
+      s->input_buffer = input_buffer;
       s->input_buffer_size = chunk_size + 4;
-      s->input_buffer = realloc (s->input_buffer, s->input_buffer_size);
     }
 
     const size_t remaining = (chunk_size + 4) - s->input_buffer_length;
 
     if (squash_snappy_framed_header_skippable (s->input_buffer)) {
-      bytes_read += squash_snappy_framed_skip (s, remaining);
+      squash_snappy_framed_skip (s, remaining);
     } else {
-      bytes_read += squash_snappy_framed_read_to_buffer (s, remaining);
+      squash_snappy_framed_read_to_buffer (s, remaining);
     }
-
-    return bytes_read;
   }
+
+  return SQUASH_OK;
 }
 
 static size_t
@@ -286,7 +313,56 @@ squash_snappy_framed_flush (SquashSnappyFramedStream* s) {
   return cp_size;
 }
 
+/* Decode a compressed or uncompressed data chunk (header included)
+ * into decompressed, which must have room for the decompressed_length
+ * bytes the chunk holds, and verify its checksum. */
+static bool
+squash_snappy_framed_decode_chunk (const uint8_t* compressed, uint8_t* decompressed, size_t decompressed_length) {
+  const size_t compressed_length = squash_snappy_framed_header_get_chunk_size (compressed);
+
+  if (compressed[0] == SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_COMPRESSED) {
+    snappy_status e =
+      snappy_uncompress ((char*) compressed + 8, compressed_length - 4,
+                         (char*) decompressed, &decompressed_length);
+
+    if (e != SNAPPY_OK)
+      return false;
+
+    uint32_t crc = 0;
+    crc = (crc << 8) | compressed[7];
+    crc = (crc << 8) | compressed[6];
+    crc = (crc << 8) | compressed[5];
+    crc = (crc << 8) | compressed[4];
+
+    if (crc != squash_snappy_framed_generate_checksum(decompressed, decompressed_length)) {
+      return false;
+    }
+  } else {
+    memcpy (decompressed, compressed + 8, compressed_length - 4);
+  }
+
+  return true;
+}
+
+/* Get the number of bytes a data chunk decompresses to. */
 static bool
+squash_snappy_framed_chunk_get_decompressed_length (const uint8_t* compressed, size_t* decompressed_length) {
+  const size_t compressed_length = squash_snappy_framed_header_get_chunk_size (compressed);
+
+  if (compressed_length < 4)
+    return false;
+
+  if (compressed[0] == SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_COMPRESSED) {
+    if (snappy_uncompressed_length ((const char*) compressed + 8, compressed_length - 4, decompressed_length) != SNAPPY_OK)
+      return false;
+  } else {
+    *decompressed_length = compressed_length - 4;
+  }
+
+  return *decompressed_length <= SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX;
+}
+
+static SquashStatus
 squash_snappy_framed_handle_chunk (SquashSnappyFramedStream* s) {
   SquashStream* stream = (SquashStream*) s;
 
@@ -302,7 +378,7 @@ squash_snappy_framed_handle_chunk (SquashSnappyFramedStream* s) {
 
   if (s->first) {
     if (compressed[0] != SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_IDENTIFIER)
-      return false;
+      return squash_error (SQUASH_FAILED);
     s->first = false;
   }
 
@@ -310,7 +386,7 @@ squash_snappy_framed_handle_chunk (SquashSnappyFramedStream* s) {
     if (compressed_length + 4 == sizeof(squash_snappy_framed_identifier) &&
         memcmp (compressed, squash_snappy_framed_identifier, sizeof(squash_snappy_framed_identifier)) == 0) {
     } else {
-      return false;
+      return squash_error (SQUASH_FAILED);
     }
   } else if (squash_snappy_framed_header_skippable (compressed)) {
     // Skip
@@ -319,45 +395,25 @@ squash_snappy_framed_handle_chunk (SquashSnappyFramedStream* s) {
     uint8_t* decompressed;
     size_t decompressed_length;
 
-    if (compressed[0] == SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_COMPRESSED) {
-      snappy_uncompressed_length ((const char*) compressed + 8, compressed_length, &decompressed_length);
-    } else {
-      decompressed_length = compressed_length - 4;
-    }
-
-    if (decompressed_length > SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX)
-      return false;
+    if (!squash_snappy_framed_chunk_get_decompressed_length (compressed, &decompressed_length))
+      return squash_error (SQUASH_FAILED);
 
+    /* Decompress straight into the caller's buffer if the whole chunk
+       fits; otherwise stage it and drain it over subsequent calls. */
     if (stream->avail_out >= decompressed_length) {
       decompressed = stream->next_out;
     } else {
       if (s->output_buffer == NULL) {
+        s->output_buffer = squash_malloc (SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX);
+        if (SQUASH_UNLIKELY(s->output_buffer == NULL))
+          return squash_error (SQUASH_MEMORY);
         s->output_buffer_size = SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX;
-        s->output_buffer = malloc (s->output_buffer_size);
       }
       decompressed = s->output_buffer;
     }
 
-    if (compressed[0] == SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_COMPRESSED) {
-      snappy_status e =
-        snappy_uncompress ((char*) compressed + 8, compressed_length - 4,
-                           (char*) decompressed, &decompressed_length);
-
-      if (e != SNAPPY_OK)
-        return false;
-
-      uint32_t crc = 0;
-      crc = (crc << 8) | compressed[7];
-      crc = (crc << 8) | compressed[6];
-      crc = (crc << 8) | compressed[5];
-      crc = (crc << 8) | compressed[4];
-
-      if (crc != squash_snappy_framed_generate_checksum(decompressed, decompressed_length)) {
-        return false;
-      }
-    } else {
-      memcpy (decompressed, compressed + 8, compressed_length - 4);
-    }
+    if (!squash_snappy_framed_decode_chunk (compressed, decompressed, decompressed_length))
+      return squash_error (SQUASH_FAILED);
 
     if (decompressed == stream->next_out) {
       stream->next_out += decompressed_length;
@@ -369,7 +425,7 @@ squash_snappy_framed_handle_chunk (SquashSnappyFramedStream* s) {
       goto success;
     }
   } else {
-    return false;
+    return squash_error (SQUASH_FAILED);
   }
 
   s->state = SQUASH_SNAPPY_FRAMED_STATE_IDLE;
@@ -383,10 +439,43 @@ squash_snappy_framed_handle_chunk (SquashSnappyFramedStream* s) {
     s->input_buffer_pos = 0;
   }
 
-  return true;
+  return SQUASH_OK;
 }
 
-static void
+/* Write one chunk (header, checksum and data) for up to 64 KiB of
+ * input.  There must be room for 8 + snappy_max_compressed_length
+ * (uncompressed_length) bytes at compressed.  Returns the size of the
+ * chunk. */
+static size_t
+squash_snappy_framed_encode_chunk (uint8_t* compressed, const uint8_t* uncompressed, size_t uncompressed_length) {
+  size_t compressed_length = snappy_max_compressed_length (uncompressed_length);
+  uint32_t crc = squash_snappy_framed_generate_checksum(uncompressed, uncompressed_length);
+
+  snappy_status e =
+    snappy_compress ((char*) uncompressed, uncompressed_length,
+                     (char*) compressed + 8, &compressed_length);
+
+  compressed[4] = (crc >>  0) & 0xff;
+  compressed[5] = (crc >>  8) & 0xff;
+  compressed[6] = (crc >> 16) & 0xff;
+  compressed[7] = (crc >> 24) & 0xff;
+
+  if (e != SNAPPY_OK || compressed_length >= uncompressed_length) {
+    compressed[0] = SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_UNCOMPRESSED;
+    compressed_length = uncompressed_length;
+    memcpy (compressed + 8, uncompressed, uncompressed_length);
+  } else {
+    compressed[0] = SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_COMPRESSED;
+  }
+
+  compressed[1] = ((compressed_length + 4) >>  0) & 0xff;
+  compressed[2] = ((compressed_length + 4) >>  8) & 0xff;
+  compressed[3] = ((compressed_length + 4) >> 16) & 0xff;
+
+  return compressed_length + 8;
+}
+
+static SquashStatus
 squash_snappy_framed_compress_chunk (SquashSnappyFramedStream* s) {
   SquashStream* stream = (SquashStream*) s;
 
@@ -399,7 +488,9 @@ squash_snappy_framed_compress_chunk (SquashSnappyFramedStream* s) {
   size_t uncompressed_length;
 
   if (s->input_buffer_length != 0) {
-    squash_snappy_framed_buffer (s);
+    SquashStatus res = squash_snappy_framed_buffer (s);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      return res;
     uncompressed = s->input_buffer;
     uncompressed_length = s->input_buffer_length;
   } else {
@@ -408,42 +499,27 @@ squash_snappy_framed_compress_chunk (SquashSnappyFramedStream* s) {
   }
 
   if (uncompressed_length == 0)
-    return;
+    return SQUASH_OK;
 
-  compressed_length = snappy_max_compressed_length (SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX);
+  /* snappy doesn't check the output size, so we can only write
+     straight into next_out if the worst case for this chunk fits;
+     otherwise compress into output_buffer and drain it later. */
+  compressed_length = snappy_max_compressed_length (uncompressed_length);
 
-  if (stream->avail_out >= (SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX + 8)) {
+  if (stream->avail_out >= (compressed_length + 8)) {
     compressed = stream->next_out;
   } else {
-    if (s->output_buffer == NULL) {
-      s->output_buffer = malloc (compressed_length + 8);
-      s->output_buffer_size = compressed_length + 8;
+    if (s->output_buffer_size < snappy_max_compressed_length (SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX) + 8) {
+      uint8_t* output_buffer = squash_realloc (s->output_buffer, snappy_max_compressed_length (SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX) + 8);
+      if (SQUASH_UNLIKELY(output_buffer == NULL))
+        return squash_error (SQUASH_MEMORY);
+      s->output_buffer = output_buffer;
+      s->output_buffer_size = snappy_max_compressed_length (SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX) + 8;
     }
     compressed = s->output_buffer;
   }
 
-  uint32_t crc = squash_snappy_framed_generate_checksum(uncompressed, uncompressed_length);
-
-  snappy_status e =
-    snappy_compress ((char*) uncompressed, uncompressed_length,
-                     (char*) compressed + 8, &compressed_length);
-
-  compressed[4] = (crc >>  0) & 0xff;
-  compressed[5] = (crc >>  8) & 0xff;
-  compressed[6] = (crc >> 16) & 0xff;
-  compressed[7] = (crc >> 24) & 0xff;
-
-  if (e != SNAPPY_OK || compressed_length >= uncompressed_length) {
-    compressed[0] = SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_UNCOMPRESSED;
-    compressed_length = uncompressed_length;
-    memcpy (compressed + 8, uncompressed, uncompressed_length);
-  } else {
-    compressed[0] = SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_COMPRESSED;
-  }
-
-  compressed[1] = ((compressed_length + 4) >>  0) & 0xff;
-  compressed[2] = ((compressed_length + 4) >>  8) & 0xff;
-  compressed[3] = ((compressed_length + 4) >> 16) & 0xff;
+  compressed_length = squash_snappy_framed_encode_chunk (compressed, uncompressed, uncompressed_length) - 8;
 
   if (s->input_buffer_length != 0) {
     assert (s->input_buffer == uncompressed);
@@ -469,11 +545,14 @@ squash_snappy_framed_compress_chunk (SquashSnappyFramedStream* s) {
 
     s->state = SQUASH_SNAPPY_FRAMED_STATE_IDLE;
   }
+
+  return SQUASH_OK;
 }
 
 static SquashStatus
 squash_snappy_framed_compress_stream (SquashStream* stream, SquashOperation operation) {
   SquashSnappyFramedStream* s = (SquashSnappyFramedStream*) stream;
+  SquashStatus res;
 
   while (true) {
     if (s->state == SQUASH_SNAPPY_FRAMED_STATE_DRAINING) {
@@ -488,8 +567,10 @@ squash_snappy_framed_compress_stream (SquashStream* stream, SquashOperation oper
         s->state = SQUASH_SNAPPY_FRAMED_STATE_IDLE;
       } else {
         if (s->output_buffer == NULL) {
+          s->output_buffer = squash_malloc (snappy_max_compressed_length (SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX + 8));
+          if (SQUASH_UNLIKELY(s->output_buffer == NULL))
+            return squash_error (SQUASH_MEMORY);
           s->output_buffer_size = snappy_max_compressed_length (SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX + 8);
-          s->output_buffer = malloc (s->output_buffer_size);
         }
         memcpy (s->output_buffer, identifier, sizeof(identifier));
         s->output_buffer_length = sizeof(identifier);
@@ -499,13 +580,17 @@ squash_snappy_framed_compress_stream (SquashStream* stream, SquashOperation oper
     } else {
       if ((s->input_buffer_length != 0) ||
           (operation == SQUASH_OPERATION_PROCESS && stream->avail_in < SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX)) {
-        squash_snappy_framed_buffer (s);
+        res = squash_snappy_framed_buffer (s);
+        if (SQUASH_UNLIKELY(res != SQUASH_OK))
+          return res;
       }
 
       if ((operation != SQUASH_OPERATION_PROCESS) ||
           (s->input_buffer_length == SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX) ||
           (stream->avail_in >= SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX)) {
-        squash_snappy_framed_compress_chunk (s);
+        res = squash_snappy_framed_compress_chunk (s);
+        if (SQUASH_UNLIKELY(res != SQUASH_OK))
+          return res;
       }
     }
 
@@ -524,6 +609,7 @@ squash_snappy_framed_compress_stream (SquashStream* stream, SquashOperation oper
 static SquashStatus
 squash_snappy_framed_decompress_stream (SquashStream* stream, SquashOperation operation) {
   SquashSnappyFramedStream* s = (SquashSnappyFramedStream*) stream;
+  SquashStatus res;
 
   if (s->state == SQUASH_SNAPPY_FRAMED_STATE_INIT) {
     if (stream->avail_in == 0)
@@ -537,25 +623,31 @@ squash_snappy_framed_decompress_stream (SquashStream* stream, SquashOperation op
 
   while (true) {
     if (s->state == SQUASH_SNAPPY_FRAMED_STATE_IDLE) {
-      if (stream->avail_in >= 4) {
-        const size_t chunk_size = squash_snappy_framed_header_get_chunk_size (stream->next_in);
-        if (stream->avail_in >= 4 + chunk_size) {
-          if (!squash_snappy_framed_handle_chunk (s))
-            return SQUASH_FAILED;
-        } else {
-          squash_snappy_framed_buffer (s);
-        }
+      /* Whole chunks are decoded straight from next_in; only a chunk
+         which straddles two calls is copied into input_buffer. */
+      if (stream->avail_in >= 4 &&
+          stream->avail_in >= 4 + squash_snappy_framed_header_get_chunk_size (stream->next_in)) {
+        res = squash_snappy_framed_handle_chunk (s);
+        if (SQUASH_UNLIKELY(res != SQUASH_OK))
+          return res;
+      } else if (stream->avail_in != 0) {
+        res = squash_snappy_framed_buffer (s);
+        if (SQUASH_UNLIKELY(res != SQUASH_OK))
+          return res;
       }
     }
 
     if (s->state == SQUASH_SNAPPY_FRAMED_STATE_BUFFERING &&
         stream->avail_in != 0) {
-      squash_snappy_framed_buffer (s);
+      res = squash_snappy_framed_buffer (s);
+      if (SQUASH_UNLIKELY(res != SQUASH_OK))
+        return res;
       if (s->input_buffer_length >= 4) {
         const size_t chunk_size = squash_snappy_framed_header_get_chunk_size (s->input_buffer);
         if (s->input_buffer_length >= 4 + chunk_size) {
-          if (!squash_snappy_framed_handle_chunk (s))
-            return SQUASH_FAILED;
+          res = squash_snappy_framed_handle_chunk (s);
+          if (SQUASH_UNLIKELY(res != SQUASH_OK))
+            return res;
         }
       }
     }
@@ -581,15 +673,248 @@ squash_snappy_framed_process_stream (SquashStream* stream, SquashOperation opera
     return squash_snappy_framed_decompress_stream (stream, operation);
 }
 
+/* Chunks are independent, so between chunks the only state is
+ * whether the stream identifier has been handled yet; that's the
+ * whole checkpoint (one byte). */
+static SquashStatus
+squash_snappy_framed_checkpoint_stream (SquashStream* stream,
+                                        size_t* checkpoint_size,
+                                        uint8_t checkpoint[SQUASH_ARRAY_PARAM(*checkpoint_size)]) {
+  SquashSnappyFramedStream* s = (SquashSnappyFramedStream*) stream;
+
+  if (SQUASH_UNLIKELY(s->state != SQUASH_SNAPPY_FRAMED_STATE_INIT && s->state != SQUASH_SNAPPY_FRAMED_STATE_IDLE) ||
+      SQUASH_UNLIKELY(s->input_buffer_length != 0))
+    return squash_error (SQUASH_STATE);
+
+  if (checkpoint == NULL || *checkpoint_size < 1) {
+    *checkpoint_size = 1;
+    return squash_error (SQUASH_BUFFER_FULL);
+  }
+
+  checkpoint[0] = (s->state == SQUASH_SNAPPY_FRAMED_STATE_IDLE) ? 1 : 0;
+  *checkpoint_size = 1;
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_snappy_framed_restore_stream (SquashStream* stream,
+                                     size_t checkpoint_size,
+                                     const uint8_t checkpoint[SQUASH_ARRAY_PARAM(checkpoint_size)]) {
+  SquashSnappyFramedStream* s = (SquashSnappyFramedStream*) stream;
+
+  if (SQUASH_UNLIKELY(checkpoint_size != 1) || SQUASH_UNLIKELY(checkpoint[0] > 1))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  s->state = (checkpoint[0] == 1) ? SQUASH_SNAPPY_FRAMED_STATE_IDLE : SQUASH_SNAPPY_FRAMED_STATE_INIT;
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_snappy_framed_compress_chunk_at (size_t index, void* user_data) {
+  SquashSnappyFramedChunk* chunk = ((SquashSnappyFramedChunk*) user_data) + index;
+
+  chunk->output_size = squash_snappy_framed_encode_chunk (chunk->output, chunk->input, chunk->input_size);
+
+  return SQUASH_OK;
+}
+
+/* Chunks are independent, so the input is compressed in batches of a
+ * few chunks per thread, each into its own worst-case slot, and the
+ * results are copied out in order.  The output is the same as the
+ * stream produces, regardless of the number of threads. */
+static SquashStatus
+squash_snappy_framed_compress_buffer (SquashCodec* codec,
+                                      size_t* compressed_size,
+                                      uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                                      size_t uncompressed_size,
+                                      const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                                      SquashOptions* options) {
+  const unsigned int threads = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_SNAPPY_FRAMED_OPT_THREADS);
+  const size_t batch_size = ((threads == 0) ? squash_get_max_threads () : threads) * SQUASH_SNAPPY_FRAMED_BATCH_CHUNKS;
+  const size_t slot_size = snappy_max_compressed_length (SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX) + 8;
+  SquashSnappyFramedChunk* chunks = NULL;
+  uint8_t* slots = NULL;
+  SquashStatus res = SQUASH_OK;
+  size_t pos = 0;
+
+  if (SQUASH_UNLIKELY(*compressed_size < sizeof(squash_snappy_framed_identifier)))
+    return squash_error (SQUASH_BUFFER_FULL);
+
+  memcpy (compressed, squash_snappy_framed_identifier, sizeof(squash_snappy_framed_identifier));
+  pos += sizeof(squash_snappy_framed_identifier);
+
+  chunks = squash_calloc (batch_size, sizeof (SquashSnappyFramedChunk));
+  slots = squash_malloc (batch_size * slot_size);
+  if (SQUASH_UNLIKELY(chunks == NULL || slots == NULL)) {
+    res = squash_error (SQUASH_MEMORY);
+    goto cleanup;
+  }
+
+  for (size_t offset = 0 ; offset < uncompressed_size ; ) {
+    size_t n_chunks = 0;
+
+    for ( ; n_chunks < batch_size && offset < uncompressed_size ; n_chunks++) {
+      SquashSnappyFramedChunk* chunk = &(chunks[n_chunks]);
+      chunk->input = uncompressed + offset;
+      chunk->input_size = ((uncompressed_size - offset) < SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX) ? (uncompressed_size - offset) : SQUASH_SNAPPY_FRAMED_UNCOMPRESSED_MAX;
+      chunk->output = slots + (n_chunks * slot_size);
+      offset += chunk->input_size;
+    }
+
+    res = squash_parallel_for (threads, n_chunks, squash_snappy_framed_compress_chunk_at, chunks);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      goto cleanup;
+
+    for (size_t i = 0 ; i < n_chunks ; i++) {
+      if (SQUASH_UNLIKELY((*compressed_size - pos) < chunks[i].output_size)) {
+        res = squash_error (SQUASH_BUFFER_FULL);
+        goto cleanup;
+      }
+
+      memcpy (compressed + pos, chunks[i].output, chunks[i].output_size);
+      pos += chunks[i].output_size;
+    }
+  }
+
+  *compressed_size = pos;
+
+ cleanup:
+  squash_free (slots);
+  squash_free (chunks);
+
+  return res;
+}
+
+/* Walk the chunk headers in a buffer.  If chunks is NULL only count
+ * the data chunks; returns the number of data chunks, or
+ * (size_t) -1 if the data is invalid.  Each chunk's input points at
+ * its header, and output_size is its decompressed length. */
+static size_t
+squash_snappy_framed_parse_chunks (size_t compressed_size,
+                                   const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                                   SquashSnappyFramedChunk* chunks,
+                                   size_t* decompressed_size) {
+  size_t n_chunks = 0;
+  size_t pos = 0;
+  size_t total = 0;
+
+  if (compressed_size < sizeof(squash_snappy_framed_identifier) ||
+      memcmp (compressed, squash_snappy_framed_identifier, sizeof(squash_snappy_framed_identifier)) != 0)
+    return (size_t) -1;
+
+  while (pos < compressed_size) {
+    const uint8_t* header = compressed + pos;
+
+    if ((compressed_size - pos) < 4)
+      return (size_t) -1;
+
+    const size_t chunk_size = squash_snappy_framed_header_get_chunk_size (header);
+    if ((compressed_size - pos - 4) < chunk_size)
+      return (size_t) -1;
+
+    if (header[0] == SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_IDENTIFIER) {
+      if (chunk_size + 4 != sizeof(squash_snappy_framed_identifier) ||
+          memcmp (header, squash_snappy_framed_identifier, sizeof(squash_snappy_framed_identifier)) != 0)
+        return (size_t) -1;
+    } else if (header[0] == SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_COMPRESSED ||
+               header[0] == SQUASH_SNAPPY_FRAMED_CHUNK_TYPE_UNCOMPRESSED) {
+      size_t decompressed_length;
+
+      if (!squash_snappy_framed_chunk_get_decompressed_length (header, &decompressed_length))
+        return (size_t) -1;
+
+      if (chunks != NULL) {
+        chunks[n_chunks].input = header;
+        chunks[n_chunks].input_size = chunk_size + 4;
+        chunks[n_chunks].output_size = decompressed_length;
+      }
+
+      n_chunks++;
+      total += decompressed_length;
+    } else if (!squash_snappy_framed_header_skippable (header)) {
+      return (size_t) -1;
+    }
+
+    pos += chunk_size + 4;
+  }
+
+  if (decompressed_size != NULL)
+    *decompressed_size = total;
+
+  return n_chunks;
+}
+
+static SquashStatus
+squash_snappy_framed_decompress_chunk_at (size_t index, void* user_data) {
+  SquashSnappyFramedChunk* chunk = ((SquashSnappyFramedChunk*) user_data) + index;
+
+  if (SQUASH_UNLIKELY(!squash_snappy_framed_decode_chunk (chunk->input, chunk->output, chunk->output_size)))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  return SQUASH_OK;
+}
+
+/* The chunk headers give the size of every chunk up front, so each
+ * one can be decompressed straight into its final position, in
+ * parallel. */
+static SquashStatus
+squash_snappy_framed_decompress_buffer (SquashCodec* codec,
+                                        size_t* decompressed_size,
+                                        uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                                        size_t compressed_size,
+                                        const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                                        SquashOptions* options) {
+  size_t total;
+  const size_t n_chunks = squash_snappy_framed_parse_chunks (compressed_size, compressed, NULL, &total);
+
+  if (SQUASH_UNLIKELY(n_chunks == (size_t) -1))
+    return squash_error (SQUASH_INVALID_BUFFER);
+  if (SQUASH_UNLIKELY(total > *decompressed_size))
+    return squash_error (SQUASH_BUFFER_FULL);
+
+  if (n_chunks == 0) {
+    *decompressed_size = 0;
+    return SQUASH_OK;
+  }
+
+  SquashSnappyFramedChunk* chunks = squash_calloc (n_chunks, sizeof (SquashSnappyFramedChunk));
+  if (SQUASH_UNLIKELY(chunks == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  squash_snappy_framed_parse_chunks (compressed_size, compressed, chunks, NULL);
+
+  size_t offset = 0;
+  for (size_t i = 0 ; i < n_chunks ; i++) {
+    chunks[i].output = decompressed + offset;
+    offset += chunks[i].output_size;
+  }
+
+  SquashStatus res = squash_parallel_for ((unsigned int) squash_options_get_int_at (options, codec, SQUASH_SNAPPY_FRAMED_OPT_THREADS),
+                                          n_chunks, squash_snappy_framed_decompress_chunk_at, chunks);
+  if (SQUASH_LIKELY(res == SQUASH_OK))
+    *decompressed_size = total;
+
+  squash_free (chunks);
+
+  return res;
+}
+
 SquashStatus
 squash_plugin_init_snappy_framed_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   const char* name = squash_codec_get_name (codec);
 
   if (strcmp ("snappy-framed", name) == 0) {
     impl->info = SQUASH_CODEC_INFO_CAN_FLUSH;
+    impl->options = squash_snappy_framed_options;
     impl->get_max_compressed_size = squash_snappy_framed_get_max_compressed_size;
     impl->create_stream = squash_snappy_framed_create_stream;
     impl->process_stream = squash_snappy_framed_process_stream;
+    impl->checkpoint_stream = squash_snappy_framed_checkpoint_stream;
+    impl->restore_stream = squash_snappy_framed_restore_stream;
+    impl->compress_buffer = squash_snappy_framed_compress_buffer;
+    impl->decompress_buffer = squash_snappy_framed_decompress_buffer;
   } else {
     return SQUASH_UNABLE_TO_LOAD;
   }
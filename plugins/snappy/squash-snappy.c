@@ -115,10 +115,8 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->get_max_compressed_size = squash_snappy_get_max_compressed_size;
     impl->decompress_buffer = squash_snappy_decompress_buffer;
     impl->compress_buffer = squash_snappy_compress_buffer;
-#if defined(SQUASH_SNAPPY_ENABLE_FRAMED)
   } else if (strcmp ("snappy-framed", name) == 0) {
-    return squash_plugin_init_snappy_framed (codec, imp);
-#endif
+    return squash_plugin_init_snappy_framed_codec (codec, impl);
   } else {
     return SQUASH_UNABLE_TO_LOAD;
   }
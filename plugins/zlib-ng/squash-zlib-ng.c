@@ -165,6 +165,8 @@ squash_zlib_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squash
   assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
 
   stream = squash_malloc (sizeof (SquashZlibStream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
   squash_zlib_stream_init (stream, codec, stream_type, options, squash_zlib_stream_destroy);
 
   stream->type = squash_zlib_codec_to_type (codec);
@@ -201,6 +203,16 @@ squash_zlib_create_stream (SquashCodec* codec, SquashStreamType stream_type, Squ
   return (SquashStream*) squash_zlib_stream_new (codec, stream_type, options);
 }
 
+static SquashStatus
+squash_zlib_reset_stream (SquashStream* stream) {
+  SquashZlibStream* s = (SquashZlibStream*) stream;
+  const int zlib_e = (stream->stream_type == SQUASH_STREAM_COMPRESS) ?
+    deflateReset (&(s->stream)) :
+    inflateReset (&(s->stream));
+
+  return SQUASH_LIKELY(zlib_e == Z_OK) ? SQUASH_OK : squash_error (SQUASH_FAILED);
+}
+
 #define SQUASH_ZLIB_STREAM_COPY_TO_ZLIB_STREAM(stream,zlib_stream) \
   zlib_stream->next_in = (Bytef*) stream->next_in; \
   zlib_stream->avail_in = (uInt) stream->avail_in; \
@@ -354,6 +366,19 @@ squash_zlib_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_siz
   }
 }
 
+static size_t
+squash_zlib_get_memory_usage (SquashCodec* codec, SquashOptions* options, SquashStreamType stream_type) {
+  const int window_bits = squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_WINDOW_BITS);
+
+  /* Figures from zlib's zconf.h, plus a bit for the stream state. */
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    const int mem_level = squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_MEM_LEVEL);
+    return (((size_t) 1) << (window_bits + 2)) + (((size_t) 1) << (mem_level + 9)) + (6 * 1024);
+  } else {
+    return (((size_t) 1) << window_bits) + (7 * 1024);
+  }
+}
+
 SquashStatus
 squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   const char* name = squash_codec_get_name (codec);
@@ -365,7 +390,9 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->options = squash_zlib_options;
     impl->create_stream = squash_zlib_create_stream;
     impl->process_stream = squash_zlib_process_stream;
+    impl->reset_stream = squash_zlib_reset_stream;
     impl->get_max_compressed_size = squash_zlib_get_max_compressed_size;
+    impl->get_memory_usage = squash_zlib_get_memory_usage;
   } else {
     return SQUASH_UNABLE_TO_LOAD;
   }
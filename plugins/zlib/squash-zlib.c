@@ -24,7 +24,12 @@
  *   Evan Nemerson <evan@nemerson.com>
  */
 
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200112L
+
 #include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
@@ -44,18 +49,81 @@ typedef struct SquashZlibStream_s {
 
   SquashZlibType type;
   z_stream stream;
+
+  /* Set when a compression stream was restored from a checkpoint.
+     zlib can't continue a wrapped stream, so it carries on as raw
+     deflate and the checksum and trailer are handled here. */
+  bool resumed;
+  uLong check;
+  uLong size;
+  uint8_t trailer[8];
+  size_t trailer_length;
+  size_t trailer_pos;
 } SquashZlibStream;
 
 #define SQUASH_ZLIB_DEFAULT_LEVEL 6
 #define SQUASH_ZLIB_DEFAULT_WINDOW_BITS 15
 #define SQUASH_ZLIB_DEFAULT_MEM_LEVEL 8
 #define SQUASH_ZLIB_DEFAULT_STRATEGY Z_DEFAULT_STRATEGY
+#define SQUASH_ZLIB_DEFAULT_BLOCK_SIZE (128 * 1024)
+#define SQUASH_ZLIB_MIN_BLOCK_SIZE (32 * 1024)
+
+/* Extra bytes each parallel block may need beyond what deflateBound
+   allows for: the stored block header plus the empty stored block
+   emitted by the sync flush. */
+#define SQUASH_ZLIB_BLOCK_OVERHEAD 16
+
+#if defined(_WIN32)
+typedef __int64 squash_zlib_off_t;
+#  define squash_zlib_fseek _fseeki64
+#  define squash_zlib_ftell _ftelli64
+#else
+typedef off_t squash_zlib_off_t;
+#  define squash_zlib_fseek fseeko
+#  define squash_zlib_ftell ftello
+#endif
+
+/* Random access index, in the style of zlib's examples/zran.c.
+ *
+ * The index starts with a 16 byte header: an 8 byte magic number,
+ * a version, the SquashZlibType, and 6 reserved bytes.  It is
+ * followed by the dictionaries for each checkpoint (the preceding
+ * 32 KiB of output, as raw deflate data), then a table of 32 byte
+ * entries, and finally a 24 byte trailer with the offset of the
+ * table, the total uncompressed size, and the number of entries.
+ * Each entry holds the uncompressed and compressed offsets of the
+ * checkpoint, the offset and compressed size of its dictionary, the
+ * uncompressed size of the dictionary, and the number of bits of the
+ * byte before the compressed offset which belong to the checkpoint.
+ * All integers are little-endian.  The table is at the end so the
+ * index can be written in a single pass, and entries are a fixed
+ * size so a checkpoint can be located with a binary search. */
+#define SQUASH_ZLIB_INDEX_VERSION 1
+#define SQUASH_ZLIB_INDEX_HEADER_SIZE 16
+#define SQUASH_ZLIB_INDEX_ENTRY_SIZE 32
+#define SQUASH_ZLIB_INDEX_TRAILER_SIZE 24
+#define SQUASH_ZLIB_INDEX_WINDOW_SIZE 32768
+#define SQUASH_ZLIB_INDEX_DEFAULT_SPAN (1024 * 1024)
+#define SQUASH_ZLIB_INDEX_CHUNK_SIZE 16384
+
+static const uint8_t squash_zlib_index_magic[8] = { 0x89, 'S', 'Q', 'I', 'D', 'X', '\r', '\n' };
+
+typedef struct SquashZlibIndexEntry_ {
+  uint64_t uncompressed_offset;
+  uint64_t compressed_offset;
+  uint64_t window_offset;
+  uint32_t window_compressed_size;
+  uint16_t window_size;
+  uint8_t bits;
+} SquashZlibIndexEntry;
 
 enum SquashZlibOptIndex {
   SQUASH_ZLIB_OPT_LEVEL = 0,
   SQUASH_ZLIB_OPT_WINDOW_BITS,
   SQUASH_ZLIB_OPT_MEM_LEVEL,
-  SQUASH_ZLIB_OPT_STRATEGY
+  SQUASH_ZLIB_OPT_STRATEGY,
+  SQUASH_ZLIB_OPT_THREADS,
+  SQUASH_ZLIB_OPT_BLOCK_SIZE
 };
 
 static SquashOptionInfo squash_zlib_options[] = {
@@ -88,9 +156,40 @@ static SquashOptionInfo squash_zlib_options[] = {
         { "fixed", Z_FIXED },
         { NULL, 0 } } },
     .default_value.int_value = SQUASH_ZLIB_DEFAULT_STRATEGY },
+  { "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 256 },
+    .default_value.int_value = 1 },
+  { "block-size",
+    SQUASH_OPTION_TYPE_RANGE_SIZE,
+    .info.range_size = {
+      .min = SQUASH_ZLIB_MIN_BLOCK_SIZE,
+      .max = 64 * 1024 * 1024 },
+    .default_value.size_value = SQUASH_ZLIB_DEFAULT_BLOCK_SIZE },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
+typedef struct SquashZlibBlock_ {
+  const uint8_t* input;
+  size_t input_size;
+  uint8_t* output;
+  size_t output_size;
+  uLong check;
+} SquashZlibBlock;
+
+typedef struct SquashZlibParallel_ {
+  SquashZlibType type;
+  int level;
+  int window_bits;
+  int mem_level;
+  int strategy;
+  const uint8_t* input;
+  SquashZlibBlock* blocks;
+  size_t n_blocks;
+} SquashZlibParallel;
+
 SQUASH_PLUGIN_EXPORT
 SquashStatus              squash_plugin_init_codec   (SquashCodec* codec, SquashCodecImpl* impl);
 
@@ -127,6 +226,17 @@ static SquashZlibType squash_zlib_codec_to_type (SquashCodec* codec) {
   }
 }
 
+static int
+squash_zlib_window_bits (SquashZlibType type, int window_bits) {
+  if (type == SQUASH_ZLIB_TYPE_DEFLATE) {
+    return -window_bits;
+  } else if (type == SQUASH_ZLIB_TYPE_GZIP) {
+    return window_bits + 16;
+  } else {
+    return window_bits;
+  }
+}
+
 static void
 squash_zlib_stream_init (SquashZlibStream* stream,
                          SquashCodec* codec,
@@ -139,6 +249,12 @@ squash_zlib_stream_init (SquashZlibStream* stream,
   stream->stream = tmp;
   stream->stream.zalloc = squash_zlib_malloc;
   stream->stream.zfree  = squash_zlib_free;
+
+  stream->resumed = false;
+  stream->check = 0;
+  stream->size = 0;
+  stream->trailer_length = 0;
+  stream->trailer_pos = 0;
 }
 
 static void
@@ -155,6 +271,19 @@ squash_zlib_stream_destroy (void* stream) {
   squash_stream_destroy (stream);
 }
 
+static int
+squash_zlib_stream_deflate_init (SquashZlibStream* stream, SquashZlibType type) {
+  SquashCodec* codec = ((SquashStream*) stream)->codec;
+  SquashOptions* options = ((SquashStream*) stream)->options;
+
+  return deflateInit2 (&(stream->stream),
+                       squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_LEVEL),
+                       Z_DEFLATED,
+                       squash_zlib_window_bits (type, squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_WINDOW_BITS)),
+                       squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_MEM_LEVEL),
+                       squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_STRATEGY));
+}
+
 static SquashZlibStream*
 squash_zlib_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
   int zlib_e = 0;
@@ -165,24 +294,16 @@ squash_zlib_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squash
   assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
 
   stream = squash_malloc (sizeof (SquashZlibStream));
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
   squash_zlib_stream_init (stream, codec, stream_type, options, squash_zlib_stream_destroy);
 
   stream->type = squash_zlib_codec_to_type (codec);
 
-  window_bits = squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_WINDOW_BITS);
-  if (stream->type == SQUASH_ZLIB_TYPE_DEFLATE) {
-    window_bits = -window_bits;
-  } else if (stream->type == SQUASH_ZLIB_TYPE_GZIP) {
-    window_bits += 16;
-  }
+  window_bits = squash_zlib_window_bits (stream->type, squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_WINDOW_BITS));
 
   if (stream_type == SQUASH_STREAM_COMPRESS) {
-    zlib_e = deflateInit2 (&(stream->stream),
-                           squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_LEVEL),
-                           Z_DEFLATED,
-                           window_bits,
-                           squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_MEM_LEVEL),
-                           squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_STRATEGY));
+    zlib_e = squash_zlib_stream_deflate_init (stream, stream->type);
   } else if (stream_type == SQUASH_STREAM_DECOMPRESS) {
     zlib_e = inflateInit2 (&(stream->stream), window_bits);
   } else {
@@ -201,6 +322,139 @@ squash_zlib_create_stream (SquashCodec* codec, SquashStreamType stream_type, Squ
   return (SquashStream*) squash_zlib_stream_new (codec, stream_type, options);
 }
 
+static SquashStatus
+squash_zlib_reset_stream (SquashStream* stream) {
+  SquashZlibStream* s = (SquashZlibStream*) stream;
+  int zlib_e;
+
+  if (s->resumed) {
+    deflateEnd (&(s->stream));
+    zlib_e = squash_zlib_stream_deflate_init (s, s->type);
+
+    s->resumed = false;
+    s->check = 0;
+    s->size = 0;
+    s->trailer_length = 0;
+    s->trailer_pos = 0;
+  } else if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
+    zlib_e = deflateReset (&(s->stream));
+  } else {
+    zlib_e = inflateReset (&(s->stream));
+  }
+
+  return SQUASH_LIKELY(zlib_e == Z_OK) ? SQUASH_OK : squash_error (SQUASH_FAILED);
+}
+
+static void
+squash_zlib_write_u32 (uint8_t* dest, uLong value, bool big_endian) {
+  for (size_t i = 0 ; i < 4 ; i++)
+    dest[big_endian ? (3 - i) : i] = (uint8_t) ((value >> (8 * i)) & 0xff);
+}
+
+static uLong
+squash_zlib_read_u32 (const uint8_t* src) {
+  return
+    (((uLong) src[0]) <<  0) | (((uLong) src[1]) <<  8) |
+    (((uLong) src[2]) << 16) | (((uLong) src[3]) << 24);
+}
+
+/* A compression checkpoint is a flags byte (bit 0 set once the header
+ * has been written), the running checksum and the input size modulo
+ * 2^32 (little-endian), and the sliding window.  Restoring it sets the window as a preset dictionary
+ * on a raw deflate stream, so the output continues the earlier stream
+ * byte for byte after its last sync flush. */
+#define SQUASH_ZLIB_CHECKPOINT_HEADER_SIZE 9
+
+static SquashStatus
+squash_zlib_checkpoint_stream (SquashStream* stream,
+                               size_t* checkpoint_size,
+                               uint8_t checkpoint[SQUASH_ARRAY_PARAM(*checkpoint_size)]) {
+#if ZLIB_VERNUM >= 0x1290
+  SquashZlibStream* s = (SquashZlibStream*) stream;
+  unsigned int pending = 0;
+  int bits = 0;
+
+  if (stream->stream_type != SQUASH_STREAM_COMPRESS)
+    return squash_error (SQUASH_INVALID_OPERATION);
+
+  if (SQUASH_UNLIKELY(deflatePending (&(s->stream), &pending, &bits) != Z_OK))
+    return squash_error (SQUASH_FAILED);
+  if (SQUASH_UNLIKELY(pending != 0 || bits != 0))
+    return squash_error (SQUASH_STATE);
+
+  uInt window_size = 0;
+  if (SQUASH_UNLIKELY(deflateGetDictionary (&(s->stream), NULL, &window_size) != Z_OK))
+    return squash_error (SQUASH_FAILED);
+
+  const size_t required = SQUASH_ZLIB_CHECKPOINT_HEADER_SIZE + (size_t) window_size;
+  if (checkpoint == NULL || *checkpoint_size < required) {
+    *checkpoint_size = required;
+    return squash_error (SQUASH_BUFFER_FULL);
+  }
+
+  const bool started = s->resumed || s->stream.total_out != 0;
+  checkpoint[0] = started ? 1 : 0;
+  squash_zlib_write_u32 (checkpoint + 1, s->resumed ? s->check : s->stream.adler, false);
+  squash_zlib_write_u32 (checkpoint + 5, (s->resumed ? s->size : s->stream.total_in) & 0xffffffff, false);
+  if (SQUASH_UNLIKELY(deflateGetDictionary (&(s->stream), checkpoint + SQUASH_ZLIB_CHECKPOINT_HEADER_SIZE, &window_size) != Z_OK))
+    return squash_error (SQUASH_FAILED);
+
+  *checkpoint_size = SQUASH_ZLIB_CHECKPOINT_HEADER_SIZE + (size_t) window_size;
+
+  return SQUASH_OK;
+#else
+  /* deflateGetDictionary is new in zlib 1.2.9. */
+  return squash_error (SQUASH_INVALID_OPERATION);
+#endif
+}
+
+static SquashStatus
+squash_zlib_restore_stream (SquashStream* stream,
+                            size_t checkpoint_size,
+                            const uint8_t checkpoint[SQUASH_ARRAY_PARAM(checkpoint_size)]) {
+  SquashZlibStream* s = (SquashZlibStream*) stream;
+
+  if (stream->stream_type != SQUASH_STREAM_COMPRESS)
+    return squash_error (SQUASH_INVALID_OPERATION);
+
+  if (SQUASH_UNLIKELY(checkpoint_size < SQUASH_ZLIB_CHECKPOINT_HEADER_SIZE) ||
+      SQUASH_UNLIKELY(checkpoint_size - SQUASH_ZLIB_CHECKPOINT_HEADER_SIZE > 32768) ||
+      SQUASH_UNLIKELY((checkpoint[0] & ~1) != 0))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  if (checkpoint[0] == 0)
+    return SQUASH_OK;
+
+  deflateEnd (&(s->stream));
+  int zlib_e = squash_zlib_stream_deflate_init (s, SQUASH_ZLIB_TYPE_DEFLATE);
+  if (zlib_e == Z_OK && checkpoint_size > SQUASH_ZLIB_CHECKPOINT_HEADER_SIZE)
+    zlib_e = deflateSetDictionary (&(s->stream),
+                                   checkpoint + SQUASH_ZLIB_CHECKPOINT_HEADER_SIZE,
+                                   (uInt) (checkpoint_size - SQUASH_ZLIB_CHECKPOINT_HEADER_SIZE));
+  if (SQUASH_UNLIKELY(zlib_e != Z_OK))
+    return squash_error (zlib_e == Z_MEM_ERROR ? SQUASH_MEMORY : SQUASH_FAILED);
+
+  s->resumed = true;
+  s->check = squash_zlib_read_u32 (checkpoint + 1);
+  s->size = squash_zlib_read_u32 (checkpoint + 5);
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_zlib_write_trailer (SquashZlibStream* s) {
+  SquashStream* stream = (SquashStream*) s;
+  const size_t remaining = s->trailer_length - s->trailer_pos;
+  const size_t cp_size = (remaining < stream->avail_out) ? remaining : stream->avail_out;
+
+  memcpy (stream->next_out, s->trailer + s->trailer_pos, cp_size);
+  stream->next_out += cp_size;
+  stream->avail_out -= cp_size;
+  s->trailer_pos += cp_size;
+
+  return (s->trailer_pos == s->trailer_length) ? SQUASH_OK : SQUASH_PROCESSING;
+}
+
 #define SQUASH_ZLIB_STREAM_COPY_TO_ZLIB_STREAM(stream,zlib_stream) \
   zlib_stream->next_in = (Bytef*) stream->next_in; \
   zlib_stream->avail_in = (uInt) stream->avail_in; \
@@ -238,7 +492,13 @@ squash_zlib_process_stream (SquashStream* stream, SquashOperation operation) {
 
   assert (stream != NULL);
 
-  zlib_stream = &(((SquashZlibStream*) stream)->stream);
+  SquashZlibStream* s = (SquashZlibStream*) stream;
+  zlib_stream = &(s->stream);
+
+  if (s->trailer_length != 0)
+    return squash_zlib_write_trailer (s);
+
+  const uint8_t* next_in = stream->next_in;
 
 #if UINT_MAX < SIZE_MAX
   if (SQUASH_UNLIKELY(UINT_MAX < stream->avail_in) ||
@@ -260,6 +520,34 @@ squash_zlib_process_stream (SquashStream* stream, SquashOperation operation) {
 #endif
   SQUASH_ZLIB_STREAM_COPY_FROM_ZLIB_STREAM(stream, zlib_stream);
 
+  if (s->resumed && s->type != SQUASH_ZLIB_TYPE_DEFLATE) {
+    const uInt consumed = (uInt) (stream->next_in - next_in);
+
+    /* crc32 and adler32 return the initial value for a NULL buffer,
+       so calls which consume nothing (finish with next_in == NULL)
+       must leave the running check alone. */
+    if (consumed != 0) {
+      s->size = (s->size + consumed) & 0xffffffff;
+      if (s->type == SQUASH_ZLIB_TYPE_GZIP)
+        s->check = crc32 (s->check, next_in, consumed);
+      else
+        s->check = adler32 (s->check, next_in, consumed);
+    }
+
+    if (zlib_e == Z_STREAM_END) {
+      if (s->type == SQUASH_ZLIB_TYPE_GZIP) {
+        squash_zlib_write_u32 (s->trailer, s->check, false);
+        squash_zlib_write_u32 (s->trailer + 4, s->size, false);
+        s->trailer_length = 8;
+      } else {
+        squash_zlib_write_u32 (s->trailer, s->check, true);
+        s->trailer_length = 4;
+      }
+
+      return squash_zlib_write_trailer (s);
+    }
+  }
+
   switch (zlib_e) {
     case Z_OK:
       switch (operation) {
@@ -311,46 +599,789 @@ squash_zlib_process_stream (SquashStream* stream, SquashOperation operation) {
   return res;
 }
 
+/* deflateBound for a stream set up with the given parameters; the
+ * bound depends on the window and memory level, so callers which know
+ * the options should pass the real ones.  Returns 0 on failure. */
+static size_t
+squash_zlib_deflate_bound (SquashZlibType type, int level, int window_bits, int mem_level, int strategy, size_t uncompressed_size) {
+  z_stream stream = { 0, };
+  stream.zalloc = squash_zlib_malloc;
+  stream.zfree = squash_zlib_free;
+
+#if SIZE_MAX > ULONG_MAX
+  if (SQUASH_UNLIKELY(uncompressed_size > ULONG_MAX))
+    return 0;
+#endif
+
+  if (deflateInit2 (&stream, level, Z_DEFLATED, squash_zlib_window_bits (type, window_bits), mem_level, strategy) != Z_OK)
+    return 0;
+
+  const size_t bound = (size_t) deflateBound (&stream, (uLong) uncompressed_size);
+
+  deflateEnd (&stream);
+
+  return bound;
+}
+
 static size_t
 squash_zlib_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
-  SquashZlibType type = squash_zlib_codec_to_type (codec);
+  const size_t block_overhead = ((uncompressed_size / SQUASH_ZLIB_MIN_BLOCK_SIZE) + 1) * SQUASH_ZLIB_BLOCK_OVERHEAD;
 
-#if SIZE_MAX < ULONG_MAX
+#if SIZE_MAX > ULONG_MAX
   if (SQUASH_UNLIKELY(uncompressed_size > ULONG_MAX)) {
     squash_error (SQUASH_BUFFER_TOO_LARGE);
     return 0;
   }
 #endif
 
-  if (type == SQUASH_ZLIB_TYPE_ZLIB) {
-    return (size_t) compressBound ((uLong) uncompressed_size);
-  } else {
-    z_stream stream = { 0, };
-    size_t max_compressed_size;
-    int zlib_e;
-
-    int window_bits = 14;
-    if (type == SQUASH_ZLIB_TYPE_DEFLATE) {
-      window_bits = -window_bits;
-    } else if (type == SQUASH_ZLIB_TYPE_GZIP) {
-      window_bits += 16;
+  /* The options aren't known here, so use the parameters deflateBound
+     is most pessimistic about: a small window with a large hash. */
+  const size_t max_compressed_size =
+    squash_zlib_deflate_bound (squash_zlib_codec_to_type (codec), 1, 9, 9, Z_DEFAULT_STRATEGY, uncompressed_size);
+  if (SQUASH_UNLIKELY(max_compressed_size == 0))
+    return 0;
+
+  /* Output from squash_zlib_compress_parallel has a little overhead
+     for every block. */
+  return max_compressed_size + block_overhead;
+}
+
+static SquashStatus
+squash_zlib_compress_single (SquashCodec* codec,
+                             size_t* compressed_size,
+                             uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                             size_t uncompressed_size,
+                             const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                             SquashOptions* options) {
+  z_stream stream = { 0, };
+  stream.zalloc = squash_zlib_malloc;
+  stream.zfree = squash_zlib_free;
+
+#if UINT_MAX < SIZE_MAX
+  if (SQUASH_UNLIKELY(UINT_MAX < uncompressed_size) ||
+      SQUASH_UNLIKELY(UINT_MAX < *compressed_size))
+    return squash_error (SQUASH_RANGE);
+#endif
+
+  int zlib_e = deflateInit2 (&stream,
+                             squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_LEVEL),
+                             Z_DEFLATED,
+                             squash_zlib_window_bits (squash_zlib_codec_to_type (codec),
+                                                      squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_WINDOW_BITS)),
+                             squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_MEM_LEVEL),
+                             squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_STRATEGY));
+  if (SQUASH_UNLIKELY(zlib_e != Z_OK))
+    return squash_error ((zlib_e == Z_MEM_ERROR) ? SQUASH_MEMORY : SQUASH_FAILED);
+
+  stream.next_in = (Bytef*) uncompressed;
+  stream.avail_in = (uInt) uncompressed_size;
+  stream.next_out = (Bytef*) compressed;
+  stream.avail_out = (uInt) *compressed_size;
+
+  zlib_e = deflate (&stream, Z_FINISH);
+  *compressed_size = (size_t) stream.total_out;
+  deflateEnd (&stream);
+
+  switch (zlib_e) {
+    case Z_STREAM_END:
+      return SQUASH_OK;
+    case Z_OK:
+    case Z_BUF_ERROR:
+      return squash_error (SQUASH_BUFFER_FULL);
+    case Z_MEM_ERROR:
+      return squash_error (SQUASH_MEMORY);
+    default:
+      return squash_error (SQUASH_FAILED);
+  }
+}
+
+/* Compress one block as raw deflate, primed with the end of the
+ * previous block as a preset dictionary.  Every block but the last
+ * ends with a sync flush, so it finishes on a byte boundary and the
+ * blocks can simply be concatenated. */
+static SquashStatus
+squash_zlib_compress_block (size_t index, void* user_data) {
+  SquashZlibParallel* p = (SquashZlibParallel*) user_data;
+  SquashZlibBlock* block = &(p->blocks[index]);
+  z_stream stream = { 0, };
+  stream.zalloc = squash_zlib_malloc;
+  stream.zfree = squash_zlib_free;
+
+  int zlib_e = deflateInit2 (&stream, p->level, Z_DEFLATED, -(p->window_bits), p->mem_level, p->strategy);
+  if (SQUASH_UNLIKELY(zlib_e != Z_OK))
+    return squash_error ((zlib_e == Z_MEM_ERROR) ? SQUASH_MEMORY : SQUASH_FAILED);
+
+  const size_t window_size = ((size_t) 1) << p->window_bits;
+  const size_t offset = (size_t) (block->input - p->input);
+  if (offset != 0) {
+    const size_t dict_size = (offset < window_size) ? offset : window_size;
+    zlib_e = deflateSetDictionary (&stream, block->input - dict_size, (uInt) dict_size);
+  }
+
+  if (SQUASH_LIKELY(zlib_e == Z_OK)) {
+    stream.next_in = (Bytef*) block->input;
+    stream.avail_in = (uInt) block->input_size;
+    stream.next_out = (Bytef*) block->output;
+    stream.avail_out = (uInt) block->output_size;
+
+    const int flush = (index == (p->n_blocks - 1)) ? Z_FINISH : Z_SYNC_FLUSH;
+    zlib_e = deflate (&stream, flush);
+    if (flush == Z_FINISH ? (zlib_e == Z_STREAM_END) : (zlib_e == Z_OK && stream.avail_in == 0 && stream.avail_out != 0))
+      zlib_e = Z_OK;
+    else if (zlib_e != Z_MEM_ERROR)
+      zlib_e = Z_BUF_ERROR;
+
+    block->output_size = (size_t) stream.total_out;
+  }
+
+  deflateEnd (&stream);
+
+  if (SQUASH_UNLIKELY(zlib_e != Z_OK))
+    return squash_error ((zlib_e == Z_MEM_ERROR) ? SQUASH_MEMORY : SQUASH_FAILED);
+
+  if (p->type == SQUASH_ZLIB_TYPE_GZIP)
+    block->check = crc32 (crc32 (0L, Z_NULL, 0), block->input, (uInt) block->input_size);
+  else if (p->type == SQUASH_ZLIB_TYPE_ZLIB)
+    block->check = adler32 (adler32 (0L, Z_NULL, 0), block->input, (uInt) block->input_size);
+
+  return SQUASH_OK;
+}
+
+/* pigz-style parallel compression: the input is split into blocks
+ * which are deflated concurrently and stitched together into a single
+ * stream, with the checksum assembled using crc32_combine or
+ * adler32_combine.  The block layout depends only on the block-size
+ * option, so the output is the same no matter how many threads are
+ * actually available. */
+static SquashStatus
+squash_zlib_compress_parallel (SquashCodec* codec,
+                               size_t* compressed_size,
+                               uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                               size_t uncompressed_size,
+                               const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                               SquashOptions* options) {
+  const size_t block_size = squash_options_get_size_at (options, codec, SQUASH_ZLIB_OPT_BLOCK_SIZE);
+  SquashZlibParallel p = {
+    squash_zlib_codec_to_type (codec),
+    squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_LEVEL),
+    squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_WINDOW_BITS),
+    squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_MEM_LEVEL),
+    squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_STRATEGY),
+    uncompressed,
+    NULL,
+    (uncompressed_size == 0) ? 1 : ((uncompressed_size + (block_size - 1)) / block_size)
+  };
+  SquashStatus res;
+  uint8_t* slots = NULL;
+
+  size_t slot_size = squash_zlib_deflate_bound (SQUASH_ZLIB_TYPE_DEFLATE, p.level, p.window_bits,
+                                                p.mem_level, p.strategy, block_size);
+  if (SQUASH_UNLIKELY(slot_size == 0))
+    return squash_error (SQUASH_FAILED);
+  slot_size += SQUASH_ZLIB_BLOCK_OVERHEAD;
+
+  p.blocks = squash_calloc (p.n_blocks, sizeof (SquashZlibBlock));
+  if (p.n_blocks <= (SIZE_MAX / slot_size))
+    slots = squash_malloc (p.n_blocks * slot_size);
+  if (SQUASH_UNLIKELY(p.blocks == NULL || slots == NULL)) {
+    res = squash_error (SQUASH_MEMORY);
+    goto cleanup;
+  }
+
+  for (size_t i = 0 ; i < p.n_blocks ; i++) {
+    SquashZlibBlock* block = &(p.blocks[i]);
+    const size_t offset = i * block_size;
+    block->input = uncompressed + offset;
+    block->input_size = ((uncompressed_size - offset) < block_size) ? (uncompressed_size - offset) : block_size;
+    block->output = slots + (i * slot_size);
+    block->output_size = slot_size;
+  }
+
+  res = squash_parallel_for ((unsigned int) squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_THREADS),
+                             p.n_blocks, squash_zlib_compress_block, &p);
+  if (SQUASH_UNLIKELY(res != SQUASH_OK))
+    goto cleanup;
+
+  size_t header_size = 0, trailer_size = 0;
+  if (p.type == SQUASH_ZLIB_TYPE_GZIP) {
+    header_size = 10;
+    trailer_size = 8;
+  } else if (p.type == SQUASH_ZLIB_TYPE_ZLIB) {
+    header_size = 2;
+    trailer_size = 4;
+  }
+
+  size_t total = header_size + trailer_size;
+  for (size_t i = 0 ; i < p.n_blocks ; i++)
+    total += p.blocks[i].output_size;
+  if (SQUASH_UNLIKELY(total > *compressed_size)) {
+    res = squash_error (SQUASH_BUFFER_FULL);
+    goto cleanup;
+  }
+
+  uint8_t* out = compressed;
+  if (p.type == SQUASH_ZLIB_TYPE_GZIP) {
+    /* ID1 ID2 CM FLG MTIME(4) XFL OS; OS 255 is "unknown". */
+    const uint8_t header[10] = { 0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0,
+                                 (uint8_t) ((p.level == 9) ? 2 : ((p.level == 1) ? 4 : 0)), 255 };
+    memcpy (out, header, sizeof (header));
+  } else if (p.type == SQUASH_ZLIB_TYPE_ZLIB) {
+    const unsigned int level_flags = (p.level < 2) ? 0 : ((p.level < 6) ? 1 : ((p.level == 6) ? 2 : 3));
+    unsigned int header = ((Z_DEFLATED + ((unsigned int) (p.window_bits - 8) << 4)) << 8) | (level_flags << 6);
+    header += 31 - (header % 31);
+    out[0] = (uint8_t) (header >> 8);
+    out[1] = (uint8_t) (header & 0xff);
+  }
+  out += header_size;
+
+  uLong check = (p.type == SQUASH_ZLIB_TYPE_GZIP) ? crc32 (0L, Z_NULL, 0) : adler32 (0L, Z_NULL, 0);
+  for (size_t i = 0 ; i < p.n_blocks ; i++) {
+    const SquashZlibBlock* block = &(p.blocks[i]);
+    memcpy (out, block->output, block->output_size);
+    out += block->output_size;
+
+    if (p.type == SQUASH_ZLIB_TYPE_GZIP)
+      check = crc32_combine (check, block->check, (z_off_t) block->input_size);
+    else if (p.type == SQUASH_ZLIB_TYPE_ZLIB)
+      check = adler32_combine (check, block->check, (z_off_t) block->input_size);
+  }
+
+  if (p.type == SQUASH_ZLIB_TYPE_GZIP) {
+    squash_zlib_write_u32 (out, check, false);
+    squash_zlib_write_u32 (out + 4, (uLong) (uncompressed_size & 0xffffffff), false);
+  } else if (p.type == SQUASH_ZLIB_TYPE_ZLIB) {
+    squash_zlib_write_u32 (out, check, true);
+  }
+
+  *compressed_size = total;
+
+ cleanup:
+
+  squash_free (slots);
+  squash_free (p.blocks);
+
+  return res;
+}
+
+static SquashStatus
+squash_zlib_compress_buffer (SquashCodec* codec,
+                             size_t* compressed_size,
+                             uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                             size_t uncompressed_size,
+                             const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                             SquashOptions* options) {
+  if (squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_THREADS) == 1)
+    return squash_zlib_compress_single (codec, compressed_size, compressed, uncompressed_size, uncompressed, options);
+  else
+    return squash_zlib_compress_parallel (codec, compressed_size, compressed, uncompressed_size, uncompressed, options);
+}
+
+static void
+squash_zlib_index_put (uint8_t* dest, uint64_t value, size_t size) {
+  for (size_t i = 0 ; i < size ; i++)
+    dest[i] = (uint8_t) ((value >> (8 * i)) & 0xff);
+}
+
+static uint64_t
+squash_zlib_index_get (const uint8_t* src, size_t size) {
+  uint64_t value = 0;
+  for (size_t i = 0 ; i < size ; i++)
+    value |= ((uint64_t) src[i]) << (8 * i);
+  return value;
+}
+
+static void
+squash_zlib_index_entry_encode (uint8_t dest[SQUASH_ZLIB_INDEX_ENTRY_SIZE], const SquashZlibIndexEntry* entry) {
+  memset (dest, 0, SQUASH_ZLIB_INDEX_ENTRY_SIZE);
+  squash_zlib_index_put (dest +  0, entry->uncompressed_offset, 8);
+  squash_zlib_index_put (dest +  8, entry->compressed_offset, 8);
+  squash_zlib_index_put (dest + 16, entry->window_offset, 8);
+  squash_zlib_index_put (dest + 24, entry->window_compressed_size, 4);
+  squash_zlib_index_put (dest + 28, entry->window_size, 2);
+  dest[30] = entry->bits;
+}
+
+static void
+squash_zlib_index_entry_decode (SquashZlibIndexEntry* entry, const uint8_t src[SQUASH_ZLIB_INDEX_ENTRY_SIZE]) {
+  entry->uncompressed_offset = squash_zlib_index_get (src + 0, 8);
+  entry->compressed_offset = squash_zlib_index_get (src + 8, 8);
+  entry->window_offset = squash_zlib_index_get (src + 16, 8);
+  entry->window_compressed_size = (uint32_t) squash_zlib_index_get (src + 24, 4);
+  entry->window_size = (uint16_t) squash_zlib_index_get (src + 28, 2);
+  entry->bits = src[30];
+}
+
+static SquashStatus
+squash_zlib_status_from_zlib (int zlib_e) {
+  switch (zlib_e) {
+    case Z_OK:
+    case Z_STREAM_END:
+      return SQUASH_OK;
+    case Z_MEM_ERROR:
+      return squash_error (SQUASH_MEMORY);
+    case Z_NEED_DICT:
+    case Z_DATA_ERROR:
+      return squash_error (SQUASH_FAILED);
+    default:
+      return squash_error (SQUASH_FAILED);
+  }
+}
+
+/* Returns false at the end of the file, or if there was an error
+   (check ferror). */
+static bool
+squash_zlib_index_fill (z_stream* stream, FILE* fp, uint8_t* buffer) {
+  if (stream->avail_in != 0)
+    return true;
+
+  const size_t bytes_read = fread (buffer, 1, SQUASH_ZLIB_INDEX_CHUNK_SIZE, fp);
+  stream->next_in = buffer;
+  stream->avail_in = (uInt) bytes_read;
+
+  return bytes_read != 0;
+}
+
+/* Record a checkpoint.  window holds the most recent output in a
+   ring buffer, with the next byte to be written at window_pos. */
+static SquashStatus
+squash_zlib_index_add (SquashZlibIndexEntry** entries, size_t* n_entries, size_t* allocated,
+                       z_stream* deflater, FILE* fp_index, uint64_t* index_pos,
+                       uint64_t uncompressed_offset, uint64_t compressed_offset, uint8_t bits,
+                       const uint8_t* window, size_t window_pos, uint8_t* scratch, size_t scratch_size) {
+  if (*n_entries == *allocated) {
+    const size_t new_allocated = (*allocated == 0) ? 64 : (*allocated * 2);
+    SquashZlibIndexEntry* new_entries = squash_realloc (*entries, new_allocated * sizeof (SquashZlibIndexEntry));
+    if (SQUASH_UNLIKELY(new_entries == NULL))
+      return squash_error (SQUASH_MEMORY);
+    *entries = new_entries;
+    *allocated = new_allocated;
+  }
+
+  SquashZlibIndexEntry* entry = &((*entries)[(*n_entries)++]);
+  entry->uncompressed_offset = uncompressed_offset;
+  entry->compressed_offset = compressed_offset;
+  entry->bits = bits;
+  entry->window_size = (uint16_t) ((uncompressed_offset < SQUASH_ZLIB_INDEX_WINDOW_SIZE) ? uncompressed_offset : SQUASH_ZLIB_INDEX_WINDOW_SIZE);
+  entry->window_offset = *index_pos;
+  entry->window_compressed_size = 0;
+
+  if (entry->window_size == 0)
+    return SQUASH_OK;
+
+  /* Unroll the ring buffer so the dictionary is contiguous. */
+  uint8_t* linear = scratch + scratch_size - SQUASH_ZLIB_INDEX_WINDOW_SIZE;
+  memcpy (linear, window + window_pos, SQUASH_ZLIB_INDEX_WINDOW_SIZE - window_pos);
+  memcpy (linear + (SQUASH_ZLIB_INDEX_WINDOW_SIZE - window_pos), window, window_pos);
+
+  int zlib_e = deflateReset (deflater);
+  if (SQUASH_UNLIKELY(zlib_e != Z_OK))
+    return squash_zlib_status_from_zlib (zlib_e);
+
+  deflater->next_in = linear + (SQUASH_ZLIB_INDEX_WINDOW_SIZE - entry->window_size);
+  deflater->avail_in = entry->window_size;
+  deflater->next_out = scratch;
+  deflater->avail_out = (uInt) (scratch_size - SQUASH_ZLIB_INDEX_WINDOW_SIZE);
+  zlib_e = deflate (deflater, Z_FINISH);
+  if (SQUASH_UNLIKELY(zlib_e != Z_STREAM_END))
+    return squash_error (SQUASH_FAILED);
+
+  entry->window_compressed_size = (uint32_t) deflater->total_out;
+  if (SQUASH_UNLIKELY(fwrite (scratch, 1, entry->window_compressed_size, fp_index) != entry->window_compressed_size))
+    return squash_error (SQUASH_IO);
+  *index_pos += entry->window_compressed_size;
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_zlib_build_index (SquashCodec* codec,
+                         SquashOptions* options,
+                         FILE* fp_index,
+                         FILE* fp_in,
+                         size_t span) {
+  const SquashZlibType type = squash_zlib_codec_to_type (codec);
+  z_stream inflater = { 0, };
+  z_stream deflater = { 0, };
+  bool inflater_ready = false, deflater_ready = false;
+  SquashZlibIndexEntry* entries = NULL;
+  size_t n_entries = 0, allocated = 0;
+  SquashStatus res = SQUASH_OK;
+  int zlib_e;
+
+  if (span == 0)
+    span = SQUASH_ZLIB_INDEX_DEFAULT_SPAN;
+
+  const int64_t start = (int64_t) squash_zlib_ftell (fp_in);
+  if (SQUASH_UNLIKELY(start < 0))
+    return squash_error (SQUASH_IO);
+
+  /* Input chunk, ring buffer for the output, and room to compress a
+     dictionary (plus a linear copy of it). */
+  const size_t scratch_size = compressBound (SQUASH_ZLIB_INDEX_WINDOW_SIZE) + SQUASH_ZLIB_INDEX_WINDOW_SIZE;
+  uint8_t* buffer = squash_malloc (SQUASH_ZLIB_INDEX_CHUNK_SIZE + SQUASH_ZLIB_INDEX_WINDOW_SIZE + scratch_size);
+  if (SQUASH_UNLIKELY(buffer == NULL))
+    return squash_error (SQUASH_MEMORY);
+  uint8_t* input = buffer;
+  uint8_t* window = input + SQUASH_ZLIB_INDEX_CHUNK_SIZE;
+  uint8_t* scratch = window + SQUASH_ZLIB_INDEX_WINDOW_SIZE;
+
+  inflater.zalloc = deflater.zalloc = squash_zlib_malloc;
+  inflater.zfree = deflater.zfree = squash_zlib_free;
+
+  zlib_e = inflateInit2 (&inflater, squash_zlib_window_bits (type, 15));
+  inflater_ready = (zlib_e == Z_OK);
+  if (inflater_ready) {
+    zlib_e = deflateInit2 (&deflater, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    deflater_ready = (zlib_e == Z_OK);
+  }
+  if (SQUASH_UNLIKELY(zlib_e != Z_OK)) {
+    res = squash_zlib_status_from_zlib (zlib_e);
+    goto cleanup;
+  }
+
+  uint8_t header[SQUASH_ZLIB_INDEX_HEADER_SIZE] = { 0, };
+  memcpy (header, squash_zlib_index_magic, sizeof (squash_zlib_index_magic));
+  header[8] = SQUASH_ZLIB_INDEX_VERSION;
+  header[9] = (uint8_t) type;
+  if (SQUASH_UNLIKELY(fwrite (header, 1, sizeof (header), fp_index) != sizeof (header))) {
+    res = squash_error (SQUASH_IO);
+    goto cleanup;
+  }
+  uint64_t index_pos = sizeof (header);
+
+  uint64_t total_in = 0, total_out = 0, last = 0;
+  bool have_checkpoint = false;
+  inflater.next_out = window;
+  inflater.avail_out = SQUASH_ZLIB_INDEX_WINDOW_SIZE;
+
+  /* gzip and zlib streams get their first checkpoint when inflate
+     stops after the header; raw deflate has no header, so start
+     with a checkpoint at the beginning of the data. */
+  if (type == SQUASH_ZLIB_TYPE_DEFLATE) {
+    res = squash_zlib_index_add (&entries, &n_entries, &allocated, &deflater, fp_index, &index_pos,
+                                 0, (uint64_t) start, 0, window, 0, scratch, scratch_size);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      goto cleanup;
+    have_checkpoint = true;
+  }
+
+  while (true) {
+    if (!squash_zlib_index_fill (&inflater, fp_in, input)) {
+      /* With Z_BLOCK, inflate stops before noticing that the last
+         block is finished; for raw deflate there is no trailer to
+         make it look, so give it a chance before declaring the input
+         truncated. */
+      if (SQUASH_LIKELY(!ferror (fp_in)) && inflate (&inflater, Z_BLOCK) == Z_STREAM_END)
+        break;
+
+      res = squash_error (ferror (fp_in) ? SQUASH_IO : SQUASH_FAILED);
+      goto cleanup;
+    }
+
+    do {
+      if (inflater.avail_out == 0) {
+        inflater.next_out = window;
+        inflater.avail_out = SQUASH_ZLIB_INDEX_WINDOW_SIZE;
+      }
+
+      total_in += inflater.avail_in;
+      total_out += inflater.avail_out;
+      zlib_e = inflate (&inflater, Z_BLOCK);
+      total_in -= inflater.avail_in;
+      total_out -= inflater.avail_out;
+
+      if (SQUASH_UNLIKELY(zlib_e != Z_OK && zlib_e != Z_STREAM_END && zlib_e != Z_BUF_ERROR)) {
+        res = squash_zlib_status_from_zlib (zlib_e);
+        goto cleanup;
+      }
+
+      if (zlib_e == Z_STREAM_END)
+        break;
+
+      /* Checkpoints can only be placed at block boundaries (or right
+         after the header), and never before the last block since
+         there is nothing left to seek to. */
+      if ((inflater.data_type & 128) != 0 && (inflater.data_type & 64) == 0 &&
+          (!have_checkpoint || (total_out - last) > span)) {
+        res = squash_zlib_index_add (&entries, &n_entries, &allocated, &deflater, fp_index, &index_pos,
+                                     total_out, (uint64_t) start + total_in, (uint8_t) (inflater.data_type & 7),
+                                     window, SQUASH_ZLIB_INDEX_WINDOW_SIZE - inflater.avail_out,
+                                     scratch, scratch_size);
+        if (SQUASH_UNLIKELY(res != SQUASH_OK))
+          goto cleanup;
+        last = total_out;
+        have_checkpoint = true;
+      }
+    } while (inflater.avail_in != 0);
+
+    if (zlib_e == Z_STREAM_END) {
+      /* gzip files may consist of several members. */
+      if (type != SQUASH_ZLIB_TYPE_GZIP || !squash_zlib_index_fill (&inflater, fp_in, input))
+        break;
+
+      zlib_e = inflateReset (&inflater);
+      if (SQUASH_UNLIKELY(zlib_e != Z_OK)) {
+        res = squash_zlib_status_from_zlib (zlib_e);
+        goto cleanup;
+      }
     }
+  }
 
-    zlib_e = deflateInit2 (&stream,
-                           SQUASH_ZLIB_DEFAULT_LEVEL,
-                           Z_DEFLATED,
-                           window_bits,
-                           9,
-                           SQUASH_ZLIB_DEFAULT_STRATEGY);
-    if (zlib_e != Z_OK) {
-      return 0;
+  if (SQUASH_UNLIKELY(ferror (fp_in))) {
+    res = squash_error (SQUASH_IO);
+    goto cleanup;
+  }
+
+  for (size_t i = 0 ; i < n_entries ; i++) {
+    uint8_t entry[SQUASH_ZLIB_INDEX_ENTRY_SIZE];
+    squash_zlib_index_entry_encode (entry, &(entries[i]));
+    if (SQUASH_UNLIKELY(fwrite (entry, 1, sizeof (entry), fp_index) != sizeof (entry))) {
+      res = squash_error (SQUASH_IO);
+      goto cleanup;
     }
+  }
 
-    max_compressed_size = (size_t) deflateBound (&stream, (uLong) uncompressed_size);
+  uint8_t trailer[SQUASH_ZLIB_INDEX_TRAILER_SIZE] = { 0, };
+  squash_zlib_index_put (trailer, index_pos, 8);
+  squash_zlib_index_put (trailer + 8, total_out, 8);
+  squash_zlib_index_put (trailer + 16, n_entries, 4);
+  if (SQUASH_UNLIKELY(fwrite (trailer, 1, sizeof (trailer), fp_index) != sizeof (trailer)))
+    res = squash_error (SQUASH_IO);
+
+ cleanup:
+
+  if (inflater_ready)
+    inflateEnd (&inflater);
+  if (deflater_ready)
+    deflateEnd (&deflater);
+  squash_free (entries);
+  squash_free (buffer);
+
+  return res;
+}
 
-    deflateEnd (&stream);
+static SquashStatus
+squash_zlib_index_read_entry (FILE* fp_index, uint64_t table_offset, uint64_t i, SquashZlibIndexEntry* entry) {
+  uint8_t buf[SQUASH_ZLIB_INDEX_ENTRY_SIZE];
+
+  if (SQUASH_UNLIKELY(squash_zlib_fseek (fp_index, (squash_zlib_off_t) (table_offset + (i * SQUASH_ZLIB_INDEX_ENTRY_SIZE)), SEEK_SET) != 0) ||
+      SQUASH_UNLIKELY(fread (buf, 1, sizeof (buf), fp_index) != sizeof (buf)))
+    return squash_error (SQUASH_IO);
+
+  squash_zlib_index_entry_decode (entry, buf);
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_zlib_extract (SquashCodec* codec,
+                     SquashOptions* options,
+                     FILE* fp_index,
+                     FILE* fp_in,
+                     uint64_t offset,
+                     size_t* decompressed_size,
+                     uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)]) {
+  const SquashZlibType type = squash_zlib_codec_to_type (codec);
+  uint8_t header[SQUASH_ZLIB_INDEX_HEADER_SIZE];
+  uint8_t trailer[SQUASH_ZLIB_INDEX_TRAILER_SIZE];
+  SquashStatus res;
+  int zlib_e;
 
-    return max_compressed_size;
+  if (SQUASH_UNLIKELY(squash_zlib_fseek (fp_index, 0, SEEK_SET) != 0) ||
+      SQUASH_UNLIKELY(fread (header, 1, sizeof (header), fp_index) != sizeof (header)) ||
+      SQUASH_UNLIKELY(squash_zlib_fseek (fp_index, -((squash_zlib_off_t) sizeof (trailer)), SEEK_END) != 0) ||
+      SQUASH_UNLIKELY(fread (trailer, 1, sizeof (trailer), fp_index) != sizeof (trailer)))
+    return squash_error (SQUASH_IO);
+
+  if (SQUASH_UNLIKELY(memcmp (header, squash_zlib_index_magic, sizeof (squash_zlib_index_magic)) != 0) ||
+      SQUASH_UNLIKELY(header[8] != SQUASH_ZLIB_INDEX_VERSION) ||
+      SQUASH_UNLIKELY(header[9] != (uint8_t) type))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  const uint64_t table_offset = squash_zlib_index_get (trailer, 8);
+  const uint64_t total_size = squash_zlib_index_get (trailer + 8, 8);
+  const uint64_t n_entries = squash_zlib_index_get (trailer + 16, 4);
+
+  if (SQUASH_UNLIKELY(offset > total_size))
+    return squash_error (SQUASH_RANGE);
+
+  if ((total_size - offset) < *decompressed_size)
+    *decompressed_size = (size_t) (total_size - offset);
+  if (*decompressed_size == 0)
+    return SQUASH_OK;
+
+  /* Find the last checkpoint at or before the offset.  The first
+     checkpoint is always at offset 0. */
+  SquashZlibIndexEntry entry;
+  uint64_t lo = 0, hi = n_entries;
+  if (SQUASH_UNLIKELY(n_entries == 0))
+    return squash_error (SQUASH_INVALID_BUFFER);
+  while ((hi - lo) > 1) {
+    const uint64_t mid = lo + ((hi - lo) / 2);
+    res = squash_zlib_index_read_entry (fp_index, table_offset, mid, &entry);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      return res;
+
+    if (entry.uncompressed_offset <= offset)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  res = squash_zlib_index_read_entry (fp_index, table_offset, lo, &entry);
+  if (SQUASH_UNLIKELY(res != SQUASH_OK))
+    return res;
+
+  const size_t scratch_size = compressBound (SQUASH_ZLIB_INDEX_WINDOW_SIZE);
+  if (SQUASH_UNLIKELY(entry.window_compressed_size > scratch_size) ||
+      SQUASH_UNLIKELY(entry.window_size > SQUASH_ZLIB_INDEX_WINDOW_SIZE))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  uint8_t* buffer = squash_malloc (SQUASH_ZLIB_INDEX_CHUNK_SIZE + SQUASH_ZLIB_INDEX_WINDOW_SIZE + scratch_size);
+  if (SQUASH_UNLIKELY(buffer == NULL))
+    return squash_error (SQUASH_MEMORY);
+  uint8_t* input = buffer;
+  uint8_t* window = input + SQUASH_ZLIB_INDEX_CHUNK_SIZE;
+  uint8_t* scratch = window + SQUASH_ZLIB_INDEX_WINDOW_SIZE;
+
+  z_stream stream = { 0, };
+  stream.zalloc = squash_zlib_malloc;
+  stream.zfree = squash_zlib_free;
+  zlib_e = inflateInit2 (&stream, -15);
+  if (SQUASH_UNLIKELY(zlib_e != Z_OK)) {
+    squash_free (buffer);
+    return squash_zlib_status_from_zlib (zlib_e);
+  }
+
+  /* Decompress the dictionary for the checkpoint. */
+  if (entry.window_size != 0) {
+    if (SQUASH_UNLIKELY(squash_zlib_fseek (fp_index, (squash_zlib_off_t) entry.window_offset, SEEK_SET) != 0) ||
+        SQUASH_UNLIKELY(fread (scratch, 1, entry.window_compressed_size, fp_index) != entry.window_compressed_size)) {
+      res = squash_error (SQUASH_IO);
+      goto cleanup;
+    }
+
+    stream.next_in = scratch;
+    stream.avail_in = entry.window_compressed_size;
+    stream.next_out = window;
+    stream.avail_out = entry.window_size;
+    zlib_e = inflate (&stream, Z_FINISH);
+    if (SQUASH_UNLIKELY(zlib_e != Z_STREAM_END) || SQUASH_UNLIKELY(stream.avail_out != 0)) {
+      res = squash_error (SQUASH_INVALID_BUFFER);
+      goto cleanup;
+    }
+
+    zlib_e = inflateReset (&stream);
+    if (SQUASH_LIKELY(zlib_e == Z_OK))
+      zlib_e = inflateSetDictionary (&stream, window, entry.window_size);
+    if (SQUASH_UNLIKELY(zlib_e != Z_OK)) {
+      res = squash_zlib_status_from_zlib (zlib_e);
+      goto cleanup;
+    }
+  }
+
+  /* If the checkpoint isn't on a byte boundary, feed the remaining
+     bits of the previous byte first. */
+  if (SQUASH_UNLIKELY(squash_zlib_fseek (fp_in, (squash_zlib_off_t) (entry.compressed_offset - (entry.bits ? 1 : 0)), SEEK_SET) != 0)) {
+    res = squash_error (SQUASH_IO);
+    goto cleanup;
+  }
+  if (entry.bits != 0) {
+    const int c = getc (fp_in);
+    if (SQUASH_UNLIKELY(c == EOF)) {
+      res = squash_error (ferror (fp_in) ? SQUASH_IO : SQUASH_FAILED);
+      goto cleanup;
+    }
+    zlib_e = inflatePrime (&stream, entry.bits, c >> (8 - entry.bits));
+    if (SQUASH_UNLIKELY(zlib_e != Z_OK)) {
+      res = squash_zlib_status_from_zlib (zlib_e);
+      goto cleanup;
+    }
+  }
+
+  stream.next_in = input;
+  stream.avail_in = 0;
+
+  uint64_t skip = offset - entry.uncompressed_offset;
+  size_t produced = 0;
+  bool raw = true;
+  res = SQUASH_OK;
+
+  while (produced < *decompressed_size) {
+    if (skip != 0) {
+      stream.next_out = window;
+      stream.avail_out = (uInt) ((skip < SQUASH_ZLIB_INDEX_WINDOW_SIZE) ? skip : SQUASH_ZLIB_INDEX_WINDOW_SIZE);
+    } else {
+      const size_t remaining = *decompressed_size - produced;
+      stream.next_out = decompressed + produced;
+      stream.avail_out = (uInt) ((remaining < UINT_MAX) ? remaining : UINT_MAX);
+    }
+
+    if (!squash_zlib_index_fill (&stream, fp_in, input)) {
+      res = squash_error (ferror (fp_in) ? SQUASH_IO : SQUASH_FAILED);
+      break;
+    }
+
+    const uInt avail_out = stream.avail_out;
+    zlib_e = inflate (&stream, Z_NO_FLUSH);
+    const size_t written = avail_out - stream.avail_out;
+    if (skip != 0)
+      skip -= written;
+    else
+      produced += written;
+
+    if (zlib_e == Z_STREAM_END) {
+      if (type != SQUASH_ZLIB_TYPE_GZIP)
+        break;
+
+      /* The raw inflater stops before the gzip trailer; skip it and
+         continue with the next member, if there is one. */
+      if (raw) {
+        for (size_t trailer_left = 8 ; trailer_left != 0 ; ) {
+          if (!squash_zlib_index_fill (&stream, fp_in, input)) {
+            res = squash_error (ferror (fp_in) ? SQUASH_IO : SQUASH_FAILED);
+            goto cleanup;
+          }
+          const size_t n = (stream.avail_in < trailer_left) ? stream.avail_in : trailer_left;
+          stream.next_in += n;
+          stream.avail_in -= (uInt) n;
+          trailer_left -= n;
+        }
+      }
+
+      if (!squash_zlib_index_fill (&stream, fp_in, input))
+        break;
+
+      zlib_e = inflateReset2 (&stream, squash_zlib_window_bits (type, 15));
+      raw = false;
+    }
+
+    if (SQUASH_UNLIKELY(zlib_e != Z_OK)) {
+      res = squash_zlib_status_from_zlib (zlib_e);
+      break;
+    }
+  }
+
+  if (SQUASH_LIKELY(res == SQUASH_OK))
+    *decompressed_size = produced;
+
+ cleanup:
+
+  inflateEnd (&stream);
+  squash_free (buffer);
+
+  return res;
+}
+
+static size_t
+squash_zlib_get_memory_usage (SquashCodec* codec, SquashOptions* options, SquashStreamType stream_type) {
+  const int window_bits = squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_WINDOW_BITS);
+
+  /* Figures from zlib's zconf.h, plus a bit for the stream state. */
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    const int mem_level = squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_MEM_LEVEL);
+    return (((size_t) 1) << (window_bits + 2)) + (((size_t) 1) << (mem_level + 9)) + (6 * 1024);
+  } else {
+    return (((size_t) 1) << window_bits) + (7 * 1024);
   }
 }
 
@@ -365,7 +1396,14 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->options = squash_zlib_options;
     impl->create_stream = squash_zlib_create_stream;
     impl->process_stream = squash_zlib_process_stream;
+    impl->reset_stream = squash_zlib_reset_stream;
+    impl->checkpoint_stream = squash_zlib_checkpoint_stream;
+    impl->restore_stream = squash_zlib_restore_stream;
     impl->get_max_compressed_size = squash_zlib_get_max_compressed_size;
+    impl->get_memory_usage = squash_zlib_get_memory_usage;
+    impl->compress_buffer = squash_zlib_compress_buffer;
+    impl->build_index = squash_zlib_build_index;
+    impl->extract = squash_zlib_extract;
   } else {
     return SQUASH_UNABLE_TO_LOAD;
   }
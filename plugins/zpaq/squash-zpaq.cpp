@@ -148,6 +148,27 @@ squash_zpaq_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_siz
     377;
 }
 
+static size_t
+squash_zpaq_get_memory_usage (SquashCodec* codec, SquashOptions* options, SquashStreamType stream_type) {
+  /* libzpaq splits the input into 16 MiB blocks by default.  These
+     are rough multiples of the block size for the models each level
+     selects: the low levels are LZ77 with a hash table, the higher
+     ones add increasingly large context mixing models, which the
+     decoder has to rebuild as well. */
+  static const size_t compress_blocks[] = { 0, 5, 6, 10, 14, 24 };
+  static const size_t decompress_blocks[] = { 0, 2, 2, 6, 10, 20 };
+  const size_t block_size = 16 * 1024 * 1024;
+  const int level = squash_options_get_int_at (options, codec, SQUASH_ZPAQ_OPT_LEVEL);
+
+  if (SQUASH_UNLIKELY(level < 1 || level > 5))
+    return 0;
+
+  if (stream_type == SQUASH_STREAM_COMPRESS)
+    return block_size * compress_blocks[level];
+  else
+    return block_size * decompress_blocks[level];
+}
+
 extern "C" SquashStatus
 squash_plugin_init_plugin (SquashPlugin* plugin) {
   const SquashOptionInfoRangeInt level_range = { 1, 5, 0, false };
@@ -166,6 +187,7 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->options = squash_zpaq_options;
     impl->splice = squash_zpaq_splice;
     impl->get_max_compressed_size = squash_zpaq_get_max_compressed_size;
+    impl->get_memory_usage = squash_zpaq_get_memory_usage;
   } else {
     return SQUASH_UNABLE_TO_LOAD;
   }
@@ -31,15 +31,15 @@
 
 #include <squash/squash.h>
 
-#include "zstd/lib/zstd.h"
-#include "zstd/lib/zstd_static.h"
-#include "zstd/lib/error.h"
+#include <zstd.h>
+#include <zstd_errors.h>
 
 SQUASH_PLUGIN_EXPORT
 SquashStatus squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl);
 
 enum SquashZstdOptIndex {
-  SQUASH_ZSTD_OPT_LEVEL = 0
+  SQUASH_ZSTD_OPT_LEVEL = 0,
+  SQUASH_ZSTD_OPT_REFERENCE
 };
 
 static SquashOptionInfo squash_zstd_options[] = {
@@ -47,11 +47,19 @@ static SquashOptionInfo squash_zstd_options[] = {
     SQUASH_OPTION_TYPE_RANGE_INT,
     .info.range_int = {
       .min = 1,
-      .max = ZSTD_MAX_CLEVEL },
+      .max = 22 },
     .default_value.int_value = 9 },
+  { "reference",
+    SQUASH_OPTION_TYPE_FILE, },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
+/* Beyond this the decoder has to be told to accept the window, and
+ * the regular match finders stop being effective, so this is also
+ * where long distance matching is switched on (like zstd's own
+ * --patch-from). */
+#define SQUASH_ZSTD_WINDOW_LOG_LIMIT_DEFAULT 27
+
 static size_t
 squash_zstd_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
   return ZSTD_compressBound (uncompressed_size);
@@ -62,26 +70,25 @@ squash_zstd_status_from_zstd_error (size_t res) {
   if (!ZSTD_isError (res))
     return SQUASH_OK;
 
-  switch ((ERR_codes) (-(int)(res))) {
-    case ZSTD_error_No_Error:
+  switch (ZSTD_getErrorCode (res)) {
+    case ZSTD_error_no_error:
       return SQUASH_OK;
     case ZSTD_error_memory_allocation:
       return squash_error (SQUASH_MEMORY);
     case ZSTD_error_dstSize_tooSmall:
       return squash_error (SQUASH_BUFFER_FULL);
     case ZSTD_error_prefix_unknown:
+    case ZSTD_error_version_unsupported:
     case ZSTD_error_frameParameter_unsupported:
-    case ZSTD_error_frameParameter_unsupportedBy32bitsImplementation:
       return squash_error (SQUASH_INVALID_BUFFER);
-    case ZSTD_error_tableLog_tooLarge:
-    case ZSTD_error_maxCode:
-    case ZSTD_error_GENERIC:
     case ZSTD_error_srcSize_wrong:
+      return squash_error (SQUASH_BUFFER_EMPTY);
+    case ZSTD_error_GENERIC:
     case ZSTD_error_corruption_detected:
-    case ZSTD_error_maxSymbolValue_tooSmall:
-    case ZSTD_error_maxSymbolValue_tooLarge:
-    case ZSTD_error_init_missing:
-    case ZSTD_error_stage_wrong:
+    case ZSTD_error_checksum_wrong:
+    case ZSTD_error_dictionary_corrupted:
+    case ZSTD_error_dictionary_wrong:
+    case ZSTD_error_frameParameter_windowTooLarge:
     default:
       return squash_error (SQUASH_FAILED);
   }
@@ -89,6 +96,20 @@ squash_zstd_status_from_zstd_error (size_t res) {
   squash_assert_unreachable ();
 }
 
+/* The window has to reach back over the whole reference from the
+ * end of the input. */
+static int
+squash_zstd_reference_window_log (size_t reference_size, size_t uncompressed_size) {
+  const ZSTD_bounds bounds = ZSTD_cParam_getBounds (ZSTD_c_windowLog);
+  const size_t span = reference_size + uncompressed_size;
+  int window_log = bounds.lowerBound;
+
+  while (window_log < bounds.upperBound && (((size_t) 1) << window_log) < span)
+    window_log++;
+
+  return window_log;
+}
+
 static SquashStatus
 squash_zstd_decompress_buffer (SquashCodec* codec,
                                size_t* decompressed_size,
@@ -96,7 +117,21 @@ squash_zstd_decompress_buffer (SquashCodec* codec,
                                size_t compressed_size,
                                const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
                                SquashOptions* options) {
-  *decompressed_size = ZSTD_decompress (decompressed, *decompressed_size, compressed, compressed_size);
+  size_t reference_size;
+  const uint8_t* reference = squash_options_get_file_at (options, codec, SQUASH_ZSTD_OPT_REFERENCE, &reference_size);
+
+  ZSTD_DCtx* dctx = ZSTD_createDCtx ();
+  if (SQUASH_UNLIKELY(dctx == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  if (reference != NULL) {
+    ZSTD_DCtx_setParameter (dctx, ZSTD_d_windowLogMax, ZSTD_dParam_getBounds (ZSTD_d_windowLogMax).upperBound);
+    ZSTD_DCtx_refPrefix (dctx, reference, reference_size);
+  }
+
+  *decompressed_size = ZSTD_decompressDCtx (dctx, decompressed, *decompressed_size, compressed, compressed_size);
+
+  ZSTD_freeDCtx (dctx);
 
   return squash_zstd_status_from_zstd_error (*decompressed_size);
 }
@@ -109,8 +144,29 @@ squash_zstd_compress_buffer (SquashCodec* codec,
                              const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
                              SquashOptions* options) {
   const int level = squash_options_get_int_at (options, codec, SQUASH_ZSTD_OPT_LEVEL);
+  size_t reference_size;
+  const uint8_t* reference = squash_options_get_file_at (options, codec, SQUASH_ZSTD_OPT_REFERENCE, &reference_size);
+
+  ZSTD_CCtx* cctx = ZSTD_createCCtx ();
+  if (SQUASH_UNLIKELY(cctx == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  ZSTD_CCtx_setParameter (cctx, ZSTD_c_compressionLevel, level);
+
+  /* The reference is used as a prefix: matches can point anywhere
+     in it, so the output only has to describe what changed. */
+  if (reference != NULL) {
+    const int window_log = squash_zstd_reference_window_log (reference_size, uncompressed_size);
+
+    ZSTD_CCtx_setParameter (cctx, ZSTD_c_windowLog, window_log);
+    if (window_log >= SQUASH_ZSTD_WINDOW_LOG_LIMIT_DEFAULT)
+      ZSTD_CCtx_setParameter (cctx, ZSTD_c_enableLongDistanceMatching, 1);
+    ZSTD_CCtx_refPrefix (cctx, reference, reference_size);
+  }
+
+  *compressed_size = ZSTD_compress2 (cctx, compressed, *compressed_size, uncompressed, uncompressed_size);
 
-  *compressed_size = ZSTD_compress (compressed, *compressed_size, uncompressed, uncompressed_size, level);
+  ZSTD_freeCCtx (cctx);
 
   return squash_zstd_status_from_zstd_error (*compressed_size);
 }
@@ -123,7 +179,7 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->options = squash_zstd_options;
     impl->get_max_compressed_size = squash_zstd_get_max_compressed_size;
     impl->decompress_buffer = squash_zstd_decompress_buffer;
-    impl->compress_buffer_unsafe = squash_zstd_compress_buffer;
+    impl->compress_buffer = squash_zstd_compress_buffer;
   } else {
     return squash_error (SQUASH_UNABLE_TO_LOAD);
   }
@@ -0,0 +1,509 @@
+/* Copyright (c) 2013-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "internal.h"
+
+/**
+ * @cond INTERNAL
+ */
+
+#define SQUASH_ARENA_ALIGNMENT ((size_t) 16)
+#define SQUASH_ARENA_ALIGN(size) \
+  (((size) + (SQUASH_ARENA_ALIGNMENT - 1)) & ~(SQUASH_ARENA_ALIGNMENT - 1))
+
+#define SQUASH_ARENA_DEFAULT_CHUNK_SIZE ((size_t) (256 * 1024))
+#define SQUASH_ARENA_MIN_CHUNK_SIZE ((size_t) (16 * 1024))
+
+/* Requests at least this large (or larger than a quarter of a chunk)
+ * skip the bump allocator and are served from the size-class free
+ * lists instead, so they can be reused individually. */
+#define SQUASH_ARENA_LARGE_SHIFT 12
+#define SQUASH_ARENA_LARGE_MIN (((size_t) 1) << 16)
+
+/* Four classes per power of two keeps the worst-case overhead of
+ * rounding up at 25%. */
+#define SQUASH_ARENA_N_CLASSES (((sizeof (size_t) * CHAR_BIT) - SQUASH_ARENA_LARGE_SHIFT) * 4)
+
+#define SQUASH_ARENA_CLASS_SMALL (UINT_MAX - 1)
+#define SQUASH_ARENA_CLASS_HEAP  (UINT_MAX)
+
+typedef struct SquashArenaHeader_ {
+  SquashArena* arena;
+  struct SquashArenaHeader_* next;
+  struct SquashArenaHeader_* prev;
+  unsigned int size_class;
+  bool zeroed;
+} SquashArenaHeader;
+
+#define SQUASH_ARENA_HEADER_SIZE SQUASH_ARENA_ALIGN(sizeof (SquashArenaHeader))
+
+typedef struct SquashArenaChunk_ {
+  struct SquashArenaChunk_* next;
+  size_t used;
+} SquashArenaChunk;
+
+#define SQUASH_ARENA_CHUNK_HEADER_SIZE SQUASH_ARENA_ALIGN(sizeof (SquashArenaChunk))
+
+struct SquashArena_ {
+  size_t chunk_size;
+  SquashArenaChunk* chunks;
+  SquashArenaChunk* current;
+
+  mtx_t large_mtx;
+  SquashArenaHeader* large;
+  SquashArenaHeader* free_large[SQUASH_ARENA_N_CLASSES];
+};
+
+static SQUASH_THREAD_LOCAL SquashArena* squash_arena_bound = NULL;
+
+static unsigned int
+squash_arena_log2 (size_t v) {
+  unsigned int r = 0;
+  while (v >>= 1)
+    r++;
+  return r;
+}
+
+static unsigned int
+squash_arena_size_class (size_t size, size_t* class_size) {
+  if (size < (((size_t) 1) << SQUASH_ARENA_LARGE_SHIFT))
+    size = ((size_t) 1) << SQUASH_ARENA_LARGE_SHIFT;
+
+  const size_t step = ((size_t) 1) << (squash_arena_log2 (size) - 2);
+  const size_t rounded = (size + (step - 1)) & ~(step - 1);
+  const unsigned int e = squash_arena_log2 (rounded);
+
+  *class_size = rounded;
+  return ((e - SQUASH_ARENA_LARGE_SHIFT) * 4) + ((unsigned int) (rounded >> (e - 2)) & 3);
+}
+
+static void*
+squash_arena_alloc_large (SquashArena* arena, size_t size, bool zero) {
+  SquashArenaHeader* header;
+  size_t class_size;
+
+  if (SQUASH_UNLIKELY(size > ((SIZE_MAX / 2) - SQUASH_ARENA_HEADER_SIZE)))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  const unsigned int size_class = squash_arena_size_class (size + SQUASH_ARENA_HEADER_SIZE, &class_size);
+  assert (size_class < SQUASH_ARENA_N_CLASSES);
+
+  mtx_lock (&(arena->large_mtx));
+  header = arena->free_large[size_class];
+  if (header != NULL)
+    arena->free_large[size_class] = header->next;
+  mtx_unlock (&(arena->large_mtx));
+
+  if (header == NULL) {
+    /* Fresh blocks from calloc are usually backed by pages the
+     * kernel has already zeroed, so only pay for zeroing when the
+     * caller actually asked for it. */
+    header = zero ? squash_calloc (1, class_size) : squash_malloc (class_size);
+    if (SQUASH_UNLIKELY(header == NULL))
+      return (squash_error (SQUASH_MEMORY), NULL);
+    header->arena = arena;
+    header->size_class = size_class;
+    header->zeroed = zero;
+  }
+
+  if (zero && !header->zeroed)
+    memset (((uint8_t*) header) + SQUASH_ARENA_HEADER_SIZE, 0, size);
+  header->zeroed = false;
+
+  mtx_lock (&(arena->large_mtx));
+  header->prev = NULL;
+  header->next = arena->large;
+  if (arena->large != NULL)
+    arena->large->prev = header;
+  arena->large = header;
+  mtx_unlock (&(arena->large_mtx));
+
+  return ((uint8_t*) header) + SQUASH_ARENA_HEADER_SIZE;
+}
+
+static void
+squash_arena_release_large (SquashArena* arena, SquashArenaHeader* header) {
+  mtx_lock (&(arena->large_mtx));
+  if (header->prev != NULL)
+    header->prev->next = header->next;
+  else
+    arena->large = header->next;
+  if (header->next != NULL)
+    header->next->prev = header->prev;
+
+  header->prev = NULL;
+  header->next = arena->free_large[header->size_class];
+  arena->free_large[header->size_class] = header;
+  mtx_unlock (&(arena->large_mtx));
+}
+
+static void*
+squash_arena_alloc_small (SquashArena* arena, size_t size, bool zero) {
+  const size_t needed = SQUASH_ARENA_HEADER_SIZE + SQUASH_ARENA_ALIGN(size);
+  const size_t capacity = arena->chunk_size - SQUASH_ARENA_CHUNK_HEADER_SIZE;
+  SquashArenaChunk* chunk = arena->current;
+
+  while (chunk != NULL && (capacity - chunk->used) < needed)
+    chunk = chunk->next;
+
+  if (chunk == NULL) {
+    chunk = squash_malloc (arena->chunk_size);
+    if (SQUASH_UNLIKELY(chunk == NULL))
+      return (squash_error (SQUASH_MEMORY), NULL);
+    chunk->used = 0;
+
+    if (arena->current != NULL) {
+      chunk->next = arena->current->next;
+      arena->current->next = chunk;
+    } else {
+      chunk->next = NULL;
+      arena->chunks = chunk;
+    }
+  }
+  arena->current = chunk;
+
+  SquashArenaHeader* header = (SquashArenaHeader*) (((uint8_t*) chunk) + SQUASH_ARENA_CHUNK_HEADER_SIZE + chunk->used);
+  chunk->used += needed;
+
+  header->arena = arena;
+  header->size_class = SQUASH_ARENA_CLASS_SMALL;
+
+  void* ptr = ((uint8_t*) header) + SQUASH_ARENA_HEADER_SIZE;
+  if (zero)
+    memset (ptr, 0, size);
+  return ptr;
+}
+
+static void*
+squash_arena_alloc (SquashArena* arena, size_t size, bool zero) {
+  if (size >= SQUASH_ARENA_LARGE_MIN || size > (arena->chunk_size / 4))
+    return squash_arena_alloc_large (arena, size, zero);
+  else
+    return squash_arena_alloc_small (arena, size, zero);
+}
+
+static void*
+squash_scratch_alloc (size_t size, bool zero) {
+  SquashArena* arena = squash_arena_bound;
+
+  if (arena != NULL)
+    return squash_arena_alloc (arena, size, zero);
+
+  if (SQUASH_UNLIKELY(size > (SIZE_MAX - SQUASH_ARENA_HEADER_SIZE)))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  SquashArenaHeader* header = zero ?
+    squash_calloc (1, SQUASH_ARENA_HEADER_SIZE + size) :
+    squash_malloc (SQUASH_ARENA_HEADER_SIZE + size);
+  if (SQUASH_UNLIKELY(header == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  header->arena = NULL;
+  header->size_class = SQUASH_ARENA_CLASS_HEAP;
+
+  return ((uint8_t*) header) + SQUASH_ARENA_HEADER_SIZE;
+}
+
+/**
+ * @endcond INTERNAL
+ */
+
+/**
+ * @defgroup Arena
+ * @brief Scoped allocation for codec scratch memory
+ *
+ * Many codecs allocate large, short-lived working buffers (hash
+ * tables, suffix arrays, window buffers) for every operation.  When
+ * the same operation is repeated many times these allocations can
+ * dominate the run time for small inputs, especially if they are
+ * zeroed.
+ *
+ * A @ref SquashArena hands out memory from large chunks using a bump
+ * pointer, and keeps freed large blocks on size-class free lists so
+ * they can be reused by the next operation instead of being returned
+ * to the system.  Everything allocated from an arena is reclaimed at
+ * once by @ref squash_arena_reset.
+ *
+ * Plugins should request scratch memory with @ref
+ * squash_scratch_malloc, @ref squash_scratch_calloc and @ref
+ * squash_scratch_free.  If an arena has been bound to the calling
+ * thread with @ref squash_arena_bind the memory comes from that
+ * arena, otherwise it comes from the regular Squash allocator.
+ *
+ * A typical caller binds an arena around a call (or a batch of
+ * calls) and resets it when the results are no longer needed:
+ *
+ * @code
+ * SquashArena* previous = squash_arena_bind (arena);
+ * res = squash_codec_compress (codec, &compressed_size, compressed, uncompressed_size, uncompressed, NULL);
+ * squash_arena_bind (previous);
+ * squash_arena_reset (arena);
+ * @endcode
+ *
+ * @note Arenas are not thread-safe; an arena must only be bound to
+ * one thread at a time.  Releasing memory from another thread is
+ * allowed.
+ *
+ * @{
+ */
+
+/**
+ * @struct SquashArena
+ * @brief A region allocator for scratch memory
+ */
+
+/**
+ * @brief Create a new arena
+ *
+ * @param chunk_size size of the chunks used for small allocations,
+ *   or 0 for the default (256 KiB)
+ * @return a new arena, or *NULL* on failure
+ */
+SquashArena*
+squash_arena_new (size_t chunk_size) {
+  if (chunk_size == 0)
+    chunk_size = SQUASH_ARENA_DEFAULT_CHUNK_SIZE;
+  else if (chunk_size < SQUASH_ARENA_MIN_CHUNK_SIZE)
+    chunk_size = SQUASH_ARENA_MIN_CHUNK_SIZE;
+
+  SquashArena* arena = squash_malloc (sizeof (SquashArena));
+  if (SQUASH_UNLIKELY(arena == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  memset (arena, 0, sizeof (SquashArena));
+  arena->chunk_size = chunk_size;
+
+  if (SQUASH_UNLIKELY(mtx_init (&(arena->large_mtx), mtx_plain) != thrd_success)) {
+    squash_free (arena);
+    return (squash_error (SQUASH_FAILED), NULL);
+  }
+
+  return arena;
+}
+
+/**
+ * @brief Destroy an arena and release all of its memory
+ *
+ * The arena must not be bound to any thread.
+ *
+ * @param arena the arena
+ */
+void
+squash_arena_free (SquashArena* arena) {
+  if (arena == NULL)
+    return;
+
+  assert (squash_arena_bound != arena);
+
+  SquashArenaChunk* chunk = arena->chunks;
+  while (chunk != NULL) {
+    SquashArenaChunk* next = chunk->next;
+    squash_free (chunk);
+    chunk = next;
+  }
+
+  SquashArenaHeader* header = arena->large;
+  while (header != NULL) {
+    SquashArenaHeader* next = header->next;
+    squash_free (header);
+    header = next;
+  }
+
+  for (size_t i = 0 ; i < SQUASH_ARENA_N_CLASSES ; i++) {
+    header = arena->free_large[i];
+    while (header != NULL) {
+      SquashArenaHeader* next = header->next;
+      squash_free (header);
+      header = next;
+    }
+  }
+
+  mtx_destroy (&(arena->large_mtx));
+  squash_free (arena);
+}
+
+/**
+ * @brief Reclaim everything allocated from an arena
+ *
+ * All memory handed out by the arena becomes invalid, but it is kept
+ * around to serve future allocations.  Any streams which were created
+ * while the arena was bound must be destroyed before calling this
+ * function.
+ *
+ * @param arena the arena
+ */
+void
+squash_arena_reset (SquashArena* arena) {
+  assert (arena != NULL);
+
+  for (SquashArenaChunk* chunk = arena->chunks ; chunk != NULL ; chunk = chunk->next)
+    chunk->used = 0;
+  arena->current = arena->chunks;
+
+  mtx_lock (&(arena->large_mtx));
+  SquashArenaHeader* header = arena->large;
+  while (header != NULL) {
+    SquashArenaHeader* next = header->next;
+    header->prev = NULL;
+    header->next = arena->free_large[header->size_class];
+    arena->free_large[header->size_class] = header;
+    header = next;
+  }
+  arena->large = NULL;
+  mtx_unlock (&(arena->large_mtx));
+}
+
+/**
+ * @brief Bind an arena to the calling thread
+ *
+ * Scratch memory requested by plugins on this thread will be served
+ * from @a arena until another arena (or *NULL*) is bound.
+ *
+ * @param arena the arena to bind, or *NULL* to unbind
+ * @return the arena which was previously bound, if any
+ */
+SquashArena*
+squash_arena_bind (SquashArena* arena) {
+  SquashArena* previous = squash_arena_bound;
+  squash_arena_bound = arena;
+  return previous;
+}
+
+/**
+ * @brief Get the arena bound to the calling thread
+ *
+ * @return the bound arena, or *NULL*
+ */
+SquashArena*
+squash_arena_get_bound (void) {
+  return squash_arena_bound;
+}
+
+/**
+ * @brief Allocate memory from an arena
+ *
+ * The memory remains valid until the arena is reset or destroyed.  It
+ * may be released earlier with @ref squash_scratch_free.
+ *
+ * @param arena the arena
+ * @param size number of bytes to allocate
+ * @return the allocation, or *NULL* on failure
+ */
+void*
+squash_arena_malloc (SquashArena* arena, size_t size) {
+  assert (arena != NULL);
+
+  return squash_arena_alloc (arena, size, false);
+}
+
+/**
+ * @brief Allocate zeroed memory from an arena
+ *
+ * @param arena the arena
+ * @param nmemb number of elements
+ * @param size size of each element
+ * @return the allocation, or *NULL* on failure
+ */
+void*
+squash_arena_calloc (SquashArena* arena, size_t nmemb, size_t size) {
+  assert (arena != NULL);
+
+  if (SQUASH_UNLIKELY(size != 0 && nmemb > (SIZE_MAX / size)))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  return squash_arena_alloc (arena, nmemb * size, true);
+}
+
+/**
+ * @brief Allocate scratch memory
+ *
+ * If an arena is bound to the calling thread the memory is allocated
+ * from it, otherwise it is allocated with @ref squash_malloc.  Either
+ * way it must be released with @ref squash_scratch_free.
+ *
+ * @param size number of bytes to allocate
+ * @return the allocation, or *NULL* on failure
+ */
+void*
+squash_scratch_malloc (size_t size) {
+  return squash_scratch_alloc (size, false);
+}
+
+/**
+ * @brief Allocate zeroed scratch memory
+ *
+ * @see squash_scratch_malloc
+ *
+ * @param nmemb number of elements
+ * @param size size of each element
+ * @return the allocation, or *NULL* on failure
+ */
+void*
+squash_scratch_calloc (size_t nmemb, size_t size) {
+  if (SQUASH_UNLIKELY(size != 0 && nmemb > (SIZE_MAX / size)))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  return squash_scratch_alloc (nmemb * size, true);
+}
+
+/**
+ * @brief Release scratch memory
+ *
+ * Small arena allocations are only reclaimed when the arena is
+ * reset; large ones are returned to the arena's free lists so they
+ * can be reused immediately.
+ *
+ * @param ptr memory allocated with @ref squash_scratch_malloc, @ref
+ *   squash_scratch_calloc, @ref squash_arena_malloc or @ref
+ *   squash_arena_calloc
+ */
+void
+squash_scratch_free (void* ptr) {
+  if (ptr == NULL)
+    return;
+
+  SquashArenaHeader* header = (SquashArenaHeader*) (((uint8_t*) ptr) - SQUASH_ARENA_HEADER_SIZE);
+
+  switch (header->size_class) {
+    case SQUASH_ARENA_CLASS_HEAP:
+      squash_free (header);
+      break;
+    case SQUASH_ARENA_CLASS_SMALL:
+      break;
+    default:
+      squash_arena_release_large (header->arena, header);
+      break;
+  }
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,53 @@
+/* Copyright (c) 2015-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include <squash/internal.h> */
+
+#ifndef SQUASH_ATOMIC_INTERNAL_H
+#define SQUASH_ATOMIC_INTERNAL_H
+
+#if !defined (SQUASH_COMPILATION)
+#error "This is internal API; you cannot use it."
+#endif
+
+SQUASH_BEGIN_DECLS
+
+#if defined(__GNUC__) || defined(__clang__) || defined(__INTEL_COMPILER)
+#  define SQUASH_ATOMIC_BUILTINS
+#  define squash_atomic_add_size(var, val) __sync_add_and_fetch(var, val)
+#  define squash_atomic_sub_size(var, val) __sync_sub_and_fetch(var, val)
+#  define squash_atomic_cas_size(var, orig, val) __sync_val_compare_and_swap(var, orig, val)
+#else
+SQUASH_INTERNAL
+size_t squash_atomic_add_size (volatile size_t* var, size_t val);
+SQUASH_INTERNAL
+size_t squash_atomic_sub_size (volatile size_t* var, size_t val);
+SQUASH_INTERNAL
+size_t squash_atomic_cas_size (volatile size_t* var, size_t orig, size_t val);
+#endif
+
+SQUASH_END_DECLS
+
+#endif /* SQUASH_ATOMIC_INTERNAL_H */
@@ -81,7 +81,7 @@ squash_buffer_new (size_t preallocated_len) {
   buffer->allocated = 0;
   const bool allocated = squash_buffer_ensure_allocation (buffer, preallocated_len);
   if (SQUASH_UNLIKELY(!allocated))
-    return (free (buffer), NULL);
+    return (squash_free (buffer), NULL);
 
   return buffer;
 }
@@ -0,0 +1,50 @@
+/* Copyright (c) 2015-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include <squash/internal.h> */
+
+#ifndef SQUASH_CHAIN_INTERNAL_H
+#define SQUASH_CHAIN_INTERNAL_H
+
+#if !defined (SQUASH_COMPILATION)
+#error "This is internal API; you cannot use it."
+#endif
+
+SQUASH_BEGIN_DECLS
+
+/* Names like "shuffle+lz4" describe a chain of stages, applied from
+ * left to right when compressing. */
+#define SQUASH_CHAIN_SEPARATOR '+'
+#define SQUASH_CHAIN_MAX_STAGES 8
+
+/* Size of the ring buffer between two stages. */
+#define SQUASH_CHAIN_BUFFER_SIZE ((size_t) (256 * 1024))
+
+SQUASH_NONNULL(1, 2) SQUASH_INTERNAL
+SquashCodec*        squash_chain_get_codec      (SquashContext* context, const char* name);
+
+SQUASH_END_DECLS
+
+#endif /* SQUASH_CHAIN_INTERNAL_H */
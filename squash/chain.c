@@ -0,0 +1,559 @@
+/* Copyright (c) 2015-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#include <assert.h>
+#include <squash/internal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A chain, such as "lz4+zstd" or "shuffle+lz4", looks like any other
+ * codec, but its streams pass the output of each stage to the next
+ * one through a ring buffer.  Stages write directly into the buffer
+ * and the next stage reads directly from it, so nothing is copied
+ * between them; the first stage reads the caller's input and the
+ * last one writes the caller's output.  Decompression runs the stages
+ * in reverse order.
+ *
+ * Filters (see filter.c) aren't codecs, so a run of filters is
+ * attached to the codec which follows it with the "filter" option:
+ * "delta:4+shuffle+lz4" is lz4 with "filter=delta:4,shuffle".  A
+ * chain can't end with a filter.
+ *
+ * If the threads option is anything other than 1, the stages run
+ * concurrently on Squash's thread pool.  In each round every stage
+ * with something to do processes the data which was available when
+ * the round started, and only writes to half of its output buffer,
+ * so the next stage can read the other half at the same time. */
+
+SQUASH_MTX_DEFINE(chains)
+
+enum SquashChainOptIndex {
+  SQUASH_CHAIN_OPT_THREADS = 0
+};
+
+static SquashOptionInfo squash_chain_options[] = {
+  { "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = SQUASH_CHAIN_MAX_STAGES },
+    .default_value.int_value = 1 },
+  { NULL, SQUASH_OPTION_TYPE_NONE, }
+};
+
+typedef struct SquashChainStage_ {
+  SquashCodec* codec;
+  /* Carries the filters in front of the stage, if any. */
+  SquashOptions* options;
+} SquashChainStage;
+
+typedef struct SquashChainCodec_ {
+  SquashCodec base_codec;
+
+  size_t n_stages;
+  SquashChainStage stages[SQUASH_CHAIN_MAX_STAGES];
+
+  /* Streams for codecs which only implement splice have to be driven
+     from the thread which created them. */
+  bool concurrent;
+} SquashChainCodec;
+
+typedef struct SquashChainBuffer_ {
+  uint8_t* data;
+  size_t start;
+  size_t length;
+} SquashChainBuffer;
+
+/* A single call to a stage's stream. */
+typedef struct SquashChainStep_ {
+  size_t stage;
+  SquashOperation operation;
+  const uint8_t* next_in;
+  size_t avail_in;
+  uint8_t* next_out;
+  size_t avail_out;
+  SquashStatus res;
+} SquashChainStep;
+
+typedef struct SquashChainStream_ {
+  SquashStream base_object;
+
+  size_t n_stages;
+  unsigned int threads;
+  SquashStream* stages[SQUASH_CHAIN_MAX_STAGES];
+  /* buffers[i] holds the input of stage i; the first stage reads
+     next_in instead, so buffers[0] is unused. */
+  SquashChainBuffer buffers[SQUASH_CHAIN_MAX_STAGES];
+  /* The stage has written all of its output. */
+  bool done[SQUASH_CHAIN_MAX_STAGES];
+  /* The stage returned SQUASH_PROCESSING, so it may have output left
+     even without more input. */
+  bool pending[SQUASH_CHAIN_MAX_STAGES];
+
+  /* The steps of the current round when running concurrently. */
+  SquashChainStep steps[SQUASH_CHAIN_MAX_STAGES];
+} SquashChainStream;
+
+static size_t
+squash_chain_buffer_get_readable (const SquashChainBuffer* buffer, const uint8_t** data) {
+  const size_t contiguous = SQUASH_CHAIN_BUFFER_SIZE - buffer->start;
+
+  *data = buffer->data + buffer->start;
+  return (buffer->length < contiguous) ? buffer->length : contiguous;
+}
+
+static size_t
+squash_chain_buffer_get_writable (const SquashChainBuffer* buffer, size_t limit, uint8_t** data) {
+  const size_t end = (buffer->start + buffer->length) % SQUASH_CHAIN_BUFFER_SIZE;
+  size_t space;
+
+  if (buffer->length == SQUASH_CHAIN_BUFFER_SIZE)
+    space = 0;
+  else if (end < buffer->start)
+    space = buffer->start - end;
+  else
+    space = SQUASH_CHAIN_BUFFER_SIZE - end;
+
+  *data = buffer->data + end;
+  return (space < limit) ? space : limit;
+}
+
+static void
+squash_chain_buffer_consume (SquashChainBuffer* buffer, size_t size) {
+  assert (size <= buffer->length);
+
+  buffer->length -= size;
+  buffer->start = (buffer->length == 0) ? 0 : ((buffer->start + size) % SQUASH_CHAIN_BUFFER_SIZE);
+}
+
+static void
+squash_chain_stream_destroy (void* stream) {
+  SquashChainStream* s = (SquashChainStream*) stream;
+
+  for (size_t i = 0 ; i < s->n_stages ; i++) {
+    if (s->stages[i] != NULL)
+      squash_object_unref (s->stages[i]);
+    squash_free (s->buffers[i].data);
+  }
+
+  squash_stream_destroy (stream);
+}
+
+static SquashStream*
+squash_chain_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  SquashChainCodec* chain = (SquashChainCodec*) codec;
+  SquashChainStream* stream = squash_malloc (sizeof (SquashChainStream));
+
+  if (SQUASH_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  memset (stream, 0, sizeof (SquashChainStream));
+  squash_stream_init (stream, codec, stream_type, options, squash_chain_stream_destroy);
+
+  stream->n_stages = chain->n_stages;
+  stream->threads = (chain->concurrent && chain->n_stages > 1) ?
+    (unsigned int) squash_options_get_int_at (options, codec, SQUASH_CHAIN_OPT_THREADS) : 1;
+
+  for (size_t i = 0 ; i < chain->n_stages ; i++) {
+    const SquashChainStage* stage =
+      &(chain->stages[(stream_type == SQUASH_STREAM_COMPRESS) ? i : (chain->n_stages - 1 - i)]);
+
+    stream->stages[i] = squash_codec_create_stream_with_options (stage->codec, stream_type, stage->options);
+    if (SQUASH_UNLIKELY(stream->stages[i] == NULL))
+      goto error;
+
+    if (i != 0) {
+      stream->buffers[i].data = squash_malloc (SQUASH_CHAIN_BUFFER_SIZE);
+      if (SQUASH_UNLIKELY(stream->buffers[i].data == NULL)) {
+        squash_error (SQUASH_MEMORY);
+        goto error;
+      }
+    }
+  }
+
+  return (SquashStream*) stream;
+
+ error:
+  squash_object_unref (stream);
+  return NULL;
+}
+
+/* Work out what stage @a i can do with the data available right now;
+ * returns false if it can't do anything. */
+static bool
+squash_chain_stream_prepare_step (SquashChainStream* stream, size_t i, SquashOperation operation, size_t limit, SquashChainStep* step) {
+  SquashStream* s = (SquashStream*) stream;
+  bool upstream_done;
+  bool complete;
+
+  if (stream->done[i])
+    return false;
+
+  step->stage = i;
+
+  if (i == 0) {
+    step->next_in = s->next_in;
+    step->avail_in = s->avail_in;
+    upstream_done = (operation == SQUASH_OPERATION_FINISH);
+    complete = true;
+  } else {
+    step->avail_in = squash_chain_buffer_get_readable (&(stream->buffers[i]), &(step->next_in));
+    upstream_done = stream->done[i - 1];
+    complete = (step->avail_in == stream->buffers[i].length);
+  }
+
+  if (i == stream->n_stages - 1) {
+    step->next_out = s->next_out;
+    step->avail_out = s->avail_out;
+  } else {
+    step->avail_out = squash_chain_buffer_get_writable (&(stream->buffers[i + 1]), limit, &(step->next_out));
+  }
+
+  /* A stage may only be finished once all of its remaining input is
+     contiguous; until then the part before the end of the ring is
+     processed normally. */
+  step->operation = (upstream_done && complete) ? SQUASH_OPERATION_FINISH : SQUASH_OPERATION_PROCESS;
+
+  if (step->avail_out == 0)
+    return false;
+  if (step->operation == SQUASH_OPERATION_PROCESS && step->avail_in == 0 && !stream->pending[i])
+    return false;
+
+  return true;
+}
+
+static void
+squash_chain_stream_run_step (SquashChainStream* stream, SquashChainStep* step) {
+  SquashStream* stage = stream->stages[step->stage];
+
+  stage->next_in = step->next_in;
+  stage->avail_in = step->avail_in;
+  stage->next_out = step->next_out;
+  stage->avail_out = step->avail_out;
+
+  step->res = (step->operation == SQUASH_OPERATION_FINISH) ?
+    squash_stream_finish (stage) :
+    squash_stream_process (stage);
+}
+
+/* Apply the result of a step to the stream; returns true if the step
+ * made any progress. */
+static bool
+squash_chain_stream_apply_step (SquashChainStream* stream, const SquashChainStep* step, SquashStatus* error) {
+  SquashStream* s = (SquashStream*) stream;
+  SquashStream* stage = stream->stages[step->stage];
+  const size_t consumed = step->avail_in - stage->avail_in;
+  const size_t produced = step->avail_out - stage->avail_out;
+  const size_t i = step->stage;
+
+  /* Steps are applied in order, so a buffer is always filled by its
+     producer before its consumer empties (and possibly rewinds) it. */
+  if (i == stream->n_stages - 1) {
+    s->next_out += produced;
+    s->avail_out -= produced;
+  } else {
+    stream->buffers[i + 1].length += produced;
+  }
+
+  if (i == 0) {
+    s->next_in += consumed;
+    s->avail_in -= consumed;
+  } else {
+    squash_chain_buffer_consume (&(stream->buffers[i]), consumed);
+  }
+
+  if (step->res == SQUASH_END_OF_STREAM ||
+      (step->operation == SQUASH_OPERATION_FINISH && step->res == SQUASH_OK)) {
+    stream->done[i] = true;
+    stream->pending[i] = false;
+    return true;
+  } else if (SQUASH_UNLIKELY(step->res < 0)) {
+    if (*error == SQUASH_OK)
+      *error = step->res;
+    return false;
+  }
+
+  stream->pending[i] = (step->res == SQUASH_PROCESSING);
+
+  return consumed != 0 || produced != 0;
+}
+
+static SquashStatus
+squash_chain_stream_run_step_cb (size_t index, void* user_data) {
+  SquashChainStream* stream = (SquashChainStream*) user_data;
+
+  squash_chain_stream_run_step (stream, &(stream->steps[index]));
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_chain_process_stream (SquashStream* stream, SquashOperation operation) {
+  SquashChainStream* s = (SquashChainStream*) stream;
+  SquashStatus error = SQUASH_OK;
+  bool progress;
+
+  if (SQUASH_UNLIKELY(operation == SQUASH_OPERATION_FLUSH))
+    return squash_error (SQUASH_INVALID_OPERATION);
+
+  do {
+    progress = false;
+
+    if (s->threads == 1) {
+      /* Each stage sees what the previous one just wrote. */
+      for (size_t i = 0 ; i < s->n_stages && error == SQUASH_OK ; i++) {
+        SquashChainStep step;
+        if (squash_chain_stream_prepare_step (s, i, operation, SQUASH_CHAIN_BUFFER_SIZE, &step)) {
+          squash_chain_stream_run_step (s, &step);
+          progress |= squash_chain_stream_apply_step (s, &step, &error);
+        }
+      }
+    } else {
+      size_t n_steps = 0;
+
+      for (size_t i = 0 ; i < s->n_stages ; i++) {
+        if (squash_chain_stream_prepare_step (s, i, operation, SQUASH_CHAIN_BUFFER_SIZE / 2, &(s->steps[n_steps])))
+          n_steps++;
+      }
+
+      squash_parallel_for (s->threads, n_steps, squash_chain_stream_run_step_cb, s);
+
+      for (size_t i = 0 ; i < n_steps ; i++)
+        progress |= squash_chain_stream_apply_step (s, &(s->steps[i]), &error);
+    }
+  } while (progress && error == SQUASH_OK);
+
+  if (SQUASH_UNLIKELY(error != SQUASH_OK))
+    return error;
+
+  if (s->done[s->n_stages - 1])
+    return (operation == SQUASH_OPERATION_FINISH) ? SQUASH_OK : SQUASH_END_OF_STREAM;
+  else if (stream->avail_out == 0)
+    return SQUASH_PROCESSING;
+  else if (operation == SQUASH_OPERATION_PROCESS && stream->avail_in == 0)
+    return SQUASH_OK;
+  else
+    return squash_error (SQUASH_FAILED);
+}
+
+static SquashStatus
+squash_chain_reset_stream (SquashStream* stream) {
+  SquashChainStream* s = (SquashChainStream*) stream;
+
+  for (size_t i = 0 ; i < s->n_stages ; i++) {
+    const SquashStatus res = squash_stream_reset (s->stages[i]);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      return res;
+
+    s->buffers[i].start = 0;
+    s->buffers[i].length = 0;
+    s->done[i] = false;
+    s->pending[i] = false;
+  }
+
+  return SQUASH_OK;
+}
+
+static size_t
+squash_chain_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
+  SquashChainCodec* chain = (SquashChainCodec*) codec;
+  size_t size = uncompressed_size;
+
+  /* Even empty input becomes a header or two, so every stage counts;
+     only a stage which can't handle its (non-empty) input fails. */
+  for (size_t i = 0 ; i < chain->n_stages ; i++) {
+    const size_t stage_size = squash_codec_get_max_compressed_size (chain->stages[i].codec, size);
+    if (SQUASH_UNLIKELY(stage_size == 0 && size != 0))
+      return 0;
+    size = stage_size;
+  }
+
+  return size;
+}
+
+static size_t
+squash_chain_get_memory_usage (SquashCodec* codec, SquashOptions* options, SquashStreamType stream_type) {
+  SquashChainCodec* chain = (SquashChainCodec*) codec;
+  size_t usage = (chain->n_stages - 1) * SQUASH_CHAIN_BUFFER_SIZE;
+
+  (void) options;
+
+  for (size_t i = 0 ; i < chain->n_stages ; i++)
+    usage += squash_codec_get_memory_usage (chain->stages[i].codec, chain->stages[i].options, stream_type);
+
+  return usage;
+}
+
+static void
+squash_chain_codec_free (SquashChainCodec* chain) {
+  for (size_t i = 0 ; i < chain->n_stages ; i++) {
+    if (chain->stages[i].options != NULL)
+      squash_object_unref (chain->stages[i].options);
+  }
+
+  squash_free (chain->base_codec.name);
+  squash_free (chain);
+}
+
+static SquashChainCodec*
+squash_chain_codec_new (SquashContext* context, const char* name) {
+  SquashChainCodec* chain = squash_malloc (sizeof (SquashChainCodec));
+  char* filters = NULL;
+  size_t filters_length = 0;
+  const char* p = name;
+
+  if (SQUASH_UNLIKELY(chain == NULL))
+    return NULL;
+  memset (chain, 0, sizeof (SquashChainCodec));
+  chain->concurrent = true;
+
+  while (true) {
+    const size_t length = strcspn (p, "+");
+    SquashFilterChain* filter_chain = NULL;
+
+    char* stage_name = squash_malloc (length + 1);
+    if (SQUASH_UNLIKELY(stage_name == NULL))
+      goto error;
+    memcpy (stage_name, p, length);
+    stage_name[length] = '\0';
+
+    if (length == 0) {
+      squash_free (stage_name);
+      goto error;
+    } else if (squash_filter_chain_parse (stage_name, &filter_chain) == SQUASH_OK) {
+      squash_filter_chain_free (filter_chain);
+
+      char* tmp = squash_realloc (filters, filters_length + length + 2);
+      if (SQUASH_UNLIKELY(tmp == NULL)) {
+        squash_free (stage_name);
+        goto error;
+      }
+      filters = tmp;
+      if (filters_length != 0)
+        filters[filters_length++] = ',';
+      memcpy (filters + filters_length, stage_name, length + 1);
+      filters_length += length;
+    } else {
+      SquashChainStage* stage = &(chain->stages[chain->n_stages]);
+
+      if (SQUASH_UNLIKELY(chain->n_stages == SQUASH_CHAIN_MAX_STAGES)) {
+        squash_free (stage_name);
+        goto error;
+      }
+
+      stage->codec = squash_context_get_codec (context, stage_name);
+      if (SQUASH_UNLIKELY(stage->codec == NULL)) {
+        squash_free (stage_name);
+        goto error;
+      }
+
+      if (filters != NULL) {
+        stage->options = squash_object_ref_sink (squash_options_new (stage->codec, "filter", filters, NULL));
+        squash_free (filters);
+        filters = NULL;
+        filters_length = 0;
+
+        if (SQUASH_UNLIKELY(stage->options == NULL)) {
+          squash_free (stage_name);
+          goto error;
+        }
+      }
+
+      if (stage->codec->impl.create_stream == NULL && stage->codec->impl.splice != NULL)
+        chain->concurrent = false;
+
+      chain->n_stages++;
+    }
+
+    squash_free (stage_name);
+
+    p += length;
+    if (*p == '\0')
+      break;
+    p++;
+  }
+
+  if (SQUASH_UNLIKELY(filters != NULL || chain->n_stages == 0))
+    goto error;
+
+  SquashCodec* codec = squash_codec_new (NULL, name);
+  if (SQUASH_UNLIKELY(codec == NULL))
+    goto error;
+  chain->base_codec = *codec;
+  squash_free (codec);
+
+  chain->base_codec.initialized = true;
+  chain->base_codec.impl.info = SQUASH_CODEC_INFO_NATIVE_STREAMING;
+  chain->base_codec.impl.options = squash_chain_options;
+  chain->base_codec.impl.create_stream = squash_chain_create_stream;
+  chain->base_codec.impl.process_stream = squash_chain_process_stream;
+  chain->base_codec.impl.reset_stream = squash_chain_reset_stream;
+  chain->base_codec.impl.get_max_compressed_size = squash_chain_get_max_compressed_size;
+  chain->base_codec.impl.get_memory_usage = squash_chain_get_memory_usage;
+
+  return chain;
+
+ error:
+  squash_free (filters);
+  squash_chain_codec_free (chain);
+  return NULL;
+}
+
+/**
+ * @brief Get (creating it if necessary) the codec for a chain
+ * @private
+ *
+ * Chains are created the first time they are requested, and owned
+ * by the context like any other codec.
+ *
+ * @param context The context
+ * @param name Names of the codecs and filters in the chain, separated
+ *   by "+" (e.g., "shuffle+lz4")
+ * @return The codec, or *NULL* if any of the stages couldn't be found
+ */
+SquashCodec*
+squash_chain_get_codec (SquashContext* context, const char* name) {
+  SquashCodec key = { 0, };
+  SquashCodec* codec;
+
+  key.name = (char*) name;
+
+  SQUASH_MTX_LOCK(chains);
+  codec = SQUASH_TREE_FIND (&(context->chains), SquashCodec_, tree, &key);
+  if (codec == NULL) {
+    SquashChainCodec* chain = squash_chain_codec_new (context, name);
+    if (chain != NULL) {
+      codec = &(chain->base_codec);
+      SQUASH_TREE_INSERT (&(context->chains), SquashCodec_, tree, codec);
+    }
+  }
+  SQUASH_MTX_UNLOCK(chains);
+
+  return codec;
+}
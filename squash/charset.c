@@ -164,9 +164,12 @@ squash_charset_convert (size_t* output_size, char** output, const char* output_c
   const char* in_p = input;
   do {
     out_size *= 2;
-    out_start = squash_realloc (out_start, out_size);
-    if (out_start == NULL)
-      return false;
+    char* tmp = squash_realloc (out_start, out_size);
+    if (tmp == NULL) {
+      res = false;
+      break;
+    }
+    out_start = tmp;
 
     char* out_p = out_start + out_off;
     size_t in_rem = input + input_size - in_p;
@@ -225,7 +228,7 @@ squash_charset_locale_to_wide (const char* input) {
   if (s == ((size_t) -1))
     return NULL;
 
-  output = calloc (s, sizeof (wchar_t));
+  output = squash_calloc (s, sizeof (wchar_t));
   if (output == NULL)
     return NULL;
 
@@ -250,7 +253,7 @@ squash_charset_wide_to_locale (const wchar_t* input) {
   if (s == ((size_t) -1))
     return NULL;
 
-  output = calloc (s, sizeof (wchar_t));
+  output = squash_calloc (s, sizeof (wchar_t));
   if (output == NULL)
     return NULL;
 
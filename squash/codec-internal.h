@@ -39,19 +39,37 @@ SquashCodec*            squash_codec_new                     (SquashPlugin* plug
 SQUASH_NONNULL(1) SQUASH_INTERNAL
 void                    squash_codec_set_extension           (SquashCodec* codec, const char* extension);
 SQUASH_NONNULL(1) SQUASH_INTERNAL
+void                    squash_codec_set_mime_type           (SquashCodec* codec, const char* mime_type);
+SQUASH_NONNULL(1, 2) SQUASH_INTERNAL
+void                    squash_codec_add_alias               (SquashCodec* codec, const char* alias);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
 void                    squash_codec_set_priority            (SquashCodec* codec, unsigned int priority);
 SQUASH_NONNULL(1, 2) SQUASH_INTERNAL
 int                     squash_codec_compare                 (SquashCodec* a, SquashCodec* b);
-SQUASH_NONNULL(1, 2) SQUASH_INTERNAL
-int                     squash_codec_extension_compare       (SquashCodec* a, SquashCodec* b);
 SQUASH_NONNULL(1) SQUASH_INTERNAL
 SquashCodecImpl*        squash_codec_get_impl                (SquashCodec* codec);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+SquashOptions*          squash_codec_options_newv            (SquashCodec* codec, va_list options);
 SQUASH_NONNULL(1, 2, 4) SQUASH_INTERNAL
 SquashStatus            squash_codec_decompress_to_buffer    (SquashCodec* codec,
                                                               SquashBuffer* decompressed,
                                                               size_t compressed_size,
                                                               uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
                                                               SquashOptions* options);
+SQUASH_NONNULL(1, 2, 3, 5) SQUASH_INTERNAL
+SquashStatus            squash_codec_compress_buffer         (SquashCodec* codec,
+                                                              size_t* compressed_size,
+                                                              uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                                                              size_t uncompressed_size,
+                                                              const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                                                              SquashOptions* options);
+SQUASH_NONNULL(1, 2, 3, 5) SQUASH_INTERNAL
+SquashStatus            squash_codec_decompress_buffer       (SquashCodec* codec,
+                                                              size_t* decompressed_size,
+                                                              uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                                                              size_t compressed_size,
+                                                              const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                                                              SquashOptions* options);
 
 SQUASH_TREE_PROTOTYPES(SquashCodec_, tree)
 SQUASH_TREE_DEFINE(SquashCodec_, tree)
@@ -0,0 +1,66 @@
+/* Copyright (c) 2015-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include <squash/internal.h> */
+
+#ifndef SQUASH_CODEC_TABLE_INTERNAL_H
+#define SQUASH_CODEC_TABLE_INTERNAL_H
+
+#if !defined (SQUASH_COMPILATION)
+#error "This is internal API; you cannot use it."
+#endif
+
+SQUASH_BEGIN_DECLS
+
+typedef struct SquashCodecTableEntry_ {
+  const char* key;
+  SquashCodec* codec;
+  bool alias;
+} SquashCodecTableEntry;
+
+/* Case-insensitive map from strings (names, extensions, MIME types)
+ * to codecs.  Entries are added while plugins are discovered, then
+ * squash_codec_table_build turns them into a perfect hash table which
+ * never changes again. */
+typedef struct SquashCodecTable_ {
+  SquashCodecTableEntry* entries;
+  size_t n_entries;
+
+  uint32_t* seeds;
+  size_t n_buckets;
+  SquashCodecTableEntry* slots;
+  size_t n_slots;
+} SquashCodecTable;
+
+SQUASH_NONNULL(1, 2, 3) SQUASH_INTERNAL
+void                squash_codec_table_add    (SquashCodecTable* table, const char* key, SquashCodec* codec, bool alias);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+void                squash_codec_table_build  (SquashCodecTable* table);
+SQUASH_NONNULL(1, 2) SQUASH_INTERNAL
+SquashCodec*        squash_codec_table_lookup (const SquashCodecTable* table, const char* key);
+
+SQUASH_END_DECLS
+
+#endif /* SQUASH_CODEC_TABLE_INTERNAL_H */
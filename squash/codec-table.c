@@ -0,0 +1,237 @@
+/* Copyright (c) 2015-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#include <assert.h>
+#include <squash/internal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_MSC_VER)
+#include <strings.h>
+#endif
+
+/* The table is a "hash and displace" perfect hash: keys are first
+ * hashed into buckets, then each bucket gets its own seed for a
+ * second hash which sends every key in the bucket to an empty slot.
+ * Looking a key up takes two hashes and one comparison, whatever the
+ * number of codecs. */
+
+/* Seeds to try for a bucket before giving up and making the table
+ * bigger. */
+#define SQUASH_CODEC_TABLE_MAX_SEED ((uint32_t) 4096)
+
+static uint32_t
+squash_codec_table_hash (const char* key, uint32_t seed) {
+  /* FNV-1a over the lower-cased key, with a murmur3 finalizer */
+  uint32_t h = 2166136261U ^ (seed * 0x9e3779b9U);
+
+  for (const unsigned char* p = (const unsigned char*) key ; *p != '\0' ; p++) {
+    const unsigned char c = (*p >= 'A' && *p <= 'Z') ? (unsigned char) (*p + ('a' - 'A')) : *p;
+    h = (h ^ c) * 16777619U;
+  }
+
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+
+  return h;
+}
+
+/**
+ * @brief Add a key to a table which hasn't been built yet
+ * @private
+ *
+ * If the key is already present it is kept, unless @a codec has a
+ * higher priority than the codec it maps to.  A codec's real name
+ * always wins over another codec's alias, whatever the priorities.
+ *
+ * @param table The table
+ * @param key The key; must remain valid as long as the table does
+ * @param codec The codec
+ * @param alias Whether @a key is an alias rather than the codec's
+ *   name
+ */
+void
+squash_codec_table_add (SquashCodecTable* table, const char* key, SquashCodec* codec, bool alias) {
+  assert (table->slots == NULL);
+
+  for (size_t i = 0 ; i < table->n_entries ; i++) {
+    SquashCodecTableEntry* entry = &(table->entries[i]);
+
+    if (strcasecmp (entry->key, key) == 0) {
+      if ((entry->alias && !alias) ||
+          (entry->alias == alias && codec->priority > entry->codec->priority)) {
+        entry->key = key;
+        entry->codec = codec;
+        entry->alias = alias;
+      }
+      return;
+    }
+  }
+
+  table->entries = squash_realloc (table->entries, sizeof (SquashCodecTableEntry) * (table->n_entries + 1));
+  table->entries[table->n_entries].key = key;
+  table->entries[table->n_entries].codec = codec;
+  table->entries[table->n_entries].alias = alias;
+  table->n_entries++;
+}
+
+/* Try to find a seed for every bucket with a table of table->n_slots
+ * slots. */
+static bool
+squash_codec_table_place (SquashCodecTable* table, const size_t* first, const size_t* members, size_t max_bucket_size) {
+  size_t* placed = squash_malloc (sizeof (size_t) * max_bucket_size);
+  bool res = true;
+
+  /* Big buckets are the hardest to place, so do them while the table
+     is still mostly empty. */
+  for (size_t size = max_bucket_size ; size > 0 && res ; size--) {
+    for (size_t b = 0 ; b < table->n_buckets && res ; b++) {
+      if (first[b + 1] - first[b] != size)
+        continue;
+
+      uint32_t seed;
+      for (seed = 1 ; seed < SQUASH_CODEC_TABLE_MAX_SEED ; seed++) {
+        size_t n_placed = 0;
+
+        for (size_t m = first[b] ; m < first[b + 1] ; m++) {
+          const SquashCodecTableEntry* entry = &(table->entries[members[m]]);
+          const size_t slot = squash_codec_table_hash (entry->key, seed) % table->n_slots;
+
+          if (table->slots[slot].key != NULL)
+            break;
+
+          table->slots[slot] = *entry;
+          placed[n_placed++] = slot;
+        }
+
+        if (n_placed == size)
+          break;
+
+        while (n_placed > 0)
+          table->slots[placed[--n_placed]].key = NULL;
+      }
+
+      if (seed == SQUASH_CODEC_TABLE_MAX_SEED)
+        res = false;
+      else
+        table->seeds[b] = seed;
+    }
+  }
+
+  squash_free (placed);
+
+  return res;
+}
+
+/**
+ * @brief Build the perfect hash table
+ * @private
+ *
+ * Once the table has been built no more keys may be added.
+ *
+ * @param table The table
+ */
+void
+squash_codec_table_build (SquashCodecTable* table) {
+  const size_t n = table->n_entries;
+
+  assert (table->slots == NULL);
+
+  if (n == 0)
+    return;
+
+  table->n_buckets = (n + 1) / 2;
+  table->n_slots = n + (n / 4) + 1;
+
+  /* Group the entries by bucket: the members of bucket b are
+     members[first[b]] to members[first[b + 1] - 1]. */
+  size_t* first = squash_malloc (sizeof (size_t) * (table->n_buckets + 1));
+  size_t* members = squash_malloc (sizeof (size_t) * n);
+  size_t* buckets = squash_malloc (sizeof (size_t) * n);
+  size_t max_bucket_size = 0;
+
+  memset (first, 0, sizeof (size_t) * (table->n_buckets + 1));
+  for (size_t i = 0 ; i < n ; i++) {
+    buckets[i] = squash_codec_table_hash (table->entries[i].key, 0) % table->n_buckets;
+    first[buckets[i] + 1]++;
+  }
+  for (size_t b = 0 ; b < table->n_buckets ; b++) {
+    if (first[b + 1] > max_bucket_size)
+      max_bucket_size = first[b + 1];
+    first[b + 1] += first[b];
+  }
+  for (size_t i = 0 ; i < n ; i++)
+    members[first[buckets[i]]++] = i;
+  for (size_t b = table->n_buckets ; b > 0 ; b--)
+    first[b] = first[b - 1];
+  first[0] = 0;
+
+  while (true) {
+    table->seeds = squash_malloc (sizeof (uint32_t) * table->n_buckets);
+    table->slots = squash_malloc (sizeof (SquashCodecTableEntry) * table->n_slots);
+    memset (table->seeds, 0, sizeof (uint32_t) * table->n_buckets);
+    memset (table->slots, 0, sizeof (SquashCodecTableEntry) * table->n_slots);
+
+    if (squash_codec_table_place (table, first, members, max_bucket_size))
+      break;
+
+    squash_free (table->seeds);
+    squash_free (table->slots);
+    table->n_slots *= 2;
+  }
+
+  squash_free (first);
+  squash_free (members);
+  squash_free (buckets);
+
+  squash_free (table->entries);
+  table->entries = NULL;
+}
+
+/**
+ * @brief Look up a key
+ * @private
+ *
+ * @param table The table, which must have been built
+ * @param key The key (case-insensitive)
+ * @return The codec, or *NULL* if the key isn't in the table
+ */
+SquashCodec*
+squash_codec_table_lookup (const SquashCodecTable* table, const char* key) {
+  if (table->n_slots == 0)
+    return NULL;
+
+  const uint32_t bucket = squash_codec_table_hash (key, 0) % table->n_buckets;
+  const SquashCodecTableEntry* entry = &(table->slots[squash_codec_table_hash (key, table->seeds[bucket]) % table->n_slots]);
+
+  return (entry->key != NULL && strcasecmp (entry->key, key) == 0) ? entry->codec : NULL;
+}
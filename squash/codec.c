@@ -168,6 +168,12 @@
  * is at least as long as the maximum compressed size for a buffer
  * of @a uncompressed_size bytes.
  *
+ * If the caller's buffer is smaller than that Squash has to compress
+ * to a scratch buffer and copy the result, so plugins should only
+ * use this when the underlying library can not detect that it has
+ * run out of room in the output buffer.  If it can, implement
+ * compress_buffer instead (possibly as well).
+ *
  * @param codec The codec.
  * @param uncompressed The uncompressed data.
  * @param uncompressed_size The size of the uncompressed data.
@@ -180,33 +186,104 @@
  */
 
 /**
- * @var SquashCodecImpl_::_reserved1
- * @brief Reserved for future use.
+ * @var SquashCodecImpl_::get_memory_usage
+ * @brief Estimate the peak memory usage of an operation.
+ *
+ * The estimate should cover the working memory the codec allocates
+ * (dictionaries, hash tables, model state, etc.), but not the input
+ * and output buffers.
+ *
+ * @param codec The codec.
+ * @param options Options which will be used for the operation (or
+ *   *NULL* for the defaults).
+ * @param stream_type Whether the estimate is for compression or
+ *   decompression.
+ * @return Estimated peak memory usage in bytes, or 0 if unknown.
+ *
+ * @see squash_codec_get_memory_usage
  */
 
 /**
- * @var SquashCodecImpl_::_reserved2
- * @brief Reserved for future use.
+ * @var SquashCodecImpl_::build_index
+ * @brief Build an index of checkpoints for random access.
+ *
+ * @param codec The codec.
+ * @param options The options.
+ * @param fp_index File to write the index to.
+ * @param fp_in Compressed file, positioned at the start of the data.
+ * @param span Approximate distance between checkpoints, in
+ *   uncompressed bytes, or 0 for the codec's default.
+ * @return A status code.
+ *
+ * @see squash_index_build
  */
 
 /**
- * @var SquashCodecImpl_::_reserved3
- * @brief Reserved for future use.
+ * @var SquashCodecImpl_::extract
+ * @brief Decompress a range of a file using an index.
+ *
+ * @param codec The codec.
+ * @param options The options.
+ * @param fp_index Index created by SquashCodecImpl::build_index.
+ * @param fp_in Compressed file.
+ * @param offset Uncompressed offset of the first byte to read.
+ * @param decompressed_size Number of bytes to read; set to the
+ *   number actually read.
+ * @param decompressed Output buffer.
+ * @return A status code.
+ *
+ * @see squash_index_extract
  */
 
 /**
- * @var SquashCodecImpl_::_reserved4
- * @brief Reserved for future use.
+ * @var SquashCodecImpl_::reset_stream
+ * @brief Reset a stream so it can be reused.
+ *
+ * Return the stream to the state it was in when create_stream
+ * returned it, keeping the same options.  Squash resets the fields of
+ * the @ref SquashStream itself.
+ *
+ * @param stream The stream.
+ * @return A status code.
+ *
+ * @see squash_stream_reset
  */
 
 /**
- * @var SquashCodecImpl_::_reserved5
- * @brief Reserved for future use.
+ * @var SquashCodecImpl_::checkpoint_stream
+ * @brief Serialize the state of a stream.
+ *
+ * Only called on an idle stream with no pending input, after a
+ * flush.  The codec writes whatever it needs to continue the stream
+ * from this point in a new stream; Squash takes care of the totals.
+ * If the buffer is too small (or NULL), set @a checkpoint_size to the
+ * size required and return ::SQUASH_BUFFER_FULL.  Return
+ * ::SQUASH_STATE if the stream still holds data which hasn't been
+ * written out, and ::SQUASH_INVALID_OPERATION if the stream can't be
+ * checkpointed with its current options.
+ *
+ * @param stream The stream.
+ * @param checkpoint_size Size of @a checkpoint; set to the number of
+ *   bytes written.
+ * @param checkpoint Buffer to write the state to.
+ * @return A status code.
+ *
+ * @see squash_stream_checkpoint
  */
 
 /**
- * @var SquashCodecImpl_::_reserved6
- * @brief Reserved for future use.
+ * @var SquashCodecImpl_::restore_stream
+ * @brief Restore a checkpoint created by checkpoint_stream.
+ *
+ * Called on a newly created stream, with the same codec, stream type
+ * and options as the one the checkpoint was taken from.
+ *
+ * @param stream The stream.
+ * @param checkpoint_size Size of @a checkpoint.
+ * @param checkpoint The state written by checkpoint_stream.
+ * @return A status code.
+ *
+ * @see squash_stream_restore
  */
 
 /**
@@ -231,14 +308,6 @@ squash_codec_compare (SquashCodec* a, SquashCodec* b) {
   return strcmp (a->name, b->name);
 }
 
-int
-squash_codec_extension_compare (SquashCodec* a, SquashCodec* b) {
-  assert (a != NULL);
-  assert (b != NULL);
-
-  return strcmp (a->extension, b->extension);
-}
-
 /**
  * @defgroup SquashCodec SquashCodec
  * @brief A compression/decompression codec
@@ -270,6 +339,9 @@ squash_codec_extension_compare (SquashCodec* a, SquashCodec* b) {
 /**
  * @var SquashCodecInfo::SQUASH_CODEC_INFO_CAN_FLUSH
  * @brief Flushing is supported
+ *
+ * Some options (such as "filter") rule flushing out for a stream; use
+ * ::squash_stream_get_info to check a particular stream.
  */
 
 /**
@@ -296,6 +368,26 @@ squash_codec_extension_compare (SquashCodec* a, SquashCodec* b) {
  * Squash plugins separately from Squash.
  */
 
+/**
+ * @var SquashCodecInfo::SQUASH_CODEC_INFO_SEGMENTED
+ * @brief Buffers larger than *INT_MAX* bytes should be split into
+ *   segments.
+ *
+ * Many codecs use an `int` for buffer lengths, so they cannot process
+ * a buffer of more than 2 GiB in a single call.  When this flag is
+ * set and the input to ::squash_codec_compress_with_options is larger
+ * than *INT_MAX* bytes, Squash splits it into independent segments,
+ * compresses each one with the codec (in parallel if the thread
+ * budget allows; see ::squash_set_max_threads), and wraps the result
+ * in a small frame which records the size of each segment.
+ * Decompression recognizes the frame and reverses the process.
+ *
+ * Inputs no larger than *INT_MAX* are passed straight to the codec, so
+ * the output is unchanged for them.  The flag is only honored for
+ * codecs which provide buffer-to-buffer compression and decompression
+ * functions.
+ */
+
 /**
  * @var SquashCodecInfo::SQUASH_CODEC_INFO_AUTO_MASK
  * @brief Mask of flags which are automatically set based on which
@@ -353,7 +445,8 @@ squash_codec_get_priority (SquashCodec* codec) {
  * @brief Get the plugin associated with a codec
  *
  * @param codec The codec
- * @return The plugin to which the codec belongs
+ * @return The plugin to which the codec belongs, or *NULL* for a
+ *   chain of codecs
  */
 SquashPlugin*
 squash_codec_get_plugin (SquashCodec* codec) {
@@ -372,7 +465,7 @@ SquashContext*
 squash_codec_get_context (SquashCodec* codec) {
   assert (codec != NULL);
 
-  return codec->plugin->context;
+  return (codec->plugin != NULL) ? codec->plugin->context : squash_context_get_default ();
 }
 
 /**
@@ -393,6 +486,10 @@ squash_codec_get_context (SquashCodec* codec) {
  */
 SquashStatus
 squash_codec_init (SquashCodec* codec) {
+  /* Chains don't belong to a plugin, and are created initialized. */
+  if (codec->plugin == NULL)
+    return codec->initialized ? SQUASH_OK : squash_error (SQUASH_UNABLE_TO_LOAD);
+
   return squash_plugin_init_codec (codec->plugin, codec, &(codec->impl));
 }
 
@@ -414,6 +511,30 @@ squash_codec_get_impl (SquashCodec* codec) {
   return &(codec->impl);
 }
 
+/**
+ * @brief Create options from a variadic list of key/value pairs
+ * @private
+ *
+ * Like ::squash_options_newv, except that if the list is empty it
+ * returns *NULL* (which means the same thing) instead of allocating
+ * and parsing a new @ref SquashOptions, which would otherwise be a
+ * large part of the cost of processing a small buffer.
+ *
+ * @param codec The codec.
+ * @param options List of key/value option pairs, followed by *NULL*
+ * @return The options, or *NULL* if there were none.
+ */
+SquashOptions*
+squash_codec_options_newv (SquashCodec* codec, va_list options) {
+  va_list peek;
+
+  va_copy (peek, options);
+  const char* key = va_arg (peek, const char*);
+  va_end (peek);
+
+  return (key == NULL) ? NULL : squash_options_newv (codec, options);
+}
+
 /**
  * @brief Get the uncompressed size of the compressed buffer
  *
@@ -438,7 +559,11 @@ squash_codec_get_uncompressed_size (SquashCodec* codec,
   assert (compressed != NULL);
 
   impl = squash_codec_get_impl (codec);
-  if (impl != NULL && impl->get_uncompressed_size != NULL) {
+  if (impl == NULL) {
+    return 0;
+  } else if (SQUASH_UNLIKELY(squash_segment_is_frame (impl, compressed_size, compressed))) {
+    return squash_segment_get_uncompressed_size (compressed_size, compressed);
+  } else if (impl->get_uncompressed_size != NULL) {
     return impl->get_uncompressed_size (codec, compressed_size, compressed);
   } else {
     return 0;
@@ -469,8 +594,47 @@ squash_codec_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_si
   assert (codec != NULL);
 
   impl = squash_codec_get_impl (codec);
-  if (impl != NULL && impl->get_max_compressed_size != NULL) {
+  if (impl == NULL || impl->get_max_compressed_size == NULL) {
+    return 0;
+  } else if (SQUASH_UNLIKELY(squash_segment_required (impl, uncompressed_size))) {
+    return squash_segment_get_max_compressed_size (codec, uncompressed_size);
+  } else {
     return impl->get_max_compressed_size (codec, uncompressed_size);
+  }
+}
+
+/**
+ * @brief Estimate the memory required to compress or decompress
+ *
+ * The result is the codec's own estimate of the peak amount of
+ * working memory it will allocate for a single operation with the
+ * given options; it does not include the input and output buffers.
+ * This is useful for rejecting dangerous settings (such as a huge
+ * dictionary) before any memory is allocated, or for deciding how
+ * many operations can safely run concurrently.
+ *
+ * Estimates are approximate, and codecs which cannot predict their
+ * memory usage will return *0*.
+ *
+ * @param codec The codec
+ * @param options The options which will be used, or *NULL* to use
+ *   the defaults
+ * @param stream_type Whether to estimate compression or
+ *   decompression
+ * @return The estimated peak memory usage in bytes, or *0* if unknown
+ */
+size_t
+squash_codec_get_memory_usage (SquashCodec* codec,
+                               SquashOptions* options,
+                               SquashStreamType stream_type) {
+  SquashCodecImpl* impl = NULL;
+
+  assert (codec != NULL);
+  assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
+
+  impl = squash_codec_get_impl (codec);
+  if (impl != NULL && impl->get_memory_usage != NULL) {
+    return impl->get_memory_usage (codec, options, stream_type);
   } else {
     return 0;
   }
@@ -501,6 +665,10 @@ squash_codec_create_stream_with_options (SquashCodec* codec, SquashStreamType st
     return impl->create_stream (codec, stream_type, options);
   } else {
     if (impl->process_stream == NULL) {
+      if (impl->splice != NULL)
+        squash_stats_fallback (codec, SQUASH_STATS_FALLBACK_SPLICE_STREAM);
+      else
+        squash_stats_fallback (codec, SQUASH_STATS_FALLBACK_BUFFER_STREAM);
       return (SquashStream*) squash_buffer_stream_new (codec, stream_type, options);
     } else {
       return NULL;
@@ -526,7 +694,7 @@ squash_codec_create_stream (SquashCodec* codec, SquashStreamType stream_type, ..
   assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
 
   va_start (ap, stream_type);
-  options = squash_options_newv (codec, ap);
+  options = squash_codec_options_newv (codec, ap);
   va_end (ap);
 
   return squash_codec_create_stream_with_options (codec, stream_type, options);
@@ -617,26 +785,68 @@ squash_buffer_splice (SquashCodec* codec,
   return res;
 }
 
-/**
- * @brief Compress a buffer with an existing @ref SquashOptions
- *
- * @param codec The codec to use
- * @param[out] compressed Location to store the compressed data
- * @param[in,out] compressed_size Location storing the size of the
- *   @a compressed buffer on input, replaced with the actual size of
- *   the compressed data
- * @param uncompressed The uncompressed data
- * @param uncompressed_size Size of the uncompressed data (in bytes)
- * @param options Compression options
- * @return A status code
- */
-SquashStatus
-squash_codec_compress_with_options (SquashCodec* codec,
-                                    size_t* compressed_size,
-                                    uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
-                                    size_t uncompressed_size,
-                                    const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
-                                    SquashOptions* options) {
+/* Scratch space for codecs which only implement
+ * compress_buffer_unsafe when the caller's buffer is smaller than the
+ * maximum compressed size.  It is kept for the life of the thread so
+ * repeated tight-fit compressions don't allocate (and fault in) a
+ * fresh worst-case buffer every time.  Buffers larger than
+ * SQUASH_CODEC_SCRATCH_MAX_RETAINED are not kept. */
+
+#define SQUASH_CODEC_SCRATCH_MAX_RETAINED ((size_t) (4 * 1024 * 1024))
+
+static SQUASH_THREAD_LOCAL uint8_t* squash_codec_scratch = NULL;
+static SQUASH_THREAD_LOCAL size_t squash_codec_scratch_size = 0;
+static SQUASH_THREAD_LOCAL bool squash_codec_scratch_in_use = false;
+
+static once_flag squash_codec_scratch_once = ONCE_FLAG_INIT;
+static tss_t squash_codec_scratch_key;
+
+static void
+squash_codec_scratch_init (void) {
+  tss_create (&squash_codec_scratch_key, squash_free);
+}
+
+static uint8_t*
+squash_codec_scratch_acquire (size_t size) {
+  /* Plugins may call back into Squash (e.g., to compress a chunk with
+     another codec), in which case the thread's buffer is busy. */
+  if (SQUASH_UNLIKELY(squash_codec_scratch_in_use) ||
+      SQUASH_UNLIKELY(size > SQUASH_CODEC_SCRATCH_MAX_RETAINED))
+    return squash_malloc (size);
+
+  if (squash_codec_scratch_size < size) {
+    call_once (&squash_codec_scratch_once, squash_codec_scratch_init);
+
+    const size_t alloc_size = squash_npot (size);
+    uint8_t* buf = squash_malloc (alloc_size);
+    if (SQUASH_UNLIKELY(buf == NULL))
+      return NULL;
+
+    squash_free (squash_codec_scratch);
+    squash_codec_scratch = buf;
+    squash_codec_scratch_size = alloc_size;
+    tss_set (squash_codec_scratch_key, buf);
+  }
+
+  squash_codec_scratch_in_use = true;
+  return squash_codec_scratch;
+}
+
+static void
+squash_codec_scratch_release (uint8_t* buf) {
+  if (SQUASH_LIKELY(buf == squash_codec_scratch))
+    squash_codec_scratch_in_use = false;
+  else
+    squash_free (buf);
+}
+
+static SquashStatus
+squash_codec_compress_buffer_unfiltered (SquashCodec* codec,
+                                         size_t* compressed_size,
+                                         uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                                         size_t uncompressed_size,
+                                         const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                                         SquashOptions* options) {
   SquashStatus res = SQUASH_OK;
   SquashCodecImpl* impl = NULL;
 
@@ -683,7 +893,13 @@ squash_codec_compress_with_options (SquashCodec* codec,
                                    options);
       goto cleanup;
     } else {
-      uint8_t* tmp_buf = squash_malloc (max_compressed_size);
+      squash_stats_fallback (codec, SQUASH_STATS_FALLBACK_UNSAFE_BUFFER);
+
+      /* We can't just try the caller's buffer first and hope the data
+         is compressible: codecs which only provide
+         compress_buffer_unsafe don't check the output bounds, so a
+         miss would be a buffer overflow rather than an error. */
+      uint8_t* tmp_buf = squash_codec_scratch_acquire (max_compressed_size);
       if (SQUASH_UNLIKELY(tmp_buf == NULL)) {
         res = squash_error (SQUASH_MEMORY);
         goto cleanup;
@@ -695,28 +911,24 @@ squash_codec_compress_with_options (SquashCodec* codec,
                                           options);
       if (res == SQUASH_OK) {
         if (SQUASH_UNLIKELY(*compressed_size < max_compressed_size)) {
-          *compressed_size = max_compressed_size;
-          squash_free (tmp_buf);
           res = squash_error (SQUASH_BUFFER_FULL);
-          goto cleanup;
         } else {
-          *compressed_size = max_compressed_size;
           memcpy (compressed, tmp_buf, max_compressed_size);
-          squash_free (tmp_buf);
-          res = SQUASH_OK;
-          goto cleanup;
         }
-      } else {
-        squash_free (tmp_buf);
-        goto cleanup;
+        *compressed_size = max_compressed_size;
       }
+
+      squash_codec_scratch_release (tmp_buf);
+      goto cleanup;
     }
   } else if (impl->splice != NULL) {
+    squash_stats_fallback (codec, SQUASH_STATS_FALLBACK_SPLICE_BUFFER);
     res = squash_buffer_splice (codec, SQUASH_STREAM_COMPRESS, compressed_size, compressed, uncompressed_size, uncompressed, options);
     goto cleanup;
   } else {
     SquashStream* stream;
 
+    squash_stats_fallback (codec, SQUASH_STATS_FALLBACK_STREAM_BUFFER);
     stream = squash_codec_create_stream_with_options (codec, SQUASH_STREAM_COMPRESS, options);
     if (SQUASH_UNLIKELY(stream == NULL)) {
       res = squash_error (SQUASH_FAILED);
@@ -757,6 +969,90 @@ squash_codec_compress_with_options (SquashCodec* codec,
   return res;
 }
 
+/* Filters (the "filter" option) are applied to the whole buffer here,
+ * unless the codec only provides streams; in that case the buffer is
+ * compressed with a stream, which applies them itself. */
+SquashStatus
+squash_codec_compress_buffer (SquashCodec* codec,
+                              size_t* compressed_size,
+                              uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                              size_t uncompressed_size,
+                              const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                              SquashOptions* options) {
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+
+  if (SQUASH_LIKELY(options == NULL || options->filters == NULL) || SQUASH_UNLIKELY(impl == NULL) ||
+      (impl->compress_buffer == NULL && impl->compress_buffer_unsafe == NULL && impl->splice == NULL))
+    return squash_codec_compress_buffer_unfiltered (codec,
+                                                    compressed_size, compressed,
+                                                    uncompressed_size, uncompressed,
+                                                    options);
+
+  uint8_t* filtered = squash_malloc (uncompressed_size != 0 ? uncompressed_size : 1);
+  if (SQUASH_UNLIKELY(filtered == NULL))
+    return squash_error (SQUASH_MEMORY);
+  memcpy (filtered, uncompressed, uncompressed_size);
+
+  squash_object_ref (options);
+
+  SquashStatus res = squash_filter_encode_buffer (options->filters, uncompressed_size, filtered);
+  if (SQUASH_LIKELY(res == SQUASH_OK))
+    res = squash_codec_compress_buffer_unfiltered (codec,
+                                                   compressed_size, compressed,
+                                                   uncompressed_size, filtered,
+                                                   options);
+
+  squash_object_unref (options);
+  squash_free (filtered);
+
+  return res;
+}
+
+/**
+ * @brief Compress a buffer with an existing @ref SquashOptions
+ *
+ * @param codec The codec to use
+ * @param[out] compressed Location to store the compressed data
+ * @param[in,out] compressed_size Location storing the size of the
+ *   @a compressed buffer on input, replaced with the actual size of
+ *   the compressed data
+ * @param uncompressed The uncompressed data
+ * @param uncompressed_size Size of the uncompressed data (in bytes)
+ * @param options Compression options
+ * @return A status code
+ */
+SquashStatus
+squash_codec_compress_with_options (SquashCodec* codec,
+                                    size_t* compressed_size,
+                                    uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                                    size_t uncompressed_size,
+                                    const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                                    SquashOptions* options) {
+  const uint64_t stats_start = squash_stats_begin ();
+  SquashStatus res;
+
+  assert (codec != NULL);
+
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+  if (impl != NULL && SQUASH_UNLIKELY(squash_segment_required (impl, uncompressed_size))) {
+    res = squash_segment_compress (codec,
+                                   compressed_size, compressed,
+                                   uncompressed_size, uncompressed,
+                                   options);
+  } else {
+    res = squash_codec_compress_buffer (codec,
+                                        compressed_size, compressed,
+                                        uncompressed_size, uncompressed,
+                                        options);
+  }
+
+  if (SQUASH_UNLIKELY(stats_start != 0))
+    squash_stats_record (codec, SQUASH_STATS_BUFFER_COMPRESS, SQUASH_STREAM_COMPRESS,
+                         uncompressed_size, (res == SQUASH_OK) ? *compressed_size : 0, stats_start);
+
+  return res;
+}
+
 /**
  * @brief Compress a buffer
  *
@@ -783,7 +1079,7 @@ SquashStatus squash_codec_compress (SquashCodec* codec,
   assert (codec != NULL);
 
   va_start (ap, uncompressed);
-  options = squash_options_newv (codec, ap);
+  options = squash_codec_options_newv (codec, ap);
   va_end (ap);
 
   return squash_codec_compress_with_options (codec,
@@ -792,26 +1088,13 @@ SquashStatus squash_codec_compress (SquashCodec* codec,
                                              options);
 }
 
-/**
- * @brief Decompress a buffer with an existing @ref SquashOptions
- *
- * @param codec The codec to use
- * @param[out] decompressed Location to store the decompressed data
- * @param[in,out] decompressed_size Location storing the size of the
- *   @a decompressed buffer on input, replaced with the actual size of
- *   the decompressed data
- * @param compressed The compressed data
- * @param compressed_size Size of the compressed data (in bytes)
- * @param options Compression options
- * @return A status code
- */
-SquashStatus
-squash_codec_decompress_with_options (SquashCodec* codec,
-                                      size_t* decompressed_size,
-                                      uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
-                                      size_t compressed_size,
-                                      const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
-                                      SquashOptions* options) {
+static SquashStatus
+squash_codec_decompress_buffer_unfiltered (SquashCodec* codec,
+                                           size_t* decompressed_size,
+                                           uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                                           size_t compressed_size,
+                                           const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                                           SquashOptions* options) {
   SquashCodecImpl* impl = NULL;
 
   assert (codec != NULL);
@@ -838,6 +1121,7 @@ squash_codec_decompress_with_options (SquashCodec* codec,
     SquashStatus status;
     SquashStream* stream;
 
+    squash_stats_fallback (codec, SQUASH_STATS_FALLBACK_STREAM_BUFFER);
     stream = squash_codec_create_stream_with_options (codec, SQUASH_STREAM_DECOMPRESS, options);
     if (stream == NULL)
       exit(EXIT_FAILURE);
@@ -872,6 +1156,82 @@ squash_codec_decompress_with_options (SquashCodec* codec,
   }
 }
 
+/* See squash_codec_compress_buffer. */
+SquashStatus
+squash_codec_decompress_buffer (SquashCodec* codec,
+                                size_t* decompressed_size,
+                                uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                                size_t compressed_size,
+                                const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                                SquashOptions* options) {
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+
+  if (SQUASH_LIKELY(options == NULL || options->filters == NULL) || SQUASH_UNLIKELY(impl == NULL) ||
+      impl->decompress_buffer == NULL)
+    return squash_codec_decompress_buffer_unfiltered (codec,
+                                                      decompressed_size, decompressed,
+                                                      compressed_size, compressed,
+                                                      options);
+
+  squash_object_ref (options);
+
+  SquashStatus res = squash_codec_decompress_buffer_unfiltered (codec,
+                                                                decompressed_size, decompressed,
+                                                                compressed_size, compressed,
+                                                                options);
+  if (res == SQUASH_OK)
+    res = squash_filter_decode_buffer (options->filters, *decompressed_size, decompressed);
+
+  squash_object_unref (options);
+
+  return res;
+}
+
+/**
+ * @brief Decompress a buffer with an existing @ref SquashOptions
+ *
+ * @param codec The codec to use
+ * @param[out] decompressed Location to store the decompressed data
+ * @param[in,out] decompressed_size Location storing the size of the
+ *   @a decompressed buffer on input, replaced with the actual size of
+ *   the decompressed data
+ * @param compressed The compressed data
+ * @param compressed_size Size of the compressed data (in bytes)
+ * @param options Compression options
+ * @return A status code
+ */
+SquashStatus
+squash_codec_decompress_with_options (SquashCodec* codec,
+                                      size_t* decompressed_size,
+                                      uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                                      size_t compressed_size,
+                                      const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                                      SquashOptions* options) {
+  const uint64_t stats_start = squash_stats_begin ();
+  SquashStatus res;
+
+  assert (codec != NULL);
+
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+  if (impl != NULL && SQUASH_UNLIKELY(squash_segment_is_frame (impl, compressed_size, compressed))) {
+    res = squash_segment_decompress (codec,
+                                     decompressed_size, decompressed,
+                                     compressed_size, compressed,
+                                     options);
+  } else {
+    res = squash_codec_decompress_buffer (codec,
+                                          decompressed_size, decompressed,
+                                          compressed_size, compressed,
+                                          options);
+  }
+
+  if (SQUASH_UNLIKELY(stats_start != 0))
+    squash_stats_record (codec, SQUASH_STATS_BUFFER_COMPRESS, SQUASH_STREAM_DECOMPRESS,
+                         compressed_size, (res == SQUASH_OK) ? *decompressed_size : 0, stats_start);
+
+  return res;
+}
+
 /**
  * @brief Decompress a buffer
  *
@@ -900,7 +1260,7 @@ squash_codec_decompress (SquashCodec* codec,
   assert (codec != NULL);
 
   va_start (ap, compressed);
-  options = squash_options_newv (codec, ap);
+  options = squash_codec_options_newv (codec, ap);
   va_end (ap);
 
   res = squash_codec_decompress_with_options (codec,
@@ -911,6 +1271,9 @@ squash_codec_decompress (SquashCodec* codec,
   return res;
 }
 
+/* Source of SquashCodec::stats_id */
+static volatile size_t squash_codec_next_stats_id = 0;
+
 /**
  * @brief Create a new codec
  * @private
@@ -924,8 +1287,9 @@ squash_codec_new (SquashPlugin* plugin, const char* name) {
   SquashCodec codec = { 0, };
 
   codec.plugin = plugin;
-  codec.name = strdup (name);
+  codec.name = squash_strdup (name);
   codec.priority = 50;
+  codec.stats_id = squash_atomic_add_size (&squash_codec_next_stats_id, 1) - 1;
   SQUASH_TREE_ENTRY_INIT(codec.tree);
 
   *codecp = codec;
@@ -947,7 +1311,7 @@ squash_codec_set_extension (SquashCodec* codec, const char* extension) {
   if (codec->extension != NULL)
     squash_free (codec->extension);
 
-  codec->extension = (extension != NULL) ? strdup (extension) : NULL;
+  codec->extension = (extension != NULL) ? squash_strdup (extension) : NULL;
 }
 
 /**
@@ -961,6 +1325,53 @@ squash_codec_get_extension (SquashCodec* codec) {
   return codec->extension;
 }
 
+/**
+ * @brief Set the codec's MIME type
+ * @private
+ *
+ * @param codec The codec
+ * @param mime_type MIME type of the codec
+ */
+void
+squash_codec_set_mime_type (SquashCodec* codec, const char* mime_type) {
+  if (codec->mime_type != NULL)
+    squash_free (codec->mime_type);
+
+  codec->mime_type = (mime_type != NULL) ? squash_strdup (mime_type) : NULL;
+}
+
+/**
+ * @brief Get the codec's MIME type
+ *
+ * @param codec The codec
+ * @return The MIME type, or *NULL* if none is known
+ */
+const char*
+squash_codec_get_mime_type (SquashCodec* codec) {
+  return codec->mime_type;
+}
+
+/**
+ * @brief Add another name the codec can be found by
+ * @private
+ *
+ * @param codec The codec
+ * @param alias The alias
+ */
+void
+squash_codec_add_alias (SquashCodec* codec, const char* alias) {
+  size_t n_aliases = 0;
+
+  if (codec->aliases != NULL) {
+    while (codec->aliases[n_aliases] != NULL)
+      n_aliases++;
+  }
+
+  codec->aliases = squash_realloc (codec->aliases, sizeof (char*) * (n_aliases + 2));
+  codec->aliases[n_aliases] = squash_strdup (alias);
+  codec->aliases[n_aliases + 1] = NULL;
+}
+
 /**
  * @brief Set the codec priority
  * @private
@@ -32,6 +32,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #if !defined (SQUASH_H_INSIDE) && !defined (SQUASH_COMPILATION)
 #error "Only <squash/squash.h> can be included directly."
 #endif
@@ -41,6 +42,7 @@ SQUASH_BEGIN_DECLS
 typedef enum {
   SQUASH_CODEC_INFO_CAN_FLUSH               = 1 <<  0,
   SQUASH_CODEC_INFO_DECOMPRESS_UNSAFE       = 1 <<  1,
+  SQUASH_CODEC_INFO_SEGMENTED               = 1 <<  2,
 
   SQUASH_CODEC_INFO_AUTO_MASK               = 0x00ff0000,
   SQUASH_CODEC_INFO_VALID                   = 1 << 16,
@@ -101,14 +103,36 @@ struct SquashCodecImpl_ {
                                                         size_t compressed_size,
                                                         const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)]);
   size_t                  (* get_max_compressed_size)  (SquashCodec* codec, size_t uncompressed_size);
+  size_t                  (* get_memory_usage)         (SquashCodec* codec,
+                                                        SquashOptions* options,
+                                                        SquashStreamType stream_type);
+
+  /* Random access */
+  SquashStatus            (* build_index)              (SquashCodec* codec,
+                                                        SquashOptions* options,
+                                                        FILE* fp_index,
+                                                        FILE* fp_in,
+                                                        size_t span);
+  SquashStatus            (* extract)                  (SquashCodec* codec,
+                                                        SquashOptions* options,
+                                                        FILE* fp_index,
+                                                        FILE* fp_in,
+                                                        uint64_t offset,
+                                                        size_t* decompressed_size,
+                                                        uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)]);
+
+  /* Reusing streams */
+  SquashStatus            (* reset_stream)             (SquashStream* stream);
+
+  /* Checkpoints */
+  SquashStatus            (* checkpoint_stream)        (SquashStream* stream,
+                                                        size_t* checkpoint_size,
+                                                        uint8_t checkpoint[SQUASH_ARRAY_PARAM(*checkpoint_size)]);
+  SquashStatus            (* restore_stream)           (SquashStream* stream,
+                                                        size_t checkpoint_size,
+                                                        const uint8_t checkpoint[SQUASH_ARRAY_PARAM(checkpoint_size)]);
 
   /* Reserved */
-  void                    (* _reserved1)               (void);
-  void                    (* _reserved2)               (void);
-  void                    (* _reserved3)               (void);
-  void                    (* _reserved4)               (void);
-  void                    (* _reserved5)               (void);
-  void                    (* _reserved6)               (void);
   void                    (* _reserved7)               (void);
   void                    (* _reserved8)               (void);
 };
@@ -127,6 +151,8 @@ SQUASH_NONNULL(1)
 SQUASH_API SquashContext*          squash_codec_get_context                  (SquashCodec* codec);
 SQUASH_NONNULL(1)
 SQUASH_API const char*             squash_codec_get_extension                (SquashCodec* codec);
+SQUASH_NONNULL(1)
+SQUASH_API const char*             squash_codec_get_mime_type                (SquashCodec* codec);
 
 SQUASH_NONNULL(1, 3)
 SQUASH_API size_t                  squash_codec_get_uncompressed_size        (SquashCodec* codec,
@@ -134,6 +160,10 @@ SQUASH_API size_t                  squash_codec_get_uncompressed_size        (Sq
                                                                               const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)]);
 SQUASH_NONNULL(1)
 SQUASH_API size_t                  squash_codec_get_max_compressed_size      (SquashCodec* codec, size_t uncompressed_size);
+SQUASH_NONNULL(1)
+SQUASH_API size_t                  squash_codec_get_memory_usage             (SquashCodec* codec,
+                                                                              SquashOptions* options,
+                                                                              SquashStreamType stream_type);
 
 SQUASH_SENTINEL
 SQUASH_NONNULL(1)
@@ -174,6 +204,8 @@ SQUASH_API SquashStatus            squash_codec_decompress_with_options      (Sq
 SQUASH_NONNULL(1)
 SQUASH_API SquashCodecInfo         squash_codec_get_info                     (SquashCodec* codec);
 SQUASH_NONNULL(1)
+SQUASH_API SquashCodecInfo         squash_stream_get_info                    (SquashStream* stream);
+SQUASH_NONNULL(1)
 SQUASH_API const SquashOptionInfo* squash_codec_get_option_info              (SquashCodec* codec);
 
 SQUASH_END_DECLS
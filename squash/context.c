@@ -89,22 +89,29 @@ squash_context_get_codec_ref (SquashContext* context, const char* codec) {
   return SQUASH_TREE_FIND (&(context->codecs), SquashCodecRef_, tree, &key);
 }
 
-static SquashCodecRef*
-squash_context_get_codec_ref_from_extension (SquashContext* context, const char* extension) {
-  SquashCodec key_codec = { 0, };
-  SquashCodecRef key = { &key_codec, };
-
-  assert (context != NULL);
-  assert (extension != NULL);
-
-  key_codec.extension = (char*) extension;
+static SquashCodec*
+squash_context_lookup_codec (const SquashCodecTable* table, const char* key) {
+  SquashCodec* codec = squash_codec_table_lookup (table, key);
 
-  return SQUASH_TREE_FIND (&(context->extensions), SquashCodecRef_, tree, &key);
+  /* TODO: we should probably see if we can load the codec from a
+     different plugin if this fails.  */
+  return (codec != NULL && squash_codec_init (codec) == SQUASH_OK) ? codec : NULL;
 }
 
 /**
  * @brief Retrieve a @ref SquashCodec from a @ref SquashContext.
  *
+ * Codec names, and any aliases listed in the plugin's squash.ini, are
+ * matched without regard to case.
+ *
+ * Several codecs (and filters) can be chained together by separating
+ * their names with a "+"; for example, "shuffle+lz4" shuffles the
+ * data before compressing it with lz4, and "lz4+zstd" compresses
+ * the output of lz4 with zstd.  The chain is a codec of its own, and
+ * its streams pass data between the stages without copying it.
+ * Setting the chain's "threads" option to anything other than 1 runs
+ * the stages concurrently.
+ *
  * @param context The context to use.
  * @param codec Name of the codec to retrieve.
  * @return The @ref SquashCodec, or *NULL* on failure.  This is owned by
@@ -112,6 +119,9 @@ squash_context_get_codec_ref_from_extension (SquashContext* context, const char*
  */
 SquashCodec*
 squash_context_get_codec (SquashContext* context, const char* codec) {
+  if (strchr (codec, SQUASH_CHAIN_SEPARATOR) != NULL)
+    return squash_chain_get_codec (context, codec);
+
   const char* sep_pos = strchr (codec, ':');
   if (sep_pos != NULL) {
     char* plugin_name = (char*) squash_malloc ((sep_pos - codec) + 1);
@@ -127,21 +137,15 @@ squash_context_get_codec (SquashContext* context, const char* codec) {
 
     return squash_plugin_get_codec (plugin, codec);
   } else {
-    SquashCodecRef* codec_ref = squash_context_get_codec_ref (context, codec);
-    if (codec_ref != NULL) {
-      /* TODO: we should probably see if we can load the codec from a
-         different plugin if this fails.  */
-      return (squash_codec_init (codec_ref->codec) == SQUASH_OK) ? codec_ref->codec : NULL;
-    } else {
-      return NULL;
-    }
+    return squash_context_lookup_codec (&(context->names), codec);
   }
 }
 
 /**
  * @brief Retrieve a @ref SquashCodec.
  *
- * @param codec Name of the codec to retrieve.
+ * @param codec Name of the codec to retrieve, or a chain of codecs
+ *   such as "shuffle+lz4" (see ::squash_context_get_codec).
  * @return The @ref SquashCodec.  This is owned by Squash and must never be
  *   freed or unreffed.
  */
@@ -153,18 +157,15 @@ squash_get_codec (const char* codec) {
 /**
  * @brief Retrieve a codec from a context based on an extension
  *
+ * The extension is matched without regard to case.
+ *
  * @param context The context
  * @param extension The extension
  * @return A ref SquashCodec or *NULL* on failure
  */
 SquashCodec*
 squash_context_get_codec_from_extension (SquashContext* context, const char* extension) {
-  SquashCodecRef* codec_ref = squash_context_get_codec_ref_from_extension (context, extension);
-  if (codec_ref != NULL) {
-    return (squash_codec_init (codec_ref->codec) == SQUASH_OK) ? codec_ref->codec : NULL;
-  } else {
-    return NULL;
-  }
+  return squash_context_lookup_codec (&(context->extensions), extension);
 }
 
 /**
@@ -178,6 +179,31 @@ squash_get_codec_from_extension (const char* extension) {
   return squash_context_get_codec_from_extension (squash_context_get_default (), extension);
 }
 
+/**
+ * @brief Retrieve a codec from a context based on a MIME type
+ *
+ * The MIME type is matched without regard to case.
+ *
+ * @param context The context
+ * @param mime_type The MIME type, such as "application/x-bzip2"
+ * @return A ref SquashCodec or *NULL* on failure
+ */
+SquashCodec*
+squash_context_get_codec_from_mime_type (SquashContext* context, const char* mime_type) {
+  return squash_context_lookup_codec (&(context->mime_types), mime_type);
+}
+
+/**
+ * @brief Retrieve a codec based on a MIME type
+ *
+ * @param mime_type The MIME type
+ * @return A ref SquashCodec or *NULL* on failure
+ */
+SquashCodec*
+squash_get_codec_from_mime_type (const char* mime_type) {
+  return squash_context_get_codec_from_mime_type (squash_context_get_default (), mime_type);
+}
+
 /**
  * @brief Retrieve a @ref SquashPlugin from a @ref SquashContext.
  *
@@ -215,11 +241,6 @@ squash_codec_ref_compare (SquashCodecRef* a, SquashCodecRef* b) {
   return squash_codec_compare (a->codec, b->codec);
 }
 
-static int
-squash_codec_ref_extension_compare (SquashCodecRef* a, SquashCodecRef* b) {
-  return squash_codec_extension_compare (a->codec, b->codec);
-}
-
 static SquashPlugin*
 squash_context_add_plugin (SquashContext* context, char* name, char* directory) {
   SquashPlugin* plugin = NULL;
@@ -254,7 +275,9 @@ squash_context_add_plugin (SquashContext* context, char* name, char* directory)
  * no other codec with the same name already has a reference.  If
  * another codec with the same name already exists and references a
  * codec with a lower priority, this will switch the reference to @a
- * codec.
+ * codec.  The codec's name, aliases, extension and MIME type are also
+ * added to the context's lookup tables, which are built once all the
+ * plugins have been found.
  *
  * @param context The context
  * @param codec The codec
@@ -278,17 +301,15 @@ squash_context_add_codec (SquashContext* context, SquashCodec* codec) {
     codec_ref->codec = codec;
   }
 
-  if (codec->extension != NULL) {
-    codec_ref = squash_context_get_codec_ref_from_extension (context, codec->extension);
-    if (codec_ref == NULL) {
-      codec_ref = (SquashCodecRef*) squash_malloc (sizeof (SquashCodecRef));
-      codec_ref->codec = codec;
-      SQUASH_TREE_ENTRY_INIT(codec_ref->tree);
-      SQUASH_TREE_INSERT (&(context->extensions), SquashCodecRef_, tree, codec_ref);
-    } else if (codec->priority > codec_ref->codec->priority) {
-      codec_ref->codec = codec;
-    }
+  squash_codec_table_add (&(context->names), codec->name, codec, false);
+  if (codec->aliases != NULL) {
+    for (char** alias = codec->aliases ; *alias != NULL ; alias++)
+      squash_codec_table_add (&(context->names), *alias, codec, true);
   }
+  if (codec->extension != NULL)
+    squash_codec_table_add (&(context->extensions), codec->extension, codec, false);
+  if (codec->mime_type != NULL)
+    squash_codec_table_add (&(context->mime_types), codec->mime_type, codec, false);
 }
 
 static char*
@@ -356,6 +377,19 @@ squash_codecs_file_parser_callback (const char* section,
       }
     } else if (strcasecmp (key, "extension") == 0) {
       squash_codec_set_extension (parser->codec, value);
+    } else if (strcasecmp (key, "mime-type") == 0) {
+      squash_codec_set_mime_type (parser->codec, value);
+    } else if (strcasecmp (key, "alias") == 0) {
+      char* aliases = squash_strdup (value);
+      char* saveptr = NULL;
+      char* alias = SQUASH_STRTOK_R (aliases, ";", &saveptr);
+
+      while (alias != NULL) {
+        squash_codec_add_alias (parser->codec, alias);
+        alias = SQUASH_STRTOK_R (NULL, ";", &saveptr);
+      }
+
+      squash_free (aliases);
     }
   }
 
@@ -648,10 +682,14 @@ squash_context_new (void) {
 
   SQUASH_TREE_INIT(&(context->codecs), squash_codec_ref_compare);
   SQUASH_TREE_INIT(&(context->plugins), squash_plugin_compare);
-  SQUASH_TREE_INIT(&(context->extensions), squash_codec_ref_extension_compare);
+  SQUASH_TREE_INIT(&(context->chains), squash_codec_compare);
 
   squash_context_find_plugins (context);
 
+  squash_codec_table_build (&(context->names));
+  squash_codec_table_build (&(context->extensions));
+  squash_codec_table_build (&(context->mime_types));
+
   return context;
 }
 
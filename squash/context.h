@@ -48,6 +48,8 @@ SQUASH_NONNULL(1, 2)
 SQUASH_API void           squash_context_foreach_codec            (SquashContext* context, SquashCodecForeachFunc func, void* data);
 SQUASH_NONNULL(1, 2)
 SQUASH_API SquashCodec*   squash_context_get_codec_from_extension (SquashContext* context, const char* extension);
+SQUASH_NONNULL(1, 2)
+SQUASH_API SquashCodec*   squash_context_get_codec_from_mime_type (SquashContext* context, const char* mime_type);
 
 SQUASH_NONNULL(1)
 SQUASH_API SquashPlugin*  squash_get_plugin                       (const char* plugin);
@@ -59,6 +61,8 @@ SQUASH_NONNULL(1)
 SQUASH_API void           squash_foreach_codec                    (SquashCodecForeachFunc func, void* data);
 SQUASH_NONNULL(1)
 SQUASH_API SquashCodec*   squash_get_codec_from_extension         (const char* extension);
+SQUASH_NONNULL(1)
+SQUASH_API SquashCodec*   squash_get_codec_from_mime_type         (const char* mime_type);
 
 SQUASH_END_DECLS
 
@@ -599,7 +599,7 @@ squash_file_vwprintf (SquashFile* file,
   if (SQUASH_UNLIKELY(size < 0))
     return squash_error (SQUASH_FAILED);
 
-  buf = calloc (size + 1, sizeof (wchar_t));
+  buf = squash_calloc (size + 1, sizeof (wchar_t));
   if (SQUASH_UNLIKELY(buf == NULL))
     return squash_error (SQUASH_MEMORY);
 
@@ -613,10 +613,12 @@ squash_file_vwprintf (SquashFile* file,
       squash_charset_convert (&data_size, &data, "UTF-8",
                               size * sizeof(wchar_t), (char*) buf, squash_charset_get_wide ());
 
-    if (SQUASH_LIKELY(conv_success))
+    if (SQUASH_LIKELY(conv_success)) {
       res = squash_file_write (file, data_size, (uint8_t*) data);
-    else
+      squash_free (data);
+    } else {
       res = squash_error (SQUASH_FAILED);
+    }
   }
 
   squash_free (buf);
@@ -724,7 +726,7 @@ squash_file_write_unlocked (SquashFile* file,
  *
  * @note This function only works for codecs which support flushing
  * (see the @ref SQUASH_CODEC_INFO_CAN_FLUSH flag in the return value
- * of @ref squash_codec_get_info).
+ * of @ref squash_codec_get_info), and not with the "filter" option.
  *
  * @param file file to flush
  * @returns *TRUE* if flushing succeeeded, *FALSE* if flushing is not
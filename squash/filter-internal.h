@@ -0,0 +1,119 @@
+/* Copyright (c) 2015-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include <squash/internal.h> */
+
+#ifndef SQUASH_FILTER_INTERNAL_H
+#define SQUASH_FILTER_INTERNAL_H
+
+#if !defined (SQUASH_COMPILATION)
+#error "This is internal API; you cannot use it."
+#endif
+
+SQUASH_BEGIN_DECLS
+
+/* Filters work on independent blocks of this many bytes, numbered
+ * from the start of the data, so buffers and streams (however the
+ * input is split up) produce the same output. */
+#define SQUASH_FILTER_BLOCK_SIZE ((size_t) (64 * 1024))
+#define SQUASH_FILTER_MAX_FILTERS 8
+
+typedef enum {
+  SQUASH_FILTER_SHUFFLE = 1,
+  SQUASH_FILTER_DELTA = 2,
+  SQUASH_FILTER_BCJ_X86 = 3
+} SquashFilterType;
+
+typedef struct SquashFilter_ {
+  SquashFilterType type;
+  size_t distance;
+} SquashFilter;
+
+struct SquashFilterChain_ {
+  char* spec;
+  size_t n_filters;
+  SquashFilter filters[SQUASH_FILTER_MAX_FILTERS];
+  bool needs_scratch;
+};
+
+/* Embedded in SquashStreamPrivate; chain is NULL for streams which
+ * aren't filtered. */
+typedef struct SquashFilterStream_ {
+  const SquashFilterChain* chain;
+  uint8_t* block;
+  uint8_t* scratch;
+
+  /* Compression: bytes of input in the block, and how many of them
+     (once filtered) the codec has consumed.  Decompression: bytes of
+     output in the block, and how many of them (once decoded) have
+     been copied to the caller. */
+  size_t length;
+  size_t position;
+  /* Offset of the block in the uncompressed data. */
+  uint64_t offset;
+
+  /* Compression: the block has been filtered; it is the last one.
+     Decompression: the block has been decoded; the codec reached the
+     end of the stream. */
+  bool ready;
+  bool last;
+} SquashFilterStream;
+
+SQUASH_NONNULL(1, 2) SQUASH_INTERNAL
+SquashStatus        squash_filter_chain_parse   (const char* spec, SquashFilterChain** chain);
+SQUASH_INTERNAL
+void                squash_filter_chain_free    (SquashFilterChain* chain);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+void                squash_filter_chain_encode  (const SquashFilterChain* chain,
+                                                 size_t size,
+                                                 uint8_t data[SQUASH_ARRAY_PARAM(size)],
+                                                 uint64_t offset,
+                                                 uint8_t* scratch);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+void                squash_filter_chain_decode  (const SquashFilterChain* chain,
+                                                 size_t size,
+                                                 uint8_t data[SQUASH_ARRAY_PARAM(size)],
+                                                 uint64_t offset,
+                                                 uint8_t* scratch);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+SquashStatus        squash_filter_encode_buffer (const SquashFilterChain* chain,
+                                                 size_t size,
+                                                 uint8_t data[SQUASH_ARRAY_PARAM(size)]);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+SquashStatus        squash_filter_decode_buffer (const SquashFilterChain* chain,
+                                                 size_t size,
+                                                 uint8_t data[SQUASH_ARRAY_PARAM(size)]);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+void                squash_filter_stream_init    (SquashFilterStream* filter, const SquashFilterChain* chain);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+SquashStatus        squash_filter_stream_prepare (SquashFilterStream* filter);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+void                squash_filter_stream_reset   (SquashFilterStream* filter);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+void                squash_filter_stream_destroy (SquashFilterStream* filter);
+
+SQUASH_END_DECLS
+
+#endif /* SQUASH_FILTER_INTERNAL_H */
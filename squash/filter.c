@@ -0,0 +1,582 @@
+/* Copyright (c) 2015-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#include <assert.h>
+#include <squash/internal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_MSC_VER)
+#include <strings.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#  define SQUASH_FILTER_SSE2
+#  include <emmintrin.h>
+#endif
+
+/* Filters which can be put in front of any codec with the "filter"
+ * option, for example "filter=shuffle:8,delta:4".  Filters are
+ * applied in the order given when compressing, and undone in reverse
+ * order when decompressing:
+ *
+ *  * shuffle:N groups the bytes of N-byte elements by significance,
+ *    like Blosc, so the codec sees runs of similar high-order bytes.
+ *  * delta:N replaces each byte with its difference from the byte N
+ *    positions earlier, like the liblzma delta filter.
+ *  * bcj-x86 converts the relative targets of x86 CALL and JMP
+ *    instructions to absolute ones, so repeated calls to the same
+ *    function look the same.
+ *
+ * None of them changes the size of the data. */
+
+/* shuffle */
+
+static size_t
+squash_filter_shuffle_range (uint8_t* dst, const uint8_t* src, size_t n, size_t width, size_t start) {
+  for (size_t j = 0 ; j < width ; j++) {
+    uint8_t* out = dst + (j * n);
+    for (size_t i = start ; i < n ; i++)
+      out[i] = src[(i * width) + j];
+  }
+  return n;
+}
+
+static size_t
+squash_filter_unshuffle_range (uint8_t* dst, const uint8_t* src, size_t n, size_t width, size_t start) {
+  for (size_t j = 0 ; j < width ; j++) {
+    const uint8_t* in = src + (j * n);
+    for (size_t i = start ; i < n ; i++)
+      dst[(i * width) + j] = in[i];
+  }
+  return n;
+}
+
+#if defined(SQUASH_FILTER_SSE2)
+/* Reverse the low bits of @a value, where @a width is the number of
+ * distinct values. */
+static size_t
+squash_filter_bit_reverse (size_t value, size_t width) {
+  size_t res = 0;
+  for (size_t w = width ; w > 1 ; w >>= 1) {
+    res = (res << 1) | (value & 1);
+    value >>= 1;
+  }
+  return res;
+}
+
+/* Element sizes 2, 4, 8 and 16, sixteen elements at a time.  Each
+ * round splits every group of vectors into its even and odd bytes,
+ * so after log2(width) rounds each vector holds one byte of all
+ * sixteen elements; the vector for byte j ends up at the bit-reversed
+ * index of j. */
+static size_t
+squash_filter_shuffle_sse2 (uint8_t* dst, const uint8_t* src, size_t n, size_t width) {
+  const __m128i mask = _mm_set1_epi16 (0x00ff);
+  __m128i v[16], t[16];
+  size_t i;
+
+  for (i = 0 ; i + 16 <= n ; i += 16) {
+    for (size_t k = 0 ; k < width ; k++)
+      v[k] = _mm_loadu_si128 ((const __m128i*) (src + (i * width) + (k * 16)));
+
+    for (size_t group = width ; group > 1 ; group >>= 1) {
+      const size_t half = group >> 1;
+      for (size_t o = 0 ; o < width ; o += group) {
+        for (size_t k = 0 ; k < half ; k++) {
+          const __m128i a = v[o + (k * 2)];
+          const __m128i b = v[o + (k * 2) + 1];
+          t[o + k] = _mm_packus_epi16 (_mm_and_si128 (a, mask), _mm_and_si128 (b, mask));
+          t[o + half + k] = _mm_packus_epi16 (_mm_srli_epi16 (a, 8), _mm_srli_epi16 (b, 8));
+        }
+      }
+      memcpy (v, t, width * sizeof (__m128i));
+    }
+
+    for (size_t g = 0 ; g < width ; g++)
+      _mm_storeu_si128 ((__m128i*) (dst + (squash_filter_bit_reverse (g, width) * n) + i), v[g]);
+  }
+
+  return i;
+}
+
+static size_t
+squash_filter_unshuffle_sse2 (uint8_t* dst, const uint8_t* src, size_t n, size_t width) {
+  __m128i v[16], t[16];
+  size_t i;
+
+  for (i = 0 ; i + 16 <= n ; i += 16) {
+    for (size_t g = 0 ; g < width ; g++)
+      v[g] = _mm_loadu_si128 ((const __m128i*) (src + (squash_filter_bit_reverse (g, width) * n) + i));
+
+    for (size_t group = 2 ; group <= width ; group <<= 1) {
+      const size_t half = group >> 1;
+      for (size_t o = 0 ; o < width ; o += group) {
+        for (size_t k = 0 ; k < half ; k++) {
+          const __m128i even = v[o + k];
+          const __m128i odd = v[o + half + k];
+          t[o + (k * 2)] = _mm_unpacklo_epi8 (even, odd);
+          t[o + (k * 2) + 1] = _mm_unpackhi_epi8 (even, odd);
+        }
+      }
+      memcpy (v, t, width * sizeof (__m128i));
+    }
+
+    for (size_t k = 0 ; k < width ; k++)
+      _mm_storeu_si128 ((__m128i*) (dst + (i * width) + (k * 16)), v[k]);
+  }
+
+  return i;
+}
+#endif /* defined(SQUASH_FILTER_SSE2) */
+
+/* Bytes after the last whole element are copied as-is. */
+static void
+squash_filter_shuffle (uint8_t* dst, const uint8_t* src, size_t size, size_t width) {
+  const size_t n = size / width;
+  size_t done = 0;
+
+#if defined(SQUASH_FILTER_SSE2)
+  if (width == 2 || width == 4 || width == 8 || width == 16)
+    done = squash_filter_shuffle_sse2 (dst, src, n, width);
+#endif
+
+  squash_filter_shuffle_range (dst, src, n, width, done);
+  memcpy (dst + (n * width), src + (n * width), size - (n * width));
+}
+
+static void
+squash_filter_unshuffle (uint8_t* dst, const uint8_t* src, size_t size, size_t width) {
+  const size_t n = size / width;
+  size_t done = 0;
+
+#if defined(SQUASH_FILTER_SSE2)
+  if (width == 2 || width == 4 || width == 8 || width == 16)
+    done = squash_filter_unshuffle_sse2 (dst, src, n, width);
+#endif
+
+  squash_filter_unshuffle_range (dst, src, n, width, done);
+  memcpy (dst + (n * width), src + (n * width), size - (n * width));
+}
+
+/* delta */
+
+static void
+squash_filter_delta_encode (uint8_t* data, size_t size, size_t distance) {
+  for (size_t i = size ; i-- > distance ; )
+    data[i] = (uint8_t) (data[i] - data[i - distance]);
+}
+
+static void
+squash_filter_delta_decode (uint8_t* data, size_t size, size_t distance) {
+  for (size_t i = distance ; i < size ; i++)
+    data[i] = (uint8_t) (data[i] + data[i - distance]);
+}
+
+/* bcj-x86
+ *
+ * A simplified version of the x86 BCJ filter: the 32-bit operand of
+ * an E8 (CALL) or E9 (JMP) opcode is converted when it is within
+ * ±16 MiB, which is what distinguishes real branches from other data
+ * in practice.  The conversion is done modulo 2^25 and keeps the
+ * operand's high byte 0x00 or 0xFF.  The four bytes after every E8
+ * or E9 are skipped whether they were converted or not, so the
+ * decoder sees the same opcodes and makes the same decisions (unlike
+ * liblzma's version, which also looks for opcodes inside operands it
+ * didn't convert). */
+
+static void
+squash_filter_bcj_x86 (uint8_t* data, size_t size, uint64_t offset, bool encode) {
+  if (size < 5)
+    return;
+
+  for (size_t i = 0 ; i <= size - 5 ; ) {
+    if (data[i] != 0xE8 && data[i] != 0xE9) {
+      i++;
+      continue;
+    }
+
+    if (data[i + 4] == 0x00 || data[i + 4] == 0xFF) {
+      uint8_t* operand = data + i + 1;
+      const uint32_t pc = (uint32_t) (offset + i + 5);
+      uint32_t value =
+        ((uint32_t) operand[0]) |
+        ((uint32_t) operand[1] << 8) |
+        ((uint32_t) operand[2] << 16) |
+        ((uint32_t) operand[3] << 24);
+
+      value = encode ? (value + pc) : (value - pc);
+      value &= 0x01ffffff;
+      if ((value & 0x01000000) != 0)
+        value |= 0xff000000;
+
+      operand[0] = (uint8_t) value;
+      operand[1] = (uint8_t) (value >> 8);
+      operand[2] = (uint8_t) (value >> 16);
+      operand[3] = (uint8_t) (value >> 24);
+    }
+
+    i += 5;
+  }
+}
+
+/* chains */
+
+static const struct {
+  const char* name;
+  SquashFilterType type;
+  size_t default_distance;
+} squash_filter_types[] = {
+  { "shuffle", SQUASH_FILTER_SHUFFLE, 4 },
+  { "delta",   SQUASH_FILTER_DELTA,   1 },
+  { "bcj-x86", SQUASH_FILTER_BCJ_X86, 0 },
+  { NULL, 0, 0 }
+};
+
+/**
+ * @brief Parse a filter chain specification
+ * @private
+ *
+ * @param spec Comma-separated list of filters, each optionally
+ *   followed by a colon and a distance (e.g., "shuffle:8,delta:4")
+ * @param[out] chain Location to store the chain, or *NULL* if @a spec
+ *   is empty
+ * @return A status code
+ * @retval SQUASH_BAD_VALUE Unknown filter or malformed distance
+ * @retval SQUASH_RANGE Distance out of range, or too many filters
+ */
+SquashStatus
+squash_filter_chain_parse (const char* spec, SquashFilterChain** chain) {
+  assert (spec != NULL);
+  assert (chain != NULL);
+
+  *chain = NULL;
+  if (*spec == '\0')
+    return SQUASH_OK;
+
+  SquashFilterChain* res = squash_malloc (sizeof (SquashFilterChain));
+  if (SQUASH_UNLIKELY(res == NULL))
+    return squash_error (SQUASH_MEMORY);
+  memset (res, 0, sizeof (SquashFilterChain));
+
+  SquashStatus status = SQUASH_OK;
+  const char* p = spec;
+  do {
+    const size_t length = strcspn (p, ",:");
+    SquashFilter* filter = res->filters + res->n_filters;
+
+    if (SQUASH_UNLIKELY(res->n_filters == SQUASH_FILTER_MAX_FILTERS)) {
+      status = squash_error (SQUASH_RANGE);
+      goto error;
+    }
+
+    size_t t;
+    for (t = 0 ; squash_filter_types[t].name != NULL ; t++) {
+      if (strlen (squash_filter_types[t].name) == length &&
+          strncasecmp (p, squash_filter_types[t].name, length) == 0)
+        break;
+    }
+    if (SQUASH_UNLIKELY(squash_filter_types[t].name == NULL)) {
+      status = squash_error (SQUASH_BAD_VALUE);
+      goto error;
+    }
+    filter->type = squash_filter_types[t].type;
+    filter->distance = squash_filter_types[t].default_distance;
+    p += length;
+
+    if (*p == ':') {
+      char* endptr = NULL;
+      const unsigned long distance = strtoul (p + 1, &endptr, 10);
+      if (SQUASH_UNLIKELY(endptr == p + 1) || SQUASH_UNLIKELY(*endptr != '\0' && *endptr != ',') ||
+          SQUASH_UNLIKELY(filter->type == SQUASH_FILTER_BCJ_X86)) {
+        status = squash_error (SQUASH_BAD_VALUE);
+        goto error;
+      }
+      if (SQUASH_UNLIKELY(distance < 1 || distance > 256)) {
+        status = squash_error (SQUASH_RANGE);
+        goto error;
+      }
+      filter->distance = (size_t) distance;
+      p = endptr;
+    }
+
+    /* shuffle:1 doesn't do anything */
+    if (filter->type == SQUASH_FILTER_SHUFFLE && filter->distance == 1)
+      continue;
+
+    if (filter->type == SQUASH_FILTER_SHUFFLE)
+      res->needs_scratch = true;
+    res->n_filters++;
+  } while (*p != '\0' && *(p++) == ',');
+
+  if (res->n_filters == 0) {
+    squash_free (res);
+    return SQUASH_OK;
+  }
+
+  res->spec = squash_strdup (spec);
+  if (SQUASH_UNLIKELY(res->spec == NULL)) {
+    status = squash_error (SQUASH_MEMORY);
+    goto error;
+  }
+
+  *chain = res;
+  return SQUASH_OK;
+
+ error:
+  squash_free (res);
+  return status;
+}
+
+/**
+ * @brief Free a filter chain
+ * @private
+ *
+ * @param chain The chain, or *NULL*
+ */
+void
+squash_filter_chain_free (SquashFilterChain* chain) {
+  if (chain == NULL)
+    return;
+
+  squash_free (chain->spec);
+  squash_free (chain);
+}
+
+/**
+ * @brief Apply a filter chain to a block
+ * @private
+ *
+ * @param chain The chain
+ * @param size Size of the block, at most ::SQUASH_FILTER_BLOCK_SIZE
+ * @param data The block, filtered in place
+ * @param offset Offset of the block in the uncompressed data
+ * @param scratch ::SQUASH_FILTER_BLOCK_SIZE bytes of scratch space,
+ *   if the chain needs it
+ */
+void
+squash_filter_chain_encode (const SquashFilterChain* chain,
+                            size_t size,
+                            uint8_t data[SQUASH_ARRAY_PARAM(size)],
+                            uint64_t offset,
+                            uint8_t* scratch) {
+  assert (size <= SQUASH_FILTER_BLOCK_SIZE);
+  assert (scratch != NULL || !chain->needs_scratch);
+
+  for (size_t f = 0 ; f < chain->n_filters ; f++) {
+    const SquashFilter* filter = chain->filters + f;
+
+    switch (filter->type) {
+      case SQUASH_FILTER_SHUFFLE:
+        memcpy (scratch, data, size);
+        squash_filter_shuffle (data, scratch, size, filter->distance);
+        break;
+      case SQUASH_FILTER_DELTA:
+        squash_filter_delta_encode (data, size, filter->distance);
+        break;
+      case SQUASH_FILTER_BCJ_X86:
+        squash_filter_bcj_x86 (data, size, offset, true);
+        break;
+      default:
+        squash_assert_unreachable ();
+    }
+  }
+}
+
+/**
+ * @brief Undo a filter chain on a block
+ * @private
+ *
+ * @param chain The chain
+ * @param size Size of the block, at most ::SQUASH_FILTER_BLOCK_SIZE
+ * @param data The block, decoded in place
+ * @param offset Offset of the block in the uncompressed data
+ * @param scratch ::SQUASH_FILTER_BLOCK_SIZE bytes of scratch space,
+ *   if the chain needs it
+ */
+void
+squash_filter_chain_decode (const SquashFilterChain* chain,
+                            size_t size,
+                            uint8_t data[SQUASH_ARRAY_PARAM(size)],
+                            uint64_t offset,
+                            uint8_t* scratch) {
+  assert (size <= SQUASH_FILTER_BLOCK_SIZE);
+  assert (scratch != NULL || !chain->needs_scratch);
+
+  for (size_t f = chain->n_filters ; f-- > 0 ; ) {
+    const SquashFilter* filter = chain->filters + f;
+
+    switch (filter->type) {
+      case SQUASH_FILTER_SHUFFLE:
+        memcpy (scratch, data, size);
+        squash_filter_unshuffle (data, scratch, size, filter->distance);
+        break;
+      case SQUASH_FILTER_DELTA:
+        squash_filter_delta_decode (data, size, filter->distance);
+        break;
+      case SQUASH_FILTER_BCJ_X86:
+        squash_filter_bcj_x86 (data, size, offset, false);
+        break;
+      default:
+        squash_assert_unreachable ();
+    }
+  }
+}
+
+static SquashStatus
+squash_filter_buffer (const SquashFilterChain* chain, size_t size, uint8_t* data, bool encode) {
+  uint8_t* scratch = NULL;
+
+  if (chain->needs_scratch) {
+    scratch = squash_malloc ((size < SQUASH_FILTER_BLOCK_SIZE) ? size : SQUASH_FILTER_BLOCK_SIZE);
+    if (SQUASH_UNLIKELY(scratch == NULL))
+      return squash_error (SQUASH_MEMORY);
+  }
+
+  for (size_t offset = 0 ; offset < size ; offset += SQUASH_FILTER_BLOCK_SIZE) {
+    const size_t block_size = ((size - offset) < SQUASH_FILTER_BLOCK_SIZE) ? (size - offset) : SQUASH_FILTER_BLOCK_SIZE;
+
+    if (encode)
+      squash_filter_chain_encode (chain, block_size, data + offset, offset, scratch);
+    else
+      squash_filter_chain_decode (chain, block_size, data + offset, offset, scratch);
+  }
+
+  squash_free (scratch);
+
+  return SQUASH_OK;
+}
+
+/**
+ * @brief Apply a filter chain to a buffer
+ * @private
+ *
+ * @param chain The chain
+ * @param size Size of the buffer
+ * @param data The buffer, filtered in place
+ * @return A status code
+ */
+SquashStatus
+squash_filter_encode_buffer (const SquashFilterChain* chain,
+                             size_t size,
+                             uint8_t data[SQUASH_ARRAY_PARAM(size)]) {
+  return squash_filter_buffer (chain, size, data, true);
+}
+
+/**
+ * @brief Undo a filter chain on a buffer
+ * @private
+ *
+ * @param chain The chain
+ * @param size Size of the buffer
+ * @param data The buffer, decoded in place
+ * @return A status code
+ */
+SquashStatus
+squash_filter_decode_buffer (const SquashFilterChain* chain,
+                             size_t size,
+                             uint8_t data[SQUASH_ARRAY_PARAM(size)]) {
+  return squash_filter_buffer (chain, size, data, false);
+}
+
+/**
+ * @brief Initialize the state used to filter a stream
+ * @private
+ *
+ * Buffers are allocated by ::squash_filter_stream_prepare.
+ *
+ * @param filter The state
+ * @param chain The chain, which must outlive the state, or *NULL* if
+ *   the stream isn't filtered
+ */
+void
+squash_filter_stream_init (SquashFilterStream* filter, const SquashFilterChain* chain) {
+  filter->chain = chain;
+  filter->block = NULL;
+  filter->scratch = NULL;
+
+  squash_filter_stream_reset (filter);
+}
+
+/**
+ * @brief Allocate the buffers used to filter a stream
+ * @private
+ *
+ * @param filter The state
+ * @return A status code
+ */
+SquashStatus
+squash_filter_stream_prepare (SquashFilterStream* filter) {
+  assert (filter->chain != NULL);
+
+  if (SQUASH_LIKELY(filter->block != NULL))
+    return SQUASH_OK;
+
+  filter->block = squash_malloc (SQUASH_FILTER_BLOCK_SIZE);
+  if (SQUASH_UNLIKELY(filter->block == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  if (filter->chain->needs_scratch) {
+    filter->scratch = squash_malloc (SQUASH_FILTER_BLOCK_SIZE);
+    if (SQUASH_UNLIKELY(filter->scratch == NULL)) {
+      squash_free (filter->block);
+      filter->block = NULL;
+      return squash_error (SQUASH_MEMORY);
+    }
+  }
+
+  return SQUASH_OK;
+}
+
+/**
+ * @brief Discard any data buffered for a stream
+ * @private
+ *
+ * @param filter The state
+ */
+void
+squash_filter_stream_reset (SquashFilterStream* filter) {
+  filter->length = 0;
+  filter->position = 0;
+  filter->offset = 0;
+  filter->ready = false;
+  filter->last = false;
+}
+
+/**
+ * @brief Free the buffers used to filter a stream
+ * @private
+ *
+ * @param filter The state
+ */
+void
+squash_filter_stream_destroy (SquashFilterStream* filter) {
+  squash_free (filter->block);
+  squash_free (filter->scratch);
+}
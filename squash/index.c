@@ -0,0 +1,133 @@
+/* Copyright (c) 2013-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "internal.h"
+
+/**
+ * @defgroup Index
+ * @brief Random access to compressed files
+ *
+ * Most compressed formats can only be decoded from the beginning, so
+ * reading a range from the middle of a large file normally means
+ * decompressing everything before it.  Codecs which support it can
+ * record checkpoints while decompressing a file once, and save them
+ * to a separate index file; afterwards any range can be extracted by
+ * resuming from the nearest checkpoint, so the cost of a read is
+ * proportional to the checkpoint spacing instead of the file size.
+ *
+ * The format of the index is codec-specific.  By convention it is
+ * stored next to the compressed file, with ".sqidx" appended to the
+ * file name.
+ *
+ * @{
+ */
+
+/**
+ * @brief Build an index for a compressed file
+ *
+ * Decompresses the contents of @a fp_in, starting at the current
+ * position, and writes an index to @a fp_index.  Offsets recorded in
+ * the index are absolute positions in @a fp_in, so the same file
+ * must be passed to ::squash_index_extract.
+ *
+ * @param codec The codec
+ * @param fp_index File to write the index to
+ * @param fp_in Compressed file
+ * @param span Approximate number of uncompressed bytes between
+ *   checkpoints, or 0 to use the codec's default
+ * @param options Options, or *NULL* to use the defaults
+ * @return @ref SQUASH_OK on success, @ref SQUASH_INVALID_OPERATION
+ *   if the codec does not support indexing, or a negative error code
+ */
+SquashStatus
+squash_index_build (SquashCodec* codec,
+                    FILE* fp_index,
+                    FILE* fp_in,
+                    size_t span,
+                    SquashOptions* options) {
+  assert (codec != NULL);
+  assert (fp_index != NULL);
+  assert (fp_in != NULL);
+
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+  if (SQUASH_UNLIKELY(impl == NULL))
+    return squash_error (SQUASH_UNABLE_TO_LOAD);
+
+  if (SQUASH_UNLIKELY(impl->build_index == NULL))
+    return squash_error (SQUASH_INVALID_OPERATION);
+
+  return impl->build_index (codec, options, fp_index, fp_in, span);
+}
+
+/**
+ * @brief Decompress a range of a file using an index
+ *
+ * @param codec The codec
+ * @param fp_index Index previously created by ::squash_index_build
+ * @param fp_in Compressed file
+ * @param offset Offset, in uncompressed bytes, of the start of the
+ *   range
+ * @param[in,out] decompressed_size Number of bytes to read; on
+ *   success, the number of bytes actually read, which is only smaller
+ *   than requested if the end of the data was reached
+ * @param[out] decompressed Buffer to store the decompressed data in
+ * @param options Options, or *NULL* to use the defaults
+ * @return @ref SQUASH_OK on success, @ref SQUASH_RANGE if @a offset
+ *   is past the end of the data, @ref SQUASH_INVALID_OPERATION if the
+ *   codec does not support indexing, or a negative error code
+ */
+SquashStatus
+squash_index_extract (SquashCodec* codec,
+                      FILE* fp_index,
+                      FILE* fp_in,
+                      uint64_t offset,
+                      size_t* decompressed_size,
+                      uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                      SquashOptions* options) {
+  assert (codec != NULL);
+  assert (fp_index != NULL);
+  assert (fp_in != NULL);
+  assert (decompressed_size != NULL);
+  assert (decompressed != NULL);
+
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+  if (SQUASH_UNLIKELY(impl == NULL))
+    return squash_error (SQUASH_UNABLE_TO_LOAD);
+
+  if (SQUASH_UNLIKELY(impl->extract == NULL))
+    return squash_error (SQUASH_INVALID_OPERATION);
+
+  return impl->extract (codec, options, fp_index, fp_in, offset, decompressed_size, decompressed);
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,59 @@
+/* Copyright (c) 2013-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include <squash/squash.h> */
+
+#ifndef SQUASH_INDEX_H
+#define SQUASH_INDEX_H
+
+#if !defined (SQUASH_H_INSIDE) && !defined (SQUASH_COMPILATION)
+#error "Only <squash/squash.h> can be included directly."
+#endif
+
+#include <squash/squash.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+SQUASH_BEGIN_DECLS
+
+SQUASH_NONNULL(1, 2, 3)
+SQUASH_API SquashStatus squash_index_build   (SquashCodec* codec,
+                                              FILE* fp_index,
+                                              FILE* fp_in,
+                                              size_t span,
+                                              SquashOptions* options);
+SQUASH_NONNULL(1, 2, 3, 5, 6)
+SQUASH_API SquashStatus squash_index_extract (SquashCodec* codec,
+                                              FILE* fp_index,
+                                              FILE* fp_in,
+                                              uint64_t offset,
+                                              size_t* decompressed_size,
+                                              uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                                              SquashOptions* options);
+
+SQUASH_END_DECLS
+
+#endif /* SQUASH_INDEX_H */
@@ -45,6 +45,7 @@
 
 #include "charset-internal.h"
 #include "tree-internal.h"
+#include "codec-table-internal.h"
 #include "types-internal.h"
 #include "memory-internal.h"
 #include "context-internal.h"
@@ -55,6 +56,11 @@
 #include "buffer-stream-internal.h"
 #include "ini-internal.h"
 #include "mtx-internal.h"
+#include "atomic-internal.h"
+#include "stats-internal.h"
+#include "segment-internal.h"
+#include "filter-internal.h"
+#include "chain-internal.h"
 #include "stream-internal.h"
 #include "util-internal.h"
 
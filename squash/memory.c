@@ -46,6 +46,7 @@
 #  error No alignmed memory allocation function
 #endif
 
+#include <stdbool.h>
 #include <string.h>
 
 #if !defined(HAVE_ALIGNED_ALLOC)
@@ -96,6 +97,144 @@ squash_wrap_malloc (size_t size) {
   return squash_memfns.calloc (1, size);
 }
 
+/* Accounting.  When enabled every allocation is prefixed with a
+ * header recording its size and the operation (if any) it was
+ * charged to, so the bytes can be returned when it is freed. */
+
+typedef struct SquashMemoryAccount_ {
+  volatile size_t current;
+  volatile size_t peak;
+  volatile size_t limit;
+  volatile size_t refs;
+} SquashMemoryAccount;
+
+typedef struct SquashMemoryHeader_ {
+  size_t size;
+  SquashMemoryAccount* account;
+} SquashMemoryHeader;
+
+#define SQUASH_MEMORY_HEADER_SIZE ((size_t) 16)
+
+static bool squash_memory_accounting = false;
+static SquashMemoryAccount squash_memory_global = { 0, 0, 0, 1 };
+static SQUASH_THREAD_LOCAL SquashMemoryAccount* squash_memory_operation = NULL;
+
+static bool
+squash_memory_account_charge (SquashMemoryAccount* account, size_t size) {
+  const size_t current = squash_atomic_add_size (&(account->current), size);
+  const size_t limit = account->limit;
+
+  if (SQUASH_UNLIKELY(current < size) ||
+      SQUASH_UNLIKELY(limit != 0 && current > limit)) {
+    squash_atomic_sub_size (&(account->current), size);
+    return false;
+  }
+
+  size_t peak = account->peak;
+  while (current > peak) {
+    const size_t prev = squash_atomic_cas_size (&(account->peak), peak, current);
+    if (prev == peak)
+      break;
+    peak = prev;
+  }
+
+  return true;
+}
+
+static void
+squash_memory_account_unref (SquashMemoryAccount* account) {
+  if (squash_atomic_sub_size (&(account->refs), 1) == 0)
+    squash_memfns.free (account);
+}
+
+static bool
+squash_memory_charge (SquashMemoryAccount* account, size_t size) {
+  if (SQUASH_UNLIKELY(!squash_memory_account_charge (&squash_memory_global, size)))
+    return false;
+
+  if (account != NULL && SQUASH_UNLIKELY(!squash_memory_account_charge (account, size))) {
+    squash_atomic_sub_size (&(squash_memory_global.current), size);
+    return false;
+  }
+
+  return true;
+}
+
+static void
+squash_memory_uncharge (SquashMemoryAccount* account, size_t size) {
+  squash_atomic_sub_size (&(squash_memory_global.current), size);
+  if (account != NULL)
+    squash_atomic_sub_size (&(account->current), size);
+}
+
+static void*
+squash_accounted_alloc (size_t size, bool zero) {
+  SquashMemoryAccount* account = squash_memory_operation;
+
+  if (SQUASH_UNLIKELY(size > (SIZE_MAX - SQUASH_MEMORY_HEADER_SIZE)) ||
+      SQUASH_UNLIKELY(!squash_memory_charge (account, size)))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  SquashMemoryHeader* header = zero ?
+    squash_memfns.calloc (1, SQUASH_MEMORY_HEADER_SIZE + size) :
+    squash_memfns.malloc (SQUASH_MEMORY_HEADER_SIZE + size);
+  if (SQUASH_UNLIKELY(header == NULL)) {
+    squash_memory_uncharge (account, size);
+    return (squash_error (SQUASH_MEMORY), NULL);
+  }
+
+  header->size = size;
+  header->account = account;
+  if (account != NULL)
+    squash_atomic_add_size (&(account->refs), 1);
+
+  return ((uint8_t*) header) + SQUASH_MEMORY_HEADER_SIZE;
+}
+
+static void
+squash_accounted_free (void* ptr) {
+  if (ptr == NULL)
+    return;
+
+  SquashMemoryHeader* header = (SquashMemoryHeader*) (((uint8_t*) ptr) - SQUASH_MEMORY_HEADER_SIZE);
+  SquashMemoryAccount* account = header->account;
+
+  squash_memory_uncharge (account, header->size);
+  if (account != NULL)
+    squash_memory_account_unref (account);
+
+  squash_memfns.free (header);
+}
+
+static void*
+squash_accounted_realloc (void* ptr, size_t size) {
+  if (ptr == NULL)
+    return squash_accounted_alloc (size, false);
+
+  SquashMemoryHeader* header = (SquashMemoryHeader*) (((uint8_t*) ptr) - SQUASH_MEMORY_HEADER_SIZE);
+  SquashMemoryAccount* account = header->account;
+  const size_t old_size = header->size;
+
+  if (SQUASH_UNLIKELY(size > (SIZE_MAX - SQUASH_MEMORY_HEADER_SIZE)))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  if (size > old_size && SQUASH_UNLIKELY(!squash_memory_charge (account, size - old_size)))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  header = squash_memfns.realloc (header, SQUASH_MEMORY_HEADER_SIZE + size);
+  if (SQUASH_UNLIKELY(header == NULL)) {
+    if (size > old_size)
+      squash_memory_uncharge (account, size - old_size);
+    return (squash_error (SQUASH_MEMORY), NULL);
+  }
+
+  if (size < old_size)
+    squash_memory_uncharge (account, old_size - size);
+  header->size = size;
+
+  return ((uint8_t*) header) + SQUASH_MEMORY_HEADER_SIZE;
+}
+
 /**
  * @defgroup Memory
  * @brief Low-level memory management
@@ -149,23 +288,176 @@ squash_set_memory_functions (SquashMemoryFuncs memfn) {
   squash_memfns = memfn;
 }
 
+/**
+ * @struct SquashMemoryUsage_
+ * @brief Memory accounting information
+ *
+ * @var SquashMemoryUsage_::current
+ * @brief Number of bytes currently allocated
+ *
+ * @var SquashMemoryUsage_::peak
+ * @brief Largest number of bytes allocated at any one time (the
+ *   high-water mark)
+ *
+ * @var SquashMemoryUsage_::limit
+ * @brief Maximum number of bytes which may be allocated, or 0 for
+ *   no limit
+ */
+
+/**
+ * Enable memory accounting and set a process-wide limit
+ *
+ * The first call to this function enables accounting: from then on
+ * Squash keeps track of how much memory is allocated through its
+ * memory management functions, and any allocation which would push
+ * the total over @a limit fails (which plugins report as @ref
+ * SQUASH_MEMORY) instead of exhausting the host.  Later calls only
+ * change the limit.
+ *
+ * Accounting is also required for @ref
+ * squash_memory_operation_begin.
+ *
+ * @note Like @ref squash_set_memory_functions, the first call to
+ * this function must happen before *any* other function in Squash
+ * (other than @ref squash_set_memory_functions).
+ *
+ * @note Only memory allocated through Squash is counted.  Plugins
+ * distributed with Squash route their own allocations through it
+ * whenever the underlying library allows it, but some libraries
+ * allocate memory internally with the standard allocator.
+ *
+ * @param limit Maximum number of bytes which may be allocated at
+ *   once, or 0 for no limit
+ */
+void
+squash_set_memory_limit (size_t limit) {
+  squash_memory_accounting = true;
+  squash_memory_global.limit = limit;
+}
+
+/**
+ * Get process-wide memory usage
+ *
+ * If accounting has not been enabled with @ref
+ * squash_set_memory_limit all fields will be 0.
+ *
+ * @param usage Location to store the usage information
+ */
+void
+squash_get_memory_usage (SquashMemoryUsage* usage) {
+  assert (usage != NULL);
+
+  usage->current = squash_memory_global.current;
+  usage->peak = squash_memory_global.peak;
+  usage->limit = squash_memory_global.limit;
+}
+
+/**
+ * Begin accounting for an operation on the calling thread
+ *
+ * Until @ref squash_memory_operation_end is called, allocations made
+ * on this thread are charged to the operation as well as to the
+ * process-wide total.  Allocations which would push the operation
+ * over @a limit fail.
+ *
+ * Memory allocated by other threads (for example, the thread Squash
+ * uses to drive plugins which only implement the splice interface
+ * through the stream API) is not charged to the operation.
+ *
+ * @param limit Maximum number of bytes the operation may have
+ *   allocated at once, or 0 for no limit
+ * @return A status code
+ * @retval SQUASH_OK Accounting started
+ * @retval SQUASH_STATE Accounting is not enabled, or an operation is
+ *   already active on this thread
+ * @retval SQUASH_MEMORY Unable to allocate memory
+ */
+SquashStatus
+squash_memory_operation_begin (size_t limit) {
+  if (SQUASH_UNLIKELY(!squash_memory_accounting) ||
+      SQUASH_UNLIKELY(squash_memory_operation != NULL))
+    return squash_error (SQUASH_STATE);
+
+  SquashMemoryAccount* account = squash_memfns.malloc (sizeof (SquashMemoryAccount));
+  if (SQUASH_UNLIKELY(account == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  account->current = 0;
+  account->peak = 0;
+  account->limit = limit;
+  account->refs = 1;
+
+  squash_memory_operation = account;
+
+  return SQUASH_OK;
+}
+
+/**
+ * End accounting for an operation on the calling thread
+ *
+ * Memory which was allocated during the operation and is still live
+ * (for example, a stream which has not yet been destroyed) remains
+ * charged to the process-wide total until it is freed.
+ *
+ * @param usage Location to store the operation's usage (including
+ *   its high-water mark), or *NULL*
+ * @return A status code
+ * @retval SQUASH_OK Success
+ * @retval SQUASH_STATE No operation is active on this thread
+ */
+SquashStatus
+squash_memory_operation_end (SquashMemoryUsage* usage) {
+  SquashMemoryAccount* account = squash_memory_operation;
+
+  if (SQUASH_UNLIKELY(account == NULL))
+    return squash_error (SQUASH_STATE);
+
+  if (usage != NULL) {
+    usage->current = account->current;
+    usage->peak = account->peak;
+    usage->limit = account->limit;
+  }
+
+  squash_memory_operation = NULL;
+  squash_memory_account_unref (account);
+
+  return SQUASH_OK;
+}
+
 void*
 squash_malloc (size_t size) {
+  if (squash_memory_accounting)
+    return squash_accounted_alloc (size, false);
+
   return squash_memfns.malloc (size);
 }
 
 void*
 squash_calloc (size_t nmemb, size_t size) {
+  if (squash_memory_accounting) {
+    if (SQUASH_UNLIKELY(size != 0 && nmemb > (SIZE_MAX / size)))
+      return (squash_error (SQUASH_MEMORY), NULL);
+    return squash_accounted_alloc (nmemb * size, true);
+  }
+
   return squash_memfns.calloc (nmemb, size);
 }
 
 void*
 squash_realloc (void* ptr, size_t size) {
+  if (squash_memory_accounting)
+    return squash_accounted_realloc (ptr, size);
+
   return squash_memfns.realloc (ptr, size);
 }
 
 void
 squash_free (void* ptr) {
+  if (squash_memory_accounting) {
+    squash_accounted_free (ptr);
+    return;
+  }
+
   squash_memfns.free (ptr);
 }
 
@@ -196,7 +488,7 @@ squash_free (void* ptr) {
  */
 void*
 squash_aligned_alloc (size_t alignment, size_t size) {
-  if (squash_memfns.aligned_alloc != NULL) {
+  if (squash_memfns.aligned_alloc != NULL && !squash_memory_accounting) {
     return squash_memfns.aligned_alloc (alignment, size);
   } else {
     /* This code is only used when people provide custom memory
@@ -209,10 +501,15 @@ squash_aligned_alloc (size_t alignment, size_t size) {
      * Note that this function will call squash_malloc() with a much
      * larger buffer than is necessary.  If you have a problem with
      * that then feel free to provide your own aligned_alloc
-     * implementation. */
+     * implementation.
+     *
+     * It is also used when memory accounting is enabled, so aligned
+     * allocations are counted like everything else. */
 
     const size_t ms = size + alignment + sizeof(void*);
-    const void* ptr = squash_memfns.malloc (ms);
+    void* ptr = squash_malloc (ms);
+    if (SQUASH_UNLIKELY(ptr == NULL))
+      return NULL;
     const uintptr_t addr = (uintptr_t) ptr;
 
     /* Figure out where to put the object.  We want a pointer to the
@@ -223,7 +520,7 @@ squash_aligned_alloc (size_t alignment, size_t size) {
       padding += alignment;
     assert ((padding + size) <= ms);
 
-    memcpy ((void*) (addr + padding - sizeof(void*)), ptr, sizeof(void*));
+    memcpy ((void*) (addr + padding - sizeof(void*)), &ptr, sizeof(void*));
     return (void*) (addr + padding);
   }
 
@@ -237,10 +534,12 @@ squash_aligned_alloc (size_t alignment, size_t size) {
  * @param ptr Buffer to deallocate
  */
 void squash_aligned_free (void* ptr) {
-  if (squash_memfns.aligned_free != NULL) {
-    return squash_memfns.aligned_free (ptr);
+  if (squash_memfns.aligned_free != NULL && !squash_memory_accounting) {
+    squash_memfns.aligned_free (ptr);
   } else if (ptr != NULL) {
-    squash_memfns.free ((void*) (((uintptr_t) ptr) - sizeof(void*)));
+    void* real_ptr;
+    memcpy (&real_ptr, (void*) (((uintptr_t) ptr) - sizeof(void*)), sizeof(void*));
+    squash_free (real_ptr);
   }
 }
 
@@ -50,8 +50,20 @@ typedef struct SquashMemoryFuncs_ {
   void  (* aligned_free)          (void* ptr);
 } SquashMemoryFuncs;
 
+typedef struct SquashMemoryUsage_ {
+  size_t current;
+  size_t peak;
+  size_t limit;
+} SquashMemoryUsage;
+
 SQUASH_API void  squash_set_memory_functions (SquashMemoryFuncs memfn);
 
+SQUASH_API void         squash_set_memory_limit       (size_t limit);
+SQUASH_NONNULL(1)
+SQUASH_API void         squash_get_memory_usage       (SquashMemoryUsage* usage);
+SQUASH_API SquashStatus squash_memory_operation_begin (size_t limit);
+SQUASH_API SquashStatus squash_memory_operation_end   (SquashMemoryUsage* usage);
+
 SQUASH_MALLOC
 SQUASH_API void* squash_malloc               (size_t size);
 SQUASH_API void* squash_realloc              (void* ptr, size_t size);
@@ -64,6 +64,10 @@
  *
  * @var SquashOptions_::values
  * @brief NULL-terminated array of option values
+ *
+ * @var SquashOptions_::filters
+ * @brief Filters applied before compression and after decompression,
+ *   set with the "filter" option
  */
 
 /**
@@ -140,6 +144,8 @@
  * @brief the value as a boolean
  * @var SquashOptionValue_::size_value
  * @brief the value as a size
+ * @var SquashOptionValue_::file_value
+ * @brief the contents of a file, see ::squash_options_get_file_at
  */
 
 /**
@@ -156,6 +162,93 @@
  * @brief value to use if none is provided by the user
  */
 
+struct SquashOptionFile_ {
+  char* path;
+  const uint8_t* data;
+  size_t size;
+  uint8_t* buffer;
+#if !defined(_WIN32)
+  FILE* fp;
+  SquashMappedFile map;
+#endif
+};
+
+static void
+squash_option_file_free (SquashOptionFile* file) {
+  if (file == NULL)
+    return;
+
+#if !defined(_WIN32)
+  squash_mapped_file_destroy (&(file->map), false);
+  if (file->fp != NULL)
+    fclose (file->fp);
+#endif
+  squash_free (file->buffer);
+  squash_free (file->path);
+  squash_free (file);
+}
+
+/* Map the file read-only if we can; files which can't be mapped
+ * (pipes, empty files, or anything on Windows) are read into
+ * memory instead.  Either way the contents stay valid until the
+ * option is changed or the options are destroyed. */
+static SquashStatus
+squash_option_file_open (const char* path, SquashOptionFile** result) {
+  SquashOptionFile* file = squash_calloc (1, sizeof (SquashOptionFile));
+  if (SQUASH_UNLIKELY(file == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  FILE* fp = fopen (path, "rb");
+  if (SQUASH_UNLIKELY(fp == NULL)) {
+    squash_free (file);
+    return squash_error (SQUASH_IO);
+  }
+
+  file->path = squash_strdup (path);
+
+#if !defined(_WIN32)
+  file->map = squash_mapped_file_empty;
+  if (squash_mapped_file_init (&(file->map), fp, 0, false)) {
+    file->fp = fp;
+    file->data = file->map.data;
+    file->size = file->map.size;
+    *result = file;
+    return SQUASH_OK;
+  }
+#endif
+
+  size_t allocated = 0;
+  for (;;) {
+    if (file->size == allocated) {
+      allocated = (allocated == 0) ? 65536 : (allocated * 2);
+      uint8_t* buffer = squash_realloc (file->buffer, allocated);
+      if (SQUASH_UNLIKELY(buffer == NULL)) {
+        fclose (fp);
+        squash_option_file_free (file);
+        return squash_error (SQUASH_MEMORY);
+      }
+      file->buffer = buffer;
+    }
+
+    const size_t bytes_read = fread (file->buffer + file->size, 1, allocated - file->size, fp);
+    file->size += bytes_read;
+    if (bytes_read == 0)
+      break;
+  }
+
+  const bool failed = ferror (fp) != 0;
+  fclose (fp);
+  if (SQUASH_UNLIKELY(failed)) {
+    squash_option_file_free (file);
+    return squash_error (SQUASH_IO);
+  }
+
+  file->data = file->buffer;
+  *result = file;
+
+  return SQUASH_OK;
+}
+
 static ptrdiff_t
 squash_options_find (SquashOptions* options, SquashCodec* codec, const char* key) {
   assert (options != NULL);
@@ -200,8 +293,11 @@ squash_options_get_string (SquashOptions* options, SquashCodec* codec, const cha
   }
 
   const ptrdiff_t option_n = squash_options_find (options, codec, key);
-  if (option_n < 0)
+  if (option_n < 0) {
+    if (options != NULL && options->filters != NULL && strcasecmp (key, "filter") == 0)
+      return options->filters->spec;
     return NULL;
+  }
 
   return squash_options_get_string_at (options, codec, option_n);
 }
@@ -285,7 +381,7 @@ squash_options_get_value_at (SquashOptions* options, SquashCodec* codec, const S
     *type = ci->type;
 
   return (options == NULL) ?
-    &((*info)->default_value) :
+    &(ci->default_value) :
     &(options->values[index]);
 }
 
@@ -321,6 +417,8 @@ squash_options_get_string_at (SquashOptions* options, SquashCodec* codec, size_t
       return info->info.enum_string.values[val->int_value].name;
     case SQUASH_OPTION_TYPE_STRING:
       return val->string_value;
+    case SQUASH_OPTION_TYPE_FILE:
+      return (val->file_value != NULL) ? val->file_value->path : NULL;
     default:
       return NULL;
   }
@@ -435,6 +533,67 @@ squash_options_get_size_at (SquashOptions* options, SquashCodec* codec, size_t i
   squash_assert_unreachable ();
 }
 
+/**
+ * Retrieve the contents of a file option
+ *
+ * File options are set to the path of a file, which is opened (and
+ * memory-mapped when possible) as soon as the option is set.  The
+ * contents remain valid, and may be shared by any number of
+ * streams, until the option is changed or @a options is destroyed.
+ *
+ * @param options the options to retrieve the value from
+ * @param codec the codec to use
+ * @param key name of the option to retrieve the value from
+ * @param size location to store the size of the file in
+ * @returns the contents of the file, or *NULL* if no file was set
+ */
+const uint8_t*
+squash_options_get_file (SquashOptions* options, SquashCodec* codec, const char* key, size_t* size) {
+  *size = 0;
+
+  if (options == NULL)
+    return NULL;
+  if (codec == NULL)
+    codec = options->codec;
+
+  const ptrdiff_t option_n = squash_options_find (options, codec, key);
+  if (option_n < 0)
+    return NULL;
+
+  return squash_options_get_file_at (options, codec, option_n, size);
+}
+
+/**
+ * Retrieve the contents of a file option
+ *
+ * @note It is undefined behavior to specify an index greater than
+ * the number of options.
+ *
+ * @param options the options to retrieve the value from
+ * @param index the index of the desired option
+ * @param size location to store the size of the file in
+ * @returns the contents of the file, or *NULL* if no file was set
+ */
+const uint8_t*
+squash_options_get_file_at (SquashOptions* options, SquashCodec* codec, size_t index, size_t* size) {
+  *size = 0;
+
+  /* There is no default file, so without options there is nothing
+     to return. */
+  if (options == NULL)
+    return NULL;
+  if (codec == NULL)
+    codec = options->codec;
+
+  SquashOptionType type;
+  const SquashOptionValue* val = squash_options_get_value_at (options, codec, NULL, &type, index);
+  if (SQUASH_UNLIKELY(val == NULL) || type != SQUASH_OPTION_TYPE_FILE || val->file_value == NULL)
+    return NULL;
+
+  *size = val->file_value->size;
+  return val->file_value->data;
+}
+
 /**
  * @brief Set the value of a string option
  *
@@ -553,8 +712,20 @@ squash_options_set_string_at (SquashOptions* options, size_t index, const char*
 
   switch ((int) info->type) {
     case SQUASH_OPTION_TYPE_STRING:
-      val->string_value = strdup (value);
+      squash_free (val->string_value);
+      val->string_value = squash_strdup (value);
       return SQUASH_OK;
+    case SQUASH_OPTION_TYPE_FILE: {
+        SquashOptionFile* file = NULL;
+        if (*value != '\0') {
+          const SquashStatus res = squash_option_file_open (value, &file);
+          if (SQUASH_UNLIKELY(res != SQUASH_OK))
+            return res;
+        }
+        squash_option_file_free (val->file_value);
+        val->file_value = file;
+        return SQUASH_OK;
+      }
     case SQUASH_OPTION_TYPE_ENUM_STRING:
       for (ptrdiff_t i = 0 ; info->info.enum_string.values[i].name != NULL ; i++) {
         if (strcasecmp (value, info->info.enum_string.values[i].name) == 0) {
@@ -709,8 +880,22 @@ squash_options_parse_option (SquashOptions* options, const char* key, const char
   assert (options->codec != NULL);
 
   const ptrdiff_t option_n = squash_options_find (options, options->codec, key);
-  if (option_n < 0)
+  if (option_n < 0) {
+    /* Filters work with every codec, unless the codec has its own
+       option with the same name. */
+    if (strcasecmp (key, "filter") == 0) {
+      SquashFilterChain* filters;
+      SquashStatus res = squash_filter_chain_parse (value, &filters);
+      if (SQUASH_UNLIKELY(res != SQUASH_OK))
+        return res;
+
+      squash_filter_chain_free (options->filters);
+      options->filters = filters;
+      return SQUASH_OK;
+    }
+
     return squash_error (SQUASH_BAD_PARAM);
+  }
 
   const SquashOptionInfo* info = squash_codec_get_option_info (options->codec) + option_n;
 
@@ -796,7 +981,8 @@ squash_options_parse_option (SquashOptions* options, const char* key, const char
       break;
 
     case SQUASH_OPTION_TYPE_STRING:
-    case SQUASH_OPTION_TYPE_ENUM_STRING: {
+    case SQUASH_OPTION_TYPE_ENUM_STRING:
+    case SQUASH_OPTION_TYPE_FILE: {
         return squash_options_set_string_at (options, option_n, value);
       }
       break;
@@ -940,15 +1126,21 @@ squash_options_create (SquashCodec* codec) {
  * @param codec The codec to create the options for.
  * @param options A variadic list of string key/value pairs followed by *NULL*
  * @return A new option group, or *NULL* if @a codec does not accept
- *   any options or could not be loaded.
+ *   any options (other than "filter") and none were given, or could
+ *   not be loaded.
  */
 SquashOptions*
 squash_options_newv (SquashCodec* codec, va_list options) {
   SquashOptions* opts = NULL;
+  va_list peek;
 
   assert (codec != NULL);
 
-  if (squash_codec_get_option_info (codec) != NULL) {
+  va_copy (peek, options);
+  const char* key = va_arg (peek, const char*);
+  va_end (peek);
+
+  if (squash_codec_get_option_info (codec) != NULL || key != NULL) {
     opts = squash_options_create (codec);
     squash_options_parsev (opts, options);
   }
@@ -962,7 +1154,9 @@ squash_options_newv (SquashCodec* codec, va_list options) {
  * @param codec The codec to create the options for.
  * @param keys A *NULL*-terminated array of keys.
  * @param values A *NULL*-terminated array of values.
- * @return A new option group, or *NULL* on failure.
+ * @return A new option group, or *NULL* if @a codec does not accept
+ *   any options (other than "filter") and none were given, or could
+ *   not be loaded.
  */
 SquashOptions*
 squash_options_newa (SquashCodec* codec, const char* const* keys, const char* const* values) {
@@ -970,7 +1164,7 @@ squash_options_newa (SquashCodec* codec, const char* const* keys, const char* co
 
   assert (codec != NULL);
 
-  if (squash_codec_get_option_info (codec) != NULL) {
+  if (squash_codec_get_option_info (codec) != NULL || (keys != NULL && keys[0] != NULL)) {
     opts = squash_options_create (codec);
     squash_options_parsea (opts, keys, values);
   }
@@ -1002,6 +1196,8 @@ squash_options_init (void* options,
 
   squash_object_init (o, true, destroy_notify);
   o->codec = codec;
+  o->values = NULL;
+  o->filters = NULL;
 
   const SquashOptionInfo* info = squash_codec_get_option_info (codec);
   if (info != NULL) {
@@ -1029,7 +1225,10 @@ squash_options_init (void* options,
           o->values[c_option].size_value = info[c_option].default_value.size_value;
           break;
         case SQUASH_OPTION_TYPE_STRING:
-          o->values[c_option].string_value = strdup (info[c_option].default_value.string_value);
+          o->values[c_option].string_value = squash_strdup (info[c_option].default_value.string_value);
+          break;
+        case SQUASH_OPTION_TYPE_FILE:
+          o->values[c_option].file_value = NULL;
           break;
         case SQUASH_OPTION_TYPE_NONE:
         default:
@@ -1063,10 +1262,14 @@ squash_options_destroy (void* options) {
     for (int i = 0 ; info[i].name != NULL ; i++)
       if (info[i].type == SQUASH_OPTION_TYPE_STRING)
         squash_free (values[i].string_value);
+      else if (info[i].type == SQUASH_OPTION_TYPE_FILE)
+        squash_option_file_free (values[i].file_value);
 
     squash_free (values);
   }
 
+  squash_filter_chain_free (o->filters);
+
   squash_object_destroy (o);
 }
 
@@ -1189,15 +1392,21 @@ squash_options_neww (SquashCodec* codec, ...) {
  * @param codec The codec to create the options for.
  * @param options A variadic list of string key/value pairs followed by *NULL*
  * @return A new option group, or *NULL* if @a codec does not accept
- *   any options or could not be loaded.
+ *   any options (other than "filter") and none were given, or could
+ *   not be loaded.
  */
 SquashOptions*
 squash_options_newvw (SquashCodec* codec, va_list options) {
   SquashOptions* opts = NULL;
+  va_list peek;
 
   assert (codec != NULL);
 
-  if (squash_codec_get_option_info (codec) != NULL) {
+  va_copy (peek, options);
+  const wchar_t* key = va_arg (peek, const wchar_t*);
+  va_end (peek);
+
+  if (squash_codec_get_option_info (codec) != NULL || key != NULL) {
     opts = squash_options_create (codec);
     squash_options_parsevw (opts, options);
   }
@@ -1211,7 +1420,9 @@ squash_options_newvw (SquashCodec* codec, va_list options) {
  * @param codec The codec to create the options for.
  * @param keys A *NULL*-terminated array of keys.
  * @param values A *NULL*-terminated array of values.
- * @return A new option group, or *NULL* on failure.
+ * @return A new option group, or *NULL* if @a codec does not accept
+ *   any options (other than "filter") and none were given, or could
+ *   not be loaded.
  */
 SquashOptions*
 squash_options_newaw (SquashCodec* codec, const wchar_t* const* keys, const wchar_t* const* values) {
@@ -1219,7 +1430,7 @@ squash_options_newaw (SquashCodec* codec, const wchar_t* const* keys, const wcha
 
   assert (codec != NULL);
 
-  if (squash_codec_get_option_info (codec) != NULL) {
+  if (squash_codec_get_option_info (codec) != NULL || (keys != NULL && keys[0] != NULL)) {
     opts = squash_options_create (codec);
     squash_options_parseaw (opts, keys, values);
   }
@@ -46,6 +46,8 @@ typedef struct SquashOptionInfoRangeInt_      SquashOptionInfoRangeInt;
 typedef struct SquashOptionInfoRangeSize_     SquashOptionInfoRangeSize;
 typedef struct SquashOptionInfo_              SquashOptionInfo;
 typedef union  SquashOptionValue_             SquashOptionValue;
+typedef struct SquashOptionFile_              SquashOptionFile;
+typedef struct SquashFilterChain_             SquashFilterChain;
 
 struct SquashOptions_ {
   SquashObject base_object;
@@ -53,6 +55,7 @@ struct SquashOptions_ {
   SquashCodec* codec;
 
   SquashOptionValue* values;
+  SquashFilterChain* filters;
 };
 
 typedef enum {
@@ -67,6 +70,8 @@ typedef enum {
 
   SQUASH_OPTION_TYPE_RANGE_INT   = (32 | SQUASH_OPTION_TYPE_INT),
   SQUASH_OPTION_TYPE_RANGE_SIZE  = (32 | SQUASH_OPTION_TYPE_SIZE),
+
+  SQUASH_OPTION_TYPE_FILE        = (64 | SQUASH_OPTION_TYPE_STRING),
 } SquashOptionType;
 
 struct SquashOptionInfoEnumStringMap_ {
@@ -102,6 +107,7 @@ union SquashOptionValue_ {
   int int_value;
   bool bool_value;
   size_t size_value;
+  SquashOptionFile* file_value;
 };
 
 struct SquashOptionInfo_ {
@@ -134,6 +140,11 @@ SQUASH_API bool           squash_options_get_bool_at   (SquashOptions* options,
 SQUASH_API int            squash_options_get_int_at    (SquashOptions* options, SquashCodec* codec, size_t index);
 SQUASH_API size_t         squash_options_get_size_at   (SquashOptions* options, SquashCodec* codec, size_t index);
 
+SQUASH_NONNULL(4)
+SQUASH_API const uint8_t* squash_options_get_file      (SquashOptions* options, SquashCodec* codec, const char* key, size_t* size);
+SQUASH_NONNULL(4)
+SQUASH_API const uint8_t* squash_options_get_file_at   (SquashOptions* options, SquashCodec* codec, size_t index, size_t* size);
+
 SQUASH_NONNULL(1, 2, 3)
 SQUASH_API SquashStatus   squash_options_set_string    (SquashOptions* options, const char* key, const char* value);
 SQUASH_NONNULL(1, 2)
@@ -112,6 +112,48 @@ squash_strdup_printf (const char* fmt, ...) {
   return buf;
 }
 
+#if !defined(_WIN32)
+typedef void* SquashPluginHandle;
+#else
+typedef HMODULE SquashPluginHandle;
+#endif
+
+/* Open the shared object for a plugin, or for one of its instruction
+ * set variants if variant is not NULL. */
+static SquashPluginHandle
+squash_plugin_open (SquashPlugin* plugin, const char* variant) {
+  SquashPluginHandle handle;
+  char* plugin_file_name;
+  const char* sep = (variant != NULL) ? "-" : "";
+
+  if (variant == NULL)
+    variant = "";
+
+  plugin_file_name = squash_strdup_printf ("%s/%ssquash%s-plugin-%s%s%s%s", plugin->directory, SQUASH_SHARED_LIBRARY_PREFIX, SQUASH_VERSION_API, plugin->name, sep, variant, SQUASH_SHARED_LIBRARY_SUFFIX);
+  if (plugin_file_name == NULL)
+    return NULL;
+
+#if !defined(_WIN32)
+  handle = dlopen (plugin_file_name, RTLD_LAZY);
+#else
+  handle = LoadLibrary (TEXT(plugin_file_name));
+  if (handle == NULL) {
+    squash_free (plugin_file_name);
+#if defined(_DEBUG)
+    plugin_file_name = squash_strdup_printf ("%s/Debug/%ssquash%s-plugin-%s%s%s%s", plugin->directory, SQUASH_SHARED_LIBRARY_PREFIX, SQUASH_VERSION_API, plugin->name, sep, variant, SQUASH_SHARED_LIBRARY_SUFFIX);
+#else
+    plugin_file_name = squash_strdup_printf ("%s/Release/%ssquash%s-plugin-%s%s%s%s", plugin->directory, SQUASH_SHARED_LIBRARY_PREFIX, SQUASH_VERSION_API, plugin->name, sep, variant, SQUASH_SHARED_LIBRARY_SUFFIX);
+#endif
+    if (plugin_file_name != NULL)
+      handle = LoadLibrary (TEXT(plugin_file_name));
+  }
+#endif
+
+  squash_free (plugin_file_name);
+
+  return handle;
+}
+
 /**
  * @brief load a %SquashPlugin
  *
@@ -122,6 +164,10 @@ squash_strdup_printf (const char* fmt, ...) {
  * The foreach functions, however, do not initialize the plugin since
  * doing so requires actually loading the plugin.
  *
+ * If the plugin was also built for newer instruction sets (such as
+ * AVX2), the best variant the CPU supports is loaded instead of the
+ * baseline build.
+ *
  * @param plugin The plugin to load.
  * @return A status code.
  * @retval SQUASH_OK The plugin has been loaded.
@@ -130,33 +176,12 @@ squash_strdup_printf (const char* fmt, ...) {
 SquashStatus
 squash_plugin_init (SquashPlugin* plugin) {
   if (plugin->plugin == NULL) {
-#if !defined(_WIN32)
-    void* handle;
-#else
-    HMODULE handle;
-#endif
-    char* plugin_file_name;
-
-    plugin_file_name = squash_strdup_printf ("%s/%ssquash%s-plugin-%s%s", plugin->directory, SQUASH_SHARED_LIBRARY_PREFIX, SQUASH_VERSION_API, plugin->name, SQUASH_SHARED_LIBRARY_SUFFIX);
-    if (plugin_file_name == NULL)
-      return squash_error (SQUASH_MEMORY);
+    SquashPluginHandle handle = NULL;
 
-#if !defined(_WIN32)
-    handle = dlopen (plugin_file_name, RTLD_LAZY);
-#else
-    handle = LoadLibrary (TEXT(plugin_file_name));
-    if (handle == NULL) {
-      squash_free (plugin_file_name);
-#if defined(_DEBUG)
-      plugin_file_name = squash_strdup_printf ("%s/Debug/%ssquash%s-plugin-%s%s", plugin->directory, SQUASH_SHARED_LIBRARY_PREFIX, SQUASH_VERSION_API, plugin->name, SQUASH_SHARED_LIBRARY_SUFFIX);
-#else
-      plugin_file_name = squash_strdup_printf ("%s/Release/%ssquash%s-plugin-%s%s", plugin->directory, SQUASH_SHARED_LIBRARY_PREFIX, SQUASH_VERSION_API, plugin->name, SQUASH_SHARED_LIBRARY_SUFFIX);
-#endif
-      handle = LoadLibrary (TEXT(plugin_file_name));
-    }
-#endif
-
-    squash_free (plugin_file_name);
+    for (const char* const* variant = squash_get_simd_variants () ; handle == NULL && *variant != NULL ; variant++)
+      handle = squash_plugin_open (plugin, *variant);
+    if (handle == NULL)
+      handle = squash_plugin_open (plugin, NULL);
 
     if (SQUASH_LIKELY(handle != NULL)) {
       SQUASH_MTX_LOCK(plugin_init);
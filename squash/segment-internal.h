@@ -0,0 +1,75 @@
+/* Copyright (c) 2015-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include <squash/internal.h> */
+
+#ifndef SQUASH_SEGMENT_INTERNAL_H
+#define SQUASH_SEGMENT_INTERNAL_H
+
+#if !defined (SQUASH_COMPILATION)
+#error "This is internal API; you cannot use it."
+#endif
+
+#include <limits.h>
+
+SQUASH_BEGIN_DECLS
+
+/* Inputs larger than this are split into segments for codecs with
+ * SQUASH_CODEC_INFO_SEGMENTED. */
+#define SQUASH_SEGMENT_THRESHOLD ((size_t) INT_MAX)
+#define SQUASH_SEGMENT_SIZE      (((size_t) 1) << 30)
+
+#define squash_segment_required(impl, uncompressed_size) \
+  ((((impl)->info & SQUASH_CODEC_INFO_SEGMENTED) != 0) && ((uncompressed_size) > SQUASH_SEGMENT_THRESHOLD))
+
+#define squash_segment_is_frame(impl, compressed_size, compressed) \
+  ((((impl)->info & SQUASH_CODEC_INFO_SEGMENTED) != 0) && squash_segment_check_frame ((compressed_size), (compressed)))
+
+SQUASH_INTERNAL
+bool         squash_segment_check_frame             (size_t compressed_size,
+                                                     const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)]);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+size_t       squash_segment_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size);
+SQUASH_NONNULL(2) SQUASH_INTERNAL
+size_t       squash_segment_get_uncompressed_size   (size_t compressed_size,
+                                                     const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)]);
+SQUASH_NONNULL(1, 2, 3, 5) SQUASH_INTERNAL
+SquashStatus squash_segment_compress                (SquashCodec* codec,
+                                                     size_t* compressed_size,
+                                                     uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                                                     size_t uncompressed_size,
+                                                     const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                                                     SquashOptions* options);
+SQUASH_NONNULL(1, 2, 3, 5) SQUASH_INTERNAL
+SquashStatus squash_segment_decompress              (SquashCodec* codec,
+                                                     size_t* decompressed_size,
+                                                     uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                                                     size_t compressed_size,
+                                                     const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                                                     SquashOptions* options);
+
+SQUASH_END_DECLS
+
+#endif /* SQUASH_SEGMENT_INTERNAL_H */
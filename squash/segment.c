@@ -0,0 +1,415 @@
+/* Copyright (c) 2015-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "internal.h"
+
+/**
+ * @cond INTERNAL
+ */
+
+/* Frame layout (all integers little-endian):
+ *
+ *   magic            8 bytes  0x89 'S' 'Q' 'S' 'E' 'G' '\r' '\n'
+ *   version          1 byte   currently 1
+ *   reserved         3 bytes  must be zero
+ *   n_segments       4 bytes
+ *   total size       8 bytes  sum of the uncompressed sizes
+ *   n_segments × {
+ *     compressed     8 bytes
+ *     uncompressed   8 bytes
+ *   }
+ *   segment data, in order
+ *
+ * Each segment is independently compressed by the codec. */
+
+#define SQUASH_SEGMENT_VERSION     1
+#define SQUASH_SEGMENT_HEADER_SIZE 24
+#define SQUASH_SEGMENT_ENTRY_SIZE  16
+
+static const uint8_t squash_segment_magic[8] = { 0x89, 'S', 'Q', 'S', 'E', 'G', '\r', '\n' };
+
+typedef struct SquashSegment_ {
+  size_t compressed_offset;
+  size_t compressed_size;
+  size_t uncompressed_offset;
+  size_t uncompressed_size;
+} SquashSegment;
+
+typedef struct SquashSegmentJob_ {
+  SquashCodec* codec;
+  SquashOptions* options;
+  uint8_t* output;
+  const uint8_t* input;
+  SquashSegment* segments;
+} SquashSegmentJob;
+
+static void
+squash_segment_write_u32 (uint8_t* dest, uint32_t value) {
+  for (size_t i = 0 ; i < 4 ; i++)
+    dest[i] = (uint8_t) (value >> (8 * i));
+}
+
+static void
+squash_segment_write_u64 (uint8_t* dest, uint64_t value) {
+  for (size_t i = 0 ; i < 8 ; i++)
+    dest[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint32_t
+squash_segment_read_u32 (const uint8_t* src) {
+  uint32_t value = 0;
+  for (size_t i = 0 ; i < 4 ; i++)
+    value |= ((uint32_t) src[i]) << (8 * i);
+  return value;
+}
+
+static uint64_t
+squash_segment_read_u64 (const uint8_t* src) {
+  uint64_t value = 0;
+  for (size_t i = 0 ; i < 8 ; i++)
+    value |= ((uint64_t) src[i]) << (8 * i);
+  return value;
+}
+
+static size_t
+squash_segment_count (size_t uncompressed_size) {
+  return (uncompressed_size / SQUASH_SEGMENT_SIZE) + (((uncompressed_size % SQUASH_SEGMENT_SIZE) != 0) ? 1 : 0);
+}
+
+static SquashStatus
+squash_segment_compress_func (size_t index, void* user_data) {
+  SquashSegmentJob* job = (SquashSegmentJob*) user_data;
+  SquashSegment* segment = &(job->segments[index]);
+
+  return squash_codec_compress_buffer (job->codec,
+                                       &(segment->compressed_size), job->output + segment->compressed_offset,
+                                       segment->uncompressed_size, job->input + segment->uncompressed_offset,
+                                       job->options);
+}
+
+static SquashStatus
+squash_segment_decompress_func (size_t index, void* user_data) {
+  SquashSegmentJob* job = (SquashSegmentJob*) user_data;
+  SquashSegment* segment = &(job->segments[index]);
+  size_t decompressed_size = segment->uncompressed_size;
+
+  SquashStatus res = squash_codec_decompress_buffer (job->codec,
+                                                     &decompressed_size, job->output + segment->uncompressed_offset,
+                                                     segment->compressed_size, job->input + segment->compressed_offset,
+                                                     job->options);
+  if (SQUASH_LIKELY(res == SQUASH_OK) && SQUASH_UNLIKELY(decompressed_size != segment->uncompressed_size))
+    res = squash_error (SQUASH_INVALID_BUFFER);
+
+  return res;
+}
+
+/**
+ * @brief Determine whether a buffer holds a valid segment frame
+ *
+ * The header is validated completely: the segment sizes must add up
+ * to exactly @a compressed_size and to the recorded total, and the
+ * total must be one which would actually have been segmented.  This
+ * makes it effectively impossible to mistake a codec's own output for
+ * a frame.
+ *
+ * @param compressed_size size of @a compressed
+ * @param compressed the compressed data
+ * @return whether @a compressed is a segment frame
+ */
+bool
+squash_segment_check_frame (size_t compressed_size,
+                            const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)]) {
+  if (compressed_size < SQUASH_SEGMENT_HEADER_SIZE ||
+      memcmp (compressed, squash_segment_magic, sizeof (squash_segment_magic)) != 0)
+    return false;
+
+  if (compressed[8] != SQUASH_SEGMENT_VERSION ||
+      compressed[9] != 0 || compressed[10] != 0 || compressed[11] != 0)
+    return false;
+
+  const uint64_t n_segments = squash_segment_read_u32 (compressed + 12);
+  const uint64_t total = squash_segment_read_u64 (compressed + 16);
+  if (n_segments == 0 ||
+      n_segments > ((compressed_size - SQUASH_SEGMENT_HEADER_SIZE) / SQUASH_SEGMENT_ENTRY_SIZE) ||
+      total <= SQUASH_SEGMENT_THRESHOLD ||
+      ((uint64_t) ((size_t) total)) != total)
+    return false;
+
+  const uint8_t* entry = compressed + SQUASH_SEGMENT_HEADER_SIZE;
+  uint64_t compressed_total = SQUASH_SEGMENT_HEADER_SIZE + (n_segments * SQUASH_SEGMENT_ENTRY_SIZE);
+  uint64_t uncompressed_total = 0;
+  for (uint64_t i = 0 ; i < n_segments ; i++, entry += SQUASH_SEGMENT_ENTRY_SIZE) {
+    const uint64_t c = squash_segment_read_u64 (entry);
+    const uint64_t u = squash_segment_read_u64 (entry + 8);
+
+    if (c == 0 || c > (compressed_size - compressed_total) ||
+        u == 0 || u > SQUASH_SEGMENT_THRESHOLD)
+      return false;
+
+    compressed_total += c;
+    uncompressed_total += u;
+  }
+
+  return compressed_total == compressed_size && uncompressed_total == total;
+}
+
+/**
+ * @brief Get the maximum size of a segmented buffer
+ *
+ * @param codec the codec
+ * @param uncompressed_size size of the uncompressed data
+ * @return the maximum size of the frame, or 0 if unknown
+ */
+size_t
+squash_segment_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+  assert (impl != NULL && impl->get_max_compressed_size != NULL);
+
+  const size_t n_segments = squash_segment_count (uncompressed_size);
+  const size_t last_size = uncompressed_size - ((n_segments - 1) * SQUASH_SEGMENT_SIZE);
+
+  const size_t full_max = impl->get_max_compressed_size (codec, SQUASH_SEGMENT_SIZE);
+  const size_t last_max = impl->get_max_compressed_size (codec, last_size);
+  if (SQUASH_UNLIKELY(full_max == 0 || last_max == 0))
+    return 0;
+
+  size_t res = SQUASH_SEGMENT_HEADER_SIZE + (n_segments * SQUASH_SEGMENT_ENTRY_SIZE);
+  if (SQUASH_UNLIKELY(((SIZE_MAX - res - last_max) / full_max) < (n_segments - 1)))
+    return 0;
+
+  return res + ((n_segments - 1) * full_max) + last_max;
+}
+
+/**
+ * @brief Get the uncompressed size of a segmented buffer
+ *
+ * @param compressed_size size of @a compressed
+ * @param compressed a segment frame
+ * @return the uncompressed size, or 0 if @a compressed is not a
+ *   valid frame
+ */
+size_t
+squash_segment_get_uncompressed_size (size_t compressed_size,
+                                      const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)]) {
+  if (!squash_segment_check_frame (compressed_size, compressed))
+    return 0;
+
+  return (size_t) squash_segment_read_u64 (compressed + 16);
+}
+
+/**
+ * @brief Compress a buffer which is too large for the codec
+ *
+ * The input is split into segments of @ref SQUASH_SEGMENT_SIZE
+ * bytes.  If @a compressed is large enough to hold the worst case,
+ * each segment is compressed directly into its own slot in parallel
+ * and the results are compacted afterwards; otherwise segments are
+ * compressed one after another into whatever space remains.
+ *
+ * @param codec the codec
+ * @param compressed_size size of @a compressed; on success, the size
+ *   of the frame
+ * @param compressed output buffer
+ * @param uncompressed_size size of @a uncompressed
+ * @param uncompressed data to compress
+ * @param options options to pass to the codec
+ * @return result of the operation
+ */
+SquashStatus
+squash_segment_compress (SquashCodec* codec,
+                         size_t* compressed_size,
+                         uint8_t compressed[SQUASH_ARRAY_PARAM(*compressed_size)],
+                         size_t uncompressed_size,
+                         const uint8_t uncompressed[SQUASH_ARRAY_PARAM(uncompressed_size)],
+                         SquashOptions* options) {
+  SquashStatus res = SQUASH_OK;
+  SquashSegment* segments = NULL;
+
+  /* Take the reference first so floating options are released on
+     every path. */
+  squash_object_ref (options);
+
+  const size_t n_segments = squash_segment_count (uncompressed_size);
+  if (SQUASH_UNLIKELY(n_segments > UINT32_MAX)) {
+    res = squash_error (SQUASH_RANGE);
+    goto cleanup;
+  }
+
+  const size_t data_offset = SQUASH_SEGMENT_HEADER_SIZE + (n_segments * SQUASH_SEGMENT_ENTRY_SIZE);
+  if (SQUASH_UNLIKELY(*compressed_size < data_offset)) {
+    res = squash_error (SQUASH_BUFFER_FULL);
+    goto cleanup;
+  }
+
+  segments = squash_calloc (n_segments, sizeof (SquashSegment));
+  if (SQUASH_UNLIKELY(segments == NULL)) {
+    res = squash_error (SQUASH_MEMORY);
+    goto cleanup;
+  }
+
+  for (size_t i = 0 ; i < n_segments ; i++) {
+    segments[i].uncompressed_offset = i * SQUASH_SEGMENT_SIZE;
+    segments[i].uncompressed_size = uncompressed_size - segments[i].uncompressed_offset;
+    if (segments[i].uncompressed_size > SQUASH_SEGMENT_SIZE)
+      segments[i].uncompressed_size = SQUASH_SEGMENT_SIZE;
+  }
+
+  size_t pos = data_offset;
+  const size_t max_compressed_size = squash_segment_get_max_compressed_size (codec, uncompressed_size);
+  if (max_compressed_size != 0 && *compressed_size >= max_compressed_size) {
+    SquashSegmentJob job = { codec, options, compressed, uncompressed, segments };
+    SquashCodecImpl* impl = squash_codec_get_impl (codec);
+
+    for (size_t i = 0 ; i < n_segments ; i++) {
+      segments[i].compressed_offset = pos;
+      segments[i].compressed_size = impl->get_max_compressed_size (codec, segments[i].uncompressed_size);
+      pos += segments[i].compressed_size;
+    }
+
+    res = squash_parallel_for (0, n_segments, squash_segment_compress_func, &job);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      goto cleanup;
+
+    pos = data_offset;
+    for (size_t i = 0 ; i < n_segments ; i++) {
+      if (segments[i].compressed_offset != pos)
+        memmove (compressed + pos, compressed + segments[i].compressed_offset, segments[i].compressed_size);
+      pos += segments[i].compressed_size;
+    }
+  } else {
+    for (size_t i = 0 ; i < n_segments ; i++) {
+      segments[i].compressed_size = *compressed_size - pos;
+      res = squash_codec_compress_buffer (codec,
+                                          &(segments[i].compressed_size), compressed + pos,
+                                          segments[i].uncompressed_size, uncompressed + segments[i].uncompressed_offset,
+                                          options);
+      if (SQUASH_UNLIKELY(res != SQUASH_OK))
+        goto cleanup;
+      pos += segments[i].compressed_size;
+    }
+  }
+
+  memcpy (compressed, squash_segment_magic, sizeof (squash_segment_magic));
+  compressed[8] = SQUASH_SEGMENT_VERSION;
+  compressed[9] = compressed[10] = compressed[11] = 0;
+  squash_segment_write_u32 (compressed + 12, (uint32_t) n_segments);
+  squash_segment_write_u64 (compressed + 16, (uint64_t) uncompressed_size);
+  for (size_t i = 0 ; i < n_segments ; i++) {
+    uint8_t* entry = compressed + SQUASH_SEGMENT_HEADER_SIZE + (i * SQUASH_SEGMENT_ENTRY_SIZE);
+    squash_segment_write_u64 (entry, (uint64_t) segments[i].compressed_size);
+    squash_segment_write_u64 (entry + 8, (uint64_t) segments[i].uncompressed_size);
+  }
+
+  *compressed_size = pos;
+
+ cleanup:
+
+  squash_free (segments);
+  squash_object_unref (options);
+
+  return res;
+}
+
+/**
+ * @brief Decompress a segment frame
+ *
+ * Segments are decompressed in parallel, each directly into its
+ * final position in @a decompressed.
+ *
+ * @param codec the codec
+ * @param decompressed_size size of @a decompressed; on success, the
+ *   size of the decompressed data
+ * @param decompressed output buffer
+ * @param compressed_size size of @a compressed
+ * @param compressed a segment frame
+ * @param options options to pass to the codec
+ * @return result of the operation
+ */
+SquashStatus
+squash_segment_decompress (SquashCodec* codec,
+                           size_t* decompressed_size,
+                           uint8_t decompressed[SQUASH_ARRAY_PARAM(*decompressed_size)],
+                           size_t compressed_size,
+                           const uint8_t compressed[SQUASH_ARRAY_PARAM(compressed_size)],
+                           SquashOptions* options) {
+  SquashStatus res = SQUASH_OK;
+  SquashSegment* segments = NULL;
+
+  squash_object_ref (options);
+
+  if (SQUASH_UNLIKELY(!squash_segment_check_frame (compressed_size, compressed))) {
+    res = squash_error (SQUASH_INVALID_BUFFER);
+    goto cleanup;
+  }
+
+  const size_t n_segments = squash_segment_read_u32 (compressed + 12);
+  const size_t total = (size_t) squash_segment_read_u64 (compressed + 16);
+  if (SQUASH_UNLIKELY(*decompressed_size < total)) {
+    res = squash_error (SQUASH_BUFFER_FULL);
+    goto cleanup;
+  }
+
+  segments = squash_calloc (n_segments, sizeof (SquashSegment));
+  if (SQUASH_UNLIKELY(segments == NULL)) {
+    res = squash_error (SQUASH_MEMORY);
+    goto cleanup;
+  }
+
+  size_t compressed_offset = SQUASH_SEGMENT_HEADER_SIZE + (n_segments * SQUASH_SEGMENT_ENTRY_SIZE);
+  size_t uncompressed_offset = 0;
+  for (size_t i = 0 ; i < n_segments ; i++) {
+    const uint8_t* entry = compressed + SQUASH_SEGMENT_HEADER_SIZE + (i * SQUASH_SEGMENT_ENTRY_SIZE);
+
+    segments[i].compressed_offset = compressed_offset;
+    segments[i].compressed_size = (size_t) squash_segment_read_u64 (entry);
+    segments[i].uncompressed_offset = uncompressed_offset;
+    segments[i].uncompressed_size = (size_t) squash_segment_read_u64 (entry + 8);
+
+    compressed_offset += segments[i].compressed_size;
+    uncompressed_offset += segments[i].uncompressed_size;
+  }
+
+  SquashSegmentJob job = { codec, options, decompressed, compressed, segments };
+  res = squash_parallel_for (0, n_segments, squash_segment_decompress_func, &job);
+  if (SQUASH_LIKELY(res == SQUASH_OK))
+    *decompressed_size = total;
+
+ cleanup:
+
+  squash_free (segments);
+  squash_object_unref (options);
+
+  return res;
+}
+
+/**
+ * @endcond
+ */
@@ -407,6 +407,8 @@ squash_splice_with_options (SquashCodec* codec,
                             size_t size,
                             SquashOptions* options) {
   SquashStatus res = SQUASH_FAILED;
+  const uint64_t stats_start = squash_stats_begin ();
+  long pos_in = -1, pos_out = -1;
 
   assert (fp_in != NULL);
   assert (fp_out != NULL);
@@ -420,7 +422,14 @@ squash_splice_with_options (SquashCodec* codec,
   SQUASH_FLOCKFILE(fp_in);
   SQUASH_FLOCKFILE(fp_out);
 
-  if (codec->impl.splice != NULL) {
+  if (SQUASH_UNLIKELY(stats_start != 0)) {
+    pos_in = ftell (fp_in);
+    pos_out = ftell (fp_out);
+  }
+
+  /* Filters are applied by streams and buffers, so only splice
+     directly if there aren't any. */
+  if (codec->impl.splice != NULL && (options == NULL || options->filters == NULL)) {
     res = squash_file_splice (fp_in, fp_out, size, stream_type, codec, options);
   } else {
 #if !defined(_WIN32)
@@ -433,6 +442,17 @@ squash_splice_with_options (SquashCodec* codec,
       res = squash_splice_stream (fp_in, fp_out, size, stream_type, codec, options);
   }
 
+  if (SQUASH_UNLIKELY(stats_start != 0)) {
+    /* Byte counts are only available for seekable files. */
+    const long end_in = (pos_in >= 0) ? ftell (fp_in) : -1;
+    const long end_out = (pos_out >= 0) ? ftell (fp_out) : -1;
+
+    squash_stats_record (codec, SQUASH_STATS_SPLICE_COMPRESS, stream_type,
+                         (end_in >= pos_in && end_in >= 0) ? (size_t) (end_in - pos_in) : 0,
+                         (end_out >= pos_out && end_out >= 0) ? (size_t) (end_out - pos_out) : 0,
+                         stats_start);
+  }
+
   SQUASH_FUNLOCKFILE(fp_in);
   SQUASH_FUNLOCKFILE(fp_out);
 
@@ -527,7 +547,7 @@ squash_splice_custom_with_options (SquashCodec* codec,
 
   squash_object_ref (options);
 
-  if (codec->impl.splice != NULL) {
+  if (codec->impl.splice != NULL && (options == NULL || options->filters == NULL)) {
     if (size == 0) {
       res = codec->impl.splice (codec, options, stream_type, squash_file_splice_read, squash_file_splice_write, user_data);
     } else {
@@ -548,7 +568,7 @@ squash_splice_custom_with_options (SquashCodec* codec,
         res = SQUASH_OK;
       }
     }
-  } else if (codec->impl.process_stream) {
+  } else if (codec->impl.process_stream != NULL || codec->impl.splice != NULL) {
     SquashStream* stream = squash_stream_new_with_options(codec, stream_type, options);
     if (SQUASH_UNLIKELY(stream == NULL))
       return squash_error (SQUASH_FAILED);
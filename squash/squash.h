@@ -144,8 +144,12 @@
 #include "license.h"
 #include "codec.h"
 #include "splice.h"
+#include "index.h"
 #include "plugin.h"
 #include "memory.h"
+#include "arena.h"
+#include "stats.h"
+#include "thread-pool.h"
 #include "context.h"
 
 #undef SQUASH_H_INSIDE
@@ -0,0 +1,63 @@
+/* Copyright (c) 2015-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include <squash/internal.h> */
+
+#ifndef SQUASH_STATS_INTERNAL_H
+#define SQUASH_STATS_INTERNAL_H
+
+#if !defined (SQUASH_COMPILATION)
+#error "This is internal API; you cannot use it."
+#endif
+
+SQUASH_BEGIN_DECLS
+
+extern SQUASH_INTERNAL volatile bool squash_stats_enabled;
+
+/* Returns a start time for squash_stats_record, or 0 if statistics
+ * are disabled.  When disabled this is a single load and branch. */
+#define squash_stats_begin() \
+  (SQUASH_UNLIKELY(squash_stats_enabled) ? squash_stats_now () : ((uint64_t) 0))
+
+#define squash_stats_fallback(codec, fallback) do {      \
+    if (SQUASH_UNLIKELY(squash_stats_enabled))           \
+      squash_stats_record_fallback ((codec), (fallback)); \
+  } while (0)
+
+SQUASH_INTERNAL
+uint64_t squash_stats_now             (void);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+void     squash_stats_record          (SquashCodec* codec,
+                                       SquashStatsOperation operation,
+                                       SquashStreamType stream_type,
+                                       size_t bytes_in,
+                                       size_t bytes_out,
+                                       uint64_t start);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+void     squash_stats_record_fallback (SquashCodec* codec, SquashStatsFallback fallback);
+
+SQUASH_END_DECLS
+
+#endif /* SQUASH_STATS_INTERNAL_H */
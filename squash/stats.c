@@ -0,0 +1,506 @@
+/* Copyright (c) 2013-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#if !defined(_WIN32)
+#  if defined(_POSIX_C_SOURCE) && (_POSIX_C_SOURCE < 199309L)
+#    undef _POSIX_C_SOURCE
+#  endif
+#  if !defined(_POSIX_C_SOURCE)
+#    define _POSIX_C_SOURCE 199309L
+#  endif
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
+#include "internal.h"
+
+/**
+ * @cond INTERNAL
+ */
+
+/* Each thread records into its own set of counters, so the hot path
+ * never takes a lock or issues an atomic operation.  Counters are
+ * stored in pages of codecs (indexed by the codec's stats_id) which
+ * are allocated the first time a thread uses a codec in the page. */
+
+#define SQUASH_STATS_PAGE_SHIFT 4
+#define SQUASH_STATS_PAGE_SIZE (((size_t) 1) << SQUASH_STATS_PAGE_SHIFT)
+#define SQUASH_STATS_MAX_PAGES ((size_t) 64)
+
+typedef struct SquashStatsThread_ {
+  struct SquashStatsThread_* next;
+  SquashCodecStats* pages[SQUASH_STATS_MAX_PAGES];
+} SquashStatsThread;
+
+volatile bool squash_stats_enabled = false;
+
+/* Protects the thread list and the retired counters, and is held
+ * while a thread publishes a new page. */
+SQUASH_MTX_DEFINE(stats)
+
+static SquashStatsThread* squash_stats_threads = NULL;
+
+/* Counters from threads which have exited. */
+static SquashStatsThread squash_stats_retired = { NULL, { NULL, } };
+
+static SQUASH_THREAD_LOCAL SquashStatsThread* squash_stats_thread = NULL;
+
+static once_flag squash_stats_key_once = ONCE_FLAG_INIT;
+static tss_t squash_stats_key;
+
+static void
+squash_stats_counters_add (SquashStatsCounters* dest, const SquashStatsCounters* src) {
+  dest->calls += src->calls;
+  dest->bytes_in += src->bytes_in;
+  dest->bytes_out += src->bytes_out;
+  dest->nanoseconds += src->nanoseconds;
+  for (size_t i = 0 ; i < SQUASH_STATS_HISTOGRAM_BUCKETS ; i++)
+    dest->histogram[i] += src->histogram[i];
+}
+
+static void
+squash_stats_codec_add (SquashCodecStats* dest, const SquashCodecStats* src) {
+  dest->codec = src->codec;
+  for (size_t op = 0 ; op < SQUASH_STATS_N_OPERATIONS ; op++)
+    squash_stats_counters_add (&(dest->operations[op]), &(src->operations[op]));
+  for (size_t fb = 0 ; fb < SQUASH_STATS_N_FALLBACKS ; fb++)
+    dest->fallbacks[fb] += src->fallbacks[fb];
+}
+
+/* Must be called with the stats mutex held. */
+static void
+squash_stats_thread_merge (SquashStatsThread* dest, const SquashStatsThread* src) {
+  for (size_t page = 0 ; page < SQUASH_STATS_MAX_PAGES ; page++) {
+    if (src->pages[page] == NULL)
+      continue;
+
+    if (dest->pages[page] == NULL) {
+      dest->pages[page] = squash_calloc (SQUASH_STATS_PAGE_SIZE, sizeof (SquashCodecStats));
+      if (SQUASH_UNLIKELY(dest->pages[page] == NULL))
+        continue;
+    }
+
+    for (size_t i = 0 ; i < SQUASH_STATS_PAGE_SIZE ; i++)
+      if (src->pages[page][i].codec != NULL)
+        squash_stats_codec_add (&(dest->pages[page][i]), &(src->pages[page][i]));
+  }
+}
+
+static void
+squash_stats_thread_free (SquashStatsThread* thread) {
+  for (size_t page = 0 ; page < SQUASH_STATS_MAX_PAGES ; page++)
+    squash_free (thread->pages[page]);
+  squash_free (thread);
+}
+
+static void
+squash_stats_thread_exit (void* data) {
+  SquashStatsThread* thread = (SquashStatsThread*) data;
+
+  SQUASH_MTX_LOCK(stats);
+  for (SquashStatsThread** t = &squash_stats_threads ; *t != NULL ; t = &((*t)->next)) {
+    if (*t == thread) {
+      *t = thread->next;
+      break;
+    }
+  }
+  squash_stats_thread_merge (&squash_stats_retired, thread);
+  SQUASH_MTX_UNLOCK(stats);
+
+  squash_stats_thread_free (thread);
+}
+
+static void
+squash_stats_key_init (void) {
+  tss_create (&squash_stats_key, squash_stats_thread_exit);
+}
+
+static SquashCodecStats*
+squash_stats_get_codec_stats (SquashCodec* codec) {
+  SquashStatsThread* thread = squash_stats_thread;
+  const size_t page = codec->stats_id >> SQUASH_STATS_PAGE_SHIFT;
+
+  if (SQUASH_UNLIKELY(page >= SQUASH_STATS_MAX_PAGES))
+    return NULL;
+
+  if (SQUASH_UNLIKELY(thread == NULL)) {
+    call_once (&squash_stats_key_once, squash_stats_key_init);
+
+    thread = squash_calloc (1, sizeof (SquashStatsThread));
+    if (SQUASH_UNLIKELY(thread == NULL))
+      return NULL;
+
+    SQUASH_MTX_LOCK(stats);
+    thread->next = squash_stats_threads;
+    squash_stats_threads = thread;
+    SQUASH_MTX_UNLOCK(stats);
+
+    tss_set (squash_stats_key, thread);
+    squash_stats_thread = thread;
+  }
+
+  if (SQUASH_UNLIKELY(thread->pages[page] == NULL)) {
+    SquashCodecStats* codecs = squash_calloc (SQUASH_STATS_PAGE_SIZE, sizeof (SquashCodecStats));
+    if (SQUASH_UNLIKELY(codecs == NULL))
+      return NULL;
+
+    SQUASH_MTX_LOCK(stats);
+    thread->pages[page] = codecs;
+    SQUASH_MTX_UNLOCK(stats);
+  }
+
+  SquashCodecStats* stats = &(thread->pages[page][codec->stats_id & (SQUASH_STATS_PAGE_SIZE - 1)]);
+  if (SQUASH_UNLIKELY(stats->codec == NULL))
+    stats->codec = codec;
+
+  return stats;
+}
+
+uint64_t
+squash_stats_now (void) {
+  uint64_t res;
+
+#if defined(_WIN32)
+  static LARGE_INTEGER frequency = { 0, };
+  LARGE_INTEGER counter;
+
+  if (frequency.QuadPart == 0)
+    QueryPerformanceFrequency (&frequency);
+  QueryPerformanceCounter (&counter);
+
+  res = (uint64_t) (((double) counter.QuadPart) * (1000000000.0 / ((double) frequency.QuadPart)));
+#else
+  struct timespec ts;
+
+  if (SQUASH_UNLIKELY(clock_gettime (CLOCK_MONOTONIC, &ts) != 0))
+    return 1;
+
+  res = (((uint64_t) ts.tv_sec) * UINT64_C(1000000000)) + ((uint64_t) ts.tv_nsec);
+#endif
+
+  /* 0 means "not recording" */
+  return (res != 0) ? res : 1;
+}
+
+void
+squash_stats_record (SquashCodec* codec,
+                     SquashStatsOperation operation,
+                     SquashStreamType stream_type,
+                     size_t bytes_in,
+                     size_t bytes_out,
+                     uint64_t start) {
+  if (start == 0)
+    return;
+
+  const uint64_t elapsed = squash_stats_now () - start;
+
+  SquashCodecStats* stats = squash_stats_get_codec_stats (codec);
+  if (SQUASH_UNLIKELY(stats == NULL))
+    return;
+
+  if (stream_type == SQUASH_STREAM_DECOMPRESS)
+    operation = (SquashStatsOperation) (operation + 1);
+
+  SquashStatsCounters* counters = &(stats->operations[operation]);
+  counters->calls++;
+  counters->bytes_in += bytes_in;
+  counters->bytes_out += bytes_out;
+  counters->nanoseconds += elapsed;
+
+  /* Bucket n holds calls which took less than 2^n units of 1024 ns
+   * (and at least 2^(n-1) units); the last bucket holds everything
+   * longer. */
+  size_t bucket = 0;
+  for (uint64_t units = elapsed >> 10 ; units != 0 && bucket < (SQUASH_STATS_HISTOGRAM_BUCKETS - 1) ; units >>= 1)
+    bucket++;
+  counters->histogram[bucket]++;
+}
+
+void
+squash_stats_record_fallback (SquashCodec* codec, SquashStatsFallback fallback) {
+  SquashCodecStats* stats = squash_stats_get_codec_stats (codec);
+  if (SQUASH_LIKELY(stats != NULL))
+    stats->fallbacks[fallback]++;
+}
+
+/**
+ * @endcond INTERNAL
+ */
+
+/**
+ * @defgroup Stats
+ * @brief Runtime statistics
+ *
+ * Squash can record how often each codec is used, how much data it
+ * processes, how long it takes, and how often Squash has to fall back
+ * on a slower code path (for example, compressing to a temporary
+ * buffer because the codec can not safely write to the caller's).
+ *
+ * Statistics are disabled by default; when disabled the overhead is
+ * a single branch per call.  Once enabled with @ref
+ * squash_stats_set_enabled each thread records into its own
+ * counters, which are only combined when @ref squash_stats_snapshot
+ * is called.
+ *
+ * Counters are recorded at the API boundary:
+ *
+ *  - buffer operations in @ref squash_codec_compress_with_options and
+ *    @ref squash_codec_decompress_with_options,
+ *  - stream operations in each call to @ref squash_stream_process,
+ *    @ref squash_stream_flush and @ref squash_stream_finish,
+ *  - splice operations in @ref squash_splice_with_options.
+ *
+ * Operations which are implemented on top of another will show up
+ * in both; a splice which uses the stream API internally is counted
+ * as a splice as well as a series of stream calls.  Byte counts for
+ * splices are only available for seekable files.
+ *
+ * @{
+ */
+
+/**
+ * @struct SquashStatsCounters_
+ * @brief Counters for one kind of operation
+ *
+ * @var SquashStatsCounters_::calls
+ * @brief Number of calls
+ *
+ * @var SquashStatsCounters_::bytes_in
+ * @brief Total number of bytes consumed
+ *
+ * @var SquashStatsCounters_::bytes_out
+ * @brief Total number of bytes produced
+ *
+ * @var SquashStatsCounters_::nanoseconds
+ * @brief Total time spent in the calls
+ *
+ * @var SquashStatsCounters_::histogram
+ * @brief Distribution of call durations
+ *
+ * Bucket *n* counts calls which took at least 2<sup>n-1</sup> but
+ * less than 2<sup>n</sup> units of 1024 nanoseconds (roughly
+ * microseconds).  Bucket 0 counts calls shorter than one unit, and
+ * the last bucket also counts everything longer than it.
+ */
+
+/**
+ * @struct SquashCodecStats_
+ * @brief Statistics for a single codec
+ *
+ * @var SquashCodecStats_::codec
+ * @brief The codec
+ *
+ * @var SquashCodecStats_::operations
+ * @brief Counters, indexed by @ref SquashStatsOperation
+ *
+ * @var SquashCodecStats_::fallbacks
+ * @brief Number of fallback events, indexed by @ref
+ *   SquashStatsFallback
+ */
+
+/**
+ * @struct SquashStats_
+ * @brief A snapshot of the statistics for all codecs
+ *
+ * @var SquashStats_::n_codecs
+ * @brief Number of elements in @a codecs
+ *
+ * @var SquashStats_::codecs
+ * @brief Statistics for each codec which has been used
+ */
+
+/**
+ * @enum SquashStatsFallback
+ * @brief Slow paths Squash may take
+ *
+ * @var SquashStatsFallback::SQUASH_STATS_FALLBACK_UNSAFE_BUFFER
+ * @brief The output buffer was too small for a codec which can only
+ *   compress to buffers of at least the maximum compressed size, so
+ *   a temporary buffer was used and copied
+ * @var SquashStatsFallback::SQUASH_STATS_FALLBACK_BUFFER_STREAM
+ * @brief A stream was created for a codec which only supports the
+ *   buffer API, so the whole input will be buffered
+ * @var SquashStatsFallback::SQUASH_STATS_FALLBACK_STREAM_BUFFER
+ * @brief A buffer operation was performed using the stream API
+ * @var SquashStatsFallback::SQUASH_STATS_FALLBACK_SPLICE_BUFFER
+ * @brief A buffer operation was performed using the splice API
+ * @var SquashStatsFallback::SQUASH_STATS_FALLBACK_SPLICE_STREAM
+ * @brief A stream was created for a codec which only supports the
+ *   splice API, which requires a helper thread
+ */
+
+/**
+ * @brief Enable or disable statistics
+ *
+ * Disabling statistics does not discard the counters recorded so
+ * far.
+ *
+ * @param enabled whether statistics should be recorded
+ */
+void
+squash_stats_set_enabled (bool enabled) {
+  squash_stats_enabled = enabled;
+}
+
+/**
+ * @brief Determine whether statistics are being recorded
+ *
+ * @return true if statistics are enabled, false otherwise
+ */
+bool
+squash_stats_get_enabled (void) {
+  return squash_stats_enabled;
+}
+
+/**
+ * @brief Take a snapshot of the statistics
+ *
+ * Counters from every thread (including threads which have exited)
+ * are combined.  Counters belonging to threads which are in the
+ * middle of an operation may be slightly out of date.
+ *
+ * @return A snapshot of the statistics which must be freed with @ref
+ *   squash_stats_free, or *NULL* on failure
+ */
+SquashStats*
+squash_stats_snapshot (void) {
+  SquashStats* res = squash_malloc (sizeof (SquashStats));
+  SquashStatsThread* total = squash_calloc (1, sizeof (SquashStatsThread));
+  if (SQUASH_UNLIKELY(res == NULL) || SQUASH_UNLIKELY(total == NULL)) {
+    squash_free (res);
+    squash_free (total);
+    return (squash_error (SQUASH_MEMORY), NULL);
+  }
+
+  SQUASH_MTX_LOCK(stats);
+  squash_stats_thread_merge (total, &squash_stats_retired);
+  for (SquashStatsThread* thread = squash_stats_threads ; thread != NULL ; thread = thread->next)
+    squash_stats_thread_merge (total, thread);
+  SQUASH_MTX_UNLOCK(stats);
+
+  size_t n_codecs = 0;
+  for (size_t page = 0 ; page < SQUASH_STATS_MAX_PAGES ; page++)
+    if (total->pages[page] != NULL)
+      for (size_t i = 0 ; i < SQUASH_STATS_PAGE_SIZE ; i++)
+        if (total->pages[page][i].codec != NULL)
+          n_codecs++;
+
+  res->n_codecs = 0;
+  res->codecs = squash_calloc (n_codecs != 0 ? n_codecs : 1, sizeof (SquashCodecStats));
+  if (SQUASH_UNLIKELY(res->codecs == NULL)) {
+    squash_free (res);
+    squash_stats_thread_free (total);
+    return (squash_error (SQUASH_MEMORY), NULL);
+  }
+
+  for (size_t page = 0 ; page < SQUASH_STATS_MAX_PAGES ; page++)
+    if (total->pages[page] != NULL)
+      for (size_t i = 0 ; i < SQUASH_STATS_PAGE_SIZE ; i++)
+        if (total->pages[page][i].codec != NULL)
+          res->codecs[res->n_codecs++] = total->pages[page][i];
+
+  squash_stats_thread_free (total);
+
+  return res;
+}
+
+/**
+ * @brief Free a snapshot
+ *
+ * @param stats the snapshot to free
+ */
+void
+squash_stats_free (SquashStats* stats) {
+  if (stats == NULL)
+    return;
+
+  squash_free (stats->codecs);
+  squash_free (stats);
+}
+
+/**
+ * @brief Get a string representation of an operation
+ *
+ * @param operation the operation
+ * @return a string describing @a operation
+ */
+const char*
+squash_stats_operation_to_string (SquashStatsOperation operation) {
+  switch (operation) {
+    case SQUASH_STATS_BUFFER_COMPRESS:
+      return "buffer-compress";
+    case SQUASH_STATS_BUFFER_DECOMPRESS:
+      return "buffer-decompress";
+    case SQUASH_STATS_STREAM_COMPRESS:
+      return "stream-compress";
+    case SQUASH_STATS_STREAM_DECOMPRESS:
+      return "stream-decompress";
+    case SQUASH_STATS_SPLICE_COMPRESS:
+      return "splice-compress";
+    case SQUASH_STATS_SPLICE_DECOMPRESS:
+      return "splice-decompress";
+    case SQUASH_STATS_N_OPERATIONS:
+    default:
+      return NULL;
+  }
+}
+
+/**
+ * @brief Get a string representation of a fallback
+ *
+ * @param fallback the fallback
+ * @return a string describing @a fallback
+ */
+const char*
+squash_stats_fallback_to_string (SquashStatsFallback fallback) {
+  switch (fallback) {
+    case SQUASH_STATS_FALLBACK_UNSAFE_BUFFER:
+      return "unsafe-buffer";
+    case SQUASH_STATS_FALLBACK_BUFFER_STREAM:
+      return "buffer-stream";
+    case SQUASH_STATS_FALLBACK_STREAM_BUFFER:
+      return "stream-buffer";
+    case SQUASH_STATS_FALLBACK_SPLICE_BUFFER:
+      return "splice-buffer";
+    case SQUASH_STATS_FALLBACK_SPLICE_STREAM:
+      return "splice-stream";
+    case SQUASH_STATS_N_FALLBACKS:
+    default:
+      return NULL;
+  }
+}
+
+/**
+ * @}
+ */
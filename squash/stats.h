@@ -0,0 +1,92 @@
+/* Copyright (c) 2013-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include <squash/squash.h> */
+
+#ifndef SQUASH_STATS_H
+#define SQUASH_STATS_H
+
+#if !defined (SQUASH_H_INSIDE) && !defined (SQUASH_COMPILATION)
+#error "Only <squash/squash.h> can be included directly."
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+SQUASH_BEGIN_DECLS
+
+#define SQUASH_STATS_HISTOGRAM_BUCKETS 24
+
+typedef enum {
+  SQUASH_STATS_BUFFER_COMPRESS = 0,
+  SQUASH_STATS_BUFFER_DECOMPRESS = 1,
+  SQUASH_STATS_STREAM_COMPRESS = 2,
+  SQUASH_STATS_STREAM_DECOMPRESS = 3,
+  SQUASH_STATS_SPLICE_COMPRESS = 4,
+  SQUASH_STATS_SPLICE_DECOMPRESS = 5,
+
+  SQUASH_STATS_N_OPERATIONS
+} SquashStatsOperation;
+
+typedef enum {
+  SQUASH_STATS_FALLBACK_UNSAFE_BUFFER = 0,
+  SQUASH_STATS_FALLBACK_BUFFER_STREAM = 1,
+  SQUASH_STATS_FALLBACK_STREAM_BUFFER = 2,
+  SQUASH_STATS_FALLBACK_SPLICE_BUFFER = 3,
+  SQUASH_STATS_FALLBACK_SPLICE_STREAM = 4,
+
+  SQUASH_STATS_N_FALLBACKS
+} SquashStatsFallback;
+
+typedef struct SquashStatsCounters_ {
+  uint64_t calls;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t nanoseconds;
+  uint64_t histogram[SQUASH_STATS_HISTOGRAM_BUCKETS];
+} SquashStatsCounters;
+
+typedef struct SquashCodecStats_ {
+  SquashCodec* codec;
+  SquashStatsCounters operations[SQUASH_STATS_N_OPERATIONS];
+  uint64_t fallbacks[SQUASH_STATS_N_FALLBACKS];
+} SquashCodecStats;
+
+typedef struct SquashStats_ {
+  size_t n_codecs;
+  SquashCodecStats* codecs;
+} SquashStats;
+
+SQUASH_API void         squash_stats_set_enabled         (bool enabled);
+SQUASH_API bool         squash_stats_get_enabled         (void);
+SQUASH_API SquashStats* squash_stats_snapshot            (void);
+SQUASH_API void         squash_stats_free                (SquashStats* stats);
+SQUASH_API const char*  squash_stats_operation_to_string (SquashStatsOperation operation);
+SQUASH_API const char*  squash_stats_fallback_to_string  (SquashStatsFallback fallback);
+
+SQUASH_END_DECLS
+
+#endif /* SQUASH_STATS_H */
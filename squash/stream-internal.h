@@ -36,6 +36,7 @@ SQUASH_BEGIN_DECLS
 
 struct SquashStreamPrivate_ {
   thrd_t thread;
+  bool started;
   bool finished;
 
   mtx_t io_mtx;
@@ -45,6 +46,8 @@ struct SquashStreamPrivate_ {
 
   SquashStatus result;
   cnd_t result_cnd;
+
+  SquashFilterStream filter;
 };
 
 #define SQUASH_OPERATION_INVALID ((SquashOperation) 0)
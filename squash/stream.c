@@ -107,6 +107,15 @@
  * consumers or plugins.
  */
 
+/**
+ * @var SquashStream_::flushed
+ * @brief Whether the last operation on the stream was a completed
+ *   flush, so nothing is buffered inside the codec.
+ *
+ * This is managed internally by Squash and should not be modified by
+ * consumers or plugins.
+ */
+
 /**
  * @var SquashStream_::user_data
  * @brief User data
@@ -189,8 +198,8 @@
  * @struct SquashStreamPrivate_
  * @brief Private data for streams
  *
- * Currently this is used exclusively for information for thread-based
- * plugins.
+ * This holds the state for thread-based plugins, and for streams
+ * using filters (see the "filter" option).
  */
 
 /**
@@ -338,11 +347,40 @@ squash_stream_thread_func (SquashStream* stream) {
   return 0;
 }
 
+/* The thread isn't started until there is something for it to do, so
+   streams which are only used for a single call (see
+   squash_stream_process_whole) never need one.  Until then, and while
+   the thread is running, the calling thread holds io_mtx. */
+static void
+squash_stream_start_thread (SquashStream* stream) {
+  SquashStreamPrivate* priv = stream->priv;
+
+  assert (!priv->started);
+
+  priv->request = SQUASH_OPERATION_INVALID;
+  priv->result = SQUASH_STATUS_INVALID;
+  priv->finished = false;
+  priv->started = true;
+
+#if !defined(NDEBUG)
+  int res =
+#endif
+    thrd_create (&(priv->thread), (thrd_start_t) squash_stream_thread_func, stream);
+  assert (res == thrd_success);
+
+  while (priv->result == SQUASH_STATUS_INVALID)
+    cnd_wait (&(priv->result_cnd), &(priv->io_mtx));
+  priv->result = SQUASH_STATUS_INVALID;
+}
+
 static SquashStatus
 squash_stream_send_to_thread (SquashStream* stream, SquashOperation operation) {
   SquashStreamPrivate* priv = stream->priv;
   SquashStatus result;
 
+  if (SQUASH_UNLIKELY(!priv->started))
+    squash_stream_start_thread (stream);
+
   priv->request = operation;
   cnd_signal (&(priv->request_cnd));
   mtx_unlock (&(priv->io_mtx));
@@ -404,11 +442,18 @@ squash_stream_init (void* stream,
   s->options = (options != NULL) ? squash_object_ref (options) : NULL;
   s->stream_type = stream_type;
   s->state = SQUASH_STREAM_STATE_IDLE;
+  s->flushed = true;
 
   s->user_data = NULL;
   s->destroy_user_data = NULL;
 
-  if (codec->impl.create_stream == NULL && codec->impl.splice != NULL) {
+  /* Buffer-based streams don't need to filter anything themselves;
+     the buffer functions they use already do. */
+  const bool filtered =
+    options != NULL && options->filters != NULL &&
+    (codec->impl.process_stream != NULL || codec->impl.splice != NULL);
+
+  if ((codec->impl.create_stream == NULL && codec->impl.splice != NULL) || filtered) {
     s->priv = squash_malloc (sizeof (SquashStreamPrivate));
 
     mtx_init (&(s->priv->io_mtx), mtx_plain);
@@ -420,16 +465,10 @@ squash_stream_init (void* stream,
     s->priv->result = SQUASH_STATUS_INVALID;
     cnd_init (&(s->priv->result_cnd));
 
+    s->priv->started = false;
     s->priv->finished = false;
-#if !defined(NDEBUG)
-    int res =
-#endif
-      thrd_create (&(s->priv->thread), (thrd_start_t) squash_stream_thread_func, s);
-    assert (res == thrd_success);
 
-    while (s->priv->result == SQUASH_STATUS_INVALID)
-      cnd_wait (&(s->priv->result_cnd), &(s->priv->io_mtx));
-    s->priv->result = SQUASH_STATUS_INVALID;
+    squash_filter_stream_init (&(s->priv->filter), filtered ? options->filters : NULL);
   } else {
     s->priv = NULL;
   }
@@ -463,13 +502,17 @@ squash_stream_destroy (void* stream) {
   if (SQUASH_UNLIKELY(s->priv != NULL)) {
     SquashStreamPrivate* priv = (SquashStreamPrivate*) s->priv;
 
-    if (!priv->finished) {
+    if (!priv->started) {
+      mtx_unlock (&(priv->io_mtx));
+    } else if (!priv->finished) {
       squash_stream_send_to_thread (s, SQUASH_OPERATION_TERMINATE);
     }
     cnd_destroy (&(priv->request_cnd));
     cnd_destroy (&(priv->result_cnd));
     mtx_destroy (&(priv->io_mtx));
 
+    squash_filter_stream_destroy (&(priv->filter));
+
     squash_free (s->priv);
   }
 
@@ -515,7 +558,7 @@ squash_stream_newv (SquashCodec* codec,
 
   assert (codec != NULL);
 
-  opts = squash_options_newv (codec, options);
+  opts = squash_codec_options_newv (codec, options);
 
   return squash_stream_new_with_options (codec, stream_type, opts);
 }
@@ -562,8 +605,58 @@ squash_stream_new (SquashCodec* codec,
   return stream;
 }
 
+/* When a codec doesn't provide its own streams, data written to a
+ * stream is normally copied into a buffer (or handed to a thread for
+ * splice-based codecs) and only compressed once the stream is
+ * finished.  If the entire message is available in the first call to
+ * finish, which is what typically happens with small messages, the
+ * buffer function can be called directly instead.
+ *
+ * Returns false, without touching the stream, if the general path has
+ * to be used instead; otherwise, *res is the result. */
+static bool
+squash_stream_process_whole (SquashStream* stream, SquashStatus* res) {
+  size_t output_size = stream->avail_out;
+
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
+    if (output_size < squash_codec_get_max_compressed_size (stream->codec, stream->avail_in))
+      return false;
+
+    *res = squash_codec_compress_with_options (stream->codec,
+                                               &output_size, stream->next_out,
+                                               stream->avail_in, stream->next_in,
+                                               stream->options);
+  } else {
+    *res = squash_codec_decompress_with_options (stream->codec,
+                                                 &output_size, stream->next_out,
+                                                 stream->avail_in, stream->next_in,
+                                                 stream->options);
+
+    /* The general path can return the output in pieces, and it
+       reports errors (including running out of output space) the
+       same way a multi-call stream would, so leave anything other
+       than success to it. */
+    if (*res != SQUASH_OK)
+      return false;
+  }
+
+  if (*res == SQUASH_OK) {
+    stream->next_in += stream->avail_in;
+    stream->total_in += stream->avail_in;
+    stream->avail_in = 0;
+
+    stream->next_out += output_size;
+    stream->total_out += output_size;
+    stream->avail_out -= output_size;
+
+    stream->state = SQUASH_STREAM_STATE_FINISHED;
+  }
+
+  return true;
+}
+
 static SquashStatus
-squash_stream_process_internal (SquashStream* stream, SquashOperation operation) {
+squash_stream_process_operation (SquashStream* stream, SquashOperation operation) {
   SquashCodec* codec;
   SquashCodecImpl* impl = NULL;
   SquashStatus res = SQUASH_OK;
@@ -625,6 +718,17 @@ squash_stream_process_internal (SquashStream* stream, SquashOperation operation)
     return squash_error (SQUASH_STATE);
   }
 
+  if (operation == SQUASH_OPERATION_FINISH &&
+      impl->process_stream == NULL &&
+      (stream->priv == NULL || stream->priv->filter.chain == NULL) &&
+      stream->state == SQUASH_STREAM_STATE_IDLE &&
+      stream->total_in == 0 &&
+      stream->avail_in != 0 &&
+      stream->avail_out != 0) {
+    if (squash_stream_process_whole (stream, &res))
+      return res;
+  }
+
   const size_t avail_in = stream->avail_in;
   const size_t avail_out = stream->avail_out;
 
@@ -687,7 +791,7 @@ squash_stream_process_internal (SquashStream* stream, SquashOperation operation)
           stream->state = SQUASH_STREAM_STATE_FINISHED;
           break;
         default:
-          return res;
+          goto restore;
       }
     } else if (current_operation == SQUASH_OPERATION_FLUSH) {
       stream->state = SQUASH_STREAM_STATE_FLUSHING;
@@ -718,7 +822,7 @@ squash_stream_process_internal (SquashStream* stream, SquashOperation operation)
           stream->state = SQUASH_STREAM_STATE_FINISHED;
           break;
         default:
-          return res;
+          goto restore;
       }
     } else if (current_operation == SQUASH_OPERATION_FINISH) {
       stream->state = SQUASH_STREAM_STATE_FINISHING;
@@ -746,7 +850,7 @@ squash_stream_process_internal (SquashStream* stream, SquashOperation operation)
           stream->state = SQUASH_STREAM_STATE_FINISHING;
           break;
         default:
-          return res;
+          goto restore;
       }
     }
 
@@ -770,6 +874,8 @@ squash_stream_process_internal (SquashStream* stream, SquashOperation operation)
     }
   }
 
+ restore:
+
   if (next_out != 0) {
     stream->avail_out = 0;
     stream->next_out = next_out;
@@ -781,6 +887,184 @@ squash_stream_process_internal (SquashStream* stream, SquashOperation operation)
   return res;
 }
 
+/* Filtered compression streams collect the input in blocks of
+ * SQUASH_FILTER_BLOCK_SIZE bytes and hand each block to the codec once
+ * it has been filtered.  Decompression streams have the codec write to
+ * a block, which is decoded and copied to the caller once it is full
+ * (or the stream ends). */
+static SquashStatus
+squash_stream_process_filtered_compress (SquashStream* stream, SquashOperation operation) {
+  SquashFilterStream* filter = &(stream->priv->filter);
+  const size_t initial_avail_out = stream->avail_out;
+  SquashStatus res;
+
+  while (true) {
+    if (filter->ready) {
+      /* The codec may have filled the output buffer without needing
+         more room for the previous block. */
+      if (stream->avail_out == 0 && initial_avail_out != 0)
+        return SQUASH_PROCESSING;
+
+      const uint8_t* next_in = stream->next_in;
+      const size_t avail_in = stream->avail_in;
+      const size_t total_in = stream->total_in;
+
+      stream->next_in = filter->block + filter->position;
+      stream->avail_in = filter->length - filter->position;
+
+      res = squash_stream_process_operation (stream, filter->last ? SQUASH_OPERATION_FINISH : SQUASH_OPERATION_PROCESS);
+
+      filter->position = filter->length - stream->avail_in;
+      stream->next_in = next_in;
+      stream->avail_in = avail_in;
+      stream->total_in = total_in;
+
+      if (res != SQUASH_OK || filter->last)
+        return res;
+
+      if (filter->position == filter->length) {
+        filter->offset += filter->length;
+        filter->length = 0;
+        filter->position = 0;
+        filter->ready = false;
+      }
+    } else if (stream->avail_in != 0) {
+      size_t n = SQUASH_FILTER_BLOCK_SIZE - filter->length;
+      if (n > stream->avail_in)
+        n = stream->avail_in;
+
+      memcpy (filter->block + filter->length, stream->next_in, n);
+      filter->length += n;
+      stream->next_in += n;
+      stream->avail_in -= n;
+      stream->total_in += n;
+
+      if (filter->length == SQUASH_FILTER_BLOCK_SIZE) {
+        squash_filter_chain_encode (filter->chain, filter->length, filter->block, filter->offset, filter->scratch);
+        filter->ready = true;
+        filter->last = (operation == SQUASH_OPERATION_FINISH && stream->avail_in == 0);
+      }
+    } else if (operation == SQUASH_OPERATION_FINISH) {
+      squash_filter_chain_encode (filter->chain, filter->length, filter->block, filter->offset, filter->scratch);
+      filter->ready = true;
+      filter->last = true;
+    } else {
+      return SQUASH_OK;
+    }
+  }
+}
+
+static SquashStatus
+squash_stream_process_filtered_decompress (SquashStream* stream, SquashOperation operation) {
+  SquashFilterStream* filter = &(stream->priv->filter);
+  SquashStatus res;
+
+  while (true) {
+    if (filter->ready) {
+      size_t n = filter->length - filter->position;
+      if (n > stream->avail_out)
+        n = stream->avail_out;
+
+      memcpy (stream->next_out, filter->block + filter->position, n);
+      filter->position += n;
+      stream->next_out += n;
+      stream->avail_out -= n;
+      stream->total_out += n;
+
+      if (filter->position != filter->length)
+        return SQUASH_PROCESSING;
+
+      filter->offset += filter->length;
+      filter->length = 0;
+      filter->position = 0;
+      filter->ready = false;
+
+      if (filter->last) {
+        stream->state = SQUASH_STREAM_STATE_FINISHED;
+        return (operation == SQUASH_OPERATION_FINISH) ? SQUASH_OK : SQUASH_END_OF_STREAM;
+      }
+    }
+
+    uint8_t* next_out = stream->next_out;
+    const size_t avail_out = stream->avail_out;
+    const size_t total_out = stream->total_out;
+
+    stream->next_out = filter->block + filter->length;
+    stream->avail_out = SQUASH_FILTER_BLOCK_SIZE - filter->length;
+
+    res = squash_stream_process_operation (stream, operation);
+
+    filter->length = SQUASH_FILTER_BLOCK_SIZE - stream->avail_out;
+    stream->next_out = next_out;
+    stream->avail_out = avail_out;
+    stream->total_out = total_out;
+
+    if (res == SQUASH_END_OF_STREAM || (res == SQUASH_OK && operation == SQUASH_OPERATION_FINISH)) {
+      /* The stream isn't finished until the caller has the rest of the
+         output. */
+      filter->last = true;
+      stream->state = (operation == SQUASH_OPERATION_FINISH) ? SQUASH_STREAM_STATE_FINISHING : SQUASH_STREAM_STATE_RUNNING;
+    } else if (res != SQUASH_OK && res != SQUASH_PROCESSING) {
+      return res;
+    }
+
+    if (filter->last || filter->length == SQUASH_FILTER_BLOCK_SIZE) {
+      squash_filter_chain_decode (filter->chain, filter->length, filter->block, filter->offset, filter->scratch);
+      filter->ready = true;
+    } else if (res == SQUASH_OK) {
+      return res;
+    }
+  }
+}
+
+static SquashStatus
+squash_stream_process_filtered (SquashStream* stream, SquashOperation operation) {
+  /* Flushing would mean flushing a partial block, which the decoder
+     can't undo until it has the rest of it (squash_stream_get_info
+     doesn't report SQUASH_CODEC_INFO_CAN_FLUSH for these streams). */
+  if (SQUASH_UNLIKELY(operation == SQUASH_OPERATION_FLUSH))
+    return squash_error (SQUASH_INVALID_OPERATION);
+
+  SquashStatus res = squash_filter_stream_prepare (&(stream->priv->filter));
+  if (SQUASH_UNLIKELY(res != SQUASH_OK))
+    return res;
+
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS)
+    return squash_stream_process_filtered_compress (stream, operation);
+  else
+    return squash_stream_process_filtered_decompress (stream, operation);
+}
+
+static SquashStatus
+squash_stream_process_dispatch (SquashStream* stream, SquashOperation operation) {
+  if (SQUASH_UNLIKELY(stream->priv != NULL) && stream->priv->filter.chain != NULL)
+    return squash_stream_process_filtered (stream, operation);
+  else
+    return squash_stream_process_operation (stream, operation);
+}
+
+static SquashStatus
+squash_stream_process_internal (SquashStream* stream, SquashOperation operation) {
+  const uint64_t stats_start = squash_stats_begin ();
+  const size_t avail_in = stream->avail_in;
+  const size_t avail_out = stream->avail_out;
+
+  SquashStatus res = squash_stream_process_dispatch (stream, operation);
+
+  /* Anything which moves data through the stream can leave some of it
+     buffered inside the codec until the next completed flush. */
+  if (operation == SQUASH_OPERATION_FLUSH)
+    stream->flushed = (res == SQUASH_OK);
+  else if (avail_in != stream->avail_in || avail_out != stream->avail_out)
+    stream->flushed = false;
+
+  if (SQUASH_UNLIKELY(stats_start != 0))
+    squash_stats_record (stream->codec, SQUASH_STATS_STREAM_COMPRESS, stream->stream_type,
+                         avail_in - stream->avail_in, avail_out - stream->avail_out, stats_start);
+
+  return res;
+}
+
 /**
  * @brief Process a stream.
  *
@@ -812,6 +1096,8 @@ squash_stream_process (SquashStream* stream) {
  *
  * @param stream The stream.
  * @return A status code.
+ * @retval SQUASH_INVALID_OPERATION The stream can't be flushed (see
+ *   ::squash_stream_get_info).
  */
 SquashStatus
 squash_stream_flush (SquashStream* stream) {
@@ -829,6 +1115,264 @@ squash_stream_finish (SquashStream* stream) {
   return squash_stream_process_internal (stream, SQUASH_OPERATION_FINISH);
 }
 
+/**
+ * @brief Get a bitmask of information about a stream
+ *
+ * This is what ::squash_codec_get_info returns for the stream's codec,
+ * less anything the stream's options rule out.  Streams with the
+ * "filter" option can't be flushed, since filters work on whole
+ * blocks.
+ *
+ * @param stream The stream.
+ * @return the stream info
+ */
+SquashCodecInfo
+squash_stream_get_info (SquashStream* stream) {
+  assert (stream != NULL);
+
+  SquashCodecInfo info = squash_codec_get_info (stream->codec);
+  if (stream->priv != NULL && stream->priv->filter.chain != NULL)
+    info = (SquashCodecInfo) (info & ~SQUASH_CODEC_INFO_CAN_FLUSH);
+
+  return info;
+}
+
+/**
+ * @brief Reset a stream so it can be reused
+ *
+ * Returns the stream to the state it was in when it was created, with
+ * the same codec and options, discarding any input or output which
+ * hasn't been processed yet.  For many small messages this is much
+ * cheaper than creating a new stream for each one.
+ *
+ * @param stream The stream.
+ * @return A status code.
+ * @retval SQUASH_INVALID_OPERATION The codec's streams can't be reset;
+ *   create a new stream instead.
+ */
+SquashStatus
+squash_stream_reset (SquashStream* stream) {
+  assert (stream != NULL);
+
+  SquashCodecImpl* impl = squash_codec_get_impl (stream->codec);
+  if (SQUASH_UNLIKELY(impl == NULL))
+    return squash_error (SQUASH_UNABLE_TO_LOAD);
+
+  if (impl->create_stream != NULL) {
+    if (impl->reset_stream == NULL)
+      return squash_error (SQUASH_INVALID_OPERATION);
+
+    SquashStatus res = impl->reset_stream (stream);
+    if (SQUASH_UNLIKELY(res != SQUASH_OK))
+      return res;
+  } else {
+    SquashBufferStream* s = (SquashBufferStream*) stream;
+    SquashStreamPrivate* priv = stream->priv;
+
+    if (priv != NULL && priv->started) {
+      if (!priv->finished)
+        squash_stream_send_to_thread (stream, SQUASH_OPERATION_TERMINATE);
+
+      /* The thread has been joined and released io_mtx. */
+      mtx_lock (&(priv->io_mtx));
+      priv->started = false;
+      priv->finished = false;
+      priv->request = SQUASH_OPERATION_INVALID;
+      priv->result = SQUASH_STATUS_INVALID;
+    }
+
+    squash_buffer_clear (s->input);
+    squash_buffer_free (s->output);
+    s->output = NULL;
+    s->output_pos = 0;
+  }
+
+  if (stream->priv != NULL)
+    squash_filter_stream_reset (&(stream->priv->filter));
+
+  stream->next_in = NULL;
+  stream->avail_in = 0;
+  stream->total_in = 0;
+
+  stream->next_out = NULL;
+  stream->avail_out = 0;
+  stream->total_out = 0;
+
+  stream->state = SQUASH_STREAM_STATE_IDLE;
+  stream->flushed = true;
+
+  return SQUASH_OK;
+}
+
+/* A checkpoint starts with a 28 byte header: an 8 byte magic number,
+ * a version, the stream type, the length of the codec name, a
+ * reserved byte, and the stream's total_in and total_out (64-bit
+ * little-endian).  It is followed by the codec name (without a
+ * terminator) and then whatever the codec's checkpoint_stream
+ * callback wrote. */
+#define SQUASH_CHECKPOINT_VERSION 1
+#define SQUASH_CHECKPOINT_HEADER_SIZE 28
+
+static const uint8_t squash_checkpoint_magic[8] = { 0x89, 'S', 'Q', 'C', 'K', 'P', '\r', '\n' };
+
+static void
+squash_checkpoint_put_u64 (uint8_t* dest, uint64_t value) {
+  for (size_t i = 0 ; i < 8 ; i++)
+    dest[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint64_t
+squash_checkpoint_get_u64 (const uint8_t* src) {
+  uint64_t value = 0;
+  for (size_t i = 0 ; i < 8 ; i++)
+    value |= ((uint64_t) src[i]) << (8 * i);
+  return value;
+}
+
+/**
+ * @brief Save the state of a stream
+ *
+ * Serializes everything needed to continue the stream later, in a
+ * new stream created with the same codec, stream type and options
+ * (see squash_stream_restore).  A long-running job which saves the
+ * checkpoint along with the input and output offsets (*total_in* and
+ * *total_out*) can resume from that point instead of starting over.
+ *
+ * The stream must be flushed first: call squash_stream_flush until it
+ * returns ::SQUASH_OK, with no input left in *avail_in*.
+ *
+ * If @a checkpoint is NULL or @a checkpoint_size is too small,
+ * @a checkpoint_size is set to the size required and
+ * ::SQUASH_BUFFER_FULL is returned.
+ *
+ * The format is specific to the codec and the version of the library
+ * it uses; restoring a checkpoint on another version may fail.
+ *
+ * @param stream The stream.
+ * @param checkpoint_size Size of @a checkpoint; set to the number of
+ *   bytes written.
+ * @param checkpoint Buffer to write the checkpoint to.
+ * @return A status code.
+ * @retval SQUASH_STATE The last operation on the stream was not a
+ *   completed squash_stream_flush, or input is left in *avail_in*.
+ * @retval SQUASH_INVALID_OPERATION The codec's streams can't be
+ *   checkpointed (at least with these options).
+ */
+SquashStatus
+squash_stream_checkpoint (SquashStream* stream, size_t* checkpoint_size, uint8_t* checkpoint) {
+  assert (stream != NULL);
+  assert (checkpoint_size != NULL);
+
+  SquashCodecImpl* impl = squash_codec_get_impl (stream->codec);
+  if (SQUASH_UNLIKELY(impl == NULL))
+    return squash_error (SQUASH_UNABLE_TO_LOAD);
+
+  /* Filtered streams hold a partial block of input. */
+  if (impl->create_stream == NULL || impl->checkpoint_stream == NULL ||
+      (stream->priv != NULL && stream->priv->filter.chain != NULL))
+    return squash_error (SQUASH_INVALID_OPERATION);
+
+  if (SQUASH_UNLIKELY(!stream->flushed) ||
+      SQUASH_UNLIKELY(stream->state != SQUASH_STREAM_STATE_IDLE) ||
+      SQUASH_UNLIKELY(stream->avail_in != 0))
+    return squash_error (SQUASH_STATE);
+
+  const char* name = squash_codec_get_name (stream->codec);
+  const size_t name_length = strlen (name);
+  assert (name_length <= UINT8_MAX);
+
+  const size_t header_size = SQUASH_CHECKPOINT_HEADER_SIZE + name_length;
+  size_t payload_size = (checkpoint != NULL && *checkpoint_size > header_size) ? *checkpoint_size - header_size : 0;
+
+  SquashStatus res = impl->checkpoint_stream (stream, &payload_size, (checkpoint != NULL && payload_size != 0) ? checkpoint + header_size : NULL);
+  if (res == SQUASH_BUFFER_FULL || (res == SQUASH_OK && (checkpoint == NULL || *checkpoint_size < header_size))) {
+    *checkpoint_size = header_size + payload_size;
+    return squash_error (SQUASH_BUFFER_FULL);
+  } else if (SQUASH_UNLIKELY(res != SQUASH_OK)) {
+    return res;
+  }
+
+  memcpy (checkpoint, squash_checkpoint_magic, sizeof (squash_checkpoint_magic));
+  checkpoint[8] = SQUASH_CHECKPOINT_VERSION;
+  checkpoint[9] = (uint8_t) stream->stream_type;
+  checkpoint[10] = (uint8_t) name_length;
+  checkpoint[11] = 0;
+  squash_checkpoint_put_u64 (checkpoint + 12, stream->total_in);
+  squash_checkpoint_put_u64 (checkpoint + 20, stream->total_out);
+  memcpy (checkpoint + SQUASH_CHECKPOINT_HEADER_SIZE, name, name_length);
+
+  *checkpoint_size = header_size + payload_size;
+
+  return SQUASH_OK;
+}
+
+/**
+ * @brief Continue a stream from a checkpoint
+ *
+ * The stream must have just been created (or reset), with the same
+ * codec, stream type and options as the stream passed to
+ * squash_stream_checkpoint.  Afterwards *total_in* and *total_out*
+ * are what they were when the checkpoint was taken; resume feeding
+ * input from that offset, and append the output to the first
+ * *total_out* bytes written before the checkpoint.
+ *
+ * @param stream The stream.
+ * @param checkpoint_size Size of @a checkpoint.
+ * @param checkpoint Checkpoint created by squash_stream_checkpoint.
+ * @return A status code.
+ * @retval SQUASH_STATE The stream has already been used.
+ * @retval SQUASH_INVALID_BUFFER The checkpoint is corrupt, or belongs
+ *   to another codec or stream type.
+ * @retval SQUASH_INVALID_OPERATION The codec's streams can't be
+ *   restored.
+ */
+SquashStatus
+squash_stream_restore (SquashStream* stream, size_t checkpoint_size, const uint8_t* checkpoint) {
+  assert (stream != NULL);
+
+  SquashCodecImpl* impl = squash_codec_get_impl (stream->codec);
+  if (SQUASH_UNLIKELY(impl == NULL))
+    return squash_error (SQUASH_UNABLE_TO_LOAD);
+
+  if (impl->create_stream == NULL || impl->restore_stream == NULL ||
+      (stream->priv != NULL && stream->priv->filter.chain != NULL))
+    return squash_error (SQUASH_INVALID_OPERATION);
+
+  if (SQUASH_UNLIKELY(stream->state != SQUASH_STREAM_STATE_IDLE) ||
+      SQUASH_UNLIKELY(stream->total_in != 0) ||
+      SQUASH_UNLIKELY(stream->total_out != 0))
+    return squash_error (SQUASH_STATE);
+
+  const char* name = squash_codec_get_name (stream->codec);
+  const size_t name_length = strlen (name);
+  const size_t header_size = SQUASH_CHECKPOINT_HEADER_SIZE + name_length;
+
+  if (SQUASH_UNLIKELY(checkpoint == NULL) ||
+      SQUASH_UNLIKELY(checkpoint_size < header_size) ||
+      SQUASH_UNLIKELY(memcmp (checkpoint, squash_checkpoint_magic, sizeof (squash_checkpoint_magic)) != 0) ||
+      SQUASH_UNLIKELY(checkpoint[8] != SQUASH_CHECKPOINT_VERSION) ||
+      SQUASH_UNLIKELY(checkpoint[9] != (uint8_t) stream->stream_type) ||
+      SQUASH_UNLIKELY(checkpoint[10] != name_length) ||
+      SQUASH_UNLIKELY(memcmp (checkpoint + SQUASH_CHECKPOINT_HEADER_SIZE, name, name_length) != 0))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  const uint64_t total_in = squash_checkpoint_get_u64 (checkpoint + 12);
+  const uint64_t total_out = squash_checkpoint_get_u64 (checkpoint + 20);
+#if SIZE_MAX < UINT64_MAX
+  if (SQUASH_UNLIKELY(total_in > SIZE_MAX) || SQUASH_UNLIKELY(total_out > SIZE_MAX))
+    return squash_error (SQUASH_RANGE);
+#endif
+
+  SquashStatus res = impl->restore_stream (stream, checkpoint_size - header_size, checkpoint + header_size);
+  if (SQUASH_UNLIKELY(res != SQUASH_OK))
+    return res;
+
+  stream->total_in = (size_t) total_in;
+  stream->total_out = (size_t) total_out;
+
+  return SQUASH_OK;
+}
+
 /**
  * @}
  */
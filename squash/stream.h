@@ -76,6 +76,7 @@ struct SquashStream_ {
   SquashOptions* options;
   SquashStreamType stream_type;
   SquashStreamState state;
+  bool flushed;
 
   void* user_data;
   SquashDestroyNotify destroy_user_data;
@@ -106,6 +107,16 @@ SQUASH_NONNULL(1)
 SQUASH_API SquashStatus    squash_stream_flush                  (SquashStream* stream);
 SQUASH_NONNULL(1)
 SQUASH_API SquashStatus    squash_stream_finish                 (SquashStream* stream);
+SQUASH_NONNULL(1)
+SQUASH_API SquashStatus    squash_stream_reset                  (SquashStream* stream);
+SQUASH_NONNULL(1, 2)
+SQUASH_API SquashStatus    squash_stream_checkpoint             (SquashStream* stream,
+                                                                 size_t* checkpoint_size,
+                                                                 uint8_t* checkpoint);
+SQUASH_NONNULL(1)
+SQUASH_API SquashStatus    squash_stream_restore                (SquashStream* stream,
+                                                                 size_t checkpoint_size,
+                                                                 const uint8_t* checkpoint);
 
 SQUASH_NONNULL(1, 2)
 SQUASH_API void            squash_stream_init                   (void* stream,
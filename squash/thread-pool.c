@@ -0,0 +1,320 @@
+/* Copyright (c) 2013-2016 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+
+/**
+ * @cond INTERNAL
+ */
+
+typedef struct SquashParallelJob_ {
+  SquashParallelFunc func;
+  void* user_data;
+  size_t n;
+  volatile size_t next_index;
+  volatile SquashStatus status;
+
+  /* The following are protected by the pool mutex */
+  unsigned int helpers_wanted;
+  unsigned int helpers_active;
+  cnd_t helpers_done;
+  struct SquashParallelJob_* next;
+} SquashParallelJob;
+
+static once_flag squash_thread_pool_once = ONCE_FLAG_INIT;
+static mtx_t squash_thread_pool_mtx;
+static cnd_t squash_thread_pool_cnd;
+static SquashParallelJob* squash_thread_pool_jobs = NULL;
+static unsigned int squash_thread_pool_idle = 0;
+
+/* Total number of threads Squash may use at once, including the
+ * caller's; 0 until initialized. */
+static volatile size_t squash_max_threads = 0;
+/* Number of extra threads currently handed out. */
+static volatile size_t squash_threads_in_use = 0;
+
+static void
+squash_thread_pool_init (void) {
+  mtx_init (&squash_thread_pool_mtx, mtx_plain);
+  cnd_init (&squash_thread_pool_cnd);
+
+  if (squash_max_threads == 0) {
+    const char* ev = getenv ("SQUASH_THREADS");
+    size_t max_threads = 1;
+
+    if (ev != NULL) {
+      if (strcmp (ev, "auto") == 0) {
+        max_threads = squash_get_cpu_count ();
+      } else {
+        char* endptr = NULL;
+        const unsigned long v = strtoul (ev, &endptr, 10);
+        if (*endptr == '\0')
+          max_threads = (v == 0) ? squash_get_cpu_count () : (size_t) v;
+      }
+    }
+
+    squash_max_threads = max_threads;
+  }
+}
+
+static void
+squash_parallel_job_run (SquashParallelJob* job) {
+  size_t index;
+
+  while ((index = squash_atomic_add_size (&(job->next_index), 1) - 1) < job->n) {
+    if (SQUASH_UNLIKELY(job->status < 0))
+      continue;
+
+    const SquashStatus res = job->func (index, job->user_data);
+    if (SQUASH_UNLIKELY(res < 0))
+      job->status = res;
+  }
+}
+
+static int
+squash_thread_pool_worker (void* user_data) {
+  (void) user_data;
+
+  mtx_lock (&squash_thread_pool_mtx);
+
+  while (true) {
+    SquashParallelJob* job = squash_thread_pool_jobs;
+    while (job != NULL && job->helpers_wanted == 0)
+      job = job->next;
+
+    if (job == NULL) {
+      squash_thread_pool_idle++;
+      cnd_wait (&squash_thread_pool_cnd, &squash_thread_pool_mtx);
+      squash_thread_pool_idle--;
+      continue;
+    }
+
+    job->helpers_wanted--;
+    job->helpers_active++;
+    mtx_unlock (&squash_thread_pool_mtx);
+
+    squash_parallel_job_run (job);
+
+    mtx_lock (&squash_thread_pool_mtx);
+    if (--(job->helpers_active) == 0)
+      cnd_signal (&(job->helpers_done));
+  }
+
+  squash_assert_unreachable ();
+}
+
+/**
+ * @endcond
+ */
+
+/**
+ * @defgroup ThreadPool Thread pool
+ * @brief Parallel execution with a process-wide thread budget
+ *
+ * Some operations can be split into independent pieces (segments of
+ * very large buffers, blocks of block-based codecs, etc.).  Squash
+ * keeps a pool of worker threads to process those pieces in
+ * parallel.
+ *
+ * To keep several parallel operations (or several libraries using
+ * Squash) from oversubscribing the machine, all threads are drawn
+ * from a single process-wide budget set with @ref
+ * squash_set_max_threads.  By default the budget is read from the
+ * `SQUASH_THREADS` environment variable ("auto" or 0 for one thread
+ * per CPU); if it is not set, Squash does not use any extra threads.
+ *
+ * Plugins which create their own threads should reserve them with
+ * @ref squash_threads_acquire and return them with @ref
+ * squash_threads_release.
+ *
+ * @{
+ */
+
+/**
+ * @brief Set the maximum number of threads Squash may use
+ *
+ * The limit includes the calling thread, so 1 disables parallelism.
+ * Lowering the limit does not affect threads which have already
+ * been acquired.
+ *
+ * @param max_threads maximum number of threads, or 0 for one per CPU
+ */
+void
+squash_set_max_threads (unsigned int max_threads) {
+  squash_max_threads = (max_threads != 0) ? max_threads : squash_get_cpu_count ();
+  call_once (&squash_thread_pool_once, squash_thread_pool_init);
+}
+
+/**
+ * @brief Get the maximum number of threads Squash may use
+ *
+ * @return the maximum number of threads, including the calling
+ *   thread
+ */
+unsigned int
+squash_get_max_threads (void) {
+  call_once (&squash_thread_pool_once, squash_thread_pool_init);
+  return (unsigned int) squash_max_threads;
+}
+
+/**
+ * @brief Reserve threads from the process-wide budget
+ *
+ * @param requested number of threads wanted (in addition to the
+ *   calling thread)
+ * @return number of threads granted, which may be anywhere from 0 to
+ *   @a requested; must later be passed to @ref squash_threads_release
+ */
+unsigned int
+squash_threads_acquire (unsigned int requested) {
+  call_once (&squash_thread_pool_once, squash_thread_pool_init);
+
+  if (requested == 0)
+    return 0;
+
+  size_t in_use = squash_threads_in_use;
+  while (true) {
+    const size_t max_extra = squash_max_threads - 1;
+    if (in_use >= max_extra)
+      return 0;
+
+    const size_t granted = ((max_extra - in_use) < requested) ? (max_extra - in_use) : requested;
+    const size_t prev = squash_atomic_cas_size (&squash_threads_in_use, in_use, in_use + granted);
+    if (prev == in_use)
+      return (unsigned int) granted;
+    in_use = prev;
+  }
+}
+
+/**
+ * @brief Return threads to the process-wide budget
+ *
+ * @param threads number of threads to return, as previously granted
+ *   by @ref squash_threads_acquire
+ */
+void
+squash_threads_release (unsigned int threads) {
+  if (threads != 0)
+    squash_atomic_sub_size (&squash_threads_in_use, threads);
+}
+
+/**
+ * @brief Call a function for every index in a range, in parallel
+ *
+ * @a func is called once for each index from 0 to @a n - 1.  The
+ * calling thread participates, and up to @a threads - 1 additional
+ * threads from the pool are used if the process-wide budget allows.
+ * If no threads are available (for example, because this is called
+ * from inside another parallel operation) every index is processed
+ * on the calling thread, so it is always safe to call.
+ *
+ * The order in which indices are processed is unspecified.  Once
+ * any call fails, the remaining indices are skipped.
+ *
+ * @param threads maximum number of threads to use, including the
+ *   calling thread, or 0 to use as many as the budget allows
+ * @param n number of indices
+ * @param func function to call for each index
+ * @param user_data data to pass to @a func
+ * @return @ref SQUASH_OK, or the error returned by @a func
+ */
+SquashStatus
+squash_parallel_for (unsigned int threads,
+                     size_t n,
+                     SquashParallelFunc func,
+                     void* user_data) {
+  assert (func != NULL);
+
+  if (threads == 0)
+    threads = squash_get_max_threads ();
+  if (n < threads)
+    threads = (unsigned int) n;
+
+  const unsigned int helpers = (threads > 1) ? squash_threads_acquire (threads - 1) : 0;
+
+  SquashParallelJob job;
+  job.func = func;
+  job.user_data = user_data;
+  job.n = n;
+  job.next_index = 0;
+  job.status = SQUASH_OK;
+  job.helpers_wanted = helpers;
+  job.helpers_active = 0;
+  job.next = NULL;
+
+  if (helpers != 0) {
+    cnd_init (&(job.helpers_done));
+
+    mtx_lock (&squash_thread_pool_mtx);
+
+    job.next = squash_thread_pool_jobs;
+    squash_thread_pool_jobs = &job;
+
+    /* The budget guarantees idle + running workers never need to
+       exceed max_threads - 1, so only spawn what's missing. */
+    for (unsigned int i = squash_thread_pool_idle ; i < helpers ; i++) {
+      thrd_t thread;
+      if (thrd_create (&thread, squash_thread_pool_worker, NULL) == thrd_success)
+        thrd_detach (thread);
+    }
+    cnd_broadcast (&squash_thread_pool_cnd);
+
+    mtx_unlock (&squash_thread_pool_mtx);
+  }
+
+  squash_parallel_job_run (&job);
+
+  if (helpers != 0) {
+    mtx_lock (&squash_thread_pool_mtx);
+
+    for (SquashParallelJob** j = &squash_thread_pool_jobs ; *j != NULL ; j = &((*j)->next)) {
+      if (*j == &job) {
+        *j = job.next;
+        break;
+      }
+    }
+    job.helpers_wanted = 0;
+
+    while (job.helpers_active != 0)
+      cnd_wait (&(job.helpers_done), &squash_thread_pool_mtx);
+
+    mtx_unlock (&squash_thread_pool_mtx);
+
+    cnd_destroy (&(job.helpers_done));
+    squash_threads_release (helpers);
+  }
+
+  return job.status;
+}
+
+/**
+ * @}
+ */
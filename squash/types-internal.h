@@ -45,7 +45,10 @@ typedef SQUASH_TREE_HEAD(SquashCodecRefTree_, SquashCodecRef_) SquashCodecRefTre
 struct SquashContext_ {
   SquashPluginTree plugins;
   SquashCodecRefTree codecs;
-  SquashCodecRefTree extensions;
+  SquashCodecTable names;
+  SquashCodecTable extensions;
+  SquashCodecTable mime_types;
+  SquashCodecTree chains;
 };
 
 struct SquashPlugin_ {
@@ -72,10 +75,15 @@ struct SquashCodec_ {
   char* name;
   int priority;
   char* extension;
+  char* mime_type;
+  /* NULL-terminated, or NULL if the codec has no aliases */
+  char** aliases;
 
   bool initialized;
   SquashCodecImpl impl;
 
+  size_t stats_id;
+
   SQUASH_TREE_ENTRY(SquashCodec_) tree;
 };
 
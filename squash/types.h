@@ -44,6 +44,7 @@ typedef struct SquashCodec_      SquashCodec;
 typedef struct SquashCodecImpl_  SquashCodecImpl;
 typedef struct SquashPlugin_     SquashPlugin;
 typedef struct SquashFile_       SquashFile;
+typedef struct SquashArena_      SquashArena;
 
 SQUASH_END_DECLS
 
@@ -35,11 +35,17 @@
 SQUASH_BEGIN_DECLS
 
 SQUASH_INTERNAL
-size_t squash_get_page_size      (void);
+size_t       squash_get_page_size      (void);
 SQUASH_INTERNAL
-size_t squash_npot               (size_t v);
+size_t       squash_npot               (size_t v);
 SQUASH_INTERNAL
-size_t squash_get_huge_page_size (void);
+size_t       squash_get_huge_page_size (void);
+SQUASH_INTERNAL
+unsigned int squash_get_cpu_count      (void);
+SQUASH_INTERNAL
+const char* const* squash_get_simd_variants (void);
+SQUASH_NONNULL(1) SQUASH_INTERNAL
+char*        squash_strdup             (const char* str);
 
 SQUASH_END_DECLS
 
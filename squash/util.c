@@ -44,6 +44,15 @@
 #  include <windows.h>
 #endif
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  define SQUASH_CPU_X86
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+#endif
+
 size_t
 squash_get_page_size (void) {
   static size_t page_size = 0;
@@ -68,6 +77,134 @@ squash_get_page_size (void) {
   return page_size;
 }
 
+unsigned int
+squash_get_cpu_count (void) {
+  static unsigned int cpu_count = 0;
+
+  if (SQUASH_UNLIKELY(cpu_count == 0)) {
+    unsigned int count = 0;
+#if defined(_WIN32)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    count = (unsigned int) si.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    const long n = sysconf (_SC_NPROCESSORS_ONLN);
+    count = SQUASH_UNLIKELY(n < 1) ? 1 : ((unsigned int) n);
+#else
+    int hw_ncpu[] = { CTL_HW, HW_NCPU };
+    int n;
+    size_t len = sizeof(n);
+    int sres = sysctl (hw_ncpu, sizeof(hw_ncpu) / sizeof(*hw_ncpu), &n, &len, NULL, 0);
+    count = (SQUASH_LIKELY(sres == 0) && n > 0) ? (unsigned int) n : 1;
+#endif
+    cpu_count = (count == 0) ? 1 : count;
+  }
+
+  return cpu_count;
+}
+
+#if defined(SQUASH_CPU_X86)
+static void
+squash_cpuid (unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+  int r[4];
+  __cpuidex (r, (int) leaf, (int) subleaf);
+  for (size_t i = 0 ; i < 4 ; i++)
+    regs[i] = (unsigned int) r[i];
+#else
+  __cpuid_count (leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t
+squash_xgetbv (void) {
+#if defined(_MSC_VER)
+  return (uint64_t) _xgetbv (0);
+#else
+  uint32_t eax, edx;
+  __asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+  return (((uint64_t) edx) << 32) | eax;
+#endif
+}
+#endif /* defined(SQUASH_CPU_X86) */
+
+static const char* squash_simd_variants[3] = { NULL, };
+static once_flag squash_simd_variants_once = ONCE_FLAG_INIT;
+
+#define SQUASH_BITS_SET(v, mask) (((v) & (mask)) == (mask))
+
+static void
+squash_simd_variants_init (void) {
+  bool avx2 = false;
+  bool avx512 = false;
+  size_t n = 0;
+
+#if defined(SQUASH_CPU_X86)
+  unsigned int regs[4];
+
+  squash_cpuid (0, 0, regs);
+  const unsigned int max_leaf = regs[0];
+  squash_cpuid (0x80000000, 0, regs);
+  const unsigned int max_extended_leaf = regs[0];
+
+  if (max_leaf >= 7 && max_extended_leaf >= 0x80000001) {
+    squash_cpuid (1, 0, regs);
+    const unsigned int ecx_1 = regs[2];
+    squash_cpuid (7, 0, regs);
+    const unsigned int ebx_7 = regs[1];
+    squash_cpuid (0x80000001, 0, regs);
+    const unsigned int ecx_80000001 = regs[2];
+
+    /* The instructions are only usable if the OS saves the wider
+       registers (XCR0: SSE and AVX state, plus opmask and ZMM state
+       for AVX-512). */
+    if (SQUASH_BITS_SET(ecx_1, 1U << 27)) {
+      const uint64_t xcr0 = squash_xgetbv ();
+
+      /* AVX2 variant: AVX2, FMA, BMI1, BMI2, LZCNT and POPCNT. */
+      avx2 =
+        SQUASH_BITS_SET(xcr0, 0x06) &&
+        SQUASH_BITS_SET(ecx_1, (1U << 12) | (1U << 23) | (1U << 28)) &&
+        SQUASH_BITS_SET(ebx_7, (1U << 3) | (1U << 5) | (1U << 8)) &&
+        SQUASH_BITS_SET(ecx_80000001, 1U << 5);
+
+      /* AVX-512 variant: F, DQ, CD, BW and VL. */
+      avx512 =
+        avx2 &&
+        SQUASH_BITS_SET(xcr0, 0xe6) &&
+        SQUASH_BITS_SET(ebx_7, (1U << 16) | (1U << 17) | (1U << 28) | (1U << 30) | (1U << 31));
+    }
+  }
+#endif
+
+  /* SQUASH_SIMD caps the variant used, mostly for benchmarking and
+     debugging: "none" for the baseline build, or "avx2". */
+  const char* ev = getenv ("SQUASH_SIMD");
+  if (ev != NULL) {
+    if (strcmp (ev, "none") == 0) {
+      avx2 = avx512 = false;
+    } else if (strcmp (ev, "avx2") == 0) {
+      avx512 = false;
+    }
+  }
+
+  if (avx512)
+    squash_simd_variants[n++] = "avx512";
+  if (avx2)
+    squash_simd_variants[n++] = "avx2";
+  squash_simd_variants[n] = NULL;
+}
+
+/* Get the instruction set variants of a plugin which this CPU can
+ * run, best first, as a NULL-terminated list.  Plugins built with
+ * SIMD_VARIANTS install one shared object per variant next to the
+ * baseline one. */
+const char* const*
+squash_get_simd_variants (void) {
+  call_once (&squash_simd_variants_once, squash_simd_variants_init);
+  return squash_simd_variants;
+}
+
 size_t squash_huge_page_size = 0;
 once_flag squash_huge_page_size_once = ONCE_FLAG_INIT;
 
@@ -139,3 +276,53 @@ squash_npot (size_t v) {
   v++;
   return v;
 }
+
+/* Like strdup(3), but the result is allocated with squash_malloc so
+ * it can (and must) be released with squash_free. */
+char*
+squash_strdup (const char* str) {
+  const size_t len = strlen (str) + 1;
+  char* res = squash_malloc (len);
+  if (SQUASH_LIKELY(res != NULL))
+    memcpy (res, str, len);
+  return res;
+}
+
+#if !defined(SQUASH_ATOMIC_BUILTINS)
+SQUASH_MTX_DEFINE(atomic_size)
+
+size_t
+squash_atomic_add_size (volatile size_t* var, size_t val) {
+  size_t res;
+
+  SQUASH_MTX_LOCK(atomic_size);
+  res = (*var += val);
+  SQUASH_MTX_UNLOCK(atomic_size);
+
+  return res;
+}
+
+size_t
+squash_atomic_sub_size (volatile size_t* var, size_t val) {
+  size_t res;
+
+  SQUASH_MTX_LOCK(atomic_size);
+  res = (*var -= val);
+  SQUASH_MTX_UNLOCK(atomic_size);
+
+  return res;
+}
+
+size_t
+squash_atomic_cas_size (volatile size_t* var, size_t orig, size_t val) {
+  size_t res;
+
+  SQUASH_MTX_LOCK(atomic_size);
+  res = *var;
+  if (res == orig)
+    *var = val;
+  SQUASH_MTX_UNLOCK(atomic_size);
+
+  return res;
+}
+#endif /* !defined(SQUASH_ATOMIC_BUILTINS) */
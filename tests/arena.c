@@ -0,0 +1,115 @@
+#include "test-squash.h"
+
+static MunitResult
+squash_test_arena_basic(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  SquashArena* arena = squash_arena_new (0);
+  munit_assert_non_null(arena);
+
+  uint8_t* small[64];
+  for (size_t i = 0 ; i < 64 ; i++) {
+    small[i] = squash_arena_malloc (arena, 1000 + i);
+    munit_assert_non_null(small[i]);
+    munit_assert_cmp_size(((uintptr_t) small[i]) % sizeof(void*), ==, 0);
+    memset (small[i], (int) i, 1000 + i);
+  }
+  for (size_t i = 0 ; i < 64 ; i++)
+    munit_assert_cmp_int(small[i][999 + i], ==, (int) i);
+
+  /* Large blocks are recycled through the free lists. */
+  uint8_t* large = squash_arena_malloc (arena, 1024 * 1024);
+  munit_assert_non_null(large);
+  memset (large, 0xff, 1024 * 1024);
+  squash_scratch_free (large);
+
+  uint8_t* zeroed = squash_arena_calloc (arena, 1024, 1024);
+  munit_assert_ptr_equal(zeroed, large);
+  for (size_t i = 0 ; i < 1024 * 1024 ; i++)
+    munit_assert_cmp_int(zeroed[i], ==, 0);
+
+  /* Reset hands the same memory out again. */
+  squash_arena_reset (arena);
+  munit_assert_ptr_equal(squash_arena_malloc (arena, 1000), small[0]);
+  munit_assert_ptr_equal(squash_arena_malloc (arena, 1024 * 1024), large);
+
+  squash_arena_free (arena);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_arena_scratch(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  SquashArena* arena = squash_arena_new (0);
+  munit_assert_non_null(arena);
+
+  munit_assert_null(squash_arena_get_bound ());
+
+  uint8_t* heap = squash_scratch_calloc (4096, 1);
+  munit_assert_non_null(heap);
+  for (size_t i = 0 ; i < 4096 ; i++)
+    munit_assert_cmp_int(heap[i], ==, 0);
+
+  munit_assert_null(squash_arena_bind (arena));
+  munit_assert_ptr_equal(squash_arena_get_bound (), arena);
+
+  uint8_t* scratch = squash_scratch_malloc (4096);
+  munit_assert_non_null(scratch);
+  squash_scratch_free (scratch);
+
+  /* Memory allocated before the arena was bound is still released
+   * to the heap. */
+  squash_scratch_free (heap);
+
+  munit_assert_ptr_equal(squash_arena_bind (NULL), arena);
+  squash_arena_free (arena);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_arena_codec(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  const size_t max_compressed_length = squash_codec_get_max_compressed_size (codec, LOREM_IPSUM_LENGTH);
+  uint8_t* compressed = munit_malloc (max_compressed_length);
+  uint8_t* decompressed = munit_malloc (LOREM_IPSUM_LENGTH);
+  SquashArena* arena = squash_arena_new (0);
+  munit_assert_non_null(arena);
+
+  squash_arena_bind (arena);
+
+  for (int i = 0 ; i < 4 ; i++) {
+    size_t compressed_length = max_compressed_length;
+    size_t decompressed_length = LOREM_IPSUM_LENGTH;
+
+    SQUASH_ASSERT_OK(squash_codec_compress (codec, &compressed_length, compressed, LOREM_IPSUM_LENGTH, LOREM_IPSUM, NULL));
+    SQUASH_ASSERT_OK(squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL));
+    munit_assert_cmp_size(decompressed_length, ==, LOREM_IPSUM_LENGTH);
+    munit_assert_memory_equal(LOREM_IPSUM_LENGTH, decompressed, LOREM_IPSUM);
+
+    squash_arena_reset (arena);
+  }
+
+  squash_arena_bind (NULL);
+  squash_arena_free (arena);
+
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+static MunitTest squash_arena_tests[] = {
+  { (char*) "/basic", squash_test_arena_basic, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+  { (char*) "/scratch", squash_test_arena_scratch, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+  { (char*) "/codec", squash_test_arena_codec, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_arena = {
+  (char*) "/arena",
+  squash_arena_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
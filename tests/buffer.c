@@ -1,3 +1,8 @@
+#if !defined(_WIN32)
+#  define _POSIX_C_SOURCE 200809L
+#  include <unistd.h>
+#endif
+
 #include "test-squash.h"
 
 static MunitResult
@@ -64,9 +69,193 @@ squash_test_single_byte(MUNIT_UNUSED const MunitParameter params[], void* user_d
   return MUNIT_OK;
 }
 
+static MunitResult
+squash_test_memory_usage(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  const size_t compress_usage = squash_codec_get_memory_usage (codec, NULL, SQUASH_STREAM_COMPRESS);
+  const size_t decompress_usage = squash_codec_get_memory_usage (codec, NULL, SQUASH_STREAM_DECOMPRESS);
+
+  /* Estimates are optional, but they should be sane. */
+  munit_assert_cmp_size(compress_usage, <, SIZE_MAX / 2);
+  munit_assert_cmp_size(decompress_usage, <, SIZE_MAX / 2);
+
+  if (strcmp ("zlib", squash_codec_get_name (codec)) == 0) {
+    SquashOptions* options = squash_options_new (codec, "window-bits", "9", NULL);
+    munit_assert_non_null(options);
+    munit_assert_cmp_size(compress_usage, >, 0);
+    munit_assert_cmp_size(squash_codec_get_memory_usage (codec, options, SQUASH_STREAM_COMPRESS), <, compress_usage);
+    squash_object_unref (options);
+  }
+
+  return MUNIT_OK;
+}
+
+static void
+squash_test_zlib_blocks_codec (SquashCodec* codec) {
+  /* Several blocks, with an incompressible tail so the worst-case
+     bound gets exercised too. */
+  const size_t data_length = 256 * 1024;
+  uint8_t* data = (uint8_t*) malloc (data_length);
+  munit_assert_non_null(data);
+  for (size_t i = 0 ; i < data_length / 2 ; i++)
+    data[i] = (LOREM_IPSUM)[i % LOREM_IPSUM_LENGTH];
+  munit_rand_memory (data_length - (data_length / 2), data + (data_length / 2));
+
+  const size_t max_compressed_length = squash_codec_get_max_compressed_size (codec, data_length);
+  uint8_t* compressed = (uint8_t*) malloc (max_compressed_length);
+  uint8_t* reference = (uint8_t*) malloc (max_compressed_length);
+  uint8_t* decompressed = (uint8_t*) malloc (data_length);
+  munit_assert_non_null(compressed);
+  munit_assert_non_null(reference);
+  munit_assert_non_null(decompressed);
+
+  /* The block layout only depends on block-size, so the output must
+     not depend on the number of threads. */
+  size_t reference_length = max_compressed_length;
+  SquashStatus res = squash_codec_compress (codec, &reference_length, reference, data_length, data,
+                                            "threads", "0", "block-size", "32768", NULL);
+  SQUASH_ASSERT_OK(res);
+
+  size_t compressed_length = max_compressed_length;
+  res = squash_codec_compress (codec, &compressed_length, compressed, data_length, data,
+                               "threads", "3", "block-size", "32768", NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size(compressed_length, ==, reference_length);
+  munit_assert_memory_equal(compressed_length, compressed, reference);
+
+  /* Non-default parameters change the bound for every block. */
+  compressed_length = max_compressed_length;
+  res = squash_codec_compress (codec, &compressed_length, compressed, data_length, data,
+                               "threads", "3", "block-size", "32768",
+                               "window-bits", "9", "mem-level", "9", "strategy", "fixed", NULL);
+  SQUASH_ASSERT_OK(res);
+
+  size_t decompressed_length = data_length;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size(decompressed_length, ==, data_length);
+  munit_assert_memory_equal(data_length, decompressed, data);
+
+  decompressed_length = data_length;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, reference_length, reference, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size(decompressed_length, ==, data_length);
+  munit_assert_memory_equal(data_length, decompressed, data);
+
+  compressed_length = reference_length - 1;
+  res = squash_codec_compress (codec, &compressed_length, compressed, data_length, data,
+                               "threads", "2", "block-size", "32768", NULL);
+  munit_assert_int(res, ==, SQUASH_BUFFER_FULL);
+
+  free (data);
+  free (compressed);
+  free (reference);
+  free (decompressed);
+}
+
+static MunitResult
+squash_test_zlib_blocks(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  static const char* const names[] = { "deflate", "zlib", "gzip" };
+  const unsigned int max_threads = squash_get_max_threads ();
+  bool found = false;
+
+  /* Make sure the blocks really are compressed concurrently. */
+  squash_set_max_threads (4);
+
+  for (size_t i = 0 ; i < sizeof (names) / sizeof (names[0]) ; i++) {
+    SquashCodec* codec = squash_get_codec (names[i]);
+    if (codec == NULL)
+      continue;
+
+    found = true;
+    squash_test_zlib_blocks_codec (codec);
+  }
+
+  squash_set_max_threads (max_threads);
+
+  return found ? MUNIT_OK : MUNIT_SKIP;
+}
+
+static MunitResult
+squash_test_reference(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+#if defined(_WIN32)
+  return MUNIT_SKIP;
+#else
+  bool has_reference = false;
+  const SquashOptionInfo* info = squash_codec_get_option_info (codec);
+  for (size_t i = 0 ; info != NULL && info[i].name != NULL ; i++)
+    if (strcmp (info[i].name, "reference") == 0 && info[i].type == SQUASH_OPTION_TYPE_FILE)
+      has_reference = true;
+  if (!has_reference)
+    return MUNIT_SKIP;
+
+  /* An incompressible "yesterday" and a "today" which differs from
+     it in a handful of places, so the output should be roughly the
+     size of the changes rather than the size of the file. */
+  const size_t data_length = 1024 * 1024;
+  uint8_t* yesterday = (uint8_t*) munit_malloc (data_length);
+  uint8_t* today = (uint8_t*) munit_malloc (data_length);
+  munit_rand_memory (data_length, yesterday);
+  memcpy (today, yesterday, data_length);
+  for (int i = 0 ; i < 32 ; i++)
+    today[munit_rand_int_range (0, (int) data_length - 1)] ^= 0x5a;
+
+  char path[] = "squash-reference-XXXXXX";
+  const int fd = mkstemp (path);
+  munit_assert_int (fd, !=, -1);
+  FILE* fp = fdopen (fd, "wb");
+  munit_assert_non_null (fp);
+  munit_assert_size (fwrite (yesterday, 1, data_length, fp), ==, data_length);
+  fclose (fp);
+
+  SquashOptions* options = squash_object_ref_sink (squash_options_new (codec, NULL));
+  munit_assert_non_null (options);
+  SQUASH_ASSERT_OK(squash_options_parse_option (options, "reference", path));
+  munit_assert_string_equal (squash_options_get_string (options, codec, "reference"), path);
+
+  size_t compressed_length = squash_codec_get_max_compressed_size (codec, data_length);
+  uint8_t* compressed = (uint8_t*) munit_malloc (compressed_length);
+  SquashStatus res = squash_codec_compress_with_options (codec, &compressed_length, compressed, data_length, today, options);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (compressed_length, <, data_length / 64);
+
+  size_t decompressed_length = data_length;
+  uint8_t* decompressed = (uint8_t*) munit_malloc (decompressed_length);
+  res = squash_codec_decompress_with_options (codec, &decompressed_length, decompressed, compressed_length, compressed, options);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, data_length);
+  munit_assert_memory_equal (data_length, decompressed, today);
+
+  /* The contents stay valid after the file is gone. */
+  unlink (path);
+  decompressed_length = data_length;
+  res = squash_codec_decompress_with_options (codec, &decompressed_length, decompressed, compressed_length, compressed, options);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_memory_equal (data_length, decompressed, today);
+
+  munit_assert_int (squash_options_parse_option (options, "reference", path), ==, SQUASH_IO);
+
+  squash_object_unref (options);
+  free (yesterday);
+  free (today);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+#endif
+}
+
 MunitTest squash_buffer_tests[] = {
   { (char*) "/basic", squash_test_basic, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   { (char*) "/single-byte", squash_test_single_byte, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/memory-usage", squash_test_memory_usage, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/zlib-blocks", squash_test_zlib_blocks, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+  { (char*) "/reference", squash_test_reference, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
@@ -0,0 +1,179 @@
+#include "test-squash.h"
+
+/* More than twice the size of the buffers between stages, so they
+   wrap around. */
+#define SQUASH_TEST_CHAIN_LENGTH ((size_t) (600 * 1024) + 4099)
+
+static uint8_t*
+squash_test_chain_data (void) {
+  uint8_t* data = malloc (SQUASH_TEST_CHAIN_LENGTH);
+  munit_assert_non_null (data);
+
+  for (size_t i = 0 ; i < SQUASH_TEST_CHAIN_LENGTH ; i++)
+    data[i] = (uint8_t) ("etaoin shrdlu\n"[munit_rand_int_range (0, 13)]);
+
+  return data;
+}
+
+static size_t
+squash_test_chain_compress (SquashCodec* codec, SquashOptions* options,
+                            size_t compressed_length, uint8_t* compressed,
+                            size_t uncompressed_length, const uint8_t* uncompressed) {
+  SquashStream* stream = squash_stream_new_with_options (codec, SQUASH_STREAM_COMPRESS, options);
+  munit_assert_non_null (stream);
+
+  SquashStatus res;
+  stream->next_out = compressed;
+  while (stream->total_in < uncompressed_length) {
+    stream->next_in = uncompressed + stream->total_in;
+    stream->avail_in = MIN(uncompressed_length - stream->total_in, 7919);
+    do {
+      stream->avail_out = MIN(compressed_length - stream->total_out, 4096);
+      res = squash_stream_process (stream);
+      SQUASH_ASSERT_NO_ERROR(res);
+    } while (res == SQUASH_PROCESSING);
+  }
+
+  do {
+    stream->avail_out = MIN(compressed_length - stream->total_out, 4096);
+    res = squash_stream_finish (stream);
+    SQUASH_ASSERT_NO_ERROR(res);
+  } while (res == SQUASH_PROCESSING);
+
+  compressed_length = stream->total_out;
+  squash_object_unref (stream);
+
+  return compressed_length;
+}
+
+static size_t
+squash_test_chain_decompress (SquashCodec* codec, SquashOptions* options,
+                              size_t decompressed_length, uint8_t* decompressed,
+                              size_t compressed_length, const uint8_t* compressed) {
+  SquashStream* stream = squash_stream_new_with_options (codec, SQUASH_STREAM_DECOMPRESS, options);
+  munit_assert_non_null (stream);
+
+  SquashStatus res = SQUASH_OK;
+  stream->next_out = decompressed;
+  while (stream->total_in < compressed_length) {
+    stream->next_in = compressed + stream->total_in;
+    stream->avail_in = MIN(compressed_length - stream->total_in, 5003);
+    do {
+      stream->avail_out = MIN(decompressed_length - stream->total_out, 1021);
+      res = squash_stream_process (stream);
+      SQUASH_ASSERT_NO_ERROR(res);
+    } while (res == SQUASH_PROCESSING);
+
+    if (res == SQUASH_END_OF_STREAM)
+      break;
+  }
+
+  if (res != SQUASH_END_OF_STREAM) {
+    do {
+      stream->avail_out = MIN(decompressed_length - stream->total_out, 1021);
+      res = squash_stream_finish (stream);
+      SQUASH_ASSERT_NO_ERROR(res);
+    } while (res == SQUASH_PROCESSING);
+  }
+
+  decompressed_length = stream->total_out;
+  squash_object_unref (stream);
+
+  return decompressed_length;
+}
+
+static MunitResult
+squash_test_chain_codec(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+  const char* name = squash_codec_get_name (codec);
+  const char* plugin = squash_plugin_get_name (squash_codec_get_plugin (codec));
+
+  /* Two copies of the codec, with a filter in front. */
+  char* chain_name = malloc ((strlen (plugin) + strlen (name) + 2) * 2 + 16);
+  munit_assert_non_null (chain_name);
+  sprintf (chain_name, "delta:2+%s:%s+%s:%s", plugin, name, plugin, name);
+
+  SquashCodec* chain = squash_get_codec (chain_name);
+  munit_assert_non_null (chain);
+  munit_assert_ptr_equal (chain, squash_get_codec (chain_name));
+  munit_assert_string_equal (squash_codec_get_name (chain), chain_name);
+  munit_assert_null (squash_codec_get_plugin (chain));
+
+  /* A chain has to end with a codec. */
+  sprintf (chain_name, "%s:%s+shuffle", plugin, name);
+  munit_assert_null (squash_get_codec (chain_name));
+  sprintf (chain_name, "%s:%s++%s:%s", plugin, name, plugin, name);
+  munit_assert_null (squash_get_codec (chain_name));
+
+  uint8_t* data = squash_test_chain_data ();
+  size_t compressed_length = squash_codec_get_max_compressed_size (chain, SQUASH_TEST_CHAIN_LENGTH);
+  if (compressed_length == 0)
+    compressed_length = (SQUASH_TEST_CHAIN_LENGTH * 2) + (64 * 1024);
+  uint8_t* compressed = malloc (compressed_length);
+  uint8_t* decompressed = malloc (SQUASH_TEST_CHAIN_LENGTH);
+  munit_assert_non_null (compressed);
+  munit_assert_non_null (decompressed);
+
+  /* With threads=2 the stages run concurrently on the thread pool,
+     but only if the budget leaves room for them. */
+  const unsigned int max_threads = squash_get_max_threads ();
+  squash_set_max_threads (4);
+
+  static const char* threads[] = { "1", "2" };
+  for (size_t t = 0 ; t < sizeof (threads) / sizeof (threads[0]) ; t++) {
+    SquashOptions* options = squash_object_ref_sink (squash_options_new (chain, "threads", threads[t], NULL));
+    munit_assert_non_null (options);
+
+    /* Stream to stream */
+    size_t length = squash_test_chain_compress (chain, options, compressed_length, compressed, SQUASH_TEST_CHAIN_LENGTH, data);
+    memset (decompressed, 0, SQUASH_TEST_CHAIN_LENGTH);
+    munit_assert_size (squash_test_chain_decompress (chain, options, SQUASH_TEST_CHAIN_LENGTH, decompressed, length, compressed),
+                       ==, SQUASH_TEST_CHAIN_LENGTH);
+    munit_assert_memory_equal (SQUASH_TEST_CHAIN_LENGTH, decompressed, data);
+
+    /* Buffer to buffer */
+    length = compressed_length;
+    SQUASH_ASSERT_OK(squash_codec_compress_with_options (chain, &length, compressed, SQUASH_TEST_CHAIN_LENGTH, data, options));
+    memset (decompressed, 0, SQUASH_TEST_CHAIN_LENGTH);
+    size_t decompressed_length = SQUASH_TEST_CHAIN_LENGTH;
+    SQUASH_ASSERT_OK(squash_codec_decompress_with_options (chain, &decompressed_length, decompressed, length, compressed, options));
+    munit_assert_size (decompressed_length, ==, SQUASH_TEST_CHAIN_LENGTH);
+    munit_assert_memory_equal (SQUASH_TEST_CHAIN_LENGTH, decompressed, data);
+
+    /* Empty buffer; not every codec supports one, but gzip does (its
+       output is never empty). */
+    if (strcmp ("gzip", name) == 0) {
+      munit_assert_size (squash_codec_get_max_compressed_size (chain, 0), !=, 0);
+      length = compressed_length;
+      SQUASH_ASSERT_OK(squash_codec_compress_with_options (chain, &length, compressed, 0, data, options));
+      decompressed_length = SQUASH_TEST_CHAIN_LENGTH;
+      SQUASH_ASSERT_OK(squash_codec_decompress_with_options (chain, &decompressed_length, decompressed, length, compressed, options));
+      munit_assert_size (decompressed_length, ==, 0);
+    }
+
+    squash_object_unref (options);
+  }
+
+  squash_set_max_threads (max_threads);
+
+  free (chain_name);
+  free (data);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+MunitTest squash_chain_tests[] = {
+  { (char*) "/codec", squash_test_chain_codec, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_chain = {
+  (char*) "/chain",
+  squash_chain_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
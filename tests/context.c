@@ -0,0 +1,96 @@
+#include "test-squash.h"
+
+#include <ctype.h>
+
+static char*
+squash_test_context_upper (const char* s) {
+  char* res = strdup (s);
+  munit_assert_non_null (res);
+
+  for (char* p = res ; *p != '\0' ; p++)
+    *p = (char) toupper ((unsigned char) *p);
+
+  return res;
+}
+
+static MunitResult
+squash_test_context_lookup(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+  const char* name = squash_codec_get_name (codec);
+
+  SquashCodec* found = squash_get_codec (name);
+  munit_assert_non_null (found);
+  munit_assert_string_equal (squash_codec_get_name (found), name);
+
+  char* upper = squash_test_context_upper (name);
+  munit_assert_ptr_equal (squash_get_codec (upper), found);
+  free (upper);
+
+  const char* extension = squash_codec_get_extension (codec);
+  if (extension != NULL) {
+    found = squash_get_codec_from_extension (extension);
+    munit_assert_non_null (found);
+    munit_assert_string_equal (squash_codec_get_extension (found), extension);
+
+    upper = squash_test_context_upper (extension);
+    munit_assert_ptr_equal (squash_get_codec_from_extension (upper), found);
+    free (upper);
+  }
+
+  const char* mime_type = squash_codec_get_mime_type (codec);
+  if (mime_type != NULL) {
+    found = squash_get_codec_from_mime_type (mime_type);
+    munit_assert_non_null (found);
+    munit_assert_string_equal (squash_codec_get_mime_type (found), mime_type);
+
+    upper = squash_test_context_upper (mime_type);
+    munit_assert_ptr_equal (squash_get_codec_from_mime_type (upper), found);
+    free (upper);
+  }
+
+  munit_assert_null (squash_get_codec ("no-such-codec"));
+  munit_assert_null (squash_get_codec (""));
+  munit_assert_null (squash_get_codec_from_extension ("no-such-extension"));
+  munit_assert_null (squash_get_codec_from_mime_type ("application/x-no-such-type"));
+
+  return MUNIT_OK;
+}
+
+static void
+squash_test_context_aliases_check_name (SquashCodec* codec, MUNIT_UNUSED void* data) {
+  const char* name = squash_codec_get_name (codec);
+
+  /* No alias may hide another codec's real name. */
+  SquashCodec* found = squash_get_codec (name);
+  munit_assert_non_null (found);
+  munit_assert_string_equal (squash_codec_get_name (found), name);
+}
+
+static MunitResult
+squash_test_context_aliases(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  squash_foreach_codec (squash_test_context_aliases_check_name, NULL);
+
+  SquashCodec* bzip2 = squash_get_codec ("bzip2");
+  if (bzip2 == NULL)
+    return MUNIT_SKIP;
+
+  munit_assert_ptr_equal (squash_get_codec ("bz2"), bzip2);
+  munit_assert_ptr_equal (squash_get_codec ("BZ2"), bzip2);
+
+  return MUNIT_OK;
+}
+
+MunitTest squash_context_tests[] = {
+  { (char*) "/lookup", squash_test_context_lookup, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/aliases", squash_test_context_aliases, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_context = {
+  (char*) "/context",
+  squash_context_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
@@ -0,0 +1,204 @@
+#if !defined(_WIN32)
+#  define _POSIX_C_SOURCE 200809L
+#  include <dirent.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include "test-squash.h"
+
+#include <stdio.h>
+
+#define SQUASH_TEST_DEDUP_LENGTH ((size_t) 512 * 1024)
+
+#if !defined(_WIN32)
+static void
+squash_test_dedup_remove_tree (const char* path) {
+  DIR* dir = opendir (path);
+
+  if (dir != NULL) {
+    struct dirent* entry;
+    while ((entry = readdir (dir)) != NULL) {
+      if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0)
+        continue;
+
+      char* child = malloc (strlen (path) + strlen (entry->d_name) + 2);
+      munit_assert_non_null (child);
+      sprintf (child, "%s/%s", path, entry->d_name);
+      squash_test_dedup_remove_tree (child);
+      free (child);
+    }
+    closedir (dir);
+    rmdir (path);
+  } else {
+    unlink (path);
+  }
+}
+
+/* Chop the last byte off every chunk in the store. */
+static void
+squash_test_dedup_tear_tree (const char* path) {
+  DIR* dir = opendir (path);
+
+  if (dir != NULL) {
+    struct dirent* entry;
+    while ((entry = readdir (dir)) != NULL) {
+      if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0)
+        continue;
+
+      char* child = malloc (strlen (path) + strlen (entry->d_name) + 2);
+      munit_assert_non_null (child);
+      sprintf (child, "%s/%s", path, entry->d_name);
+      squash_test_dedup_tear_tree (child);
+      free (child);
+    }
+    closedir (dir);
+  } else {
+    struct stat st;
+    munit_assert_int (stat (path, &st), ==, 0);
+    munit_assert_int (truncate (path, st.st_size - 1), ==, 0);
+  }
+}
+#endif
+
+static MunitResult
+squash_test_dedup_store(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  if (strcmp ("dedup", squash_codec_get_name (codec)) != 0)
+    return MUNIT_SKIP;
+
+#if defined(_WIN32)
+  return MUNIT_SKIP;
+#else
+  char store[] = "/tmp/squash-dedup-XXXXXX";
+  munit_assert_non_null (mkdtemp (store));
+
+  /* Two "backups": random (incompressible) data, then the same data
+     with an insertion near the start and a few bytes changed in the
+     middle.  Content-defined chunking should resynchronize after
+     each edit, so almost all of the second one is references. */
+  uint8_t* first = malloc (SQUASH_TEST_DEDUP_LENGTH);
+  uint8_t* second = malloc (SQUASH_TEST_DEDUP_LENGTH + 1000);
+  munit_assert_non_null (first);
+  munit_assert_non_null (second);
+  munit_rand_memory (SQUASH_TEST_DEDUP_LENGTH, first);
+  memcpy (second, first, 5000);
+  munit_rand_memory (1000, second + 5000);
+  memcpy (second + 6000, first + 5000, SQUASH_TEST_DEDUP_LENGTH - 5000);
+  memset (second + (SQUASH_TEST_DEDUP_LENGTH / 2), 0, 64);
+
+  const size_t max_compressed_length = squash_codec_get_max_compressed_size (codec, SQUASH_TEST_DEDUP_LENGTH + 1000);
+  uint8_t* compressed = malloc (max_compressed_length);
+  uint8_t* decompressed = malloc (SQUASH_TEST_DEDUP_LENGTH + 1000);
+  munit_assert_non_null (compressed);
+  munit_assert_non_null (decompressed);
+
+  size_t compressed_length = max_compressed_length;
+  SQUASH_ASSERT_OK(squash_codec_compress (codec, &compressed_length, compressed, SQUASH_TEST_DEDUP_LENGTH, first,
+                                          "store", store, NULL));
+  munit_assert_size (compressed_length, >, SQUASH_TEST_DEDUP_LENGTH);
+
+  compressed_length = max_compressed_length;
+  SQUASH_ASSERT_OK(squash_codec_compress (codec, &compressed_length, compressed, SQUASH_TEST_DEDUP_LENGTH + 1000, second,
+                                          "store", store, NULL));
+  munit_assert_size (compressed_length, <, SQUASH_TEST_DEDUP_LENGTH / 8);
+
+  size_t decompressed_length = SQUASH_TEST_DEDUP_LENGTH + 1000;
+  SQUASH_ASSERT_OK(squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed,
+                                            "store", store, NULL));
+  munit_assert_size (decompressed_length, ==, SQUASH_TEST_DEDUP_LENGTH + 1000);
+  munit_assert_memory_equal (decompressed_length, decompressed, second);
+
+  /* References can't be resolved without the store. */
+  decompressed_length = SQUASH_TEST_DEDUP_LENGTH + 1000;
+  SQUASH_ASSERT_STATUS(squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL),
+                       SQUASH_NOT_FOUND);
+
+  /* A stream claiming to wrap another dedup stream is rejected. */
+  static const uint8_t nested[] = { 'S', 'Q', 'D', 'D', 1, 5, 'd', 'e', 'd', 'u', 'p' };
+  decompressed_length = SQUASH_TEST_DEDUP_LENGTH + 1000;
+  SQUASH_ASSERT_STATUS(squash_codec_decompress (codec, &decompressed_length, decompressed, sizeof (nested), nested, NULL),
+                       SQUASH_INVALID_BUFFER);
+
+  squash_test_dedup_remove_tree (store);
+  free (first);
+  free (second);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+#endif
+}
+
+static MunitResult
+squash_test_dedup_torn(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  if (strcmp ("dedup", squash_codec_get_name (codec)) != 0)
+    return MUNIT_SKIP;
+
+#if defined(_WIN32)
+  return MUNIT_SKIP;
+#else
+  char store[] = "/tmp/squash-dedup-XXXXXX";
+  munit_assert_non_null (mkdtemp (store));
+
+  uint8_t* data = malloc (SQUASH_TEST_DEDUP_LENGTH);
+  munit_assert_non_null (data);
+  munit_rand_memory (SQUASH_TEST_DEDUP_LENGTH, data);
+
+  const size_t max_compressed_length = squash_codec_get_max_compressed_size (codec, SQUASH_TEST_DEDUP_LENGTH);
+  uint8_t* compressed = malloc (max_compressed_length);
+  uint8_t* decompressed = malloc (SQUASH_TEST_DEDUP_LENGTH);
+  munit_assert_non_null (compressed);
+  munit_assert_non_null (decompressed);
+
+  size_t compressed_length = max_compressed_length;
+  SQUASH_ASSERT_OK(squash_codec_compress (codec, &compressed_length, compressed, SQUASH_TEST_DEDUP_LENGTH, data,
+                                          "store", store, NULL));
+
+  /* Damaged chunks (as left by a crash while one was written) must
+     not be referenced; the data is stored again instead. */
+  squash_test_dedup_tear_tree (store);
+
+  compressed_length = max_compressed_length;
+  SQUASH_ASSERT_OK(squash_codec_compress (codec, &compressed_length, compressed, SQUASH_TEST_DEDUP_LENGTH, data,
+                                          "store", store, NULL));
+  munit_assert_size (compressed_length, >, SQUASH_TEST_DEDUP_LENGTH);
+
+  size_t decompressed_length = SQUASH_TEST_DEDUP_LENGTH;
+  SQUASH_ASSERT_OK(squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL));
+  munit_assert_size (decompressed_length, ==, SQUASH_TEST_DEDUP_LENGTH);
+  munit_assert_memory_equal (decompressed_length, decompressed, data);
+
+  /* The chunks were rewritten, so they can be referenced again. */
+  compressed_length = max_compressed_length;
+  SQUASH_ASSERT_OK(squash_codec_compress (codec, &compressed_length, compressed, SQUASH_TEST_DEDUP_LENGTH, data,
+                                          "store", store, NULL));
+  munit_assert_size (compressed_length, <, SQUASH_TEST_DEDUP_LENGTH / 8);
+
+  squash_test_dedup_remove_tree (store);
+  free (data);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+#endif
+}
+
+MunitTest squash_dedup_tests[] = {
+  { (char*) "/store", squash_test_dedup_store, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/torn", squash_test_dedup_torn, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_dedup = {
+  (char*) "/dedup",
+  squash_dedup_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
@@ -0,0 +1,297 @@
+#include "test-squash.h"
+
+/* Not a multiple of the 64 KiB blocks filters work on, or of most
+   element sizes. */
+#define SQUASH_TEST_FILTER_LENGTH ((size_t) (3 * 64 * 1024) + 1237)
+#define SQUASH_TEST_FILTER_BLOCK_SIZE ((size_t) (64 * 1024))
+
+/* Slowly changing 32-bit little-endian integers, sprinkled with x86
+   calls. */
+static uint8_t*
+squash_test_filter_data (void) {
+  uint8_t* data = malloc (SQUASH_TEST_FILTER_LENGTH);
+  munit_assert_non_null (data);
+
+  uint32_t value = 0;
+  for (size_t i = 0 ; i < SQUASH_TEST_FILTER_LENGTH ; i += 4) {
+    value += (uint32_t) munit_rand_int_range (0, 64);
+    for (size_t j = 0 ; j < 4 && i + j < SQUASH_TEST_FILTER_LENGTH ; j++)
+      data[i + j] = (uint8_t) (value >> (j * 8));
+  }
+
+  for (size_t i = 0 ; i + 5 < SQUASH_TEST_FILTER_LENGTH ; i += 97) {
+    const int32_t target = munit_rand_int_range (-100000, 100000);
+    data[i] = 0xE8;
+    data[i + 1] = (uint8_t) target;
+    data[i + 2] = (uint8_t) (target >> 8);
+    data[i + 3] = (uint8_t) (target >> 16);
+    data[i + 4] = (uint8_t) (target >> 24);
+  }
+
+  return data;
+}
+
+/* Straightforward implementations of the filters, applied to each
+   block. */
+static void
+squash_test_filter_shuffle (uint8_t* data, size_t size, size_t width) {
+  uint8_t* tmp = malloc (size);
+  munit_assert_non_null (tmp);
+  memcpy (tmp, data, size);
+
+  const size_t n = size / width;
+  for (size_t i = 0 ; i < n ; i++)
+    for (size_t j = 0 ; j < width ; j++)
+      data[(j * n) + i] = tmp[(i * width) + j];
+
+  free (tmp);
+}
+
+static void
+squash_test_filter_delta (uint8_t* data, size_t size, size_t distance) {
+  for (size_t i = size ; i-- > distance ; )
+    data[i] -= data[i - distance];
+}
+
+static void
+squash_test_filter_bcj_x86 (uint8_t* data, size_t size, size_t offset) {
+  for (size_t i = 0 ; i + 5 <= size ; i++) {
+    if (data[i] != 0xE8 && data[i] != 0xE9)
+      continue;
+
+    if (data[i + 4] == 0x00 || data[i + 4] == 0xFF) {
+      int32_t rel = (int32_t) ((uint32_t) data[i + 1] | ((uint32_t) data[i + 2] << 8) | ((uint32_t) data[i + 3] << 16) | ((uint32_t) data[i + 4] << 24));
+      int64_t abs = (int64_t) rel + (int64_t) (offset + i + 5);
+      /* Wrap to [-2^24, 2^24) */
+      abs = ((abs + 0x1000000) & 0x1ffffff) - 0x1000000;
+      const uint32_t v = (uint32_t) (int32_t) abs;
+      data[i + 1] = (uint8_t) v;
+      data[i + 2] = (uint8_t) (v >> 8);
+      data[i + 3] = (uint8_t) (v >> 16);
+      data[i + 4] = (uint8_t) (v >> 24);
+    }
+    i += 4;
+  }
+}
+
+static MunitResult
+squash_test_filter_copy(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  /* The copy codec's output is the filtered data itself. */
+  if (strcmp ("copy", squash_codec_get_name (codec)) != 0)
+    return MUNIT_SKIP;
+
+  static const struct {
+    const char* spec;
+    char filter;
+    size_t param;
+  } filters[] = {
+    { "shuffle:2",  's',  2 },
+    { "shuffle:3",  's',  3 },
+    { "shuffle",    's',  4 },
+    { "shuffle:8",  's',  8 },
+    { "shuffle:16", 's', 16 },
+    { "shuffle:24", 's', 24 },
+    { "delta:4",    'd',  4 },
+    { "DELTA",      'd',  1 },
+    { "bcj-x86",    'b',  0 }
+  };
+
+  uint8_t* data = squash_test_filter_data ();
+  uint8_t* expected = malloc (SQUASH_TEST_FILTER_LENGTH);
+  uint8_t* filtered = malloc (SQUASH_TEST_FILTER_LENGTH);
+  munit_assert_non_null (expected);
+  munit_assert_non_null (filtered);
+
+  for (size_t f = 0 ; f < sizeof (filters) / sizeof (filters[0]) ; f++) {
+    memcpy (expected, data, SQUASH_TEST_FILTER_LENGTH);
+    for (size_t offset = 0 ; offset < SQUASH_TEST_FILTER_LENGTH ; offset += SQUASH_TEST_FILTER_BLOCK_SIZE) {
+      const size_t block_size = MIN(SQUASH_TEST_FILTER_LENGTH - offset, SQUASH_TEST_FILTER_BLOCK_SIZE);
+      switch (filters[f].filter) {
+        case 's':
+          squash_test_filter_shuffle (expected + offset, block_size, filters[f].param);
+          break;
+        case 'd':
+          squash_test_filter_delta (expected + offset, block_size, filters[f].param);
+          break;
+        case 'b':
+          squash_test_filter_bcj_x86 (expected + offset, block_size, offset);
+          break;
+      }
+    }
+
+    size_t filtered_length = SQUASH_TEST_FILTER_LENGTH;
+    SQUASH_ASSERT_OK(squash_codec_compress (codec, &filtered_length, filtered, SQUASH_TEST_FILTER_LENGTH, data,
+                                            "filter", filters[f].spec, NULL));
+    munit_assert_size (filtered_length, ==, SQUASH_TEST_FILTER_LENGTH);
+    munit_assert_memory_equal (SQUASH_TEST_FILTER_LENGTH, filtered, expected);
+
+    size_t decompressed_length = SQUASH_TEST_FILTER_LENGTH;
+    SQUASH_ASSERT_OK(squash_codec_decompress (codec, &decompressed_length, expected, filtered_length, filtered,
+                                              "filter", filters[f].spec, NULL));
+    munit_assert_size (decompressed_length, ==, SQUASH_TEST_FILTER_LENGTH);
+    munit_assert_memory_equal (SQUASH_TEST_FILTER_LENGTH, expected, data);
+  }
+
+  SquashOptions* options = squash_object_ref_sink (squash_options_new (codec, "filter", "shuffle:8,delta:2", NULL));
+  munit_assert_non_null (options);
+  munit_assert_string_equal (squash_options_get_string (options, NULL, "filter"), "shuffle:8,delta:2");
+  SQUASH_ASSERT_STATUS(squash_options_parse_option (options, "filter", "lz77"), SQUASH_BAD_VALUE);
+  SQUASH_ASSERT_STATUS(squash_options_parse_option (options, "filter", "shuffle:0"), SQUASH_RANGE);
+  SQUASH_ASSERT_STATUS(squash_options_parse_option (options, "filter", "delta:257"), SQUASH_RANGE);
+  SQUASH_ASSERT_STATUS(squash_options_parse_option (options, "filter", "delta:x"), SQUASH_BAD_VALUE);
+  SQUASH_ASSERT_STATUS(squash_options_parse_option (options, "filter", "bcj-x86:4"), SQUASH_BAD_VALUE);
+  SQUASH_ASSERT_STATUS(squash_options_parse_option (options, "filter", "delta,"), SQUASH_BAD_VALUE);
+  SQUASH_ASSERT_OK(squash_options_parse_option (options, "filter", ""));
+  munit_assert_null (squash_options_get_string (options, NULL, "filter"));
+  squash_object_unref (options);
+
+  free (data);
+  free (expected);
+  free (filtered);
+
+  return MUNIT_OK;
+}
+
+static void
+squash_test_filter_stream_compress (SquashCodec* codec, SquashOptions* options,
+                                    size_t* compressed_length, uint8_t* compressed,
+                                    size_t uncompressed_length, const uint8_t* uncompressed) {
+  SquashStream* stream = squash_stream_new_with_options (codec, SQUASH_STREAM_COMPRESS, options);
+  munit_assert_non_null (stream);
+  SquashStatus res;
+
+  stream->next_out = compressed;
+  while (stream->total_in < uncompressed_length) {
+    stream->next_in = uncompressed + stream->total_in;
+    stream->avail_in = MIN(uncompressed_length - stream->total_in, 7919);
+    do {
+      stream->avail_out = MIN(*compressed_length - stream->total_out, 4096);
+      res = squash_stream_process (stream);
+      SQUASH_ASSERT_NO_ERROR(res);
+    } while (res == SQUASH_PROCESSING);
+  }
+
+  do {
+    stream->avail_out = MIN(*compressed_length - stream->total_out, 4096);
+    res = squash_stream_finish (stream);
+    SQUASH_ASSERT_NO_ERROR(res);
+  } while (res == SQUASH_PROCESSING);
+
+  *compressed_length = stream->total_out;
+  squash_object_unref (stream);
+}
+
+static void
+squash_test_filter_stream_decompress (SquashCodec* codec, SquashOptions* options,
+                                      size_t* decompressed_length, uint8_t* decompressed,
+                                      size_t compressed_length, const uint8_t* compressed) {
+  SquashStream* stream = squash_stream_new_with_options (codec, SQUASH_STREAM_DECOMPRESS, options);
+  munit_assert_non_null (stream);
+  SquashStatus res = SQUASH_OK;
+
+  stream->next_in = compressed;
+  stream->avail_in = compressed_length;
+  stream->next_out = decompressed;
+  do {
+    stream->avail_out = MIN(*decompressed_length - stream->total_out, 1021);
+    res = squash_stream_process (stream);
+    SQUASH_ASSERT_NO_ERROR(res);
+  } while (res == SQUASH_PROCESSING);
+
+  while (res == SQUASH_OK) {
+    stream->avail_out = MIN(*decompressed_length - stream->total_out, 1021);
+    res = squash_stream_finish (stream);
+    SQUASH_ASSERT_NO_ERROR(res);
+    if (res == SQUASH_OK)
+      break;
+    res = SQUASH_OK;
+  }
+
+  *decompressed_length = stream->total_out;
+  squash_object_unref (stream);
+}
+
+static MunitResult
+squash_test_filter_codec(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  uint8_t* data = squash_test_filter_data ();
+  const size_t max_compressed_length = squash_codec_get_max_compressed_size (codec, SQUASH_TEST_FILTER_LENGTH);
+  uint8_t* compressed = malloc (max_compressed_length);
+  uint8_t* decompressed = malloc (SQUASH_TEST_FILTER_LENGTH);
+  munit_assert_non_null (compressed);
+  munit_assert_non_null (decompressed);
+
+  SquashOptions* options = squash_object_ref_sink (squash_options_new (codec, "filter", "bcj-x86,shuffle:4,delta:1", NULL));
+  munit_assert_non_null (options);
+
+  /* Buffer to buffer */
+  size_t compressed_length = max_compressed_length;
+  SQUASH_ASSERT_OK(squash_codec_compress_with_options (codec, &compressed_length, compressed, SQUASH_TEST_FILTER_LENGTH, data, options));
+
+  size_t decompressed_length = SQUASH_TEST_FILTER_LENGTH;
+  SQUASH_ASSERT_OK(squash_codec_decompress_with_options (codec, &decompressed_length, decompressed, compressed_length, compressed, options));
+  munit_assert_size (decompressed_length, ==, SQUASH_TEST_FILTER_LENGTH);
+  munit_assert_memory_equal (SQUASH_TEST_FILTER_LENGTH, decompressed, data);
+
+  /* Without the filter the data comes back different */
+  if (strcmp ("copy", squash_codec_get_name (codec)) == 0) {
+    decompressed_length = SQUASH_TEST_FILTER_LENGTH;
+    SQUASH_ASSERT_OK(squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL));
+    munit_assert_memory_not_equal (SQUASH_TEST_FILTER_LENGTH, decompressed, data);
+  }
+
+  /* Buffer to stream */
+  memset (decompressed, 0, SQUASH_TEST_FILTER_LENGTH);
+  decompressed_length = SQUASH_TEST_FILTER_LENGTH;
+  squash_test_filter_stream_decompress (codec, options, &decompressed_length, decompressed, compressed_length, compressed);
+  munit_assert_size (decompressed_length, ==, SQUASH_TEST_FILTER_LENGTH);
+  munit_assert_memory_equal (SQUASH_TEST_FILTER_LENGTH, decompressed, data);
+
+  /* Filters need whole blocks, so filtered streams can't be flushed */
+  SquashStream* stream = squash_stream_new_with_options (codec, SQUASH_STREAM_COMPRESS, options);
+  munit_assert_non_null (stream);
+  munit_assert_int (squash_stream_get_info (stream) & SQUASH_CODEC_INFO_CAN_FLUSH, ==, 0);
+  SQUASH_ASSERT_STATUS(squash_stream_flush (stream), SQUASH_INVALID_OPERATION);
+  squash_object_unref (stream);
+
+  stream = squash_stream_new (codec, SQUASH_STREAM_COMPRESS, NULL);
+  munit_assert_non_null (stream);
+  munit_assert_int (squash_stream_get_info (stream), ==, squash_codec_get_info (codec));
+  squash_object_unref (stream);
+
+  /* Stream to buffer */
+  compressed_length = max_compressed_length;
+  squash_test_filter_stream_compress (codec, options, &compressed_length, compressed, SQUASH_TEST_FILTER_LENGTH, data);
+
+  memset (decompressed, 0, SQUASH_TEST_FILTER_LENGTH);
+  decompressed_length = SQUASH_TEST_FILTER_LENGTH;
+  SQUASH_ASSERT_OK(squash_codec_decompress_with_options (codec, &decompressed_length, decompressed, compressed_length, compressed, options));
+  munit_assert_size (decompressed_length, ==, SQUASH_TEST_FILTER_LENGTH);
+  munit_assert_memory_equal (SQUASH_TEST_FILTER_LENGTH, decompressed, data);
+
+  squash_object_unref (options);
+  free (data);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+MunitTest squash_filter_tests[] = {
+  { (char*) "/copy", squash_test_filter_copy, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/codec", squash_test_filter_codec, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_filter = {
+  (char*) "/filter",
+  squash_filter_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
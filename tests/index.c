@@ -0,0 +1,98 @@
+#include "test-squash.h"
+
+#define SQUASH_TEST_INDEX_LENGTH ((size_t) 1024 * 1024)
+#define SQUASH_TEST_INDEX_SPAN ((size_t) 64 * 1024)
+
+static MunitResult
+squash_test_index_extract(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+  const bool gzip = strcmp ("gzip", squash_codec_get_name (codec)) == 0;
+
+  FILE* compressed = tmpfile ();
+  FILE* index = tmpfile ();
+  munit_assert_non_null(compressed);
+  munit_assert_non_null(index);
+
+  /* Half text, half noise, so there are both long and short deflate
+     blocks. */
+  const size_t member_length = SQUASH_TEST_INDEX_LENGTH;
+  uint8_t* data = malloc (member_length * 2);
+  munit_assert_non_null(data);
+  for (size_t i = 0 ; i < member_length / 2 ; i++)
+    data[i] = (LOREM_IPSUM)[i % LOREM_IPSUM_LENGTH];
+  munit_rand_memory (member_length - (member_length / 2), data + (member_length / 2));
+
+  size_t compressed_length = squash_codec_get_max_compressed_size (codec, member_length);
+  uint8_t* buf = malloc (compressed_length);
+  munit_assert_non_null(buf);
+  SQUASH_ASSERT_OK(squash_codec_compress (codec, &compressed_length, buf, member_length, data, NULL));
+
+  /* Offsets in the index are absolute, so don't start at 0. */
+  const uint8_t prefix[7] = { 0, };
+  munit_assert_size(fwrite (prefix, 1, sizeof (prefix), compressed), ==, sizeof (prefix));
+  munit_assert_size(fwrite (buf, 1, compressed_length, compressed), ==, compressed_length);
+
+  /* gzip files may have several members. */
+  size_t data_length = member_length;
+  if (gzip) {
+    memcpy (data + member_length, data, member_length);
+    munit_assert_size(fwrite (buf, 1, compressed_length, compressed), ==, compressed_length);
+    data_length *= 2;
+  }
+
+  munit_assert_int(fseek (compressed, sizeof (prefix), SEEK_SET), ==, 0);
+  SquashStatus res = squash_index_build (codec, index, compressed, SQUASH_TEST_INDEX_SPAN, NULL);
+  MunitResult result = MUNIT_OK;
+  if (res == SQUASH_INVALID_OPERATION) {
+    result = MUNIT_SKIP;
+    goto cleanup;
+  }
+  SQUASH_ASSERT_OK(res);
+
+  uint8_t* range = malloc (SQUASH_TEST_INDEX_SPAN * 2);
+  munit_assert_non_null(range);
+
+  for (int i = 0 ; i < 16 ; i++) {
+    const size_t offset = (size_t) munit_rand_int_range (0, (int) data_length - 1);
+    size_t range_length = (size_t) munit_rand_int_range (1, SQUASH_TEST_INDEX_SPAN * 2);
+
+    SQUASH_ASSERT_OK(squash_index_extract (codec, index, compressed, offset, &range_length, range, NULL));
+    munit_assert_size(range_length, ==, MIN(data_length - offset, range_length));
+    munit_assert_memory_equal(range_length, range, data + offset);
+  }
+
+  /* Reading past the end is truncated, starting past the end is an
+     error. */
+  size_t range_length = 1024;
+  SQUASH_ASSERT_OK(squash_index_extract (codec, index, compressed, data_length - 10, &range_length, range, NULL));
+  munit_assert_size(range_length, ==, 10);
+  munit_assert_memory_equal(range_length, range, data + data_length - 10);
+
+  range_length = 1024;
+  SQUASH_ASSERT_STATUS(squash_index_extract (codec, index, compressed, data_length + 1, &range_length, range, NULL), SQUASH_RANGE);
+
+  free (range);
+
+ cleanup:
+
+  free (buf);
+  free (data);
+  fclose (index);
+  fclose (compressed);
+
+  return result;
+}
+
+MunitTest squash_index_tests[] = {
+  { (char*) "/extract", squash_test_index_extract, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_index = {
+  (char*) "/index",
+  squash_index_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
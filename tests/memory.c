@@ -0,0 +1,108 @@
+#include "test-squash.h"
+
+static MunitResult
+squash_test_memory_limit(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  SquashMemoryUsage usage;
+
+  squash_get_memory_usage (&usage);
+  munit_assert_cmp_size(usage.limit, ==, 0);
+  munit_assert_cmp_size(usage.peak, >=, usage.current);
+
+  squash_set_memory_limit (usage.current + (1024 * 1024));
+
+  munit_assert_null(squash_malloc (2 * 1024 * 1024));
+
+  uint8_t* ptr = squash_malloc (512 * 1024);
+  munit_assert_non_null(ptr);
+  munit_assert_null(squash_realloc (ptr, 2 * 1024 * 1024));
+  ptr = squash_realloc (ptr, 768 * 1024);
+  munit_assert_non_null(ptr);
+
+  SquashMemoryUsage during;
+  squash_get_memory_usage (&during);
+  munit_assert_cmp_size(during.current, ==, usage.current + (768 * 1024));
+  munit_assert_cmp_size(during.peak, >=, during.current);
+
+  squash_free (ptr);
+
+  void* aligned = squash_aligned_alloc (64, 4096);
+  munit_assert_non_null(aligned);
+  munit_assert_cmp_size(((uintptr_t) aligned) % 64, ==, 0);
+  squash_aligned_free (aligned);
+
+  squash_get_memory_usage (&during);
+  munit_assert_cmp_size(during.current, ==, usage.current);
+
+  squash_set_memory_limit (0);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_memory_operation(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  SquashMemoryUsage usage;
+
+  SQUASH_ASSERT_OK(squash_memory_operation_begin (64 * 1024));
+  SQUASH_ASSERT_STATUS(squash_memory_operation_begin (0), SQUASH_STATE);
+
+  uint8_t* a = squash_malloc (32 * 1024);
+  munit_assert_non_null(a);
+  munit_assert_null(squash_malloc (48 * 1024));
+  uint8_t* b = squash_calloc (16, 1024);
+  munit_assert_non_null(b);
+  squash_free (a);
+
+  /* Memory allocated during the operation may outlive it. */
+  SQUASH_ASSERT_OK(squash_memory_operation_end (&usage));
+  munit_assert_cmp_size(usage.current, ==, 16 * 1024);
+  munit_assert_cmp_size(usage.peak, ==, 48 * 1024);
+  munit_assert_cmp_size(usage.limit, ==, 64 * 1024);
+  squash_free (b);
+
+  SQUASH_ASSERT_STATUS(squash_memory_operation_end (NULL), SQUASH_STATE);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_memory_codec(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+  SquashMemoryUsage usage;
+
+  size_t compressed_length = squash_codec_get_max_compressed_size (codec, LOREM_IPSUM_LENGTH);
+  uint8_t* compressed = munit_malloc (compressed_length);
+
+  SQUASH_ASSERT_OK(squash_memory_operation_begin (0));
+  SquashStream* stream = squash_codec_create_stream (codec, SQUASH_STREAM_COMPRESS, NULL);
+  munit_assert_non_null(stream);
+  stream->next_in = LOREM_IPSUM;
+  stream->avail_in = LOREM_IPSUM_LENGTH;
+  stream->next_out = compressed;
+  stream->avail_out = compressed_length;
+  SQUASH_ASSERT_NO_ERROR(squash_stream_finish (stream));
+  squash_object_unref (stream);
+  SQUASH_ASSERT_OK(squash_memory_operation_end (&usage));
+
+  /* At the very least the stream itself was charged. */
+  munit_assert_cmp_size(usage.peak, >=, sizeof (SquashStream));
+
+  free (compressed);
+
+  return MUNIT_OK;
+}
+
+static MunitTest squash_memory_tests[] = {
+  { (char*) "/limit", squash_test_memory_limit, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+  { (char*) "/operation", squash_test_memory_operation, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+  { (char*) "/codec", squash_test_memory_codec, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_memory = {
+  (char*) "/memory",
+  squash_memory_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
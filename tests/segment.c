@@ -0,0 +1,61 @@
+#include "test-squash.h"
+
+#include <limits.h>
+
+/* Just over INT_MAX, so the input has to be split. */
+#define SQUASH_TEST_SEGMENT_LENGTH (((size_t) INT_MAX) + (((size_t) 1) << 27))
+
+static MunitResult
+squash_test_segment_large(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  if ((squash_codec_get_info (codec) & SQUASH_CODEC_INFO_SEGMENTED) == 0)
+    return MUNIT_SKIP;
+  /* Needs several GiB of memory, so it's opt-in. */
+  if (SIZE_MAX <= SQUASH_TEST_SEGMENT_LENGTH || getenv ("SQUASH_TEST_LARGE") == NULL)
+    return MUNIT_SKIP;
+
+  const size_t uncompressed_length = SQUASH_TEST_SEGMENT_LENGTH;
+  uint8_t* uncompressed = calloc (uncompressed_length, 1);
+  munit_assert_non_null(uncompressed);
+  for (size_t i = 0 ; i < uncompressed_length ; i += (((size_t) 1) << 20))
+    memcpy (uncompressed + i, LOREM_IPSUM, MIN(LOREM_IPSUM_LENGTH, uncompressed_length - i));
+
+  size_t compressed_length = squash_codec_get_max_compressed_size (codec, uncompressed_length);
+  munit_assert_size(compressed_length, >, uncompressed_length);
+  uint8_t* compressed = malloc (compressed_length);
+  munit_assert_non_null(compressed);
+
+  SQUASH_ASSERT_OK(squash_codec_compress (codec, &compressed_length, compressed, uncompressed_length, uncompressed, NULL));
+
+  if ((squash_codec_get_info (codec) & SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE) != 0)
+    munit_assert_size(squash_codec_get_uncompressed_size (codec, compressed_length, compressed), ==, uncompressed_length);
+
+  size_t decompressed_length = uncompressed_length;
+  uint8_t* decompressed = malloc (decompressed_length);
+  munit_assert_non_null(decompressed);
+
+  SQUASH_ASSERT_OK(squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL));
+  munit_assert_size(decompressed_length, ==, uncompressed_length);
+  munit_assert_memory_equal(uncompressed_length, decompressed, uncompressed);
+
+  free (uncompressed);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+static MunitTest squash_segment_tests[] = {
+  { (char*) "/large", squash_test_segment_large, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_segment = {
+  (char*) "/segment",
+  squash_segment_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
@@ -0,0 +1,140 @@
+#include "test-squash.h"
+
+#include "../squash/tinycthread/source/tinycthread.h"
+
+static const SquashCodecStats*
+squash_test_stats_find (const SquashStats* stats, SquashCodec* codec) {
+  for (size_t i = 0 ; i < stats->n_codecs ; i++)
+    if (stats->codecs[i].codec == codec)
+      return &(stats->codecs[i]);
+  return NULL;
+}
+
+static uint64_t
+squash_test_stats_calls (SquashCodec* codec, SquashStatsOperation operation) {
+  SquashStats* stats = squash_stats_snapshot ();
+  munit_assert_non_null(stats);
+  const SquashCodecStats* cs = squash_test_stats_find (stats, codec);
+  const uint64_t res = (cs != NULL) ? cs->operations[operation].calls : 0;
+  squash_stats_free (stats);
+  return res;
+}
+
+static MunitResult
+squash_test_stats_buffer(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  size_t compressed_length = squash_codec_get_max_compressed_size (codec, LOREM_IPSUM_LENGTH);
+  uint8_t* compressed = munit_malloc (compressed_length);
+  size_t decompressed_length = LOREM_IPSUM_LENGTH;
+  uint8_t* decompressed = munit_malloc (decompressed_length);
+
+  SquashStats* before = squash_stats_snapshot ();
+  munit_assert_non_null(before);
+  const SquashCodecStats* cb = squash_test_stats_find (before, codec);
+  SquashCodecStats zero = { codec, };
+  if (cb == NULL)
+    cb = &zero;
+
+  squash_stats_set_enabled (true);
+  munit_assert_true(squash_stats_get_enabled ());
+  SQUASH_ASSERT_OK(squash_codec_compress (codec, &compressed_length, compressed, LOREM_IPSUM_LENGTH, LOREM_IPSUM, NULL));
+  SQUASH_ASSERT_OK(squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL));
+  squash_stats_set_enabled (false);
+
+  SquashStats* after = squash_stats_snapshot ();
+  munit_assert_non_null(after);
+  const SquashCodecStats* ca = squash_test_stats_find (after, codec);
+  munit_assert_non_null(ca);
+
+  const SquashStatsCounters* c = &(ca->operations[SQUASH_STATS_BUFFER_COMPRESS]);
+  const SquashStatsCounters* cp = &(cb->operations[SQUASH_STATS_BUFFER_COMPRESS]);
+  munit_assert_cmp_uint64(c->calls - cp->calls, ==, 1);
+  munit_assert_cmp_uint64(c->bytes_in - cp->bytes_in, ==, LOREM_IPSUM_LENGTH);
+  munit_assert_cmp_uint64(c->bytes_out - cp->bytes_out, ==, compressed_length);
+
+  uint64_t histogram_total = 0;
+  for (size_t i = 0 ; i < SQUASH_STATS_HISTOGRAM_BUCKETS ; i++)
+    histogram_total += c->histogram[i] - cp->histogram[i];
+  munit_assert_cmp_uint64(histogram_total, ==, 1);
+
+  const SquashStatsCounters* d = &(ca->operations[SQUASH_STATS_BUFFER_DECOMPRESS]);
+  const SquashStatsCounters* dp = &(cb->operations[SQUASH_STATS_BUFFER_DECOMPRESS]);
+  munit_assert_cmp_uint64(d->calls - dp->calls, ==, 1);
+  munit_assert_cmp_uint64(d->bytes_in - dp->bytes_in, ==, compressed_length);
+  munit_assert_cmp_uint64(d->bytes_out - dp->bytes_out, ==, LOREM_IPSUM_LENGTH);
+
+  squash_stats_free (before);
+  squash_stats_free (after);
+
+  /* Nothing is recorded while disabled. */
+  const uint64_t calls = squash_test_stats_calls (codec, SQUASH_STATS_BUFFER_COMPRESS);
+  compressed_length = squash_codec_get_max_compressed_size (codec, LOREM_IPSUM_LENGTH);
+  SQUASH_ASSERT_OK(squash_codec_compress (codec, &compressed_length, compressed, LOREM_IPSUM_LENGTH, LOREM_IPSUM, NULL));
+  munit_assert_cmp_uint64(squash_test_stats_calls (codec, SQUASH_STATS_BUFFER_COMPRESS), ==, calls);
+
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+static int
+squash_test_stats_thread_func (void* user_data) {
+  SquashCodec* codec = (SquashCodec*) user_data;
+  SquashStream* stream = squash_codec_create_stream (codec, SQUASH_STREAM_COMPRESS, NULL);
+  uint8_t buf[4096];
+
+  if (stream == NULL)
+    return 1;
+
+  stream->next_in = LOREM_IPSUM;
+  stream->avail_in = LOREM_IPSUM_LENGTH;
+  do {
+    stream->next_out = buf;
+    stream->avail_out = sizeof (buf);
+  } while (squash_stream_finish (stream) == SQUASH_PROCESSING);
+
+  squash_object_unref (stream);
+
+  return 0;
+}
+
+static MunitResult
+squash_test_stats_threads(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+  thrd_t threads[4];
+  int thread_res;
+
+  const uint64_t calls = squash_test_stats_calls (codec, SQUASH_STATS_STREAM_COMPRESS);
+
+  squash_stats_set_enabled (true);
+  for (size_t i = 0 ; i < 4 ; i++)
+    munit_assert_int(thrd_create (&(threads[i]), squash_test_stats_thread_func, codec), ==, thrd_success);
+  for (size_t i = 0 ; i < 4 ; i++) {
+    thrd_join (threads[i], &thread_res);
+    munit_assert_int(thread_res, ==, 0);
+  }
+  squash_stats_set_enabled (false);
+
+  /* The threads have exited, so their counters must have been kept. */
+  munit_assert_cmp_uint64(squash_test_stats_calls (codec, SQUASH_STATS_STREAM_COMPRESS), >=, calls + 4);
+
+  return MUNIT_OK;
+}
+
+static MunitTest squash_stats_tests[] = {
+  { (char*) "/buffer", squash_test_stats_buffer, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/threads", squash_test_stats_threads, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_stats = {
+  (char*) "/stats",
+  squash_stats_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
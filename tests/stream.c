@@ -223,10 +223,310 @@ squash_test_stream_single_byte(MUNIT_UNUSED const MunitParameter params[], void*
   return MUNIT_OK;
 }
 
+static SquashStatus
+squash_test_stream_finish_all (SquashStream* stream,
+                               size_t output_length, uint8_t output[SQUASH_ARRAY_PARAM(output_length)],
+                               size_t input_length, const uint8_t input[SQUASH_ARRAY_PARAM(input_length)]) {
+  SquashStatus res;
+
+  stream->next_in = input;
+  stream->avail_in = input_length;
+  stream->next_out = output;
+  stream->avail_out = output_length;
+
+  do {
+    res = squash_stream_finish (stream);
+  } while (res == SQUASH_PROCESSING);
+
+  return (res == SQUASH_END_OF_STREAM) ? SQUASH_OK : res;
+}
+
+static MunitResult
+squash_test_stream_reset(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+  const size_t message_length = 200;
+  const size_t compressed_length = squash_codec_get_max_compressed_size (codec, message_length);
+  uint8_t* compressed = munit_malloc (compressed_length);
+  uint8_t* decompressed = munit_malloc (message_length);
+  SquashStatus res;
+
+  SquashStream* compress = squash_codec_create_stream (codec, SQUASH_STREAM_COMPRESS, NULL);
+  SquashStream* decompress = squash_codec_create_stream (codec, SQUASH_STREAM_DECOMPRESS, NULL);
+  munit_assert_non_null (compress);
+  munit_assert_non_null (decompress);
+
+  res = squash_stream_reset (compress);
+  if (res == SQUASH_INVALID_OPERATION) {
+    squash_object_unref (compress);
+    squash_object_unref (decompress);
+    free (compressed);
+    free (decompressed);
+    return MUNIT_SKIP;
+  }
+  SQUASH_ASSERT_OK(res);
+
+  for (size_t i = 0 ; i < 4 ; i++) {
+    const uint8_t* message = (const uint8_t*) (LOREM_IPSUM) + (i * 317);
+
+    /* Abandon part of a message to make sure it is discarded. */
+    if (i == 2) {
+      compress->next_in = (const uint8_t*) LOREM_IPSUM;
+      compress->avail_in = message_length;
+      compress->next_out = compressed;
+      compress->avail_out = compressed_length;
+      do {
+        res = squash_stream_process (compress);
+      } while (res == SQUASH_PROCESSING);
+      SQUASH_ASSERT_OK(res);
+      SQUASH_ASSERT_OK(squash_stream_reset (compress));
+    }
+
+    res = squash_test_stream_finish_all (compress, compressed_length, compressed, message_length, message);
+    SQUASH_ASSERT_OK(res);
+    munit_assert_size (compress->total_in, ==, message_length);
+
+    res = squash_test_stream_finish_all (decompress, message_length, decompressed, compress->total_out, compressed);
+    SQUASH_ASSERT_OK(res);
+    munit_assert_size (decompress->total_out, ==, message_length);
+    munit_assert_memory_equal (message_length, decompressed, message);
+
+    SQUASH_ASSERT_OK(squash_stream_reset (compress));
+    SQUASH_ASSERT_OK(squash_stream_reset (decompress));
+    munit_assert_size (compress->total_in, ==, 0);
+    munit_assert_size (decompress->total_out, ==, 0);
+  }
+
+  squash_object_unref (compress);
+  squash_object_unref (decompress);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+/* Compress input[start, end) into output, which must have room for
+   all of it, and flush (or finish, if end is the end of the input)
+   so the stream can be checkpointed. */
+static SquashStatus
+squash_test_stream_checkpoint_run (SquashStream* stream, uint8_t* output, size_t input_length, const uint8_t* input, size_t end) {
+  SquashStatus res;
+
+  munit_assert_size (stream->total_in, <=, end);
+
+  stream->next_in = input + stream->total_in;
+  stream->avail_in = end - stream->total_in;
+  stream->next_out = output + stream->total_out;
+  stream->avail_out = (input_length * 2) + 1024 - stream->total_out;
+
+  do {
+    res = (end == input_length) ? squash_stream_finish (stream) : squash_stream_flush (stream);
+  } while (res == SQUASH_PROCESSING);
+
+  return res;
+}
+
+static SquashStream*
+squash_test_stream_checkpoint_restore (SquashCodec* codec, size_t checkpoint_size, const uint8_t* checkpoint) {
+  SquashStream* stream = (strcmp ("lz4", squash_codec_get_name (codec)) == 0) ?
+    squash_codec_create_stream (codec, SQUASH_STREAM_COMPRESS, "threads", "2", NULL) :
+    squash_codec_create_stream (codec, SQUASH_STREAM_COMPRESS, NULL);
+  munit_assert_non_null (stream);
+
+  if (checkpoint != NULL)
+    SQUASH_ASSERT_OK(squash_stream_restore (stream, checkpoint_size, checkpoint));
+
+  return stream;
+}
+
+static MunitResult
+squash_test_stream_checkpoint(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_non_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+  const uint8_t* input = (const uint8_t*) LOREM_IPSUM;
+  const size_t input_length = LOREM_IPSUM_LENGTH;
+  uint8_t* compressed = munit_malloc ((input_length * 2) + 1024);
+  uint8_t* decompressed = munit_malloc (input_length);
+  uint8_t* checkpoint = NULL;
+  size_t checkpoint_size = 0;
+  SquashStatus res;
+
+  if ((squash_codec_get_info (codec) & SQUASH_CODEC_INFO_CAN_FLUSH) == 0) {
+    free (compressed);
+    free (decompressed);
+    return MUNIT_SKIP;
+  }
+
+  /* Checkpoint at a third and two thirds of the way through, each
+     time throwing away the stream (and some work done after the
+     checkpoint) and continuing in a new one. */
+  SquashStream* stream = squash_test_stream_checkpoint_restore (codec, 0, NULL);
+  for (size_t i = 1 ; i <= 2 ; i++) {
+    const size_t offset = (input_length * i) / 3;
+
+    SQUASH_ASSERT_OK(squash_test_stream_checkpoint_run (stream, compressed, input_length, input, offset));
+
+    checkpoint_size = 0;
+    res = squash_stream_checkpoint (stream, &checkpoint_size, NULL);
+    if (res == SQUASH_INVALID_OPERATION) {
+      squash_object_unref (stream);
+      free (compressed);
+      free (decompressed);
+      return MUNIT_SKIP;
+    }
+    SQUASH_ASSERT_STATUS(res, SQUASH_BUFFER_FULL);
+
+    checkpoint = realloc (checkpoint, checkpoint_size);
+    munit_assert_non_null (checkpoint);
+    SQUASH_ASSERT_OK(squash_stream_checkpoint (stream, &checkpoint_size, checkpoint));
+
+    const size_t total_out = stream->total_out;
+
+    /* Input which has only been processed may still be buffered inside
+       the codec, so it can't be checkpointed until it is flushed. */
+    stream->next_in = input + stream->total_in;
+    stream->avail_in = 10;
+    stream->next_out = compressed + stream->total_out;
+    stream->avail_out = (input_length * 2) + 1024 - stream->total_out;
+    res = squash_stream_process (stream);
+    munit_assert_true (res == SQUASH_OK || res == SQUASH_PROCESSING);
+    size_t unflushed_size = 0;
+    SQUASH_ASSERT_STATUS(squash_stream_checkpoint (stream, &unflushed_size, NULL), SQUASH_STATE);
+
+    squash_test_stream_checkpoint_run (stream, compressed, input_length, input, offset + 100);
+    squash_object_unref (stream);
+
+    stream = squash_test_stream_checkpoint_restore (codec, checkpoint_size, checkpoint);
+    munit_assert_size (stream->total_in, ==, offset);
+    munit_assert_size (stream->total_out, ==, total_out);
+  }
+
+  /* Write the rest, then finish separately without any input, the
+     way a caller which has already written everything would. */
+  stream->next_in = input + stream->total_in;
+  stream->avail_in = input_length - stream->total_in;
+  stream->next_out = compressed + stream->total_out;
+  stream->avail_out = (input_length * 2) + 1024 - stream->total_out;
+  do {
+    res = squash_stream_process (stream);
+  } while (res == SQUASH_PROCESSING);
+  SQUASH_ASSERT_OK(res);
+
+  stream->next_in = NULL;
+  stream->avail_in = 0;
+  do {
+    res = squash_stream_finish (stream);
+  } while (res == SQUASH_PROCESSING);
+  SQUASH_ASSERT_OK(res);
+
+  size_t decompressed_length = input_length;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, stream->total_out, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, input_length);
+  munit_assert_memory_equal (input_length, decompressed, input);
+
+  /* A checkpoint only fits a fresh stream of the same type. */
+  SQUASH_ASSERT_STATUS(squash_stream_restore (stream, checkpoint_size, checkpoint), SQUASH_STATE);
+  squash_object_unref (stream);
+
+  stream = squash_codec_create_stream (codec, SQUASH_STREAM_DECOMPRESS, NULL);
+  munit_assert_non_null (stream);
+  res = squash_stream_restore (stream, checkpoint_size, checkpoint);
+  munit_assert_true (res == SQUASH_INVALID_BUFFER || res == SQUASH_INVALID_OPERATION);
+  squash_object_unref (stream);
+
+  free (checkpoint);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_stream_lz4_threads(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  SquashCodec* codec = squash_get_codec ("lz4");
+  if (codec == NULL)
+    return MUNIT_SKIP;
+
+  /* Make sure blocks really are compressed concurrently. */
+  const unsigned int max_threads = squash_get_max_threads ();
+  squash_set_max_threads (4);
+
+  /* Several 64 KiB blocks and a partial one, half of them
+     incompressible so both block encodings are used. */
+  const size_t data_length = (5 * 64 * 1024) + 1234;
+  uint8_t* data = (uint8_t*) malloc (data_length);
+  munit_assert_non_null(data);
+  for (size_t i = 0 ; i < data_length / 2 ; i++)
+    data[i] = (LOREM_IPSUM)[i % LOREM_IPSUM_LENGTH];
+  munit_rand_memory (data_length - (data_length / 2), data + (data_length / 2));
+
+  const size_t max_compressed_length = squash_codec_get_max_compressed_size (codec, data_length);
+  uint8_t* reference = (uint8_t*) malloc (max_compressed_length);
+  uint8_t* compressed = (uint8_t*) malloc (max_compressed_length);
+  uint8_t* decompressed = (uint8_t*) malloc (data_length);
+  munit_assert_non_null(reference);
+  munit_assert_non_null(compressed);
+  munit_assert_non_null(decompressed);
+
+  size_t reference_length = max_compressed_length;
+  SquashStatus res = squash_codec_compress (codec, &reference_length, reference, data_length, data,
+                                            "threads", "0", "checksum", "true", NULL);
+  SQUASH_ASSERT_OK(res);
+
+  /* Feed the stream in odd-sized pieces; block boundaries don't
+     depend on how the input arrives or how many blocks are batched
+     together, so the output must match. */
+  SquashStream* stream = squash_codec_create_stream (codec, SQUASH_STREAM_COMPRESS,
+                                                     "threads", "3", "checksum", "true", NULL);
+  munit_assert_non_null(stream);
+  size_t compressed_length = 0;
+  size_t data_pos = 0;
+  do {
+    const size_t in_step = ((data_length - data_pos) < 40000) ? (data_length - data_pos) : 40000;
+    stream->next_in = data + data_pos;
+    stream->avail_in = in_step;
+    stream->next_out = compressed + compressed_length;
+    stream->avail_out = ((max_compressed_length - compressed_length) < 1000) ? (max_compressed_length - compressed_length) : 1000;
+    const size_t avail_out = stream->avail_out;
+
+    if (data_pos + in_step == data_length)
+      res = squash_stream_finish (stream);
+    else
+      res = squash_stream_process (stream);
+    munit_assert_true(res == SQUASH_OK || res == SQUASH_PROCESSING);
+
+    data_pos += in_step - stream->avail_in;
+    compressed_length += avail_out - stream->avail_out;
+  } while (data_pos != data_length || res == SQUASH_PROCESSING);
+  squash_object_unref (stream);
+
+  munit_assert_size(compressed_length, ==, reference_length);
+  munit_assert_memory_equal(compressed_length, compressed, reference);
+
+  size_t decompressed_length = data_length;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size(decompressed_length, ==, data_length);
+  munit_assert_memory_equal(data_length, decompressed, data);
+
+  squash_set_max_threads (max_threads);
+
+  free (data);
+  free (reference);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
 MunitTest squash_stream_tests[] = {
   { (char*) "/compress", squash_test_stream_compress, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   { (char*) "/decompress", squash_test_stream_decompress, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   { (char*) "/single-byte", squash_test_stream_single_byte, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/reset", squash_test_stream_reset, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/checkpoint", squash_test_stream_checkpoint, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/lz4-threads", squash_test_stream_lz4_threads, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
   { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
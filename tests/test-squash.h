@@ -9,12 +9,21 @@ void* squash_test_get_codec(MUNIT_UNUSED const MunitParameter params[], void* us
 
 #define SQUASH_CODEC_PARAMETER ((MunitParameterEnum*)(uintptr_t) 0xdeadbeef)
 
+MunitSuite squash_test_suite_arena;
 MunitSuite squash_test_suite_buffer;
 MunitSuite squash_test_suite_bounds;
+MunitSuite squash_test_suite_chain;
+MunitSuite squash_test_suite_context;
+MunitSuite squash_test_suite_dedup;
 MunitSuite squash_test_suite_file;
+MunitSuite squash_test_suite_filter;
 MunitSuite squash_test_suite_flush;
+MunitSuite squash_test_suite_index;
+MunitSuite squash_test_suite_memory;
 MunitSuite squash_test_suite_random;
+MunitSuite squash_test_suite_segment;
 MunitSuite squash_test_suite_splice;
+MunitSuite squash_test_suite_stats;
 MunitSuite squash_test_suite_stream;
 MunitSuite squash_test_suite_threads;
 
@@ -93,12 +93,21 @@ squash_suite_set_params (MunitSuite* suite) {
 int
 main(int argc, char* const argv[MUNIT_ARRAY_PARAM(argc + 1)]) {
   MunitSuite test_suites[] = {
+    squash_test_suite_arena,
     squash_test_suite_buffer,
     squash_test_suite_bounds,
+    squash_test_suite_chain,
+    squash_test_suite_context,
+    squash_test_suite_dedup,
     squash_test_suite_file,
+    squash_test_suite_filter,
     squash_test_suite_flush,
+    squash_test_suite_index,
+    squash_test_suite_memory,
     squash_test_suite_random,
+    squash_test_suite_segment,
     squash_test_suite_splice,
+    squash_test_suite_stats,
     squash_test_suite_stream,
     squash_test_suite_threads,
     { NULL, NULL, 0, 0 }
@@ -119,6 +128,7 @@ main(int argc, char* const argv[MUNIT_ARRAY_PARAM(argc + 1)]) {
   };
 
   squash_set_memory_functions (memfns);
+  squash_set_memory_limit (0);
 
   if (getenv ("SQUASH_PLUGINS") == NULL) {
 #if !defined(_WIN32)
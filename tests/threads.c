@@ -98,8 +98,51 @@ squash_test_threads_buffer(MUNIT_UNUSED const MunitParameter params[], void* use
   return MUNIT_OK;
 }
 
+#define SQUASH_TEST_PARALLEL_N 4096
+
+static SquashStatus
+squash_test_parallel_for_func (size_t index, void* user_data) {
+  uint8_t* hits = (uint8_t*) user_data;
+
+  hits[index]++;
+
+  return (index == SQUASH_TEST_PARALLEL_N) ? SQUASH_FAILED : SQUASH_OK;
+}
+
+static MunitResult
+squash_test_threads_parallel_for(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  const unsigned int max_threads = squash_get_max_threads ();
+  uint8_t* hits = munit_newa(uint8_t, SQUASH_TEST_PARALLEL_N + 1);
+
+  squash_set_max_threads (4);
+  munit_assert_uint(squash_get_max_threads (), ==, 4);
+
+  /* Every index is processed exactly once. */
+  SQUASH_ASSERT_OK(squash_parallel_for (0, SQUASH_TEST_PARALLEL_N, squash_test_parallel_for_func, hits));
+  for (size_t i = 0 ; i < SQUASH_TEST_PARALLEL_N ; i++)
+    munit_assert_uint(hits[i], ==, 1);
+
+  /* Errors are propagated. */
+  SQUASH_ASSERT_STATUS(squash_parallel_for (0, SQUASH_TEST_PARALLEL_N + 1, squash_test_parallel_for_func, hits), SQUASH_FAILED);
+
+  /* The budget is shared and doesn't include the calling thread. */
+  const unsigned int granted = squash_threads_acquire (8);
+  munit_assert_uint(granted, ==, 3);
+  munit_assert_uint(squash_threads_acquire (1), ==, 0);
+  SQUASH_ASSERT_OK(squash_parallel_for (0, 16, squash_test_parallel_for_func, hits));
+  squash_threads_release (granted);
+  munit_assert_uint(squash_threads_acquire (1), ==, 1);
+  squash_threads_release (1);
+
+  squash_set_max_threads (max_threads);
+  free (hits);
+
+  return MUNIT_OK;
+}
+
 MunitTest squash_threads_tests[] = {
   { (char*) "/buffer", squash_test_threads_buffer, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/parallel-for", squash_test_threads_parallel_for, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
   { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
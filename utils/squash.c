@@ -54,12 +54,19 @@ print_help_and_exit (int argc, char** argv, int exit_code) {
   fprintf (stderr, "\t-o, --option key=value  Pass the option to the encoder/decoder.\n");
   fprintf (stderr, "\t-1 .. -9                Pass the compression level to the encoder.\n");
   fprintf (stderr, "\t                        Equivalent to -o level=N\n");
+  fprintf (stderr, "\t    --reference file    Compress (or decompress) relative to a previous\n");
+  fprintf (stderr, "\t                        version of the data, so only the changes need to\n");
+  fprintf (stderr, "\t                        be stored.  The same file is required to\n");
+  fprintf (stderr, "\t                        decompress.  Equivalent to -o reference=file\n");
   fprintf (stderr, "\t-c, --codec codec       Use the specified codec.  By default squash will\n");
   fprintf (stderr, "\t                        attempt to guess it based on the extension.\n");
+  fprintf (stderr, "\t                        Codecs separated by '+' (e.g., shuffle+lz4) are\n");
+  fprintf (stderr, "\t                        applied one after the other.\n");
   fprintf (stderr, "\t-L, --list-codecs       List available codecs and exit\n");
   fprintf (stderr, "\t-P, --list-plugins      List available plugins and exit\n");
   fprintf (stderr, "\t-f, --force             Overwrite the output file if it exists.\n");
   fprintf (stderr, "\t-d, --decompress        Decompress\n");
+  fprintf (stderr, "\t-s, --stats             Print statistics to stderr when finished.\n");
   fprintf (stderr, "\t-V, --version           Print version number and exit\n");
   fprintf (stderr, "\t-h, --help              Print this help screen and exit.\n");
 
@@ -143,6 +150,47 @@ list_plugins_and_codecs_foreach_cb (SquashPlugin* plugin, void* data) {
   free (prefix);
 }
 
+static void
+print_stats (void) {
+  SquashStats* stats = squash_stats_snapshot ();
+  if (stats == NULL)
+    return;
+
+  for (size_t c = 0 ; c < stats->n_codecs ; c++) {
+    const SquashCodecStats* cs = &(stats->codecs[c]);
+
+    SquashPlugin* plugin = squash_codec_get_plugin (cs->codec);
+    if (plugin != NULL)
+      fprintf (stderr, "%s:%s\n", squash_plugin_get_name (plugin), squash_codec_get_name (cs->codec));
+    else
+      fprintf (stderr, "%s\n", squash_codec_get_name (cs->codec));
+
+    for (int op = 0 ; op < SQUASH_STATS_N_OPERATIONS ; op++) {
+      const SquashStatsCounters* counters = &(cs->operations[op]);
+      if (counters->calls == 0)
+        continue;
+
+      fprintf (stderr, "\t%-18s %10llu calls %14llu bytes in %14llu bytes out %10.3f ms\n",
+               squash_stats_operation_to_string ((SquashStatsOperation) op),
+               (unsigned long long) counters->calls,
+               (unsigned long long) counters->bytes_in,
+               (unsigned long long) counters->bytes_out,
+               ((double) counters->nanoseconds) / 1000000.0);
+    }
+
+    for (int fb = 0 ; fb < SQUASH_STATS_N_FALLBACKS ; fb++) {
+      if (cs->fallbacks[fb] == 0)
+        continue;
+
+      fprintf (stderr, "\tfallback %-9s %10llu\n",
+               squash_stats_fallback_to_string ((SquashStatsFallback) fb),
+               (unsigned long long) cs->fallbacks[fb]);
+    }
+  }
+
+  squash_stats_free (stats);
+}
+
 #if !defined(_WIN32)
 #define squash_strndup(s,n) strndup(s,n)
 #else
@@ -169,12 +217,14 @@ int main (int argc, char** argv) {
   FILE* output = NULL;
   char* input_name = NULL;
   char* output_name = NULL;
+  const char* reference_name = NULL;
   bool list_codecs = false;
   bool list_plugins = false;
   char** option_keys = NULL;
   char** option_values = NULL;
   bool keep = false;
   bool force = false;
+  bool stats = false;
   int opt;
   int optc = 0;
   char* tmp_string;
@@ -184,11 +234,13 @@ int main (int argc, char** argv) {
   const struct parg_option squash_options[] = {
     {"keep", PARG_NOARG, NULL, 'k'},
     {"option", PARG_REQARG, NULL, 'o'},
+    {"reference", PARG_REQARG, NULL, 'r'},
     {"codec", PARG_REQARG, NULL, 'c'},
     {"list-codecs", PARG_NOARG, NULL, 'L'},
     {"list-plugins", PARG_NOARG, NULL, 'P'},
     {"force", PARG_NOARG, NULL, 'f'},
     {"decompress", PARG_NOARG, NULL, 'd'},
+    {"stats", PARG_NOARG, NULL, 's'},
     {"version", PARG_NOARG, NULL, 'V'},
     {"help", PARG_NOARG, NULL, 'h'},
     {NULL, 0, NULL, 0}
@@ -199,11 +251,11 @@ int main (int argc, char** argv) {
   *option_keys = NULL;
   *option_values = NULL;
 
-  optend = parg_reorder (argc, argv, "c:ko:123456789LPfdhb:V", squash_options);
+  optend = parg_reorder (argc, argv, "c:ko:123456789LPfdshb:V", squash_options);
 
   parg_init(&ps);
 
-  while ( (opt = parg_getopt_long (&ps, optend, argv, "c:ko:123456789LPfdhb:V", squash_options, NULL)) != -1 ) {
+  while ( (opt = parg_getopt_long (&ps, optend, argv, "c:ko:123456789LPfdshb:V", squash_options, NULL)) != -1 ) {
     switch ( opt ) {
       case 'c':
         codec = squash_get_codec (ps.optarg);
@@ -219,6 +271,9 @@ int main (int argc, char** argv) {
       case 'o':
         parse_option (&option_keys, &option_values, ps.optarg);
         break;
+      case 'r':
+        reference_name = ps.optarg;
+        break;
       case '1':
       case '2':
       case '3':
@@ -248,6 +303,10 @@ int main (int argc, char** argv) {
       case 'd':
         direction = SQUASH_STREAM_DECOMPRESS;
         break;
+      case 's':
+        stats = true;
+        squash_stats_set_enabled (true);
+        break;
       case 'V':
         print_version_and_exit (argc, argv, EXIT_SUCCESS);
         break;
@@ -372,8 +431,28 @@ int main (int argc, char** argv) {
 
   options = squash_options_newa (codec, (const char * const*) option_keys, (const char * const*) option_values);
 
+  /* Unlike -o, a reference the codec can't use is an error rather
+     than something to silently ignore. */
+  if (reference_name != NULL) {
+    res = (options != NULL) ?
+      squash_options_parse_option (options, "reference", reference_name) :
+      SQUASH_BAD_PARAM;
+    if (res == SQUASH_BAD_PARAM) {
+      fprintf (stderr, "The %s codec does not support --reference\n", squash_codec_get_name (codec));
+      retval = exit_failure ();
+      goto cleanup;
+    } else if (res != SQUASH_OK) {
+      fprintf (stderr, "Unable to use reference '%s': %s\n", reference_name, squash_status_to_string (res));
+      retval = exit_failure ();
+      goto cleanup;
+    }
+  }
+
   res = squash_splice_with_options (codec, direction, output, input, 0, options);
 
+  if (stats)
+    print_stats ();
+
   if ( res != SQUASH_OK ) {
     fprintf (stderr, "Failed to %s: %s\n",
              (direction == SQUASH_STREAM_COMPRESS) ? "compress" : "decompress",